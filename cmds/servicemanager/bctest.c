@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <time.h>
 
 #include "binder.h"
 
@@ -31,6 +32,87 @@ uint32_t svcmgr_lookup(struct binder_state *bs, uint32_t target, const char *nam
     return handle;
 }
 
+/* looks up count names in one call; handles are returned in handles[],
+ * zero for the names that were not found */
+int svcmgr_lookup_many(struct binder_state *bs, uint32_t target,
+                       const char **names, uint32_t count, uint32_t *handles)
+{
+    uint32_t i, n;
+    unsigned iodata[4096/4];
+    struct binder_io msg, reply;
+
+    if (count > SVC_MGR_MAX_BATCH)
+        return -1;
+
+    bio_init(&msg, iodata, sizeof(iodata), 4);
+    bio_put_uint32(&msg, 0);  // strict mode header
+    bio_put_string16_x(&msg, SVC_MGR_NAME);
+    bio_put_uint32(&msg, count);
+    for (i = 0; i < count; i++)
+        bio_put_string16_x(&msg, names[i]);
+
+    if (binder_call(bs, &msg, &reply, target, SVC_MGR_CHECK_SERVICES))
+        return -1;
+
+    n = bio_get_uint32(&reply);
+    for (i = 0; i < count; i++) {
+        handles[i] = (i < n) ? bio_get_ref(&reply) : 0;
+        if (handles[i])
+            binder_acquire(bs, handles[i]);
+    }
+
+    binder_done(bs, &msg, &reply);
+
+    return 0;
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+/* measures single and batched lookup throughput for one name */
+void svcmgr_bench(struct binder_state *bs, uint32_t target, const char *name, int iterations)
+{
+    const char *names[SVC_MGR_MAX_BATCH];
+    uint32_t handles[SVC_MGR_MAX_BATCH];
+    double start, elapsed;
+    uint32_t handle;
+    int i, j;
+
+    start = now_us();
+    for (i = 0; i < iterations; i++) {
+        handle = svcmgr_lookup(bs, target, name);
+        if (handle)
+            binder_release(bs, handle);
+    }
+    elapsed = now_us() - start;
+    fprintf(stderr,"lookup(%s): %d calls, %.2f us/lookup, %.0f lookups/s\n",
+            name, iterations, elapsed / iterations, iterations * 1000000.0 / elapsed);
+
+    for (j = 0; j < SVC_MGR_MAX_BATCH; j++)
+        names[j] = name;
+
+    start = now_us();
+    for (i = 0; i < iterations; i++) {
+        if (svcmgr_lookup_many(bs, target, names, SVC_MGR_MAX_BATCH, handles)) {
+            fprintf(stderr,"batched lookup not supported\n");
+            return;
+        }
+        for (j = 0; j < SVC_MGR_MAX_BATCH; j++) {
+            if (handles[j])
+                binder_release(bs, handles[j]);
+        }
+    }
+    elapsed = now_us() - start;
+    fprintf(stderr,"lookup_many(%s x %d): %d calls, %.2f us/lookup, %.0f lookups/s\n",
+            name, SVC_MGR_MAX_BATCH, iterations,
+            elapsed / (iterations * SVC_MGR_MAX_BATCH),
+            iterations * SVC_MGR_MAX_BATCH * 1000000.0 / elapsed);
+}
+
 int svcmgr_publish(struct binder_state *bs, uint32_t target, const char *name, void *ptr)
 {
     int status;
@@ -88,6 +170,22 @@ int main(int argc, char **argv)
             fprintf(stderr,"lookup(%s) = %x\n", argv[1], handle);
             argc--;
             argv++;
+        } else if (!strcmp(argv[0],"bench")) {
+            int iterations = 1000;
+            if (argc < 2) {
+                fprintf(stderr,"argument required\n");
+                return -1;
+            }
+            if (argc > 2 && atoi(argv[2]) > 0) {
+                iterations = atoi(argv[2]);
+            }
+            svcmgr_bench(bs, svcmgr, argv[1], iterations);
+            if (argc > 2 && atoi(argv[2]) > 0) {
+                argc--;
+                argv++;
+            }
+            argc--;
+            argv++;
         } else if (!strcmp(argv[0],"publish")) {
             if (argc < 2) {
                 fprintf(stderr,"argument required\n");
@@ -232,12 +232,12 @@ int binder_parse(struct binder_state *bs, struct binder_io *bio,
             }
             binder_dump_txn(txn);
             if (func) {
-                unsigned rdata[256/4];
+                unsigned rdata[BINDER_LOOP_REPLY_SIZE/4];
                 struct binder_io msg;
                 struct binder_io reply;
                 int res;
 
-                bio_init(&reply, rdata, sizeof(rdata), 4);
+                bio_init(&reply, rdata, sizeof(rdata), BINDER_LOOP_REPLY_OBJS);
                 bio_init_from_txn(&msg, txn);
                 res = func(bs, txn, &msg, &reply);
                 binder_send_reply(bs, &reply, txn->data.ptr.buffer, res);
@@ -489,7 +489,11 @@ void bio_put_obj(struct binder_io *bio, void *ptr)
 {
     struct flat_binder_object *obj;
 
-    obj = bio_alloc_obj(bio);
+    if (ptr)
+        obj = bio_alloc_obj(bio);
+    else
+        obj = bio_alloc(bio, sizeof(*obj));
+
     if (!obj)
         return;
 
@@ -616,6 +620,13 @@ static struct flat_binder_object *_bio_get_obj(struct binder_io *bio)
             return bio_get(bio, sizeof(struct flat_binder_object));
     }
 
+    /* null objects are written without an offset, see Parcel::readObject() */
+    if (bio->data_avail >= sizeof(struct flat_binder_object)) {
+        struct flat_binder_object *obj = (struct flat_binder_object *) bio->data;
+        if (obj->binder == 0 && obj->cookie == 0)
+            return bio_get(bio, sizeof(struct flat_binder_object));
+    }
+
     bio->data_avail = 0;
     bio->flags |= BIO_F_OVERFLOW;
     return NULL;
@@ -39,8 +39,17 @@ enum {
     SVC_MGR_CHECK_SERVICE,
     SVC_MGR_ADD_SERVICE,
     SVC_MGR_LIST_SERVICES,
+    SVC_MGR_CHECK_SERVICES,
 };
 
+/* maximum number of names in one SVC_MGR_CHECK_SERVICES call; must match
+ * IServiceManager.h and fit in a binder_loop() reply */
+#define SVC_MGR_MAX_BATCH 32
+
+/* size of the reply buffer binder_loop() hands to its handler */
+#define BINDER_LOOP_REPLY_SIZE 2048
+#define BINDER_LOOP_REPLY_OBJS SVC_MGR_MAX_BATCH
+
 typedef int (*binder_handler)(struct binder_state *bs,
                               struct binder_transaction_data *txn,
                               struct binder_io *msg,
@@ -128,6 +128,8 @@ static int svc_can_find(const uint16_t *name, size_t name_len, pid_t spid)
 struct svcinfo
 {
     struct svcinfo *next;
+    struct svcinfo *hash_next;
+    uint32_t hash;
     uint32_t handle;
     struct binder_death death;
     int allow_isolated;
@@ -135,14 +137,31 @@ struct svcinfo
     uint16_t name[0];
 };
 
+/* all services, most recently added first (the order list_service uses) */
 struct svcinfo *svclist = NULL;
 
+/* the same services, chained by name hash */
+#define SVC_HASH_SIZE 256
+static struct svcinfo *svchash[SVC_HASH_SIZE];
+
+static uint32_t svc_hash(const uint16_t *s16, size_t len)
+{
+    uint32_t hash = 2166136261U;
+
+    while (len--) {
+        hash ^= *s16++;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
 struct svcinfo *find_svc(const uint16_t *s16, size_t len)
 {
     struct svcinfo *si;
+    uint32_t hash = svc_hash(s16, len);
 
-    for (si = svclist; si; si = si->next) {
-        if ((len == si->len) &&
+    for (si = svchash[hash % SVC_HASH_SIZE]; si; si = si->hash_next) {
+        if ((hash == si->hash) && (len == si->len) &&
             !memcmp(s16, si->name, len * sizeof(uint16_t))) {
             return si;
         }
@@ -234,6 +253,9 @@ int do_add_service(struct binder_state *bs,
         si->death.func = (void*) svcinfo_death;
         si->death.ptr = si;
         si->allow_isolated = allow_isolated;
+        si->hash = svc_hash(s, len);
+        si->hash_next = svchash[si->hash % SVC_HASH_SIZE];
+        svchash[si->hash % SVC_HASH_SIZE] = si;
         si->next = svclist;
         svclist = si;
     }
@@ -253,6 +275,7 @@ int svcmgr_handler(struct binder_state *bs,
     size_t len;
     uint32_t handle;
     uint32_t strict_policy;
+    uint32_t count;
     int allow_isolated;
 
     //ALOGI("target=%x code=%d pid=%d uid=%d\n",
@@ -301,6 +324,29 @@ int svcmgr_handler(struct binder_state *bs,
         bio_put_ref(reply, handle);
         return 0;
 
+    case SVC_MGR_CHECK_SERVICES:
+        /* batched check_service: a count followed by that many names,
+         * answered with the count and one ref or null binder per name */
+        count = bio_get_uint32(msg);
+        if (count > SVC_MGR_MAX_BATCH) {
+            ALOGE("check_services(%u) uid=%d - TOO MANY NAMES\n",
+                    count, txn->sender_euid);
+            return -1;
+        }
+        bio_put_uint32(reply, count);
+        while (count-- > 0) {
+            s = bio_get_string16(msg, &len);
+            if (s == NULL) {
+                return -1;
+            }
+            handle = do_find_service(bs, s, len, txn->sender_euid, txn->sender_pid);
+            if (handle)
+                bio_put_ref(reply, handle);
+            else
+                bio_put_obj(reply, NULL); /* null binder, not handle 0 */
+        }
+        return 0;
+
     case SVC_MGR_ADD_SERVICE:
         s = bio_get_string16(msg, &len);
         if (s == NULL) {
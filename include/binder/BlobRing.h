@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_BLOB_RING_H
+#define ANDROID_BLOB_RING_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <binder/IBinder.h>
+#include <utils/Errors.h>
+#include <utils/Mutex.h>
+#include <utils/RefBase.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+// ---------------------------------------------------------------------------
+namespace android {
+
+/*
+ * A BlobRing is an anonymous shared memory region that Parcel::writeBlob()
+ * carves blobs out of, instead of creating (and mapping) a new ashmem region
+ * for every blob.
+ *
+ * The writing side gets the ring of a connection from forBinder() and
+ * attaches it to the Parcels it sends over it with Parcel::setBlobRing().
+ * The reading side maps the ring the first time it sees it and keeps the
+ * mapping for as long as blobs from that ring are alive, and for a few of
+ * the most recently used rings beyond that, so subsequent blobs are read in
+ * place without mapping anything; the fds received with each blob are only
+ * read from to check that they are the cached ring.
+ *
+ * The ring is sealed read-only before it is sent, so readers cannot change
+ * the blobs or the slice headers.  Readers report the slices they hold and
+ * release through a separate control page, one word per slice; a reader
+ * that misuses it can only make the writer reuse the slices of its own
+ * blobs early, which is why a ring carries blobs to a single process.
+ *
+ * The writer never takes back a slice that a live reader holds.  Slices
+ * that no reader picked up within the abandon timeout (the transaction
+ * failed, or the receiver never read the blob) and slices held by a process
+ * that has died are reclaimed; a reader that turns up after its slice was
+ * taken back fails to read the blob.  While the ring is full, writeBlob()
+ * falls back to a shared memory region of its own for each blob.
+ */
+class BlobRing : public RefBase
+{
+public:
+    enum { DEFAULT_CONNECTION_RING_SIZE = 1024 * 1024 };
+
+    // How long a slice can wait for its reader before it is reclaimed.
+    static const nsecs_t DEFAULT_ABANDON_TIMEOUT = 5000000000LL; // 5 s
+
+    // Creates a ring of (at least) the given size for writing blobs.
+    // Returns NULL if the shared memory regions could not be created.
+    static sp<BlobRing> create(size_t size,
+            nsecs_t abandonTimeout = DEFAULT_ABANDON_TIMEOUT);
+
+    // Returns the ring for blobs sent to the remote binder, creating it the
+    // first time.  The ring lives as long as this process's proxy for the
+    // binder.  Returns NULL for local binders and if the ring could not be
+    // created.
+    static sp<BlobRing> forBinder(const sp<IBinder>& binder,
+            size_t size = DEFAULT_CONNECTION_RING_SIZE);
+
+    // Returns the ring identified by token, mapping it from fd and
+    // controlFd if this process does not have it mapped yet, or if they turn
+    // out not to be the regions that are mapped under that token.  The fds
+    // are not retained.
+    static sp<BlobRing> import(int fd, int controlFd, uint64_t token, size_t size);
+
+    // Reserves a slice of len bytes for writing.  Returns the offset of the
+    // slice from base() and sets outGeneration, or returns NO_MEMORY if the
+    // ring is too full.  Only valid on the side that created the ring.
+    ssize_t reserve(size_t len, uint32_t* outGeneration);
+
+    // Claims the slice at offset for reading, if a slice of the given
+    // generation that holds at least len bytes is waiting there for its
+    // reader.  Once claimed, the slice is not reused until it is released.
+    bool claim(size_t offset, size_t len, uint32_t generation);
+
+    // Marks the slice at offset, as returned by reserve() along with
+    // generation, as free.  Does nothing if that slice is no longer live.
+    void release(size_t offset, uint32_t generation);
+
+    // Returns true if a live slice of the given generation starts at offset
+    // and holds at least len bytes.
+    bool isLiveSlice(size_t offset, size_t len, uint32_t generation) const;
+
+    inline uint8_t* base() const { return mBase; }
+    inline size_t getSize() const { return mSize; }
+    inline int getFd() const { return mFd; }
+    inline int getControlFd() const { return mControlFd; }
+    inline uint64_t getToken() const { return mToken; }
+
+protected:
+    virtual ~BlobRing();
+
+private:
+    // A slice of the ring, in the order they were reserved; padding at the
+    // end of the ring has no control slot.
+    struct Slice {
+        size_t offset;
+        size_t length;
+        int32_t slot;
+        uint32_t generation;
+        nsecs_t reserveTime;
+    };
+
+    BlobRing(int fd, uint8_t* base, size_t size, int controlFd, uint8_t* control,
+            uint64_t token, nsecs_t abandonTimeout);
+    BlobRing(const BlobRing&);
+    BlobRing& operator=(const BlobRing&);
+
+    ssize_t allocateLocked(size_t need, nsecs_t now);
+
+    // Frees the slices at the tail of the ring that were released or
+    // abandoned.
+    void reclaimLocked(nsecs_t now);
+    bool isReclaimableLocked(const Slice& slice, nsecs_t now);
+
+    // Owned fds of the regions on the writing side, -1 on reading sides.
+    const int mFd;
+    uint8_t* const mBase;
+    const size_t mSize;
+    const int mControlFd;
+    uint8_t* const mControl;
+    const uint64_t mToken;
+    const nsecs_t mAbandonTimeout;
+
+    // Writer state; guarded by mLock.
+    mutable Mutex mLock;
+    size_t mHead;
+    size_t mTail;
+    size_t mUsed;
+    uint32_t mGeneration;
+    Vector<Slice> mSlices;
+    Vector<int32_t> mFreeSlots;
+};
+
+}; // namespace android
+
+// ---------------------------------------------------------------------------
+
+#endif // ANDROID_BLOB_RING_H
@@ -55,12 +55,22 @@ public:
      */
     virtual Vector<String16>    listServices() = 0;
 
+    /**
+     * Retrieve several existing services at once, non-blocking.  The
+     * result has one entry per name, NULL for services that don't exist.
+     */
+    virtual Vector<sp<IBinder> > checkServices(const Vector<String16>& names) const = 0;
+
     enum {
         GET_SERVICE_TRANSACTION = IBinder::FIRST_CALL_TRANSACTION,
         CHECK_SERVICE_TRANSACTION,
         ADD_SERVICE_TRANSACTION,
         LIST_SERVICES_TRANSACTION,
+        CHECK_SERVICES_TRANSACTION,
     };
+
+    // Maximum number of names in one CHECK_SERVICES_TRANSACTION.
+    enum { MAX_CHECK_SERVICES = 32 };
 };
 
 sp<IServiceManager> defaultServiceManager();
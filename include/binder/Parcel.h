@@ -25,6 +25,8 @@
 #include <utils/Flattenable.h>
 #include <linux/binder.h>
 
+#include <binder/BlobRing.h>
+
 // ---------------------------------------------------------------------------
 namespace android {
 
@@ -135,10 +137,19 @@ public:
 
     // Writes a blob to the parcel.
     // If the blob is small, then it is stored in-place, otherwise it is
-    // transferred by way of an anonymous shared memory region.
+    // transferred by way of an anonymous shared memory region.  When a
+    // BlobRing is attached to the parcel, mid-sized and large blobs are
+    // carved out of the ring instead, as long as it has room.
     // The caller should call release() on the blob after writing its contents.
     status_t            writeBlob(size_t len, WritableBlob* outBlob);
 
+    // Attaches a ring that writeBlob() reserves shared memory from.  The
+    // ring is kept across freeData(); pass NULL to detach it.  Callers that
+    // send many blobs to the same process attach the ring of that
+    // connection, as returned by BlobRing::forBinder().
+    void                setBlobRing(const sp<BlobRing>& ring);
+    sp<BlobRing>        getBlobRing() const;
+
     status_t            writeObject(const flat_binder_object& val, bool nullMetaData);
 
     // Like Parcel.java's writeNoException().  Just writes a zero int32.
@@ -199,6 +210,8 @@ public:
 
     // Reads a blob from the parcel.
     // The caller should call release() on the blob after reading its contents.
+    // A blob that was carved out of a BlobRing can only be read once, and
+    // only until the ring's abandon timeout if it has not been read yet.
     status_t            readBlob(size_t len, ReadableBlob* outBlob) const;
 
     const flat_binder_object* readObject(bool nullMetaData) const;
@@ -209,6 +222,10 @@ public:
     // Debugging: get metrics on current allocations.
     static size_t       getGlobalAllocSize();
     static size_t       getGlobalAllocCount();
+    // Debugging: number of Parcel buffers that were served from the
+    // per-thread buffer pool, and number that had to come from the heap.
+    static size_t       getGlobalPoolHitCount();
+    static size_t       getGlobalHeapAllocCount();
 
 private:
     typedef void        (*release_func)(Parcel* parcel,
@@ -269,6 +286,8 @@ private:
     release_func        mOwner;
     void*               mOwnerCookie;
 
+    sp<BlobRing>        mBlobRing;
+
     class Blob {
     public:
         Blob();
@@ -279,11 +298,16 @@ private:
 
     protected:
         void init(bool mapped, void* data, size_t size);
+        void init(const sp<BlobRing>& ring, size_t offset, uint32_t generation,
+                size_t size);
         void clear();
 
         bool mMapped;
         void* mData;
         size_t mSize;
+        sp<BlobRing> mRing;
+        size_t mRingOffset;
+        uint32_t mRingGeneration;
     };
 
     class FlattenableHelperInterface {
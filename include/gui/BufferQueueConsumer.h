@@ -142,6 +142,9 @@ public:
     // Retrieve the sideband buffer stream, if any.
     virtual sp<NativeHandle> getSidebandStream() const;
 
+    // Copy the always-on statistics of the BufferQueue.
+    virtual status_t getStatistics(BufferQueueStatistics* outStatistics) const;
+
     // dump our state in a String
     virtual void dump(String8& result, const char* prefix) const;
 
@@ -18,8 +18,10 @@
 #define ANDROID_GUI_BUFFERQUEUECORE_H
 
 #include <gui/BufferQueueDefs.h>
+#include <gui/BufferQueueStatistics.h>
 #include <gui/BufferSlot.h>
 
+#include <utils/BitSet.h>
 #include <utils/Condition.h>
 #include <utils/Mutex.h>
 #include <utils/NativeHandle.h>
@@ -67,6 +69,9 @@ public:
     // The default API number used to indicate that no producer is connected
     enum { NO_CONNECTED_API = 0 };
 
+    // The number of BufferSlot::BufferState values.
+    enum { NUM_BUFFER_STATES = BufferSlot::ACQUIRED + 1 };
+
     typedef Vector<BufferItem> Fifo;
 
     // BufferQueueCore manages a pool of gralloc memory slots to be used by
@@ -108,14 +113,44 @@ private:
     // initial default is 2.
     status_t setDefaultMaxBufferCountLocked(int count);
 
+    // setSlotStateLocked moves the given slot to the given state and updates
+    // mStateSlots accordingly. Slot states must only be changed through this
+    // method.
+    void setSlotStateLocked(int slot, BufferSlot::BufferState state);
+
+    // setSlotBufferLocked sets the GraphicBuffer of the given slot and updates
+    // mAllocatedSlots accordingly. Slot buffers must only be changed through
+    // this method.
+    void setSlotBufferLocked(int slot, const sp<GraphicBuffer>& buffer);
+
+    // getSlotsBelow returns the set of slots with an index below
+    // maxBufferCount.
+    static BitSet64 getSlotsBelow(int maxBufferCount);
+
+    // getSlotsLocked returns the set of slots with an index below
+    // maxBufferCount that are in the given state.
+    BitSet64 getSlotsLocked(BufferSlot::BufferState state,
+            int maxBufferCount) const;
+
+    // getOldestSlotLocked returns the slot with the lowest frame number in the
+    // given set, or INVALID_BUFFER_SLOT if the set is empty.
+    int getOldestSlotLocked(BitSet64 slots) const;
+
     // freeBufferLocked frees the GraphicBuffer and sync resources for the
     // given slot.
     void freeBufferLocked(int slot);
 
     // freeAllBuffersLocked frees the GraphicBuffer and sync resources for
-    // all slots.
+    // all slots, recycling the buffers of the FREE slots.
     void freeAllBuffersLocked();
 
+    // recycleBufferLocked gives the GraphicBuffer of the given slot to the
+    // GraphicBufferPool of this process before the slot drops it, if the
+    // buffers of this BufferQueue are allocated in this process. It must
+    // only be called for buffers that nobody outside of the BufferQueue and
+    // its consumer can still use, i.e. not for detached buffers.
+    void recycleBufferLocked(int slot);
+
     // stillTracking returns true iff the buffer item is still being tracked
     // in one of the slots.
     bool stillTracking(const BufferItem* item) const;
@@ -167,6 +202,15 @@ private:
     // the producer.
     sp<IProducerListener> mConnectedProducerListener;
 
+    // mConnectedProducerUid is the uid of the producer that is connected,
+    // or -1 if none is. Recycled buffers are only handed out to this uid
+    // again.
+    uid_t mConnectedProducerUid;
+
+    // mRecycleBuffers is whether mAllocator is local, in which case freed
+    // buffers are given to the GraphicBufferPool.
+    bool mRecycleBuffers;
+
     // mSlots is an array of buffer slots that must be mirrored on the producer
     // side. This allows buffer ownership to be transferred between the producer
     // and consumer without sending a GraphicBuffer over Binder. The entire
@@ -174,6 +218,15 @@ private:
     // allocated for a slot when requestBuffer is called with that slot's index.
     BufferQueueDefs::SlotsType mSlots;
 
+    // mStateSlots holds, for each BufferSlot::BufferState, the set of slots
+    // that are currently in that state. It lets dequeueBuffer, acquireBuffer
+    // and friends find and count slots without scanning all of mSlots while
+    // holding mMutex. This limits NUM_BUFFER_SLOTS to 64.
+    BitSet64 mStateSlots[NUM_BUFFER_STATES];
+
+    // mAllocatedSlots is the set of slots that have a GraphicBuffer.
+    BitSet64 mAllocatedSlots;
+
     // mQueue is a FIFO of queued buffers used in synchronous mode.
     Fifo mQueue;
 
@@ -246,6 +299,10 @@ private:
     // mIsAllocatingCondition is a condition variable used by producers to wait until mIsAllocating
     // becomes false.
     mutable Condition mIsAllocatingCondition;
+
+    // mStatistics are the always-on statistics of this BufferQueue. They are
+    // only updated while mMutex is held anyway.
+    BufferQueueStatistics mStatistics;
 }; // class BufferQueueCore
 
 } // namespace android
@@ -173,17 +173,30 @@ public:
     virtual void allocateBuffers(bool async, uint32_t width, uint32_t height,
             uint32_t format, uint32_t usage);
 
+    // See IGraphicBufferProducer::queueAndDequeueBuffer
+    virtual status_t queueAndDequeueBuffer(int buf,
+            const QueueBufferInput& input, QueueBufferOutput* output,
+            int* outSlot, sp<Fence>* outFence, sp<GraphicBuffer>* outBuffer,
+            status_t* outDequeueResult, bool async, uint32_t width,
+            uint32_t height, uint32_t format, uint32_t usage);
+
 private:
     // This is required by the IBinder::DeathRecipient interface
     virtual void binderDied(const wp<IBinder>& who);
 
+    // dequeueBufferInternal implements dequeueBuffer. If canBlock is false, it
+    // returns WOULD_BLOCK instead of waiting for a free slot.
+    status_t dequeueBufferInternal(int* outSlot, sp<Fence>* outFence,
+            bool async, uint32_t width, uint32_t height, uint32_t format,
+            uint32_t usage, bool canBlock);
+
     // waitForFreeSlotThenRelock finds the oldest slot in the FREE state. It may
     // block if there are no available slots and we are not in non-blocking
-    // mode (producer and consumer controlled by the application). If it blocks,
-    // it will release mCore->mMutex while blocked so that other operations on
-    // the BufferQueue may succeed.
+    // mode (producer and consumer controlled by the application) and canBlock
+    // is true. If it blocks, it will release mCore->mMutex while blocked so
+    // that other operations on the BufferQueue may succeed.
     status_t waitForFreeSlotThenRelock(const char* caller, bool async,
-            int* found, status_t* returnFlags) const;
+            bool canBlock, int* found, status_t* returnFlags) const;
 
     sp<BufferQueueCore> mCore;
 
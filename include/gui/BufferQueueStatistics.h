@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_GUI_BUFFERQUEUESTATISTICS_H
+#define ANDROID_GUI_BUFFERQUEUESTATISTICS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Flattenable.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+class String8;
+
+// BufferQueueStatistics holds histograms of where the buffers of a
+// BufferQueue spend their time, collected since the BufferQueue was
+// created. BufferQueueCore updates them under its mutex as buffers move
+// between states; IGraphicBufferConsumer::getStatistics returns a copy.
+class BufferQueueStatistics : public LightFlattenablePod<BufferQueueStatistics> {
+public:
+    // TimeHistogram counts durations in power-of-two buckets: bucket 0
+    // counts durations shorter than FIRST_BUCKET_NS, bucket i counts those
+    // in [FIRST_BUCKET_NS << (i - 1), FIRST_BUCKET_NS << i), and the last
+    // bucket also counts everything longer.
+    struct TimeHistogram {
+        enum { NUM_BUCKETS = 16 };
+        static const nsecs_t FIRST_BUCKET_NS = 125000; // 125 us
+
+        uint32_t buckets[NUM_BUCKETS];
+        uint64_t count;
+        int64_t totalNs;
+        int64_t maxNs;
+
+        void add(nsecs_t duration);
+
+        // getBucketEnd returns the exclusive upper bound of a bucket.
+        static nsecs_t getBucketEnd(size_t bucket);
+    };
+
+    // DepthHistogram counts queue depths; the last bucket also counts all
+    // deeper queues.
+    struct DepthHistogram {
+        enum { NUM_BUCKETS = 8 };
+
+        uint32_t buckets[NUM_BUCKETS];
+
+        void add(size_t depth);
+    };
+
+    BufferQueueStatistics();
+
+    // how long dequeueBuffer took to find a free slot, including waiting
+    // for one to be released
+    TimeHistogram dequeueWait;
+
+    // how long queued buffers waited to be acquired
+    TimeHistogram queueToAcquire;
+
+    // how long the consumer held acquired buffers before releasing them
+    TimeHistogram acquireToRelease;
+
+    // the number of queued buffers right after each queueBuffer
+    DepthHistogram queueDepth;
+
+    // the number of queued buffers that were replaced or dropped before
+    // they could be acquired
+    uint64_t numDropped;
+
+    // dump appends the statistics to result, one line per histogram.
+    void dump(String8& result, const char* prefix) const;
+};
+
+} // namespace android
+
+#endif // ANDROID_GUI_BUFFERQUEUESTATISTICS_H
@@ -39,7 +39,9 @@ struct BufferSlot {
       mEglFence(EGL_NO_SYNC_KHR),
       mAcquireCalled(false),
       mNeedsCleanupOnRelease(false),
-      mAttachedByConsumer(false) {
+      mAttachedByConsumer(false),
+      mQueueTime(0),
+      mAcquireTime(0) {
     }
 
     // mGraphicBuffer points to the buffer allocated for this slot or is NULL
@@ -135,6 +137,11 @@ struct BufferSlot {
     // If so, it needs to set the BUFFER_NEEDS_REALLOCATION flag when dequeued
     // to prevent the producer from using a stale cached buffer.
     bool mAttachedByConsumer;
+
+    // mQueueTime and mAcquireTime are when the buffer was last queued and
+    // acquired, for the BufferQueueStatistics.
+    nsecs_t mQueueTime;
+    nsecs_t mAcquireTime;
 };
 
 } // namespace android
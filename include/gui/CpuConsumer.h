@@ -108,7 +108,30 @@ class CpuConsumer : public ConsumerBase
     // lockNextBuffer.
     status_t unlockBuffer(const LockedBuffer &nativeBuffer);
 
+    // setReadAheadDepth enables read-ahead mode, in which a helper thread
+    // acquires and locks up to depth queued buffers before lockNextBuffer is
+    // called, so that lockNextBuffer can hand out a buffer that is already
+    // mapped instead of waiting for its fence and mapping it itself. Buffers
+    // that have been read ahead count against maxLockedBuffers, so depth may
+    // not be larger than it, and the helper thread only reads ahead while
+    // fewer than maxLockedBuffers buffers are locked. A depth of 0, the
+    // default, turns read-ahead off; buffers that were already read ahead are
+    // still handed out by lockNextBuffer. Returns BAD_VALUE if depth is
+    // larger than maxLockedBuffers.
+    status_t setReadAheadDepth(uint32_t depth);
+
+  protected:
+    // Overrides ConsumerBase so that the read-ahead thread is woken up when
+    // a new buffer is queued.
+    virtual void onFrameAvailable(const BufferItem& item);
+
+    // Overrides ConsumerBase to stop reading ahead and return the buffers
+    // that were read ahead but not handed out.
+    virtual void abandonLocked();
+
   private:
+    class ReadAheadThread;
+
     // Maximum number of buffers that can be locked at a time
     uint32_t mMaxLockedBuffers;
 
@@ -116,6 +139,27 @@ class CpuConsumer : public ConsumerBase
 
     virtual void freeBufferLocked(int slotIndex);
 
+    // lockBuffer locks buffer, which was acquired as item, for CPU reading
+    // and fills in nativeBuffer. It does not access the slots, so it can be
+    // called without holding mMutex.
+    static status_t lockBuffer(const String8& name,
+            const sp<GraphicBuffer>& buffer,
+            const BufferQueue::BufferItem& item, LockedBuffer* nativeBuffer);
+
+    // addAcquiredBufferLocked records that the buffer of the given slot was
+    // locked at nativeBuffer.data and returns the index of its entry in
+    // mAcquiredBuffers.
+    size_t addAcquiredBufferLocked(int slot, const sp<GraphicBuffer>& buffer,
+            const LockedBuffer& nativeBuffer);
+
+    // readAheadLoop is run by the read-ahead thread until mReadAheadExit is
+    // set.
+    void readAheadLoop();
+
+    // discardReadAheadLocked unlocks and releases the buffers that were read
+    // ahead but not handed out yet.
+    void discardReadAheadLocked();
+
     // Tracking for buffers acquired by the user
     struct AcquiredBuffer {
         // Need to track the original mSlot index and the buffer itself because
@@ -132,9 +176,37 @@ class CpuConsumer : public ConsumerBase
     };
     Vector<AcquiredBuffer> mAcquiredBuffers;
 
-    // Count of currently locked buffers
+    // Count of buffers currently locked by the user
     uint32_t mCurrentLockedBuffers;
 
+    // mReadAheadDepth is the maximum number of buffers the read-ahead thread
+    // keeps locked in mReadAheadBuffers. See setReadAheadDepth.
+    uint32_t mReadAheadDepth;
+
+    // mReadAheadBuffers holds the buffers that were read ahead, in the order
+    // they were acquired. Their entries in mAcquiredBuffers are already
+    // filled in, but they are not counted in mCurrentLockedBuffers until
+    // lockNextBuffer hands them out.
+    Vector<LockedBuffer> mReadAheadBuffers;
+
+    // mReadAheadPending is true while the read-ahead thread locks a buffer
+    // that it has acquired without holding mMutex. lockNextBuffer waits for
+    // it so that buffers are still handed out in order.
+    bool mReadAheadPending;
+
+    // mReadAheadWake is set whenever the read-ahead thread may be able to
+    // acquire another buffer, and cleared when acquiring fails.
+    bool mReadAheadWake;
+
+    // mReadAheadExit tells the read-ahead thread to exit.
+    bool mReadAheadExit;
+
+    // mReadAheadCondition is signaled whenever one of the read-ahead fields
+    // above changes.
+    Condition mReadAheadCondition;
+
+    sp<ReadAheadThread> mReadAheadThread;
+
 };
 
 } // namespace android
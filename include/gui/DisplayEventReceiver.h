@@ -34,6 +34,8 @@ namespace android {
 
 class BitTube;
 class IDisplayEventConnection;
+class IMemoryHeap;
+struct VsyncTiming;
 
 // ----------------------------------------------------------------------------
 
@@ -126,9 +128,19 @@ public:
      */
     status_t requestNextVsync();
 
+    /*
+     * getVsyncTiming() reads the vsync model that SurfaceFlinger publishes
+     * in shared memory. Clients that only need to know when the next vsync
+     * will happen can use it to predict it, without a binder call or a
+     * wakeup per frame. Returns NOT_ENOUGH_DATA if there is no model yet.
+     */
+    status_t getVsyncTiming(VsyncTiming* outTiming);
+
 private:
     sp<IDisplayEventConnection> mEventConnection;
     sp<BitTube> mDataChannel;
+    // fetched by the first getVsyncTiming() call
+    sp<IMemoryHeap> mVsyncTimingHeap;
 };
 
 // ----------------------------------------------------------------------------
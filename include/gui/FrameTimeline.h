@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_GUI_FRAME_TIMELINE_H
+#define ANDROID_GUI_FRAME_TIMELINE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+
+namespace android {
+
+class IMemoryHeap;
+
+/*
+ * SurfaceFlinger publishes the timeline of every composed frame, for every
+ * layer and display, to a ring of FrameTimelineRecords in shared memory
+ * (see ISurfaceComposer::getFrameTimeline()). Once a tool has the heap it
+ * can follow the timeline with a FrameTimelineReader without any further
+ * binder calls.
+ *
+ * Records are published once all of their fences have signaled (or given
+ * up on), so they are not strictly in present order. Times are in
+ * nanoseconds on the SYSTEM_TIME_MONOTONIC clock, or TIME_UNKNOWN.
+ */
+struct FrameTimelineRecord {
+    enum {
+        TYPE_LAYER      = 1,
+        TYPE_DISPLAY    = 2,
+    };
+
+    enum {
+        NAME_LENGTH     = 32,
+    };
+
+    static const int64_t TIME_UNKNOWN = -1;
+
+    // for internal use by the ring, odd while the record is being written
+    volatile int32_t seq;
+    uint32_t type;
+    // TYPE_LAYER: the layer's sequence number; TYPE_DISPLAY: the HWC
+    // display id
+    int32_t id;
+    uint32_t reserved;
+    // TYPE_LAYER: the buffer's frame number; TYPE_DISPLAY: the number of
+    // frames composed for that display
+    uint64_t frameNumber;
+
+    // TYPE_LAYER
+    int64_t queueTime;              // the producer queued the buffer
+    int64_t latchTime;              // handlePageFlip() latched the buffer
+    int64_t desiredPresentTime;     // the buffer's timestamp
+    int64_t frameReadyTime;         // the buffer's acquire fence signaled
+
+    // TYPE_DISPLAY
+    int64_t compositionStartTime;   // the refresh started
+    int64_t hwcPrepareDuration;     // time spent in HWC prepare()
+    int64_t hwcSetDuration;         // time spent in HWC set()
+    int64_t gpuCompositionDoneTime; // GLES composition fence signaled
+
+    // both
+    int64_t presentTime;            // the frame was presented
+
+    // the layer or display name, truncated and null-terminated
+    char name[NAME_LENGTH];
+};
+
+/*
+ * The start of the shared memory; the records follow it.
+ */
+struct FrameTimelineHeader {
+    enum {
+        MAGIC           = 0x46544c31, // 'FTL1'
+        VERSION         = 1,
+    };
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t capacity;
+    // the number of records ever published
+    volatile int32_t writeCount;
+    uint32_t reserved[3];
+};
+
+/*
+ * Writes records to a new frame timeline ring. There must be only one
+ * writer for a ring.
+ */
+class FrameTimelineWriter : public LightRefBase<FrameTimelineWriter> {
+public:
+    FrameTimelineWriter(uint32_t capacity);
+    ~FrameTimelineWriter();
+
+    status_t initCheck() const;
+
+    // write publishes a copy of record; its seq field is ignored.
+    void write(const FrameTimelineRecord& record);
+
+    const sp<IMemoryHeap>& getHeap() const { return mHeap; }
+
+private:
+    sp<IMemoryHeap> mHeap;
+    FrameTimelineHeader* mHeader;
+    FrameTimelineRecord* mRecords;
+    uint32_t mCapacity;
+};
+
+/*
+ * Follows a frame timeline ring, starting at the time it is created.
+ */
+class FrameTimelineReader {
+public:
+    FrameTimelineReader(const sp<IMemoryHeap>& heap);
+
+    status_t initCheck() const;
+
+    // read copies up to count of the records published since the last
+    // call to records, oldest first, and returns how many were copied.
+    // If outLost is not NULL, it is set to the number of records that were
+    // overwritten before they could be read.
+    size_t read(FrameTimelineRecord* records, size_t count,
+            uint32_t* outLost = NULL);
+
+private:
+    sp<IMemoryHeap> mHeap;
+    const FrameTimelineHeader* mHeader;
+    const FrameTimelineRecord* mRecords;
+    uint32_t mCapacity;
+    uint32_t mNext;
+};
+
+}; // namespace android
+
+#endif // ANDROID_GUI_FRAME_TIMELINE_H
@@ -330,6 +330,14 @@ private:
         Rect mCropRect;
     };
 
+    // getEglImageLocked returns the EglImage for the given buffer and crop
+    // rect from mEglImageCache, adding a new one if the cache has none. The
+    // crop rect is ignored if EGL_ANDROID_image_crop is not supported.
+    //
+    // This method must be called with mMutex locked.
+    sp<EglImage> getEglImageLocked(const sp<GraphicBuffer>& graphicBuffer,
+            const Rect& crop);
+
     // freeBufferLocked frees up the given buffer slot. If the slot has been
     // initialized this will release the reference to the GraphicBuffer in that
     // slot and destroy the EGLImage in that slot.  Otherwise it has no effect.
@@ -337,6 +345,12 @@ private:
     // This method must be called with mMutex locked.
     virtual void freeBufferLocked(int slotIndex);
 
+    // evictEglImagesLocked removes the EglImages of the buffer with the given
+    // id from mEglImageCache, unless a slot still holds that buffer.
+    //
+    // This method must be called with mMutex locked.
+    void evictEglImagesLocked(uint64_t bufferId);
+
     // computeCurrentTransformMatrixLocked computes the transform matrix for the
     // current texture.  It uses mCurrentTransform and the current GraphicBuffer
     // to compute this matrix and stores it in mCurrentTransformMatrix.
@@ -435,6 +449,10 @@ private:
         // mEglImage is the EGLImage created from mGraphicBuffer.
         sp<EglImage> mEglImage;
 
+        // mEglImageCrop is the crop rect that mEglImage was looked up with
+        // in mEglImageCache.
+        Rect mEglImageCrop;
+
         // mFence is the EGL sync object that must signal before the buffer
         // associated with this buffer slot may be dequeued. It is initialized
         // to EGL_NO_SYNC_KHR when the buffer is created and (optionally, based
@@ -463,6 +481,28 @@ private:
     // of the buffer allocated to a slot.
     EglSlot mEglSlots[BufferQueue::NUM_BUFFER_SLOTS];
 
+    // EglImageCacheEntry is an EglImage in mEglImageCache together with the
+    // id of its GraphicBuffer and the crop rect it is for.
+    struct EglImageCacheEntry {
+        uint64_t mBufferId;
+        Rect mCrop;
+        sp<EglImage> mEglImage;
+    };
+
+    // mEglImageCache holds the most recently used EglImages, least recently
+    // used first, so that a buffer that comes back with a crop rect it had
+    // before does not need a new EGLImage. Entries are evicted once no slot
+    // holds their buffer any more, so that the cache doesn't keep freed
+    // buffers alive. EGLImages don't belong to a context, so the cache also
+    // survives detachFromContext.
+    enum { MAX_CACHED_EGL_IMAGES = 8 };
+    Vector<EglImageCacheEntry> mEglImageCache;
+
+    // mEglImageCacheHits and mEglImageCacheMisses count the lookups in
+    // mEglImageCache.
+    uint32_t mEglImageCacheHits;
+    uint32_t mEglImageCacheMisses;
+
     // mCurrentTexture is the buffer slot index of the buffer that is currently
     // bound to the OpenGL texture. It is initialized to INVALID_BUFFER_SLOT,
     // indicating that no buffer slot is currently bound to the texture. Note,
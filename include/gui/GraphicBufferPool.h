@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_GUI_GRAPHIC_BUFFER_POOL_H
+#define ANDROID_GUI_GRAPHIC_BUFFER_POOL_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <ui/PixelFormat.h>
+
+#include <utils/RefBase.h>
+#include <utils/Singleton.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+#include <utils/threads.h>
+
+namespace android {
+// ----------------------------------------------------------------------------
+
+class Fence;
+class GraphicBuffer;
+class String8;
+
+// GraphicBufferPool keeps the buffers that BufferQueues of this process
+// free, so that GraphicBufferAlloc can hand them out again instead of
+// allocating new ones from gralloc. This avoids the bursts of allocations
+// and frees that resizing, rotating and animating windows cause.
+//
+// A pooled buffer is only handed out again for exactly the same width,
+// height, format and usage, only to the uid that it was freed by, so that
+// no app can see the contents of another app's buffers, and only once
+// nothing else in this process references it and its release fence has
+// signaled, so that the consumer is done with it. Buffers are kept for at
+// most MAX_AGE and the pool never holds more than MAX_BYTES; the oldest
+// buffers are dropped first. A background thread drops buffers as they
+// reach MAX_AGE, so that an idle process doesn't keep them.
+//
+// Consumers of this process must drop their own references to a buffer once
+// its slot is freed for it to be handed out again; GLConsumer drops the
+// EGLImage it caches for the buffer then.
+class GraphicBufferPool : public Singleton<GraphicBufferPool>
+{
+public:
+    enum { MAX_BYTES = 32 * 1024 * 1024 };
+    static const nsecs_t MAX_AGE = 2000000000; // 2 s
+
+    // acquire returns a pooled buffer with the given properties that was
+    // freed by owner, or NULL if there is none.
+    sp<GraphicBuffer> acquire(uint32_t w, uint32_t h, PixelFormat format,
+            uint32_t usage, uid_t owner);
+
+    // recycle adds a buffer that owner no longer uses to the pool. The buffer
+    // is not handed out before releaseFence signals. Protected buffers and
+    // buffers of formats whose size is unknown are not pooled.
+    void recycle(const sp<GraphicBuffer>& buffer,
+            const sp<Fence>& releaseFence, uid_t owner);
+
+    // trim drops the buffers that have been pooled for MAX_AGE.
+    void trim();
+
+    // dump appends the pool statistics to result.
+    void dump(String8& result) const;
+
+private:
+    struct Entry {
+        sp<GraphicBuffer> buffer;
+        sp<Fence> releaseFence;
+        uid_t owner;
+        size_t size;
+        nsecs_t recycleTime;
+    };
+
+    class TrimThread;
+
+    friend class Singleton<GraphicBufferPool>;
+    GraphicBufferPool();
+
+    // trimLoop waits until the oldest buffer reaches MAX_AGE and drops it;
+    // it runs on mTrimThread.
+    void trimLoop();
+
+    void trimLocked(nsecs_t now);
+    void removeLocked(size_t index);
+
+    mutable Mutex mMutex;
+
+    // mTrimThread is started once the first buffer is pooled, and
+    // mTrimCondition wakes it up when the pool stops being empty.
+    sp<Thread> mTrimThread;
+    Condition mTrimCondition;
+
+    // mEntries holds the pooled buffers, oldest first.
+    Vector<Entry> mEntries;
+    size_t mPooledBytes;
+
+    // statistics since boot
+    uint64_t mNumHits;
+    uint64_t mNumMisses;
+    uint64_t mNumRecycled;
+    uint64_t mNumDropped;
+};
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_GUI_GRAPHIC_BUFFER_POOL_H
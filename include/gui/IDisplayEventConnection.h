@@ -29,6 +29,7 @@ namespace android {
 // ----------------------------------------------------------------------------
 
 class BitTube;
+class IMemoryHeap;
 
 class IDisplayEventConnection : public IInterface
 {
@@ -54,6 +55,12 @@ public:
      * if the vsync rate is > 0.
      */
     virtual void requestNextVsync() = 0;    // asynchronous
+
+    /*
+     * getVsyncTiming() returns the read-only page in which the EventThread
+     * publishes its vsync model, see VsyncTimingReader.
+     */
+    virtual status_t getVsyncTiming(sp<IMemoryHeap>* outHeap) const = 0;
 };
 
 // ----------------------------------------------------------------------------
@@ -33,6 +33,7 @@
 namespace android {
 // ----------------------------------------------------------------------------
 
+class BufferQueueStatistics;
 class Fence;
 class GraphicBuffer;
 class IConsumerListener;
@@ -306,6 +307,13 @@ public:
     // Retrieve the sideband buffer stream, if any.
     virtual sp<NativeHandle> getSidebandStream() const = 0;
 
+    // getStatistics copies the statistics that the BufferQueue keeps about
+    // how long its buffers are dequeued, queued and acquired, see
+    // BufferQueueStatistics. It takes no lock but the BufferQueue's own, so
+    // it is cheap enough to be polled.
+    virtual status_t getStatistics(
+            BufferQueueStatistics* outStatistics) const = 0;
+
     // dump state into a string
     virtual void dump(String8& result, const char* prefix) const = 0;
 
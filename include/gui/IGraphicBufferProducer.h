@@ -476,6 +476,28 @@ public:
     // allocated, this function has no effect.
     virtual void allocateBuffers(bool async, uint32_t width, uint32_t height,
             uint32_t format, uint32_t usage) = 0;
+
+    // queueAndDequeueBuffer queues the buffer in slot buf exactly like
+    // queueBuffer and then, if that succeeded, tries to dequeue the next
+    // buffer like dequeueBuffer. Over binder, both happen in a single
+    // transaction.
+    //
+    // Unlike dequeueBuffer, the dequeue never blocks. If no buffer is
+    // available right away, *outDequeueResult is WOULD_BLOCK and the client
+    // should call dequeueBuffer when it needs the buffer. Producers that
+    // don't support dequeuing ahead also report WOULD_BLOCK.
+    //
+    // The return value is that of queueBuffer. When it is NO_ERROR,
+    // *outDequeueResult holds what dequeueBuffer would have returned, and if
+    // that isn't an error, *outSlot and *outFence are set as by
+    // dequeueBuffer. If the dequeued slot needs reallocation, *outBuffer is
+    // set to its new buffer as by requestBuffer, which then doesn't need to
+    // be called.
+    virtual status_t queueAndDequeueBuffer(int buf,
+            const QueueBufferInput& input, QueueBufferOutput* output,
+            int* outSlot, sp<Fence>* outFence, sp<GraphicBuffer>* outBuffer,
+            status_t* outDequeueResult, bool async, uint32_t width,
+            uint32_t height, uint32_t format, uint32_t usage);
 };
 
 // ----------------------------------------------------------------------------
@@ -29,6 +29,7 @@ namespace android {
 // ----------------------------------------------------------------------------
 
 class BitTube;
+class SensorEventRing;
 
 class ISensorEventConnection : public IInterface
 {
@@ -40,6 +41,15 @@ public:
                                    nsecs_t maxBatchReportLatencyNs, int reservedFlags) = 0;
     virtual status_t setEventRate(int handle, nsecs_t ns) = 0;
     virtual status_t flush() = 0;
+
+    // getSensorEventRing switches the connection from its BitTube to a
+    // SensorEventRing of at least capacity events, whose doorbell is rung
+    // at most once per doorbellLatencyNs, and returns the reader end of it,
+    // or NULL on failure. Events that are already in the BitTube stay
+    // there, so this is best called before any sensor is enabled. The
+    // BitTube is still used to acknowledge wake-up events.
+    virtual sp<SensorEventRing> getSensorEventRing(size_t capacity,
+            nsecs_t doorbellLatencyNs) = 0;
 };
 
 // ----------------------------------------------------------------------------
@@ -158,6 +158,12 @@ public:
      * Requires the ACCESS_SURFACE_FLINGER permission.
      */
     virtual status_t getAnimationFrameStats(FrameStats* outStats) const = 0;
+
+    /* Gets the shared memory frame timeline (see gui/FrameTimeline.h).
+     *
+     * Requires the ACCESS_SURFACE_FLINGER permission.
+     */
+    virtual status_t getFrameTimeline(sp<IMemoryHeap>* outHeap) = 0;
 };
 
 // ----------------------------------------------------------------------------
@@ -185,6 +191,7 @@ public:
         GET_ANIMATION_FRAME_STATS,
         SET_POWER_MODE,
         GET_DISPLAY_STATS,
+        GET_FRAME_TIMELINE,
     };
 
     virtual status_t onTransact(uint32_t code, const Parcel& data,
@@ -42,6 +42,7 @@ namespace android {
 
 class ISensorEventConnection;
 class Sensor;
+class SensorEventRing;
 class Looper;
 
 // ----------------------------------------------------------------------------
@@ -77,16 +78,28 @@ public:
     status_t flush() const;
     // Send an ack for every wake_up sensor event that is set to WAKE_UP_SENSOR_EVENT_NEEDS_ACK.
     void sendAck(const ASensorEvent* events, int count);
+
+    // Switch this queue from the BitTube to a shared-memory SensorEventRing of at least capacity
+    // events, whose doorbell is rung at most once per doorbellLatencyNs. Call this before enabling
+    // any sensor; getFd() returns the doorbell afterwards, and read() reads from the ring.
+    status_t useEventRing(size_t capacity, nsecs_t doorbellLatencyNs);
+    // Read events in place when an event ring is used: events is pointed at the oldest unread
+    // events and the number of them is returned. They stay valid until consumeEvents() is called.
+    // Returns INVALID_OPERATION if no event ring is used.
+    ssize_t peekEvents(ASensorEvent const** events);
+    void consumeEvents(size_t count);
 private:
     sp<Looper> getLooper() const;
     sp<ISensorEventConnection> mSensorEventConnection;
     sp<BitTube> mSensorChannel;
+    sp<SensorEventRing> mEventRing;
     mutable Mutex mLock;
     mutable sp<Looper> mLooper;
     ASensorEvent* mRecBuffer;
     size_t mAvailable;
     size_t mConsumed;
     uint32_t mNumAcksToSend;
+    bool mSensorChannelDrained;
 };
 
 // ----------------------------------------------------------------------------
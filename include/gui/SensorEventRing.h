@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_GUI_SENSOR_EVENT_RING_H
+#define ANDROID_GUI_SENSOR_EVENT_RING_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+#include <utils/Timers.h>
+
+struct ASensorEvent;
+
+namespace android {
+// ----------------------------------------------------------------------------
+
+class IMemoryHeap;
+class Parcel;
+
+/*
+ * The start of the shared memory of a SensorEventRing; the events follow
+ * it.
+ */
+struct SensorEventRingHeader {
+    enum {
+        MAGIC           = 0x53455231, // 'SER1'
+        VERSION         = 1,
+    };
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t eventSize;
+    uint32_t capacity;
+    // the number of events ever written, only changed by the writer
+    volatile int32_t writeCount;
+    // the number of events ever consumed, only changed by the reader
+    volatile int32_t readCount;
+    uint32_t reserved[2];
+};
+
+/*
+ * SensorEventRing is a single-producer/single-consumer ring of
+ * ASensorEvents in shared memory, with an eventfd as a doorbell. It is an
+ * alternative to the BitTube of a sensor event connection for high-rate
+ * sensors: SensorService writes a batch of events without a system call,
+ * and the app reads them in place.
+ *
+ * SensorService creates the ring and is the writer, the app gets it from
+ * ISensorEventConnection::getSensorEventRing() and is the reader. The
+ * reader has to be able to write readCount, so it maps the memory
+ * read-write; the writer therefore never trusts anything in the shared
+ * memory but readCount, and treats a readCount that makes no sense as a
+ * full ring.
+ */
+class SensorEventRing : public RefBase
+{
+public:
+    enum {
+        MIN_CAPACITY    = 16,
+        MAX_CAPACITY    = 4096,
+    };
+
+    // Creates the writer end of a new ring of at least capacity events,
+    // rounded up to a power of two and clamped to [MIN_CAPACITY,
+    // MAX_CAPACITY]. The doorbell is rung at most once per
+    // doorbellLatencyNs, unless the ring fills up or events that must not
+    // wait are written; see write().
+    SensorEventRing(size_t capacity, nsecs_t doorbellLatencyNs);
+
+    // Creates the reader end of the ring in data.
+    explicit SensorEventRing(const Parcel& data);
+
+    virtual ~SensorEventRing();
+
+    // check state after construction
+    status_t initCheck() const;
+
+    // get the doorbell file-descriptor, which is readable when events are
+    // available.
+    int getFd() const;
+
+    uint32_t getCapacity() const { return mCapacity; }
+
+    // parcels the reader end of this ring
+    status_t writeToParcel(Parcel* reply) const;
+
+    // Writer: appends all numEvents events to the ring, or returns -EAGAIN
+    // without writing any if there is not enough room, like a BitTube.
+    // The doorbell is rung if doorbellLatencyNs has passed since it was
+    // last rung, if the ring is at least half full, or if any of the events
+    // is a flush complete event or needs an acknowledgement; otherwise it
+    // is rung by a later write or by ringDoorbell(). The writer must call
+    // ringDoorbell() by getPendingDoorbellTime() in case no write comes.
+    ssize_t write(ASensorEvent const* events, size_t numEvents);
+
+    // Writer: rings the doorbell if events were written since it was last
+    // rung.
+    void ringDoorbell();
+
+    // Writer: returns the time, in the SYSTEM_TIME_MONOTONIC base, when the
+    // doorbell for the events written since it was last rung is due, or -1
+    // if there are no such events.
+    nsecs_t getPendingDoorbellTime() const;
+
+    // Reader: points events at the oldest unread events and returns how
+    // many of them are contiguous in memory, or 0 if there are none. The
+    // events stay valid until consume() is called.
+    ssize_t peek(ASensorEvent const** events);
+
+    // Reader: marks the oldest numEvents events as read, so that the
+    // writer can reuse their space.
+    void consume(size_t numEvents);
+
+    // Reader: copies up to numEvents of the oldest unread events and
+    // returns how many were copied.
+    ssize_t read(ASensorEvent* events, size_t numEvents);
+
+    // Reader: resets the doorbell. This must be done before reading the
+    // events, so that a doorbell rung for later events is not lost.
+    void clearDoorbell();
+
+private:
+    sp<IMemoryHeap> mHeap;
+    SensorEventRingHeader* mHeader;
+    ASensorEvent* mEvents;
+    uint32_t mCapacity;
+    int mDoorbellFd;
+
+    // writer state, never read back from the shared memory
+    uint32_t mWriteCount;
+    nsecs_t mDoorbellLatency;
+    nsecs_t mLastDoorbellTime;
+    bool mDoorbellPending;
+};
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_GUI_SENSOR_EVENT_RING_H
@@ -18,18 +18,21 @@
 #define ANDROID_GUI_STREAMSPLITTER_H
 
 #include <gui/IConsumerListener.h>
+#include <gui/IGraphicBufferProducer.h>
 #include <gui/IProducerListener.h>
 
 #include <utils/Condition.h>
 #include <utils/KeyedVector.h>
 #include <utils/Mutex.h>
 #include <utils/StrongPointer.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
 
 namespace android {
 
 class GraphicBuffer;
 class IGraphicBufferConsumer;
-class IGraphicBufferProducer;
+class String8;
 
 // StreamSplitter is an autonomous class that manages one input BufferQueue
 // and multiple output BufferQueues. By using the buffer attach and detach logic
@@ -63,17 +66,55 @@ public:
     // of other error codes.
     status_t addOutput(const sp<IGraphicBufferProducer>& outputQueue);
 
+    // OutputPolicy says what the splitter does when an output does not keep
+    // up with the input.
+    enum OutputPolicy {
+        // Every buffer is queued to the output. If the output holds on to
+        // too many buffers, the splitter stops acquiring from the input, so
+        // the output slows down the input and all other outputs. This is the
+        // policy of outputs added without one.
+        OUTPUT_LOSSLESS,
+
+        // The splitter queues at most MAX_OUTSTANDING_BUFFERS buffers to the
+        // output at once and keeps up to queueDepth more waiting for it. When
+        // another buffer arrives, the oldest waiting one is dropped for this
+        // output. The output never slows down the input.
+        OUTPUT_DROP_OLDEST,
+
+        // Like OUTPUT_DROP_OLDEST with a queueDepth of 1: only the latest
+        // buffer waits for the output, e.g. for a preview.
+        OUTPUT_LATEST_ONLY,
+    };
+
+    // addOutput adds an output BufferQueue to the splitter like the method
+    // above, with the given policy. queueDepth is only used by
+    // OUTPUT_DROP_OLDEST and must be at least 1.
+    //
+    // Each output that is not OUTPUT_LOSSLESS may hold up to
+    // MAX_OUTSTANDING_BUFFERS + queueDepth buffers of the input, so the
+    // producer of the input must be able to allocate that many more.
+    //
+    // BAD_VALUE is returned if outputQueue is NULL, policy is unknown or
+    // queueDepth is 0 with OUTPUT_DROP_OLDEST.
+    status_t addOutput(const sp<IGraphicBufferProducer>& outputQueue,
+            OutputPolicy policy, size_t queueDepth);
+
     // setName sets the consumer name of the input queue
     void setName(const String8& name);
 
+    // dump appends the policy, queue depth and buffer latency of each
+    // output to result.
+    void dump(String8& result, const char* prefix) const;
+
 private:
     // From IConsumerListener
     //
     // During this callback, we store some tracking information, detach the
-    // buffer from the input, and attach it to each of the outputs. This call
-    // can block if there are too many outstanding buffers. If it blocks, it
-    // will resume when onBufferReleasedByOutput releases a buffer back to the
-    // input.
+    // buffer from the input, and attach it to each of the outputs, or let it
+    // wait for the outputs that may not have more buffers (see OutputPolicy).
+    // This call can block if lossless outputs hold too many buffers. If it
+    // blocks, it will resume when onBufferReleasedByOutput gets one of them
+    // back.
     virtual void onFrameAvailable(const BufferItem& item);
 
     // From IConsumerListener
@@ -93,17 +134,34 @@ private:
     // During this callback, we detach the buffer from the output queue that
     // generated the callback, update our state tracking to see if this is the
     // last output releasing the buffer, and if so, release it to the input.
-    // If we release the buffer to the input, we allow a blocked
-    // onFrameAvailable call to proceed.
+    // If this was the last lossless output holding the buffer, we allow a
+    // blocked onFrameAvailable call to proceed. If a buffer is waiting for
+    // the output, it is queued to it.
     void onBufferReleasedByOutput(const sp<IGraphicBufferProducer>& from);
 
-    // When this is called, the splitter disconnects from (i.e., abandons) its
+    // When this is called, the splitter releases the buffers still waiting
+    // for an output to the input, disconnects from (i.e., abandons) its
     // input queue and signals any waiting onFrameAvailable calls to wake up.
     // It still processes callbacks from other outputs, but only detaches their
     // buffers so they can continue operating until they run out of buffers to
     // acquire. This must be called with mMutex locked.
     void onAbandonedLocked();
 
+    class BufferTracker;
+
+    // queueToOutputLocked attaches the tracked buffer to the given output and
+    // queues it there. If the output turns out to be abandoned, the buffer is
+    // counted as released by it. This must be called with mMutex locked.
+    void queueToOutputLocked(size_t outputIndex,
+            const sp<BufferTracker>& tracker);
+
+    // onOutputDoneLocked counts the tracked buffer as released by the given
+    // output, which either released or dropped it. Once every output is done
+    // with the buffer, it is released to the input. This must be called with
+    // mMutex locked.
+    void onOutputDoneLocked(size_t outputIndex,
+            const sp<BufferTracker>& tracker);
+
     // This is a thin wrapper class that lets us determine which BufferQueue
     // the IProducerListener::onBufferReleased callback is associated with. We
     // create one of these per output BufferQueue, and then pass the producer
@@ -128,9 +186,14 @@ private:
 
     class BufferTracker : public LightRefBase<BufferTracker> {
     public:
-        BufferTracker(const sp<GraphicBuffer>& buffer);
+        BufferTracker(const sp<GraphicBuffer>& buffer,
+                const IGraphicBufferProducer::QueueBufferInput& queueInput,
+                size_t losslessOutputs);
 
         const sp<GraphicBuffer>& getBuffer() const { return mBuffer; }
+        const IGraphicBufferProducer::QueueBufferInput& getQueueInput() const {
+            return mQueueInput;
+        }
         const sp<Fence>& getMergedFence() const { return mMergedFence; }
 
         void mergeFence(const sp<Fence>& with);
@@ -139,6 +202,10 @@ private:
         // Only called while mMutex is held
         size_t incrementReleaseCountLocked() { return ++mReleaseCount; }
 
+        // Returns the number of lossless outputs that still hold the buffer
+        // Only called while mMutex is held
+        size_t decrementLosslessOutputsLocked() { return --mLosslessOutputs; }
+
     private:
         // Only destroy through LightRefBase
         friend LightRefBase<BufferTracker>;
@@ -150,9 +217,43 @@ private:
 
         sp<GraphicBuffer> mBuffer; // One instance that holds this native handle
         sp<Fence> mMergedFence;
+        IGraphicBufferProducer::QueueBufferInput mQueueInput;
         size_t mReleaseCount;
+        size_t mLosslessOutputs;
+    };
+
+    // Output holds the state and statistics of one output BufferQueue.
+    struct Output {
+        Output();
+
+        sp<IGraphicBufferProducer> mQueue;
+        OutputPolicy mPolicy;
+        size_t mQueueDepth;
+
+        // mInFlight is the number of buffers queued to the output that it
+        // has not released yet.
+        size_t mInFlight;
+
+        // mWaiting holds the buffers waiting for the output, oldest first.
+        // It is always empty for lossless outputs.
+        Vector<sp<BufferTracker> > mWaiting;
+
+        // mQueueTimes maps the ids of the buffers in flight to when they
+        // were queued to the output.
+        KeyedVector<uint64_t, nsecs_t> mQueueTimes;
+
+        // statistics
+        uint64_t mQueued;
+        uint64_t mDropped;
+        size_t mMaxDepth;
+        nsecs_t mTotalLatency;
+        nsecs_t mMaxLatency;
     };
 
+    // indexOfOutputLocked returns the index in mOutputs of the given output
+    // queue, or -1 if it is not an output of this splitter.
+    ssize_t indexOfOutputLocked(const sp<IGraphicBufferProducer>& queue) const;
+
     // Only called from createSplitter
     StreamSplitter(const sp<IGraphicBufferConsumer>& inputQueue);
 
@@ -167,11 +268,16 @@ private:
     // communicate with it further.
     bool mIsAbandoned;
 
-    Mutex mMutex;
+    mutable Mutex mMutex;
     Condition mReleaseCondition;
+
+    // mOutstandingBuffers is the number of buffers that a lossless output
+    // still holds. onFrameAvailable waits while there are
+    // MAX_OUTSTANDING_BUFFERS of them.
     int mOutstandingBuffers;
     sp<IGraphicBufferConsumer> mInput;
-    Vector<sp<IGraphicBufferProducer> > mOutputs;
+    Vector<Output> mOutputs;
+    size_t mNumLosslessOutputs;
 
     // Map of GraphicBuffer IDs (GraphicBuffer::getId()) to buffer tracking
     // objects (which are mostly for counting how many outputs have released the
@@ -186,11 +186,40 @@ private:
     void freeAllBuffers();
     int getSlotFromBufferLocked(android_native_buffer_t* buffer) const;
 
+    // cancelDequeuedAheadLocked returns the buffer that was dequeued ahead
+    // by queueBuffer, if any, to the IGraphicBufferProducer. mMutex must be
+    // locked.
+    void cancelDequeuedAheadLocked();
+
+    // hasDefaultSizeLocked returns whether the buffer of the given slot has
+    // the size that the IGraphicBufferProducer currently gives buffers that
+    // are dequeued without a size. It is false if the Surface doesn't have
+    // the buffer yet. mMutex must be locked.
+    bool hasDefaultSizeLocked(int slot) const;
+
     struct BufferSlot {
         sp<GraphicBuffer> buffer;
         Region dirtyRegion;
     };
 
+    // DequeuedAhead describes a buffer that queueBuffer dequeued with
+    // IGraphicBufferProducer::queueAndDequeueBuffer and that the next
+    // dequeueBuffer hands out, provided it is still asked for with the same
+    // parameters and, if it was dequeued with the default size, that size
+    // hasn't changed.
+    struct DequeuedAhead {
+        DequeuedAhead() : slot(INVALID_SLOT), async(false), width(0),
+                height(0), format(0), usage(0) {}
+        enum { INVALID_SLOT = -1 };
+        int slot;
+        sp<Fence> fence;
+        bool async;
+        uint32_t width;
+        uint32_t height;
+        uint32_t format;
+        uint32_t usage;
+    };
+
     // mSurfaceTexture is the interface to the surface texture server. All
     // operations on the surface texture client ultimately translate into
     // interactions with the server using this interface.
@@ -282,6 +311,16 @@ private:
     // one buffer behind the producer.
     mutable bool mConsumerRunningBehind;
 
+    // mDequeueAhead is set while the Surface is connected with
+    // NATIVE_WINDOW_API_EGL. GL producers dequeue right after every queue,
+    // so queueBuffer then also dequeues the next buffer in the same
+    // transaction.
+    bool mDequeueAhead;
+
+    // mDequeuedAhead is the buffer dequeued by the last queueBuffer, if
+    // mDequeuedAhead.slot is not DequeuedAhead::INVALID_SLOT.
+    DequeuedAhead mDequeuedAhead;
+
     // mMutex is the mutex used to prevent concurrent access to the member
     // variables of Surface objects. It must be locked whenever the
     // member variables are accessed.
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_GUI_VSYNC_TIMING_H
+#define ANDROID_GUI_VSYNC_TIMING_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+#include <utils/Timers.h>
+#include <utils/threads.h>
+
+namespace android {
+
+class IMemoryHeap;
+
+/*
+ * The vsync model that SurfaceFlinger's DispSync has fitted to the hardware
+ * vsync events, as seen by one EventThread. Its vsync events happen at
+ * phase + phaseOffset + k * period for every integer k. Times are in
+ * nanoseconds on the SYSTEM_TIME_MONOTONIC clock.
+ */
+struct VsyncTiming {
+    // the period of the events, including any refresh skipping; 0 while
+    // there is no model yet
+    nsecs_t period;
+    // the time of some hardware vsync event
+    nsecs_t phase;
+    // the EventThread's offset from the hardware vsync events
+    nsecs_t phaseOffset;
+    // the newest hardware vsync timestamp the model was fitted to; the
+    // model is extrapolated from there
+    nsecs_t referenceTime;
+    // incremented every time the model or the offset changes
+    uint32_t sequence;
+
+    // computeNextVsync returns the time of the first event after when.
+    nsecs_t computeNextVsync(nsecs_t when) const;
+};
+
+/*
+ * The shared memory that a VsyncTiming is published in, protected by a
+ * seqlock.
+ */
+struct VsyncTimingPage {
+    enum {
+        MAGIC           = 0x56545031, // 'VTP1'
+        VERSION         = 1,
+    };
+
+    uint32_t magic;
+    uint32_t version;
+    // odd while the page is being written
+    volatile int32_t seq;
+    uint32_t reserved;
+    int64_t period;
+    int64_t phase;
+    int64_t phaseOffset;
+    int64_t referenceTime;
+};
+
+/*
+ * Publishes a VsyncTiming to a new page that clients map read-only.
+ * It may be called from several threads.
+ */
+class VsyncTimingWriter : public LightRefBase<VsyncTimingWriter> {
+public:
+    VsyncTimingWriter();
+    ~VsyncTimingWriter();
+
+    status_t initCheck() const;
+
+    // publishModel publishes a new model; the phase offset is kept.
+    void publishModel(nsecs_t period, nsecs_t phase, nsecs_t referenceTime);
+
+    // publishPhaseOffset publishes a new phase offset; the model is kept.
+    void publishPhaseOffset(nsecs_t phaseOffset);
+
+    const sp<IMemoryHeap>& getHeap() const { return mHeap; }
+
+private:
+    void publishLocked();
+
+    sp<IMemoryHeap> mHeap;
+    VsyncTimingPage* mPage;
+
+    Mutex mMutex;
+    VsyncTiming mTiming;
+};
+
+/*
+ * Reads the VsyncTiming from a page published by a VsyncTimingWriter,
+ * without any binder calls.
+ */
+class VsyncTimingReader {
+public:
+    VsyncTimingReader(const sp<IMemoryHeap>& heap);
+
+    status_t initCheck() const;
+
+    // read copies the current timing to outTiming. It returns
+    // NOT_ENOUGH_DATA if there is no model yet, and WOULD_BLOCK if the page
+    // kept changing while it was being read.
+    status_t read(VsyncTiming* outTiming) const;
+
+private:
+    sp<IMemoryHeap> mHeap;
+    const VsyncTimingPage* mPage;
+};
+
+}; // namespace android
+
+#endif // ANDROID_GUI_VSYNC_TIMING_H
@@ -28,6 +28,7 @@
  */
 
 #include <input/Input.h>
+#include <input/TouchPredictor.h>
 #include <utils/Errors.h>
 #include <utils/Timers.h>
 #include <utils/RefBase.h>
@@ -176,6 +177,31 @@ public:
      */
     status_t receiveMessage(InputMessage* msg);
 
+    /* Sends several messages to the other endpoint using as few system calls as possible.
+     *
+     * Each message is sent as its own datagram, exactly as sendMessage would send it, so
+     * the other endpoint may receive them either way.  Only the first msg->size() bytes
+     * of each message are read.
+     *
+     * Sets outCount to the number of messages that were sent, always the first ones.
+     *
+     * Returns OK if all messages were sent.
+     * Otherwise returns the error that sendMessage would have returned for the first
+     * message that was not sent.
+     */
+    status_t sendMessages(const InputMessage* const* msgs, size_t count, size_t* outCount);
+
+    /* Receives up to count messages sent by the other endpoint with a single system call.
+     *
+     * Sets outCount to the number of valid messages stored in msgs.
+     *
+     * Returns OK if at least one message was received and all of them were valid.
+     * Otherwise returns the error that receiveMessage would have returned for the message
+     * that follows the valid ones.  If that message was received but is invalid, it and
+     * any messages received after it are dropped.
+     */
+    status_t receiveMessages(InputMessage* msgs, size_t count, size_t* outCount);
+
     /* Returns a new object that has a duplicate of this channel's fd. */
     sp<InputChannel> dup() const;
 
@@ -189,6 +215,11 @@ private:
  */
 class InputPublisher {
 public:
+    enum {
+        // Maximum number of events in a batch.
+        MAX_BATCH_SIZE = 16,
+    };
+
     /* Creates a publisher associated with an input channel. */
     explicit InputPublisher(const sp<InputChannel>& channel);
 
@@ -259,8 +290,44 @@ public:
      */
     status_t receiveFinishedSignal(uint32_t* outSeq, bool* outHandled);
 
+    /* Starts a batch of events.
+     *
+     * The events published until endBatch() is called are not sent right away but held
+     * and then sent together.  Meanwhile publishKeyEvent and publishMotionEvent return OK
+     * once the event was added to the batch, BAD_VALUE if it is invalid, or NO_MEMORY if
+     * the batch is full.
+     */
+    void beginBatch();
+
+    /* Returns true if no more events can be added to the current batch. */
+    bool isBatchFull() const;
+
+    /* Sends the events of the current batch and ends it.
+     *
+     * Sets outCount to the number of events that were sent, always the first ones.
+     *
+     * Returns OK if all events were sent.
+     * Otherwise returns the error that publishing the first unsent event on its own
+     * would have returned.
+     */
+    status_t endBatch(size_t* outCount);
+
 private:
+    // Size of the buffer holding the current batch.  Events are stored back to back using
+    // only as many bytes as they need, but one is only added while there is still room
+    // for an event with MAX_POINTERS pointers, so that isBatchFull() need not know the
+    // next event.  That leaves room for a full batch of events with one pointer.
+    static const size_t BATCH_BUFFER_SIZE = 3 * sizeof(InputMessage);
+
     sp<InputChannel> mChannel;
+
+    bool mBatching;
+    size_t mBatchCount;
+    size_t mBatchBytes;
+    const InputMessage* mBatchMessages[MAX_BATCH_SIZE];
+    uint64_t mBatchBuffer[BATCH_BUFFER_SIZE / sizeof(uint64_t)];
+
+    status_t publishMessage(const InputMessage* msg);
 };
 
 /*
@@ -317,7 +384,8 @@ public:
      *
      * Should be called after calling consume() to determine whether the consumer
      * has a deferred event to be processed.  Deferred events are somewhat special in
-     * that they have already been removed from the input channel.  If the input channel
+     * that they have already been removed from the input channel.  This includes events
+     * that were received together with earlier ones but not consumed yet.  If the input channel
      * becomes empty, the client may need to do extra work to ensure that it processes
      * the deferred event despite the fact that the input channel's file descriptor
      * is not readable.
@@ -338,13 +406,43 @@ public:
      */
     bool hasPendingBatch() const;
 
+    /* Enables or disables touch prediction.
+     *
+     * When enabled, batched touches are resampled at the time the frame is expected
+     * to be presented, presentLatency after the frame time passed to consume(), by
+     * predicting the pointer positions from their recent movements with the specified
+     * velocity tracker strategy, such as "lsq2" or "int2".  Otherwise they are
+     * resampled slightly before the frame time.
+     *
+     * Passing a NULL strategy disables touch prediction, which is the default.
+     * Has no effect if touch resampling is disabled.
+     */
+    void setTouchPrediction(const char* strategy, nsecs_t presentLatency);
+
 private:
     // True if touch resampling is enabled.
     const bool mResampleTouch;
 
+    // The touch predictor, or NULL if touch prediction is disabled.
+    TouchPredictor* mTouchPredictor;
+
+    // The time from the frame time to the expected present time of the frame.
+    nsecs_t mPresentLatency;
+
+    // Maximum number of messages to receive with a single system call.
+    static const size_t RECEIVE_BATCH_SIZE = 8;
+
     // The input channel.
     sp<InputChannel> mChannel;
 
+    // Messages received from the input channel that have not been handled yet.
+    InputMessage mReceivedMsgs[RECEIVE_BATCH_SIZE];
+    size_t mReceivedCount;
+    size_t mReceivedIndex;
+
+    // The error to return once the received messages have been handled.
+    status_t mReceiveStatus;
+
     // The current input message.
     InputMessage mMsg;
 
@@ -380,6 +478,7 @@ private:
             return pointers[idToIndex[id]];
         }
     };
+    static const size_t MAX_PREDICTION_MOVEMENTS = 8;
     struct TouchState {
         int32_t deviceId;
         int32_t source;
@@ -387,6 +486,14 @@ private:
         size_t historySize;
         History history[2];
         History lastResample;
+        // Time of the last predicted sample, which can be ahead of the samples
+        // still to come; 0 if none was predicted.
+        nsecs_t lastPredictionTime;
+
+        // A longer history of the pointer positions alone, for touch prediction.
+        size_t movementCurrent;
+        size_t movementCount;
+        TouchPredictor::Movement movements[MAX_PREDICTION_MOVEMENTS];
 
         void initialize(int32_t deviceId, int32_t source) {
             this->deviceId = deviceId;
@@ -395,6 +502,9 @@ private:
             historySize = 0;
             lastResample.eventTime = 0;
             lastResample.idBits.clear();
+            lastPredictionTime = 0;
+            movementCurrent = 0;
+            movementCount = 0;
         }
 
         void addHistory(const InputMessage* msg) {
@@ -403,11 +513,38 @@ private:
                 historySize += 1;
             }
             history[historyCurrent].initializeFrom(msg);
+            addMovement(history[historyCurrent]);
         }
 
         const History* getHistory(size_t index) const {
             return &history[(historyCurrent + index) & 1];
         }
+
+        void addMovement(const History& history) {
+            movementCurrent = (movementCurrent + 1) % MAX_PREDICTION_MOVEMENTS;
+            if (movementCount < MAX_PREDICTION_MOVEMENTS) {
+                movementCount += 1;
+            }
+            TouchPredictor::Movement& movement = movements[movementCurrent];
+            movement.eventTime = history.eventTime;
+            movement.idBits = history.idBits;
+            for (BitSet32 idBits(history.idBits); !idBits.isEmpty(); ) {
+                uint32_t id = idBits.clearFirstMarkedBit();
+                uint32_t index = history.idBits.getIndexOfBit(id);
+                const PointerCoords& coords = history.getPointerById(id);
+                movement.positions[index].x = coords.getX();
+                movement.positions[index].y = coords.getY();
+            }
+        }
+
+        // Copies the movements into outMovements, oldest first, and returns their number.
+        size_t getMovements(TouchPredictor::Movement* outMovements) const {
+            for (size_t i = 0; i < movementCount; i++) {
+                outMovements[i] = movements[(movementCurrent + MAX_PREDICTION_MOVEMENTS
+                        - movementCount + 1 + i) % MAX_PREDICTION_MOVEMENTS];
+            }
+            return movementCount;
+        }
     };
     Vector<TouchState> mTouchStates;
 
@@ -430,12 +567,15 @@ private:
     void rewriteMessage(const TouchState& state, InputMessage* msg);
     void resampleTouchState(nsecs_t frameTime, MotionEvent* event,
             const InputMessage *next);
+    void predictTouchState(TouchState& touchState, nsecs_t sampleTime, MotionEvent* event);
 
     ssize_t findBatch(int32_t deviceId, int32_t source) const;
     ssize_t findTouchState(int32_t deviceId, int32_t source) const;
 
     status_t sendUnchainedFinishedSignal(uint32_t seq, bool handled);
 
+    status_t receiveMessage(InputMessage* msg);
+
     static void initializeKeyEvent(KeyEvent* event, const InputMessage* msg);
     static void initializeMotionEvent(MotionEvent* event, const InputMessage* msg);
     static void addSample(MotionEvent* event, const InputMessage* msg);
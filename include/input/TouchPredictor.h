@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBINPUT_TOUCH_PREDICTOR_H
+#define _LIBINPUT_TOUCH_PREDICTOR_H
+
+#include <input/Input.h>
+#include <input/VelocityTracker.h>
+#include <utils/Timers.h>
+#include <utils/BitSet.h>
+
+namespace android {
+
+/*
+ * Predicts where touch pointers will be shortly after their most recent movement.
+ *
+ * The prediction evaluates the position estimator of a velocity tracker strategy
+ * at the requested time, so any strategy can serve as a predictor: "lsq2" fits a
+ * quadratic to the recent movements, "int2" runs them through a second order
+ * integrating filter, and "lsq1" over the last two movements is plain linear
+ * extrapolation.
+ */
+class TouchPredictor {
+public:
+    // The positions of a set of pointers at one point in time.
+    // The positions array is in order by increasing id, as for VelocityTracker.
+    struct Movement {
+        nsecs_t eventTime;
+        BitSet32 idBits;
+        VelocityTracker::Position positions[MAX_POINTERS];
+    };
+
+    // Creates a predictor using the specified velocity tracker strategy.
+    // If strategy is NULL, uses the default strategy for the platform.
+    explicit TouchPredictor(const char* strategy = NULL);
+
+    ~TouchPredictor();
+
+    // Replaces the movements that predictions are based on, oldest first.
+    void setMovements(const Movement* movements, size_t count);
+
+    // Predicts the position of the specified pointer id at the specified time.
+    // Returns false if there is no information available about the pointer.
+    bool predict(uint32_t id, nsecs_t time, float* outX, float* outY) const;
+
+private:
+    VelocityTracker mVelocityTracker;
+};
+
+} // namespace android
+
+#endif // _LIBINPUT_TOUCH_PREDICTOR_H
@@ -135,6 +135,11 @@ public:
 
 /*
  * Velocity tracker algorithm based on least-squares linear regression.
+ *
+ * Without weighting, the strategy keeps the sums that make up the normal equations
+ * of the fit up to date for each pointer as movements are added, so getting an
+ * estimator only takes solving a small system shared by both axes.  Weighted fits
+ * depend on the age of every sample, so they are solved from the history each time.
  */
 class LeastSquaresVelocityTrackerStrategy : public VelocityTrackerStrategy {
 public:
@@ -182,12 +187,36 @@ private:
         }
     };
 
+    // Sums over the samples of a pointer that an unweighted fit uses, which are the
+    // newest movements of the pointer within the horizon.  Times are in seconds
+    // relative to the newest movement and positions are relative to an origin near
+    // the samples, which keeps the sums well conditioned.
+    struct Sums {
+        uint32_t count;
+        bool ordered; // false if the samples are not in time order
+        double originX, originY;
+        double t[2 * VelocityTracker::Estimator::MAX_DEGREE + 1]; // sums of t^k
+        double xt[VelocityTracker::Estimator::MAX_DEGREE + 1];    // sums of x t^k
+        double yt[VelocityTracker::Estimator::MAX_DEGREE + 1];    // sums of y t^k
+        double xx, yy;
+    };
+
     float chooseWeight(uint32_t index) const;
 
+    void resetSums(Sums& sums, const VelocityTracker::Position& origin) const;
+    void addToSums(Sums& sums, nsecs_t age, const VelocityTracker::Position& position,
+            double sign) const;
+    void shiftSums(Sums& sums, nsecs_t delta) const;
+    void removeOldestFromSums(uint32_t id, Sums& sums) const;
+    void rebuildSums(uint32_t id);
+    bool getEstimatorFromSums(uint32_t id, VelocityTracker::Estimator* outEstimator) const;
+    bool getEstimatorFromHistory(uint32_t id, VelocityTracker::Estimator* outEstimator) const;
+
     const uint32_t mDegree;
     const Weighting mWeighting;
     uint32_t mIndex;
     Movement mMovements[HISTORY_SIZE];
+    Sums mSums[MAX_POINTER_ID + 1]; // only maintained without weighting
 };
 
 
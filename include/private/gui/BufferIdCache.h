@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_GUI_BUFFER_ID_CACHE_H
+#define ANDROID_GUI_BUFFER_ID_CACHE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <gui/BufferQueueDefs.h>
+
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+#include <utils/threads.h>
+
+namespace android {
+// ----------------------------------------------------------------------------
+
+class GraphicBuffer;
+class Parcel;
+
+// BufferIdCache lets the proxy side of a buffer queue interface receive a
+// GraphicBuffer it already has as its id only, instead of as a full
+// GraphicBuffer with fds that have to be dup()ed and registered with
+// gralloc again.
+//
+// The proxy sends the ids of the buffers in its cache with a request
+// (writeIds), the binder side sends each buffer of the reply either in
+// full or, if the proxy listed its id, as the id alone (writeBuffer), and
+// the proxy resolves the reply against the buffers it listed
+// (readBuffer). A proxy only ever lists buffers it holds, so a reply can
+// always be resolved.
+//
+// BufferQueue doesn't send a buffer again while it stays in its slot, so
+// the cache pays off for buffers that come back after their slot was freed,
+// as GraphicBufferPool recycling and buffer count changes do. A buffer is
+// therefore kept after another buffer is received for its slot or its slot
+// is detached or released, but only the MAX_FREED_BUFFERS most recently
+// freed ones are, and only for MAX_FREED_AGE, checked whenever the cache is
+// used. Once the queue has freed all of its buffers or the proxy has
+// disconnected, nothing is kept. The cache never holds more than
+// MAX_BUFFERS buffers.
+class BufferIdCache
+{
+public:
+    enum { MAX_BUFFERS = BufferQueueDefs::NUM_BUFFER_SLOTS };
+    enum { MAX_FREED_BUFFERS = 4 };
+    static const nsecs_t MAX_FREED_AGE = 1000000000; // 1 s
+
+    // The buffers listed with one request; they stay valid until its reply
+    // has been read, even if the cache drops them meanwhile.
+    typedef Vector<sp<GraphicBuffer> > Snapshot;
+
+    BufferIdCache();
+    ~BufferIdCache();
+
+    // Proxy: writes the ids of the cached buffers to data.
+    void writeIds(Parcel* data, Snapshot* outSnapshot);
+
+    // Proxy: reads a buffer written by writeBuffer for the given slot,
+    // resolving ids against snapshot, and caches it for that slot. The
+    // buffer previously received for the slot counts as freed. outBuffer is
+    // set to NULL if no buffer was sent. A slot of -1 stands for no
+    // particular slot.
+    status_t readBuffer(const Parcel& reply, const Snapshot& snapshot,
+            int slot, sp<GraphicBuffer>* outBuffer);
+
+    // Proxy: marks the buffer received for the given slot as freed, once the
+    // slot has been detached or released.
+    void freeSlot(int slot);
+
+    // Proxy: drops all buffers, once the buffer queue has freed them or the
+    // proxy has disconnected.
+    void clear();
+
+    // Binder side: reads the ids written by writeIds.
+    static status_t readIds(const Parcel& data, Vector<uint64_t>* outIds);
+
+    // Binder side: writes buffer, which may be NULL, as its id if it is one
+    // of ids and in full otherwise.
+    static status_t writeBuffer(Parcel* reply,
+            const sp<GraphicBuffer>& buffer, const Vector<uint64_t>& ids);
+
+private:
+    struct Entry {
+        sp<GraphicBuffer> buffer;
+        // the slot the buffer was last received for, or -1 once freed
+        int slot;
+        // when the buffer was freed
+        nsecs_t freeTime;
+    };
+
+    void addLocked(const sp<GraphicBuffer>& buffer, int slot, nsecs_t now);
+    void freeLocked(size_t index, nsecs_t now);
+
+    // Drops the freed buffers older than MAX_FREED_AGE and the least
+    // recently received freed buffers beyond MAX_FREED_BUFFERS.
+    void trimLocked(nsecs_t now);
+
+    Mutex mMutex;
+
+    // mEntries holds the cached buffers, least recently received first.
+    Vector<Entry> mEntries;
+};
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_GUI_BUFFER_ID_CACHE_H
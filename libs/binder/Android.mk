@@ -16,6 +16,7 @@
 sources := \
     AppOpsManager.cpp \
     Binder.cpp \
+    BlobRing.cpp \
     BpBinder.cpp \
     BufferedTextOutput.cpp \
     Debug.cpp \
@@ -61,3 +62,7 @@ endif
 endif
 LOCAL_CFLAGS += -Werror
 include $(BUILD_STATIC_LIBRARY)
+
+ifeq (,$(ONE_SHOT_MAKEFILE))
+include $(call first-makefiles-under,$(LOCAL_PATH))
+endif
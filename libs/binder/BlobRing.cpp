@@ -0,0 +1,606 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BlobRing"
+//#define LOG_NDEBUG 0
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <cutils/ashmem.h>
+#include <cutils/atomic.h>
+#include <utils/KeyedVector.h>
+#include <utils/Log.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+#include <binder/BlobRing.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+static const uint32_t BLOB_RING_MAGIC = 0x42524e47; // 'BRNG'
+static const uint32_t BLOB_CONTROL_MAGIC = 0x4252434c; // 'BRCL'
+static const uint32_t SLICE_MAGIC = 0x534c4943; // 'SLIC'
+
+// Layout of the ring: a header, followed by slices.  Every slice starts with
+// a slice_header and is a multiple of SLICE_ALIGN bytes long.  Only the
+// writer can write to the ring.
+struct blob_ring_header {
+    uint32_t magic;
+    uint32_t size;
+    uint64_t token;
+};
+
+struct slice_header {
+    uint32_t magic;
+    uint32_t length;
+    uint32_t generation;
+    uint32_t slot;
+};
+
+// Layout of the control page, which readers write to: a header, followed by
+// the state of each slice, at the slot given in its slice_header.
+struct blob_control_header {
+    uint32_t magic;
+    volatile int32_t probe;
+    uint64_t token;
+};
+
+// The state of a slice is its generation shifted left by two, with one of
+// the SLICE_* values below in the low bits.  State changes only succeed for
+// the generation they are meant for, so a late reader cannot claim or free
+// the slice that has since been reserved with the same slot.
+struct slice_state {
+    volatile int32_t state;
+    volatile int32_t owner; // pid of the reader that claimed the slice
+};
+
+enum {
+    SLICE_WAITING = 0,  // reserved, not claimed by its reader yet
+    SLICE_HELD = 1,     // claimed by its reader
+    SLICE_RELEASED = 2,
+    SLICE_REVOKED = 3,  // taken back from a reader that never came
+};
+
+static const size_t SLICE_ALIGN = 16;
+static const size_t DATA_START = 64;
+static const uint32_t MAX_GENERATION = 0x1fffffff;
+static const size_t CONTROL_SIZE = 4096;
+static const size_t MAX_SLICES =
+        (CONTROL_SIZE - sizeof(blob_control_header)) / sizeof(slice_state);
+
+static inline size_t align_slice(size_t size) {
+    return (size + SLICE_ALIGN - 1) & ~(SLICE_ALIGN - 1);
+}
+
+static inline int32_t make_state(uint32_t generation, int32_t status) {
+    return int32_t(generation << 2) | status;
+}
+
+static inline slice_state* slice_states(uint8_t* control) {
+    return reinterpret_cast<slice_state*>(control + sizeof(blob_control_header));
+}
+
+// How many of the most recently imported rings stay mapped once no blob
+// refers to them anymore.
+static const size_t MAX_RETAINED_RINGS = 4;
+
+// Rings currently mapped in this process, keyed by token, and the ones that
+// are kept mapped, most recently used first.  A ring's destructor takes
+// gBlobRingsLock, so the last reference to a ring must not be dropped while
+// the lock is held.
+static Mutex gBlobRingsLock;
+static KeyedVector<uint64_t, wp<BlobRing> > gBlobRings;
+static Vector<sp<BlobRing> > gRetainedRings;
+static uint64_t gProbeState; // guarded by gBlobRingsLock
+
+// Serializes forBinder(); the address of gConnectionRingId identifies the
+// ring attached to a proxy.
+static Mutex gConnectionRingsLock;
+static int gConnectionRingId;
+
+static uint64_t make_token() {
+    uint64_t token = 0;
+    int fd = open("/dev/urandom", O_RDONLY);
+    if (fd >= 0) {
+        if (read(fd, &token, sizeof(token)) != sizeof(token)) {
+            token = 0;
+        }
+        close(fd);
+    }
+    if (token == 0) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        token = (uint64_t(getpid()) << 32) ^ uint64_t(ts.tv_sec) * 1000000000LL ^ ts.tv_nsec;
+    }
+    return token;
+}
+
+// Returns an unpredictable probe value; gBlobRingsLock must be held.
+static int32_t next_probe_l() {
+    if (gProbeState == 0) {
+        gProbeState = make_token() | 1;
+    }
+    // xorshift64*
+    gProbeState ^= gProbeState >> 12;
+    gProbeState ^= gProbeState << 25;
+    gProbeState ^= gProbeState >> 27;
+    return int32_t((gProbeState * 2685821657736338717ULL) >> 32);
+}
+
+// Returns true if controlFd refers to the control page mapped at control.
+// The header fields are not enough to tell, since anyone can create a region
+// with the same header; instead a fresh value is stored through the existing
+// mapping and must be read back through controlFd.  ashmem regions can be
+// read with pread(), so this costs one syscall rather than a mapping.
+// gBlobRingsLock must be held.
+static bool maps_control_l(int controlFd, uint8_t* control) {
+    blob_control_header* header = reinterpret_cast<blob_control_header*>(control);
+    const int32_t probe = next_probe_l();
+    android_atomic_release_store(probe, &header->probe);
+    int32_t other;
+    if (TEMP_FAILURE_RETRY(::pread(controlFd, &other, sizeof(other),
+            offsetof(blob_control_header, probe))) != ssize_t(sizeof(other))) {
+        return false;
+    }
+    return other == probe;
+}
+
+// Returns true if the header read through fd is the one of the ring mapped
+// at base.  Only the writer and the reader of a ring know its token.
+static bool has_ring_header(int fd, const uint8_t* base) {
+    blob_ring_header header;
+    if (TEMP_FAILURE_RETRY(::pread(fd, &header, sizeof(header), 0))
+            != ssize_t(sizeof(header))) {
+        return false;
+    }
+    return memcmp(&header, base, sizeof(header)) == 0;
+}
+
+// Keeps the ring mapped for a while after its last blob is released, so a
+// reader that releases every blob before the next one arrives does not map
+// and unmap the ring for each of them.  gBlobRingsLock must be held; the ring
+// pushed out of the list, if any, is returned so that it can be dropped
+// after the lock is released.
+static sp<BlobRing> retain_l(const sp<BlobRing>& ring) {
+    sp<BlobRing> evicted;
+    for (size_t i = 0; i < gRetainedRings.size(); i++) {
+        if (gRetainedRings[i] == ring) {
+            gRetainedRings.removeAt(i);
+            break;
+        }
+    }
+    if (gRetainedRings.size() >= MAX_RETAINED_RINGS) {
+        evicted = gRetainedRings[gRetainedRings.size() - 1];
+        gRetainedRings.removeAt(gRetainedRings.size() - 1);
+    }
+    gRetainedRings.insertAt(ring, 0);
+    return evicted;
+}
+
+static void release_connection_ring(const void* id, void* obj, void* /*cookie*/) {
+    static_cast<BlobRing*>(obj)->decStrong(id);
+}
+
+// Returns the slice of the given generation whose data starts at offset and
+// holds at least len bytes, or NULL if there is none.
+static const slice_header* find_slice(const uint8_t* base, size_t size, size_t offset,
+        size_t len, uint32_t generation) {
+    if (offset < DATA_START + sizeof(slice_header) || offset > size
+            || (offset & (SLICE_ALIGN - 1)) || len > size - offset
+            || generation == 0 || generation > MAX_GENERATION) {
+        return NULL;
+    }
+    const slice_header* slice = reinterpret_cast<const slice_header*>(
+            base + offset - sizeof(slice_header));
+    if (slice->magic != SLICE_MAGIC || slice->generation != generation
+            || slice->slot >= MAX_SLICES
+            || slice->length < sizeof(slice_header) + len
+            || slice->length > size - (offset - sizeof(slice_header))) {
+        return NULL;
+    }
+    return slice;
+}
+
+// ---------------------------------------------------------------------------
+
+BlobRing::BlobRing(int fd, uint8_t* base, size_t size, int controlFd, uint8_t* control,
+        uint64_t token, nsecs_t abandonTimeout)
+    : mFd(fd), mBase(base), mSize(size), mControlFd(controlFd), mControl(control),
+      mToken(token), mAbandonTimeout(abandonTimeout),
+      mHead(DATA_START), mTail(DATA_START), mUsed(0), mGeneration(0)
+{
+    if (mFd >= 0) {
+        for (size_t i = MAX_SLICES; i > 0; i--) {
+            mFreeSlots.push(int32_t(i - 1));
+        }
+    }
+}
+
+BlobRing::~BlobRing()
+{
+    {
+        Mutex::Autolock _l(gBlobRingsLock);
+        ssize_t index = gBlobRings.indexOfKey(mToken);
+        if (index >= 0 && gBlobRings.valueAt(index).unsafe_get() == this) {
+            gBlobRings.removeItemsAt(index);
+        }
+    }
+    ::munmap(mBase, mSize);
+    ::munmap(mControl, CONTROL_SIZE);
+    if (mFd >= 0) {
+        ::close(mFd);
+    }
+    if (mControlFd >= 0) {
+        ::close(mControlFd);
+    }
+}
+
+// Creates an ashmem region of size bytes and maps it for writing.  Returns
+// the fd and sets outBase, or returns -1.
+static int create_region(const char* name, size_t size, uint8_t** outBase) {
+    int fd = ashmem_create_region(name, size);
+    if (fd < 0) {
+        ALOGE("error creating ashmem region: %s", strerror(errno));
+        return -1;
+    }
+    void* base = ::mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        ALOGE("mmap(fd=%d, size=%zu) failed (%s)", fd, size, strerror(errno));
+        ::close(fd);
+        return -1;
+    }
+    *outBase = static_cast<uint8_t*>(base);
+    return fd;
+}
+
+sp<BlobRing> BlobRing::create(size_t size, nsecs_t abandonTimeout)
+{
+    const size_t pagesize = getpagesize();
+    size = (size + pagesize - 1) & ~(pagesize - 1);
+    if (size <= DATA_START || size_t(uint32_t(size)) != size) {
+        return NULL;
+    }
+
+    uint8_t* base;
+    int fd = create_region("Parcel BlobRing", size, &base);
+    if (fd < 0) {
+        return NULL;
+    }
+    uint8_t* control;
+    int controlFd = create_region("Parcel BlobRing control", CONTROL_SIZE, &control);
+    if (controlFd < 0) {
+        ::munmap(base, size);
+        ::close(fd);
+        return NULL;
+    }
+
+    const uint64_t token = make_token();
+    blob_ring_header* header = reinterpret_cast<blob_ring_header*>(base);
+    header->magic = BLOB_RING_MAGIC;
+    header->size = size;
+    header->token = token;
+    blob_control_header* controlHeader = reinterpret_cast<blob_control_header*>(control);
+    controlHeader->magic = BLOB_CONTROL_MAGIC;
+    controlHeader->token = token;
+
+    sp<BlobRing> ring = new BlobRing(fd, base, size, controlFd, control, token,
+            abandonTimeout);
+
+    // From now on the ring can only be mapped read-only; our own mapping
+    // stays writable.
+    if (ashmem_set_prot_region(fd, PROT_READ) < 0) {
+        ALOGE("error sealing ring: %s", strerror(errno));
+        return NULL;
+    }
+
+    Mutex::Autolock _l(gBlobRingsLock);
+    gBlobRings.add(token, ring);
+    return ring;
+}
+
+sp<BlobRing> BlobRing::forBinder(const sp<IBinder>& binder, size_t size)
+{
+    if (binder == NULL || binder->remoteBinder() == NULL) {
+        return NULL;
+    }
+
+    Mutex::Autolock _l(gConnectionRingsLock);
+    BlobRing* ring = static_cast<BlobRing*>(binder->findObject(&gConnectionRingId));
+    if (ring != NULL) {
+        return ring;
+    }
+    sp<BlobRing> created = create(size);
+    if (created == NULL) {
+        return NULL;
+    }
+    created->incStrong(&gConnectionRingId);
+    binder->attachObject(&gConnectionRingId, created.get(), NULL, release_connection_ring);
+    return created;
+}
+
+sp<BlobRing> BlobRing::import(int fd, int controlFd, uint64_t token, size_t size)
+{
+    // Rings that lose their last reference in here are only dropped once
+    // gBlobRingsLock has been released; see gRetainedRings.
+    sp<BlobRing> cached, evicted;
+    bool cache = true;
+    {
+        Mutex::Autolock _l(gBlobRingsLock);
+        ssize_t index = gBlobRings.indexOfKey(token);
+        if (index >= 0) {
+            cached = gBlobRings.valueAt(index).promote();
+            if (cached != NULL) {
+                if (cached->getSize() == size
+                        && maps_control_l(controlFd, cached->mControl)
+                        && has_ring_header(fd, cached->base())) {
+                    if (cached->mFd < 0) {
+                        evicted = retain_l(cached);
+                    }
+                    return cached;
+                }
+                // Not the regions we know by that token.  Map them on their
+                // own without replacing the cached ring.
+                ALOGW("import: fds do not map ring %#" PRIx64, token);
+                cache = false;
+            }
+        }
+    }
+
+    if (size <= DATA_START || size_t(uint32_t(size)) != size) {
+        return NULL;
+    }
+    int regionSize = ashmem_get_size_region(fd);
+    int controlSize = ashmem_get_size_region(controlFd);
+    if (regionSize < 0 || size_t(regionSize) < size
+            || controlSize < 0 || size_t(controlSize) < CONTROL_SIZE) {
+        ALOGE("import: ring regions too small (%d < %zu or %d < %zu)",
+                regionSize, size, controlSize, CONTROL_SIZE);
+        return NULL;
+    }
+    void* base = ::mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        ALOGE("mmap(fd=%d, size=%zu) failed (%s)", fd, size, strerror(errno));
+        return NULL;
+    }
+    void* control = ::mmap(NULL, CONTROL_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+            controlFd, 0);
+    if (control == MAP_FAILED) {
+        ALOGE("mmap(fd=%d, size=%zu) failed (%s)", controlFd, CONTROL_SIZE,
+                strerror(errno));
+        ::munmap(base, size);
+        return NULL;
+    }
+    const blob_ring_header* header = static_cast<const blob_ring_header*>(base);
+    const blob_control_header* controlHeader =
+            static_cast<const blob_control_header*>(control);
+    if (header->magic != BLOB_RING_MAGIC || header->size != size
+            || header->token != token || controlHeader->magic != BLOB_CONTROL_MAGIC
+            || controlHeader->token != token) {
+        ALOGE("import: ring header does not match");
+        ::munmap(base, size);
+        ::munmap(control, CONTROL_SIZE);
+        return NULL;
+    }
+
+    ALOGV("import: mapped ring %#" PRIx64 " (%zu bytes)", token, size);
+    sp<BlobRing> ring = new BlobRing(-1, static_cast<uint8_t*>(base), size,
+            -1, static_cast<uint8_t*>(control), token, 0);
+    if (cache) {
+        Mutex::Autolock _l(gBlobRingsLock);
+        gBlobRings.replaceValueFor(token, ring);
+        evicted = retain_l(ring);
+    }
+    return ring;
+}
+
+ssize_t BlobRing::reserve(size_t len, uint32_t* outGeneration)
+{
+    if (mFd < 0) {
+        return INVALID_OPERATION;
+    }
+    const size_t need = align_slice(sizeof(slice_header) + len);
+    if (need < len || need > mSize - DATA_START) {
+        return NO_MEMORY;
+    }
+
+    Mutex::Autolock _l(mLock);
+    const nsecs_t now = systemTime();
+    reclaimLocked(now);
+    if (mFreeSlots.isEmpty()) {
+        return NO_MEMORY;
+    }
+    ssize_t offset = allocateLocked(need, now);
+    if (offset < 0) {
+        return offset;
+    }
+
+    mGeneration = mGeneration < MAX_GENERATION ? mGeneration + 1 : 1;
+    Slice record;
+    record.offset = offset;
+    record.length = need;
+    record.slot = mFreeSlots.top();
+    record.generation = mGeneration;
+    record.reserveTime = now;
+    mFreeSlots.pop();
+    mSlices.push(record);
+
+    slice_header* slice = reinterpret_cast<slice_header*>(mBase + offset);
+    slice->magic = SLICE_MAGIC;
+    slice->length = need;
+    slice->generation = mGeneration;
+    slice->slot = record.slot;
+    slice_state* state = &slice_states(mControl)[record.slot];
+    android_atomic_release_store(0, &state->owner);
+    android_atomic_release_store(make_state(mGeneration, SLICE_WAITING), &state->state);
+    *outGeneration = mGeneration;
+    return offset + sizeof(slice_header);
+}
+
+bool BlobRing::claim(size_t offset, size_t len, uint32_t generation)
+{
+    const slice_header* slice = find_slice(mBase, mSize, offset, len, generation);
+    if (slice == NULL) {
+        return false;
+    }
+    slice_state* state = &slice_states(mControl)[slice->slot];
+    android_atomic_release_store(getpid(), &state->owner);
+    if (android_atomic_acquire_cas(make_state(generation, SLICE_WAITING),
+            make_state(generation, SLICE_HELD), &state->state)) {
+        ALOGW("claim: slice at offset %zu, generation %u is gone", offset, generation);
+        return false;
+    }
+    return true;
+}
+
+void BlobRing::release(size_t offset, uint32_t generation)
+{
+    const slice_header* slice = find_slice(mBase, mSize, offset, 0, generation);
+    if (slice != NULL) {
+        slice_state* state = &slice_states(mControl)[slice->slot];
+        const int32_t released = make_state(generation, SLICE_RELEASED);
+        if (!android_atomic_release_cas(make_state(generation, SLICE_HELD), released,
+                    &state->state)
+                || !android_atomic_release_cas(make_state(generation, SLICE_WAITING),
+                    released, &state->state)) {
+            return;
+        }
+    }
+    ALOGE("release: no live slice at offset %zu, generation %u", offset, generation);
+}
+
+bool BlobRing::isLiveSlice(size_t offset, size_t len, uint32_t generation) const
+{
+    const slice_header* slice = find_slice(mBase, mSize, offset, len, generation);
+    if (slice == NULL) {
+        return false;
+    }
+    const int32_t state = android_atomic_acquire_load(
+            &slice_states(mControl)[slice->slot].state);
+    return state == make_state(generation, SLICE_WAITING)
+            || state == make_state(generation, SLICE_HELD);
+}
+
+ssize_t BlobRing::allocateLocked(size_t need, nsecs_t now)
+{
+    if (mUsed == 0) {
+        mHead = mTail = DATA_START;
+    }
+
+    size_t offset;
+    if (mUsed == 0 || mHead > mTail) {
+        // Free space is [mHead, mSize) followed by [DATA_START, mTail).
+        if (need <= mSize - mHead) {
+            offset = mHead;
+        } else if (need <= mTail - DATA_START) {
+            // Pad out the end of the ring and wrap around.
+            Slice pad;
+            pad.offset = mHead;
+            pad.length = mSize - mHead;
+            pad.slot = -1;
+            pad.generation = 0;
+            pad.reserveTime = now;
+            mSlices.push(pad);
+            mUsed += pad.length;
+            offset = DATA_START;
+        } else {
+            return NO_MEMORY;
+        }
+    } else if (mHead < mTail && need <= mTail - mHead) {
+        offset = mHead;
+    } else {
+        return NO_MEMORY;
+    }
+
+    mHead = offset + need;
+    if (mHead == mSize) {
+        mHead = DATA_START;
+    }
+    mUsed += need;
+    return offset;
+}
+
+void BlobRing::reclaimLocked(nsecs_t now)
+{
+    while (!mSlices.isEmpty() && isReclaimableLocked(mSlices[0], now)) {
+        const Slice& slice = mSlices[0];
+        if (slice.slot >= 0) {
+            mFreeSlots.push(slice.slot);
+        }
+        mTail = slice.offset + slice.length;
+        if (mTail == mSize) {
+            mTail = DATA_START;
+        }
+        mUsed -= slice.length;
+        mSlices.removeAt(0);
+    }
+}
+
+bool BlobRing::isReclaimableLocked(const Slice& slice, nsecs_t now)
+{
+    if (slice.slot < 0) {
+        return true;
+    }
+    slice_state* state = &slice_states(mControl)[slice.slot];
+    const int32_t waiting = make_state(slice.generation, SLICE_WAITING);
+    for (;;) {
+        const int32_t value = android_atomic_acquire_load(&state->state);
+        if (value == make_state(slice.generation, SLICE_RELEASED)) {
+            return true;
+        }
+        if (value == waiting) {
+            // Nobody read the blob: the transaction failed, or the receiver
+            // dropped it.  Take it back once it is old enough, unless the
+            // reader claims it first.
+            if (now - slice.reserveTime < mAbandonTimeout) {
+                return false;
+            }
+            if (!android_atomic_release_cas(waiting,
+                    make_state(slice.generation, SLICE_REVOKED), &state->state)) {
+                ALOGW("reclaim: slice at %zu was never read", slice.offset);
+                return true;
+            }
+            continue;
+        }
+        if (value == make_state(slice.generation, SLICE_HELD)) {
+            // Held until its reader releases it, unless the reader is gone.
+            const pid_t owner = android_atomic_acquire_load(&state->owner);
+            if (owner > 0 && ::kill(owner, 0) < 0 && errno == ESRCH) {
+                ALOGW("reclaim: reader %d of slice at %zu died", owner, slice.offset);
+                return true;
+            }
+            return false;
+        }
+        // Only the reader writes other values, and only its own blobs can
+        // suffer from it.
+        ALOGE("reclaim: slice at %zu has unexpected state %#x", slice.offset, value);
+        return true;
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
@@ -180,6 +180,36 @@ public:
         }
         return res;
     }
+
+    virtual Vector<sp<IBinder> > checkServices(const Vector<String16>& names) const
+    {
+        Vector<sp<IBinder> > res;
+        const size_t N = names.size();
+        res.setCapacity(N);
+
+        for (size_t start = 0; start < N; start += MAX_CHECK_SERVICES) {
+            const size_t count = (N - start < size_t(MAX_CHECK_SERVICES)) ?
+                    N - start : size_t(MAX_CHECK_SERVICES);
+            Parcel data, reply;
+            data.writeInterfaceToken(IServiceManager::getInterfaceDescriptor());
+            data.writeInt32(count);
+            for (size_t i = start; i < start + count; i++) {
+                data.writeString16(names[i]);
+            }
+            status_t err = remote()->transact(CHECK_SERVICES_TRANSACTION, data, &reply);
+            if (err != NO_ERROR || size_t(reply.readInt32()) != count) {
+                // Older service managers don't know about batched lookups.
+                for (size_t i = start; i < start + count; i++) {
+                    res.add(checkService(names[i]));
+                }
+                continue;
+            }
+            for (size_t i = 0; i < count; i++) {
+                res.add(reply.readStrongBinder());
+            }
+        }
+        return res;
+    }
 };
 
 IMPLEMENT_META_INTERFACE(ServiceManager, "android.os.IServiceManager");
@@ -223,6 +253,24 @@ status_t BnServiceManager::onTransact(
             }
             return NO_ERROR;
         } break;
+        case CHECK_SERVICES_TRANSACTION: {
+            CHECK_INTERFACE(IServiceManager, data, reply);
+            size_t N = data.readInt32();
+            if (N > MAX_CHECK_SERVICES) {
+                return BAD_VALUE;
+            }
+            Vector<String16> names;
+            names.setCapacity(N);
+            for (size_t i=0; i<N; i++) {
+                names.add(data.readString16());
+            }
+            Vector<sp<IBinder> > list = checkServices(names);
+            reply->writeInt32(N);
+            for (size_t i=0; i<N; i++) {
+                reply->writeStrongBinder(list[i]);
+            }
+            return NO_ERROR;
+        } break;
         default:
             return BBinder::onTransact(code, data, reply, flags);
     }
@@ -19,6 +19,7 @@
 
 #include <binder/Parcel.h>
 
+#include <binder/BlobRing.h>
 #include <binder/IPCThreadState.h>
 #include <binder/Binder.h>
 #include <binder/BpBinder.h>
@@ -33,6 +34,7 @@
 #include <utils/misc.h>
 #include <utils/Flattenable.h>
 #include <cutils/ashmem.h>
+#include <cutils/atomic.h>
 
 #include <private/binder/binder_module.h>
 #include <private/binder/Static.h>
@@ -65,6 +67,16 @@
 // Maximum size of a blob to transfer in-place.
 static const size_t IN_PLACE_BLOB_LIMIT = 40 * 1024;
 
+// Minimum size of a blob to transfer through the Parcel's BlobRing, if any.
+static const size_t RING_BLOB_MIN = 4 * 1024;
+
+// How a blob is transferred; written ahead of the blob.
+enum {
+    BLOB_INPLACE = 0,
+    BLOB_ASHMEM = 1,
+    BLOB_RING = 2,
+};
+
 // XXX This can be made public if we want to provide
 // support for typed data.
 struct small_flat_data
@@ -78,6 +90,138 @@ namespace android {
 static pthread_mutex_t gParcelGlobalAllocSizeLock = PTHREAD_MUTEX_INITIALIZER;
 static size_t gParcelGlobalAllocSize = 0;
 static size_t gParcelGlobalAllocCount = 0;
+static volatile int32_t gParcelGlobalPoolHitCount = 0;
+static volatile int32_t gParcelGlobalHeapAllocCount = 0;
+
+// ---------------------------------------------------------------------------
+// Per-thread pool of Parcel data and object buffers.
+//
+// Buffers are handed out in power-of-two size classes so that the
+// grow/shrink pattern of a typical transaction always lands on a buffer
+// that a previous Parcel on the same thread has already returned.  Once a
+// thread has warmed up, steady-state transactions (reply Parcels, Parcels
+// built on the stack by proxies, etc.) do not touch the heap at all.
+
+// Smallest and largest buffers kept in the pool, as log2 of the size.
+static const size_t POOL_MIN_CLASS_SHIFT = 7;     // 128 bytes
+static const size_t POOL_MAX_CLASS_SHIFT = 15;    // 32 KiB
+static const size_t POOL_NUM_CLASSES =
+        POOL_MAX_CLASS_SHIFT - POOL_MIN_CLASS_SHIFT + 1;
+// Number of free buffers cached per size class and per thread.
+static const size_t POOL_DEPTH = 4;
+
+struct parcel_buffer_pool
+{
+    void* buffers[POOL_NUM_CLASSES][POOL_DEPTH];
+    size_t count[POOL_NUM_CLASSES];
+};
+
+static pthread_once_t gParcelPoolKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t gParcelPoolKey;
+
+static void free_buffer_pool(void* st)
+{
+    parcel_buffer_pool* pool = static_cast<parcel_buffer_pool*>(st);
+    for (size_t c=0; c<POOL_NUM_CLASSES; c++) {
+        for (size_t i=0; i<pool->count[c]; i++) {
+            free(pool->buffers[c][i]);
+        }
+    }
+    free(pool);
+}
+
+static void make_buffer_pool_key()
+{
+    pthread_key_create(&gParcelPoolKey, free_buffer_pool);
+}
+
+static parcel_buffer_pool* buffer_pool()
+{
+    pthread_once(&gParcelPoolKeyOnce, make_buffer_pool_key);
+    parcel_buffer_pool* pool =
+            static_cast<parcel_buffer_pool*>(pthread_getspecific(gParcelPoolKey));
+    if (pool == NULL) {
+        pool = static_cast<parcel_buffer_pool*>(calloc(1, sizeof(parcel_buffer_pool)));
+        if (pool != NULL) {
+            pthread_setspecific(gParcelPoolKey, pool);
+        }
+    }
+    return pool;
+}
+
+// Returns the size class for a buffer of the given size, or -1 if
+// buffers of that size are not pooled.
+static ssize_t pool_class_for_size(size_t size)
+{
+    if (size > (size_t(1) << POOL_MAX_CLASS_SHIFT)) {
+        return -1;
+    }
+    size_t c = 0;
+    while ((size_t(1) << (c + POOL_MIN_CLASS_SHIFT)) < size) {
+        c++;
+    }
+    return c;
+}
+
+// Allocates a buffer of at least 'size' bytes.  The real size of the
+// buffer is returned in 'outCapacity' and must be handed back to
+// pool_free() along with the buffer.
+static void* pool_alloc(size_t size, size_t* outCapacity)
+{
+    const ssize_t c = pool_class_for_size(size);
+    if (c >= 0) {
+        const size_t capacity = size_t(1) << (c + POOL_MIN_CLASS_SHIFT);
+        parcel_buffer_pool* pool = buffer_pool();
+        if (pool != NULL && pool->count[c] > 0) {
+            android_atomic_inc(&gParcelGlobalPoolHitCount);
+            *outCapacity = capacity;
+            return pool->buffers[c][--pool->count[c]];
+        }
+        size = capacity;
+    }
+    void* buffer = malloc(size);
+    if (buffer != NULL) {
+        android_atomic_inc(&gParcelGlobalHeapAllocCount);
+        *outCapacity = size;
+    }
+    return buffer;
+}
+
+// Returns a buffer obtained from pool_alloc() to the calling thread's pool,
+// or to the heap if the pool for that size class is full.
+static void pool_free(void* buffer, size_t capacity)
+{
+    if (buffer == NULL) {
+        return;
+    }
+    const ssize_t c = pool_class_for_size(capacity);
+    if (c >= 0 && (size_t(1) << (c + POOL_MIN_CLASS_SHIFT)) == capacity) {
+        parcel_buffer_pool* pool = buffer_pool();
+        if (pool != NULL && pool->count[c] < POOL_DEPTH) {
+            pool->buffers[c][pool->count[c]++] = buffer;
+            return;
+        }
+    }
+    free(buffer);
+}
+
+// Grows a buffer obtained from pool_alloc() to at least 'size' bytes,
+// preserving the first 'used' bytes.  On failure the original buffer is
+// left untouched and NULL is returned.
+static void* pool_realloc(void* buffer, size_t capacity, size_t used,
+        size_t size, size_t* outCapacity)
+{
+    if (buffer != NULL && size <= capacity) {
+        *outCapacity = capacity;
+        return buffer;
+    }
+    void* data = pool_alloc(size, outCapacity);
+    if (data != NULL && buffer != NULL) {
+        memcpy(data, buffer, used < size ? used : size);
+        pool_free(buffer, capacity);
+    }
+    return data;
+}
 
 void acquire_object(const sp<ProcessState>& proc,
     const flat_binder_object& obj, const void* who)
@@ -322,6 +466,14 @@ size_t Parcel::getGlobalAllocCount() {
     return count;
 }
 
+size_t Parcel::getGlobalPoolHitCount() {
+    return uint32_t(android_atomic_acquire_load(&gParcelGlobalPoolHitCount));
+}
+
+size_t Parcel::getGlobalHeapAllocCount() {
+    return uint32_t(android_atomic_acquire_load(&gParcelGlobalHeapAllocCount));
+}
+
 const uint8_t* Parcel::data() const
 {
     return mData;
@@ -439,13 +591,15 @@ status_t Parcel::appendFrom(const Parcel *parcel, size_t offset, size_t len)
         // grow objects
         if (mObjectsCapacity < mObjectsSize + numObjects) {
             int newSize = ((mObjectsSize + numObjects)*3)/2;
-            binder_size_t *objects =
-                (binder_size_t*)realloc(mObjects, newSize*sizeof(binder_size_t));
+            size_t capacity;
+            binder_size_t *objects = (binder_size_t*)pool_realloc(mObjects,
+                    mObjectsCapacity*sizeof(binder_size_t), mObjectsSize*sizeof(binder_size_t),
+                    newSize*sizeof(binder_size_t), &capacity);
             if (objects == (binder_size_t*)0) {
                 return NO_MEMORY;
             }
             mObjects = objects;
-            mObjectsCapacity = newSize;
+            mObjectsCapacity = capacity/sizeof(binder_size_t);
         }
 
         // append and acquire objects
@@ -829,9 +983,31 @@ status_t Parcel::writeBlob(size_t len, WritableBlob* outBlob)
 {
     status_t status;
 
+    if (mAllowFds && mBlobRing != NULL && len >= RING_BLOB_MIN) {
+        uint32_t generation;
+        ssize_t offset = mBlobRing->reserve(len, &generation);
+        if (offset >= 0) {
+            ALOGV("writeBlob: write to ring at %zd", offset);
+            status = writeInt32(BLOB_RING);
+            if (!status) status = writeFileDescriptor(mBlobRing->getFd());
+            if (!status) status = writeFileDescriptor(mBlobRing->getControlFd());
+            if (!status) status = writeInt64(mBlobRing->getToken());
+            if (!status) status = writeInt32(offset);
+            if (!status) status = writeInt32(generation);
+            if (!status) status = writeInt32(mBlobRing->getSize());
+            if (!status) {
+                outBlob->init(false /*mapped*/, mBlobRing->base() + offset, len);
+                return NO_ERROR;
+            }
+            mBlobRing->release(offset, generation);
+            return status;
+        }
+        // The ring is full, fall back to one of the other transfer modes.
+    }
+
     if (!mAllowFds || len <= IN_PLACE_BLOB_LIMIT) {
         ALOGV("writeBlob: write in place");
-        status = writeInt32(0);
+        status = writeInt32(BLOB_INPLACE);
         if (status) return status;
 
         void* ptr = writeInplace(len);
@@ -857,7 +1033,7 @@ status_t Parcel::writeBlob(size_t len, WritableBlob* outBlob)
             if (result < 0) {
                 status = result;
             } else {
-                status = writeInt32(1);
+                status = writeInt32(BLOB_ASHMEM);
                 if (!status) {
                     status = writeFileDescriptor(fd, true /*takeOwnership*/);
                     if (!status) {
@@ -909,6 +1085,16 @@ status_t Parcel::write(const FlattenableHelperInterface& val)
     return err;
 }
 
+void Parcel::setBlobRing(const sp<BlobRing>& ring)
+{
+    mBlobRing = ring;
+}
+
+sp<BlobRing> Parcel::getBlobRing() const
+{
+    return mBlobRing;
+}
+
 status_t Parcel::writeObject(const flat_binder_object& val, bool nullMetaData)
 {
     const bool enoughData = (mDataPos+sizeof(val)) <= mDataCapacity;
@@ -941,10 +1127,13 @@ restart_write:
     }
     if (!enoughObjects) {
         size_t newSize = ((mObjectsSize+2)*3)/2;
-        binder_size_t* objects = (binder_size_t*)realloc(mObjects, newSize*sizeof(binder_size_t));
+        size_t capacity;
+        binder_size_t* objects = (binder_size_t*)pool_realloc(mObjects,
+                mObjectsCapacity*sizeof(binder_size_t), mObjectsSize*sizeof(binder_size_t),
+                newSize*sizeof(binder_size_t), &capacity);
         if (objects == NULL) return NO_MEMORY;
         mObjects = objects;
-        mObjectsCapacity = newSize;
+        mObjectsCapacity = capacity/sizeof(binder_size_t);
     }
 
     goto restart_write;
@@ -1261,11 +1450,35 @@ int Parcel::readParcelFileDescriptor(int& outCommChannel) const {
 
 status_t Parcel::readBlob(size_t len, ReadableBlob* outBlob) const
 {
-    int32_t useAshmem;
-    status_t status = readInt32(&useAshmem);
+    int32_t blobType;
+    status_t status = readInt32(&blobType);
     if (status) return status;
 
-    if (!useAshmem) {
+    if (blobType == BLOB_RING) {
+        ALOGV("readBlob: read from ring");
+        int fd = readFileDescriptor();
+        if (fd == int(BAD_TYPE)) return BAD_VALUE;
+        int controlFd = readFileDescriptor();
+        if (controlFd == int(BAD_TYPE)) return BAD_VALUE;
+        int64_t token;
+        int32_t offset, generation, size;
+        status = readInt64(&token);
+        if (!status) status = readInt32(&offset);
+        if (!status) status = readInt32(&generation);
+        if (!status) status = readInt32(&size);
+        if (status) return status;
+
+        sp<BlobRing> ring = BlobRing::import(fd, controlFd, token, uint32_t(size));
+        if (ring == NULL
+                || !ring->claim(uint32_t(offset), len, uint32_t(generation))) {
+            return BAD_VALUE;
+        }
+
+        outBlob->init(ring, uint32_t(offset), uint32_t(generation), len);
+        return NO_ERROR;
+    }
+
+    if (blobType == BLOB_INPLACE) {
         ALOGV("readBlob: read in place");
         const void* ptr = readInplace(len);
         if (!ptr) return BAD_VALUE;
@@ -1523,9 +1736,9 @@ void Parcel::freeDataNoInit()
             gParcelGlobalAllocSize -= mDataCapacity;
             gParcelGlobalAllocCount--;
             pthread_mutex_unlock(&gParcelGlobalAllocSizeLock);
-            free(mData);
+            pool_free(mData, mDataCapacity);
         }
-        if (mObjects) free(mObjects);
+        pool_free(mObjects, mObjectsCapacity*sizeof(binder_size_t));
     }
 }
 
@@ -1544,29 +1757,33 @@ status_t Parcel::restartWrite(size_t desired)
         return continueWrite(desired);
     }
 
-    uint8_t* data = (uint8_t*)realloc(mData, desired);
-    if (!data && desired > mDataCapacity) {
+    // The existing contents are discarded, so there is nothing to copy
+    // when a bigger buffer is needed; a smaller request keeps the buffer.
+    size_t capacity;
+    uint8_t* data = (uint8_t*)pool_realloc(mData, mDataCapacity, 0, desired, &capacity);
+    if (!data) {
         mError = NO_MEMORY;
         return NO_MEMORY;
     }
 
     releaseObjects();
 
-    if (data) {
-        LOG_ALLOC("Parcel %p: restart from %zu to %zu capacity", this, mDataCapacity, desired);
+    if (data != mData) {
+        LOG_ALLOC("Parcel %p: restart from %zu to %zu capacity", this, mDataCapacity, capacity);
         pthread_mutex_lock(&gParcelGlobalAllocSizeLock);
-        gParcelGlobalAllocSize += desired;
+        gParcelGlobalAllocSize += capacity;
         gParcelGlobalAllocSize -= mDataCapacity;
+        if (!mData) gParcelGlobalAllocCount++;
         pthread_mutex_unlock(&gParcelGlobalAllocSizeLock);
         mData = data;
-        mDataCapacity = desired;
+        mDataCapacity = capacity;
     }
 
     mDataSize = mDataPos = 0;
     ALOGV("restartWrite Setting data size of %p to %zu", this, mDataSize);
     ALOGV("restartWrite Setting data pos of %p to %zu", this, mDataPos);
 
-    free(mObjects);
+    pool_free(mObjects, mObjectsCapacity*sizeof(binder_size_t));
     mObjects = NULL;
     mObjectsSize = mObjectsCapacity = 0;
     mNextObjectHint = 0;
@@ -1603,17 +1820,20 @@ status_t Parcel::continueWrite(size_t desired)
 
         // If there is a different owner, we need to take
         // posession.
-        uint8_t* data = (uint8_t*)malloc(desired);
+        size_t capacity;
+        uint8_t* data = (uint8_t*)pool_alloc(desired, &capacity);
         if (!data) {
             mError = NO_MEMORY;
             return NO_MEMORY;
         }
         binder_size_t* objects = NULL;
+        size_t objectsCapacity = 0;
 
         if (objectsSize) {
-            objects = (binder_size_t*)malloc(objectsSize*sizeof(binder_size_t));
+            objects = (binder_size_t*)pool_alloc(objectsSize*sizeof(binder_size_t),
+                    &objectsCapacity);
             if (!objects) {
-                free(data);
+                pool_free(data, capacity);
 
                 mError = NO_MEMORY;
                 return NO_MEMORY;
@@ -1637,9 +1857,9 @@ status_t Parcel::continueWrite(size_t desired)
         mOwner(this, mData, mDataSize, mObjects, mObjectsSize, mOwnerCookie);
         mOwner = NULL;
 
-        LOG_ALLOC("Parcel %p: taking ownership of %zu capacity", this, desired);
+        LOG_ALLOC("Parcel %p: taking ownership of %zu capacity", this, capacity);
         pthread_mutex_lock(&gParcelGlobalAllocSizeLock);
-        gParcelGlobalAllocSize += desired;
+        gParcelGlobalAllocSize += capacity;
         gParcelGlobalAllocCount++;
         pthread_mutex_unlock(&gParcelGlobalAllocSizeLock);
 
@@ -1647,8 +1867,9 @@ status_t Parcel::continueWrite(size_t desired)
         mObjects = objects;
         mDataSize = (mDataSize < desired) ? mDataSize : desired;
         ALOGV("continueWrite Setting data size of %p to %zu", this, mDataSize);
-        mDataCapacity = desired;
-        mObjectsSize = mObjectsCapacity = objectsSize;
+        mDataCapacity = capacity;
+        mObjectsSize = objectsSize;
+        mObjectsCapacity = objectsCapacity/sizeof(binder_size_t);
         mNextObjectHint = 0;
 
     } else if (mData) {
@@ -1664,27 +1885,26 @@ status_t Parcel::continueWrite(size_t desired)
                 }
                 release_object(proc, *flat, this);
             }
-            binder_size_t* objects =
-                (binder_size_t*)realloc(mObjects, objectsSize*sizeof(binder_size_t));
-            if (objects) {
-                mObjects = objects;
-            }
+            // The objects buffer is kept at its current capacity; it goes
+            // back to the pool when the Parcel is freed.
             mObjectsSize = objectsSize;
             mNextObjectHint = 0;
         }
 
-        // We own the data, so we can just do a realloc().
+        // We own the data, so we can just move it to a bigger buffer.
         if (desired > mDataCapacity) {
-            uint8_t* data = (uint8_t*)realloc(mData, desired);
+            size_t capacity;
+            uint8_t* data = (uint8_t*)pool_realloc(mData, mDataCapacity, mDataCapacity,
+                    desired, &capacity);
             if (data) {
                 LOG_ALLOC("Parcel %p: continue from %zu to %zu capacity", this, mDataCapacity,
-                        desired);
+                        capacity);
                 pthread_mutex_lock(&gParcelGlobalAllocSizeLock);
-                gParcelGlobalAllocSize += desired;
+                gParcelGlobalAllocSize += capacity;
                 gParcelGlobalAllocSize -= mDataCapacity;
                 pthread_mutex_unlock(&gParcelGlobalAllocSizeLock);
                 mData = data;
-                mDataCapacity = desired;
+                mDataCapacity = capacity;
             } else if (desired > mDataCapacity) {
                 mError = NO_MEMORY;
                 return NO_MEMORY;
@@ -1702,7 +1922,8 @@ status_t Parcel::continueWrite(size_t desired)
 
     } else {
         // This is the first data.  Easy!
-        uint8_t* data = (uint8_t*)malloc(desired);
+        size_t capacity;
+        uint8_t* data = (uint8_t*)pool_alloc(desired, &capacity);
         if (!data) {
             mError = NO_MEMORY;
             return NO_MEMORY;
@@ -1713,9 +1934,9 @@ status_t Parcel::continueWrite(size_t desired)
             ALOGE("continueWrite: %zu/%p/%zu/%zu", mDataCapacity, mObjects, mObjectsCapacity, desired);
         }
 
-        LOG_ALLOC("Parcel %p: allocating with %zu capacity", this, desired);
+        LOG_ALLOC("Parcel %p: allocating with %zu capacity", this, capacity);
         pthread_mutex_lock(&gParcelGlobalAllocSizeLock);
-        gParcelGlobalAllocSize += desired;
+        gParcelGlobalAllocSize += capacity;
         gParcelGlobalAllocCount++;
         pthread_mutex_unlock(&gParcelGlobalAllocSizeLock);
 
@@ -1723,7 +1944,7 @@ status_t Parcel::continueWrite(size_t desired)
         mDataSize = mDataPos = 0;
         ALOGV("continueWrite Setting data size of %p to %zu", this, mDataSize);
         ALOGV("continueWrite Setting data pos of %p to %zu", this, mDataPos);
-        mDataCapacity = desired;
+        mDataCapacity = capacity;
     }
 
     return NO_ERROR;
@@ -1767,7 +1988,7 @@ void Parcel::scanForFds() const
 // --- Parcel::Blob ---
 
 Parcel::Blob::Blob() :
-        mMapped(false), mData(NULL), mSize(0) {
+        mMapped(false), mData(NULL), mSize(0), mRingOffset(0), mRingGeneration(0) {
 }
 
 Parcel::Blob::~Blob() {
@@ -1778,6 +1999,9 @@ void Parcel::Blob::release() {
     if (mMapped && mData) {
         ::munmap(mData, mSize);
     }
+    if (mRing != NULL) {
+        mRing->release(mRingOffset, mRingGeneration);
+    }
     clear();
 }
 
@@ -1787,10 +2011,23 @@ void Parcel::Blob::init(bool mapped, void* data, size_t size) {
     mSize = size;
 }
 
+void Parcel::Blob::init(const sp<BlobRing>& ring, size_t offset, uint32_t generation,
+        size_t size) {
+    mMapped = false;
+    mData = ring->base() + offset;
+    mSize = size;
+    mRing = ring;
+    mRingOffset = offset;
+    mRingGeneration = generation;
+}
+
 void Parcel::Blob::clear() {
     mMapped = false;
     mData = NULL;
     mSize = 0;
+    mRing.clear();
+    mRingOffset = 0;
+    mRingGeneration = 0;
 }
 
 }; // namespace android
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures the cost of writing and reading back a blob through a Parcel for
+ * each of the blob transfer modes (in place, one ashmem region per blob and
+ * BlobRing), across a range of payload sizes.
+ *
+ * usage: binderBlobBenchmark [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <binder/BlobRing.h>
+#include <binder/Parcel.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+enum Mode {
+    MODE_INPLACE,
+    MODE_ASHMEM,
+    MODE_RING,
+};
+
+static const size_t kSizes[] = {
+    4 * 1024, 16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024,
+};
+
+// Must be kept in sync with IN_PLACE_BLOB_LIMIT in Parcel.cpp
+static const size_t kInPlaceBlobLimit = 40 * 1024;
+
+static const size_t kRingSize = 4 * 1024 * 1024;
+
+// Returns the average time in microseconds of one write/read round trip,
+// or a negative value on error.
+static double runOne(Mode mode, const sp<BlobRing>& ring, size_t len, int iterations)
+{
+    uint32_t checksum = 0;
+    nsecs_t start = systemTime();
+    for (int i = 0; i < iterations; i++) {
+        Parcel parcel;
+        if (mode == MODE_INPLACE) {
+            parcel.pushAllowFds(false);
+        } else if (mode == MODE_RING) {
+            parcel.setBlobRing(ring);
+        }
+
+        Parcel::WritableBlob out;
+        if (parcel.writeBlob(len, &out) != NO_ERROR) {
+            return -1;
+        }
+        memset(out.data(), i, len);
+        out.release();
+
+        parcel.setDataPosition(0);
+        Parcel::ReadableBlob in;
+        if (parcel.readBlob(len, &in) != NO_ERROR) {
+            return -1;
+        }
+        const uint8_t* data = static_cast<const uint8_t*>(in.data());
+        for (size_t j = 0; j < len; j += 64) {
+            checksum += data[j];
+        }
+        in.release();
+    }
+    nsecs_t elapsed = systemTime() - start;
+    if (checksum == 0xffffffff) {
+        // keep the compiler from discarding the reads
+        printf(" ");
+    }
+    return double(elapsed) / iterations / 1000.0;
+}
+
+int main(int argc, char** argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000;
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    sp<BlobRing> ring = BlobRing::create(kRingSize);
+    if (ring == NULL) {
+        fprintf(stderr, "could not create a %zu byte BlobRing\n", kRingSize);
+        return 1;
+    }
+
+    printf("%10s %12s %12s %12s   (us per write+read)\n",
+            "size", "inplace", "ashmem", "ring");
+    for (size_t i = 0; i < sizeof(kSizes) / sizeof(kSizes[0]); i++) {
+        const size_t len = kSizes[i];
+        printf("%10zu", len);
+        for (int mode = MODE_INPLACE; mode <= MODE_RING; mode++) {
+            if (mode == MODE_ASHMEM && len <= kInPlaceBlobLimit) {
+                // Parcel always writes blobs this small in place.
+                printf(" %12s", "-");
+                continue;
+            }
+            double us = runOne(Mode(mode), ring, len, iterations);
+            if (us < 0) {
+                printf(" %12s", "error");
+            } else {
+                printf(" %12.2f", us);
+            }
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "binderBlobRingTest"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <gtest/gtest.h>
+
+#include <binder/Binder.h>
+#include <binder/BlobRing.h>
+#include <binder/IServiceManager.h>
+#include <binder/Parcel.h>
+
+#include <utils/Timers.h>
+
+namespace android {
+
+static const size_t kRingSize = 64 * 1024;
+
+// Three blobs of this size fit in a kRingSize ring, a fourth does not.
+static const size_t kBlobSize = 16 * 1024;
+
+class BlobRingTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        mRing = BlobRing::create(kRingSize);
+        ASSERT_TRUE(mRing != NULL);
+        ASSERT_EQ(kRingSize, mRing->getSize());
+    }
+
+    bool inRing(const void* data) const {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        return p >= mRing->base() && p < mRing->base() + mRing->getSize();
+    }
+
+    // Writes a blob of len bytes filled with value to parcel through the
+    // ring, and returns where it was written.
+    const void* writeBlob(Parcel* parcel, size_t len, uint8_t value) {
+        parcel->setBlobRing(mRing);
+        Parcel::WritableBlob out;
+        EXPECT_EQ(NO_ERROR, parcel->writeBlob(len, &out));
+        memset(out.data(), value, len);
+        const void* data = out.data();
+        out.release();
+        return data;
+    }
+
+    // Reads the blob written by writeBlob() back and checks its contents.
+    void readBlob(const Parcel& parcel, size_t len, uint8_t value,
+            Parcel::ReadableBlob* in) {
+        parcel.setDataPosition(0);
+        ASSERT_EQ(NO_ERROR, parcel.readBlob(len, in));
+        const uint8_t* data = static_cast<const uint8_t*>(in->data());
+        for (size_t i = 0; i < len; i++) {
+            ASSERT_EQ(value, data[i]) << "at byte " << i;
+        }
+    }
+
+    sp<BlobRing> mRing;
+};
+
+TEST_F(BlobRingTest, RoundTripIsReadInPlace) {
+    Parcel parcel;
+    const void* written = writeBlob(&parcel, kBlobSize, 0x5a);
+    EXPECT_TRUE(inRing(written));
+
+    Parcel::ReadableBlob in;
+    readBlob(parcel, kBlobSize, 0x5a, &in);
+    EXPECT_EQ(written, in.data());
+}
+
+TEST_F(BlobRingTest, WrapsAroundWhileBlobsAreHeld) {
+    // Keep the previous blob held while the next one is written, so the
+    // ring is never empty, and cycle through several times its capacity.
+    Parcel parcels[2];
+    Parcel::ReadableBlob held[2];
+    const void* first = NULL;
+    bool wrapped = false;
+    for (int i = 0; i < 16; i++) {
+        Parcel& parcel = parcels[i % 2];
+        parcel.freeData();
+        const void* written = writeBlob(&parcel, kBlobSize, uint8_t(i));
+        ASSERT_TRUE(inRing(written)) << "blob " << i;
+        if (first == NULL) {
+            first = written;
+        } else if (written == first) {
+            wrapped = true;
+        }
+
+        readBlob(parcel, kBlobSize, uint8_t(i), &held[i % 2]);
+        if (i > 0) {
+            // The new blob must not have overwritten the held one.
+            const uint8_t* data = static_cast<const uint8_t*>(held[(i + 1) % 2].data());
+            EXPECT_EQ(uint8_t(i - 1), data[0]);
+            EXPECT_EQ(uint8_t(i - 1), data[kBlobSize - 1]);
+            held[(i + 1) % 2].release();
+        }
+    }
+    EXPECT_TRUE(wrapped);
+}
+
+TEST_F(BlobRingTest, FullRingFallsBackWithoutReclaimingHeldSlices) {
+    Parcel parcels[4];
+    Parcel::ReadableBlob held[3];
+    for (int i = 0; i < 3; i++) {
+        EXPECT_TRUE(inRing(writeBlob(&parcels[i], kBlobSize, uint8_t(i + 1))));
+        readBlob(parcels[i], kBlobSize, uint8_t(i + 1), &held[i]);
+    }
+
+    // The ring is full of blobs that are still being read: the next blob
+    // goes elsewhere and the held ones stay intact.
+    EXPECT_FALSE(inRing(writeBlob(&parcels[3], kBlobSize, 0xff)));
+    Parcel::ReadableBlob in;
+    readBlob(parcels[3], kBlobSize, 0xff, &in);
+    in.release();
+    for (int i = 0; i < 3; i++) {
+        const uint8_t* data = static_cast<const uint8_t*>(held[i].data());
+        EXPECT_EQ(uint8_t(i + 1), data[0]);
+        EXPECT_EQ(uint8_t(i + 1), data[kBlobSize - 1]);
+    }
+
+    // Releasing the oldest blob makes room again.
+    held[0].release();
+    Parcel parcel;
+    EXPECT_TRUE(inRing(writeBlob(&parcel, kBlobSize, 0x11)));
+}
+
+TEST_F(BlobRingTest, UnreadBlobsAreReclaimedAfterTimeout) {
+    mRing = BlobRing::create(kRingSize, ms2ns(50));
+    ASSERT_TRUE(mRing != NULL);
+
+    // Nobody ever reads these, as when the transaction fails.
+    Parcel parcels[3];
+    for (int i = 0; i < 3; i++) {
+        EXPECT_TRUE(inRing(writeBlob(&parcels[i], kBlobSize, uint8_t(i + 1))));
+    }
+    Parcel parcel;
+    EXPECT_FALSE(inRing(writeBlob(&parcel, kBlobSize, 0xff)));
+
+    usleep(100 * 1000);
+    parcel.freeData();
+    EXPECT_TRUE(inRing(writeBlob(&parcel, kBlobSize, 0x11)));
+
+    // A reader that turns up too late does not get the reused slice.
+    Parcel::ReadableBlob in;
+    parcels[0].setDataPosition(0);
+    EXPECT_EQ(BAD_VALUE, parcels[0].readBlob(kBlobSize, &in));
+    readBlob(parcel, kBlobSize, 0x11, &in);
+}
+
+TEST_F(BlobRingTest, BlobsHeldByDeadReaderAreReclaimed) {
+    Parcel parcels[3];
+    for (int i = 0; i < 3; i++) {
+        EXPECT_TRUE(inRing(writeBlob(&parcels[i], kBlobSize, uint8_t(i + 1))));
+    }
+
+    // The reader of the oldest blob dies without releasing it.
+    pid_t pid = fork();
+    ASSERT_LE(0, pid);
+    if (pid == 0) {
+        Parcel::ReadableBlob in;
+        parcels[0].setDataPosition(0);
+        _exit(parcels[0].readBlob(kBlobSize, &in) == NO_ERROR ? 0 : 1);
+    }
+    int status;
+    ASSERT_EQ(pid, TEMP_FAILURE_RETRY(waitpid(pid, &status, 0)));
+    ASSERT_TRUE(WIFEXITED(status));
+    ASSERT_EQ(0, WEXITSTATUS(status));
+
+    // The blob is claimed: nobody else can read it.
+    Parcel::ReadableBlob in;
+    parcels[0].setDataPosition(0);
+    EXPECT_EQ(BAD_VALUE, parcels[0].readBlob(kBlobSize, &in));
+
+    for (int i = 1; i < 3; i++) {
+        readBlob(parcels[i], kBlobSize, uint8_t(i + 1), &in);
+        in.release();
+    }
+    Parcel parcel;
+    EXPECT_TRUE(inRing(writeBlob(&parcel, kBlobSize, 0x11)));
+}
+
+TEST_F(BlobRingTest, RingCannotBeMappedWritable) {
+    void* base = mmap(NULL, kRingSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+            mRing->getFd(), 0);
+    EXPECT_EQ(MAP_FAILED, base);
+    if (base != MAP_FAILED) {
+        munmap(base, kRingSize);
+    }
+    base = mmap(NULL, kRingSize, PROT_READ, MAP_SHARED, mRing->getFd(), 0);
+    ASSERT_NE(MAP_FAILED, base);
+    munmap(base, kRingSize);
+}
+
+TEST_F(BlobRingTest, ReleaseOfStaleGenerationIsIgnored) {
+    uint32_t generation;
+    ssize_t offset = mRing->reserve(kBlobSize, &generation);
+    ASSERT_LE(0, offset);
+    EXPECT_TRUE(mRing->isLiveSlice(offset, kBlobSize, generation));
+    EXPECT_FALSE(mRing->isLiveSlice(offset, kBlobSize, generation + 1));
+    EXPECT_FALSE(mRing->isLiveSlice(offset, kRingSize, generation));
+
+    mRing->release(offset, generation + 1);
+    EXPECT_TRUE(mRing->isLiveSlice(offset, kBlobSize, generation));
+    mRing->release(offset, generation);
+    EXPECT_FALSE(mRing->isLiveSlice(offset, kBlobSize, generation));
+}
+
+TEST(BlobRingConnectionTest, OneRingPerRemoteBinder) {
+    sp<IBinder> local = new BBinder();
+    EXPECT_TRUE(BlobRing::forBinder(local) == NULL);
+
+    sp<IBinder> remote = defaultServiceManager()->asBinder();
+    ASSERT_TRUE(remote->remoteBinder() != NULL);
+    sp<BlobRing> ring = BlobRing::forBinder(remote);
+    ASSERT_TRUE(ring != NULL);
+    EXPECT_EQ(ring, BlobRing::forBinder(remote));
+}
+
+} // namespace android
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "binderServiceManagerTest"
+
+#include <gtest/gtest.h>
+
+#include <binder/IServiceManager.h>
+#include <binder/ProcessState.h>
+#include <utils/String8.h>
+
+namespace android {
+
+static const char* kMissingService = "binderServiceManagerTest.missing";
+
+class ServiceManagerTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        ProcessState::self()->startThreadPool();
+        mServiceManager = defaultServiceManager();
+        ASSERT_TRUE(mServiceManager != NULL);
+    }
+
+    sp<IServiceManager> mServiceManager;
+};
+
+TEST_F(ServiceManagerTest, CheckServicesReturnsNullForMissingName) {
+    Vector<String16> names;
+    names.add(String16(kMissingService));
+
+    Vector<sp<IBinder> > services = mServiceManager->checkServices(names);
+    ASSERT_EQ(1U, services.size());
+    EXPECT_TRUE(services[0] == NULL);
+    EXPECT_NE(mServiceManager->asBinder(), services[0]);
+}
+
+TEST_F(ServiceManagerTest, CheckServicesMatchesCheckService) {
+    // Interleave registered names with missing ones so that a null reply
+    // can't shift or corrupt the references that follow it, and go past
+    // one transaction's worth of names.
+    Vector<String16> registered = mServiceManager->listServices();
+    ASSERT_LT(0U, registered.size());
+
+    Vector<String16> names;
+    for (size_t i = 0; names.size() <= IServiceManager::MAX_CHECK_SERVICES; i++) {
+        names.add(String16(kMissingService));
+        names.add(registered[i % registered.size()]);
+    }
+
+    Vector<sp<IBinder> > services = mServiceManager->checkServices(names);
+    ASSERT_EQ(names.size(), services.size());
+    for (size_t i = 0; i < names.size(); i++) {
+        EXPECT_EQ(mServiceManager->checkService(names[i]), services[i])
+                << "name " << i << ": " << String8(names[i]).string();
+    }
+}
+
+} // namespace android
@@ -5,18 +5,22 @@ LOCAL_SRC_FILES:= \
 	IGraphicBufferConsumer.cpp \
 	IConsumerListener.cpp \
 	BitTube.cpp \
+	BufferIdCache.cpp \
 	BufferItem.cpp \
 	BufferItemConsumer.cpp \
 	BufferQueue.cpp \
 	BufferQueueConsumer.cpp \
 	BufferQueueCore.cpp \
 	BufferQueueProducer.cpp \
+	BufferQueueStatistics.cpp \
 	BufferSlot.cpp \
 	ConsumerBase.cpp \
 	CpuConsumer.cpp \
 	DisplayEventReceiver.cpp \
+	FrameTimeline.cpp \
 	GLConsumer.cpp \
 	GraphicBufferAlloc.cpp \
+	GraphicBufferPool.cpp \
 	GuiConfig.cpp \
 	IDisplayEventConnection.cpp \
 	IGraphicBufferAlloc.cpp \
@@ -29,12 +33,14 @@ LOCAL_SRC_FILES:= \
 	LayerState.cpp \
 	Sensor.cpp \
 	SensorEventQueue.cpp \
+	SensorEventRing.cpp \
 	SensorManager.cpp \
 	StreamSplitter.cpp \
 	Surface.cpp \
 	SurfaceControl.cpp \
 	SurfaceComposerClient.cpp \
 	SyncFeatures.cpp \
+	VsyncTiming.cpp \
 
 LOCAL_SHARED_LIBRARIES := \
 	libbinder \
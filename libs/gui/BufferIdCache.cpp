@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BufferIdCache"
+//#define LOG_NDEBUG 0
+
+#include <binder/Parcel.h>
+
+#include <private/gui/BufferIdCache.h>
+
+#include <ui/GraphicBuffer.h>
+
+#include <utils/Log.h>
+
+namespace android {
+// ----------------------------------------------------------------------------
+
+// how a buffer is sent by writeBuffer
+enum {
+    BUFFER_NONE     = 0,
+    BUFFER_FULL     = 1,
+    BUFFER_CACHED   = 2,
+};
+
+BufferIdCache::BufferIdCache() {
+}
+
+BufferIdCache::~BufferIdCache() {
+}
+
+void BufferIdCache::writeIds(Parcel* data, Snapshot* outSnapshot) {
+    Mutex::Autolock lock(mMutex);
+    trimLocked(systemTime());
+    outSnapshot->clear();
+    data->writeInt32(mEntries.size());
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        data->writeInt64(static_cast<int64_t>(mEntries[i].buffer->getId()));
+        outSnapshot->push(mEntries[i].buffer);
+    }
+}
+
+status_t BufferIdCache::readBuffer(const Parcel& reply,
+        const Snapshot& snapshot, int slot, sp<GraphicBuffer>* outBuffer) {
+    outBuffer->clear();
+    switch (reply.readInt32()) {
+        case BUFFER_NONE:
+            return NO_ERROR;
+        case BUFFER_FULL: {
+            sp<GraphicBuffer> buffer = new GraphicBuffer();
+            status_t err = reply.read(*buffer);
+            if (err != NO_ERROR) {
+                return err;
+            }
+            Mutex::Autolock lock(mMutex);
+            addLocked(buffer, slot, systemTime());
+            *outBuffer = buffer;
+            return NO_ERROR;
+        }
+        case BUFFER_CACHED: {
+            const uint64_t id = static_cast<uint64_t>(reply.readInt64());
+            for (size_t i = 0; i < snapshot.size(); i++) {
+                if (snapshot[i]->getId() == id) {
+                    Mutex::Autolock lock(mMutex);
+                    addLocked(snapshot[i], slot, systemTime());
+                    *outBuffer = snapshot[i];
+                    return NO_ERROR;
+                }
+            }
+            ALOGE("readBuffer: buffer %#llx was not offered",
+                    static_cast<unsigned long long>(id));
+            return BAD_VALUE;
+        }
+    }
+    return BAD_TYPE;
+}
+
+status_t BufferIdCache::readIds(const Parcel& data, Vector<uint64_t>* outIds) {
+    outIds->clear();
+    const int32_t count = data.readInt32();
+    if (count < 0 || count > MAX_BUFFERS) {
+        ALOGE("readIds: bad buffer count %d", count);
+        return BAD_VALUE;
+    }
+    outIds->setCapacity(count);
+    for (int32_t i = 0; i < count; i++) {
+        outIds->push(static_cast<uint64_t>(data.readInt64()));
+    }
+    return NO_ERROR;
+}
+
+status_t BufferIdCache::writeBuffer(Parcel* reply,
+        const sp<GraphicBuffer>& buffer, const Vector<uint64_t>& ids) {
+    if (buffer == NULL) {
+        return reply->writeInt32(BUFFER_NONE);
+    }
+    const uint64_t id = buffer->getId();
+    for (size_t i = 0; i < ids.size(); i++) {
+        if (ids[i] == id) {
+            reply->writeInt32(BUFFER_CACHED);
+            return reply->writeInt64(static_cast<int64_t>(id));
+        }
+    }
+    reply->writeInt32(BUFFER_FULL);
+    return reply->write(*buffer);
+}
+
+void BufferIdCache::freeSlot(int slot) {
+    Mutex::Autolock lock(mMutex);
+    const nsecs_t now = systemTime();
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        if (mEntries[i].slot == slot) {
+            freeLocked(i, now);
+            break;
+        }
+    }
+    trimLocked(now);
+}
+
+void BufferIdCache::clear() {
+    Mutex::Autolock lock(mMutex);
+    mEntries.clear();
+}
+
+void BufferIdCache::addLocked(const sp<GraphicBuffer>& buffer, int slot,
+        nsecs_t now) {
+    const uint64_t id = buffer->getId();
+    for (size_t i = 0; i < mEntries.size(); ) {
+        if (mEntries[i].buffer->getId() == id) {
+            mEntries.removeAt(i);
+            continue;
+        }
+        // The buffer queue has freed whatever the slot held before.
+        if (slot >= 0 && mEntries[i].slot == slot) {
+            freeLocked(i, now);
+        }
+        i++;
+    }
+    if (mEntries.size() >= MAX_BUFFERS) {
+        // Make room, preferably by dropping a freed buffer.
+        size_t victim = 0;
+        for (size_t i = 0; i < mEntries.size(); i++) {
+            if (mEntries[i].slot < 0) {
+                victim = i;
+                break;
+            }
+        }
+        mEntries.removeAt(victim);
+    }
+    Entry entry;
+    entry.buffer = buffer;
+    entry.slot = slot;
+    entry.freeTime = now;
+    mEntries.push(entry);
+    trimLocked(now);
+}
+
+void BufferIdCache::freeLocked(size_t index, nsecs_t now) {
+    Entry& entry(mEntries.editItemAt(index));
+    entry.slot = -1;
+    entry.freeTime = now;
+}
+
+void BufferIdCache::trimLocked(nsecs_t now) {
+    size_t freed = 0;
+    for (size_t i = mEntries.size(); i > 0; i--) {
+        const Entry& entry(mEntries[i - 1]);
+        if (entry.slot < 0 && (++freed > MAX_FREED_BUFFERS ||
+                now - entry.freeTime > MAX_FREED_AGE)) {
+            mEntries.removeAt(i - 1);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
@@ -44,12 +44,8 @@ status_t BufferQueueConsumer::acquireBuffer(BufferItem* outBuffer,
     // buffers acquired. We allow the max buffer count to be exceeded by one
     // buffer so that the consumer can successfully set up the newly acquired
     // buffer before releasing the old one.
-    int numAcquiredBuffers = 0;
-    for (int s = 0; s < BufferQueueDefs::NUM_BUFFER_SLOTS; ++s) {
-        if (mSlots[s].mBufferState == BufferSlot::ACQUIRED) {
-            ++numAcquiredBuffers;
-        }
-    }
+    const int numAcquiredBuffers = static_cast<int>(
+            mCore->mStateSlots[BufferSlot::ACQUIRED].count());
     if (numAcquiredBuffers >= mCore->mMaxAcquiredBufferCount + 1) {
         BQ_LOGE("acquireBuffer: max acquired buffer count reached: %d (max %d)",
                 numAcquiredBuffers, mCore->mMaxAcquiredBufferCount);
@@ -119,9 +115,10 @@ status_t BufferQueueConsumer::acquireBuffer(BufferItem* outBuffer,
                     desiredPresent, expectedPresent, mCore->mQueue.size());
             if (mCore->stillTracking(front)) {
                 // Front buffer is still in mSlots, so mark the slot as free
-                mSlots[front->mSlot].mBufferState = BufferSlot::FREE;
+                mCore->setSlotStateLocked(front->mSlot, BufferSlot::FREE);
             }
             mCore->mQueue.erase(front);
+            mCore->mStatistics.numDropped++;
             front = mCore->mQueue.begin();
         }
 
@@ -153,8 +150,11 @@ status_t BufferQueueConsumer::acquireBuffer(BufferItem* outBuffer,
     if (mCore->stillTracking(front)) {
         mSlots[slot].mAcquireCalled = true;
         mSlots[slot].mNeedsCleanupOnRelease = false;
-        mSlots[slot].mBufferState = BufferSlot::ACQUIRED;
+        mCore->setSlotStateLocked(slot, BufferSlot::ACQUIRED);
         mSlots[slot].mFence = Fence::NO_FENCE;
+        mSlots[slot].mAcquireTime = systemTime();
+        mCore->mStatistics.queueToAcquire.add(
+                mSlots[slot].mAcquireTime - mSlots[slot].mQueueTime);
     }
 
     // If the buffer has previously been acquired by the consumer, set
@@ -219,18 +219,10 @@ status_t BufferQueueConsumer::attachBuffer(int* outSlot,
 
     // Make sure we don't have too many acquired buffers and find a free slot
     // to put the buffer into (the oldest if there are multiple).
-    int numAcquiredBuffers = 0;
-    int found = BufferQueueCore::INVALID_BUFFER_SLOT;
-    for (int s = 0; s < BufferQueueDefs::NUM_BUFFER_SLOTS; ++s) {
-        if (mSlots[s].mBufferState == BufferSlot::ACQUIRED) {
-            ++numAcquiredBuffers;
-        } else if (mSlots[s].mBufferState == BufferSlot::FREE) {
-            if (found == BufferQueueCore::INVALID_BUFFER_SLOT ||
-                    mSlots[s].mFrameNumber < mSlots[found].mFrameNumber) {
-                found = s;
-            }
-        }
-    }
+    const int numAcquiredBuffers = static_cast<int>(
+            mCore->mStateSlots[BufferSlot::ACQUIRED].count());
+    const int found = mCore->getOldestSlotLocked(
+            mCore->mStateSlots[BufferSlot::FREE]);
 
     if (numAcquiredBuffers >= mCore->mMaxAcquiredBufferCount + 1) {
         BQ_LOGE("attachBuffer(P): max acquired buffer count reached: %d "
@@ -247,8 +239,9 @@ status_t BufferQueueConsumer::attachBuffer(int* outSlot,
     ATRACE_BUFFER_INDEX(*outSlot);
     BQ_LOGV("attachBuffer(C): returning slot %d", *outSlot);
 
-    mSlots[*outSlot].mGraphicBuffer = buffer;
-    mSlots[*outSlot].mBufferState = BufferSlot::ACQUIRED;
+    mCore->setSlotBufferLocked(*outSlot, buffer);
+    mCore->setSlotStateLocked(*outSlot, BufferSlot::ACQUIRED);
+    mSlots[*outSlot].mAcquireTime = systemTime();
     mSlots[*outSlot].mAttachedByConsumer = true;
     mSlots[*outSlot].mNeedsCleanupOnRelease = false;
     mSlots[*outSlot].mFence = Fence::NO_FENCE;
@@ -310,7 +303,9 @@ status_t BufferQueueConsumer::releaseBuffer(int slot, uint64_t frameNumber,
             mSlots[slot].mEglDisplay = eglDisplay;
             mSlots[slot].mEglFence = eglFence;
             mSlots[slot].mFence = releaseFence;
-            mSlots[slot].mBufferState = BufferSlot::FREE;
+            mCore->setSlotStateLocked(slot, BufferSlot::FREE);
+            mCore->mStatistics.acquireToRelease.add(
+                    systemTime() - mSlots[slot].mAcquireTime);
             listener = mCore->mConnectedProducerListener;
             BQ_LOGV("releaseBuffer: releasing slot %d", slot);
         } else if (mSlots[slot].mNeedsCleanupOnRelease) {
@@ -516,6 +511,13 @@ sp<NativeHandle> BufferQueueConsumer::getSidebandStream() const {
     return mCore->mSidebandStream;
 }
 
+status_t BufferQueueConsumer::getStatistics(
+        BufferQueueStatistics* outStatistics) const {
+    Mutex::Autolock lock(mCore->mMutex);
+    *outStatistics = mCore->mStatistics;
+    return NO_ERROR;
+}
+
 void BufferQueueConsumer::dump(String8& result, const char* prefix) const {
     mCore->dump(result, prefix);
 }
@@ -24,6 +24,7 @@
 
 #include <gui/BufferItem.h>
 #include <gui/BufferQueueCore.h>
+#include <gui/GraphicBufferPool.h>
 #include <gui/IConsumerListener.h>
 #include <gui/IGraphicBufferAlloc.h>
 #include <gui/IProducerListener.h>
@@ -51,7 +52,10 @@ BufferQueueCore::BufferQueueCore(const sp<IGraphicBufferAlloc>& allocator) :
     mConsumerUsageBits(0),
     mConnectedApi(NO_CONNECTED_API),
     mConnectedProducerListener(),
+    mConnectedProducerUid(-1),
+    mRecycleBuffers(false),
     mSlots(),
+    mAllocatedSlots(),
     mQueue(),
     mOverrideMaxBufferCount(0),
     mDequeueCondition(),
@@ -75,6 +79,14 @@ BufferQueueCore::BufferQueueCore(const sp<IGraphicBufferAlloc>& allocator) :
             BQ_LOGE("createGraphicBufferAlloc failed");
         }
     }
+    if (mAllocator != NULL) {
+        mRecycleBuffers = mAllocator->asBinder()->localBinder() != NULL;
+    }
+
+    // All slots start out FREE
+    for (int s = 0; s < BufferQueueDefs::NUM_BUFFER_SLOTS; ++s) {
+        mStateSlots[BufferSlot::FREE].markBit(s);
+    }
 }
 
 BufferQueueCore::~BufferQueueCore() {}
@@ -128,6 +140,8 @@ void BufferQueueCore::dump(String8& result, const char* prefix) const {
 
         result.append("\n");
     }
+
+    mStatistics.dump(result, prefix);
 }
 
 int BufferQueueCore::getMinUndequeuedBufferCountLocked(bool async) const {
@@ -161,11 +175,11 @@ int BufferQueueCore::getMaxBufferCountLocked(bool async) const {
     // waiting to be consumed need to have their slots preserved. Such buffers
     // will temporarily keep the max buffer count up until the slots no longer
     // need to be preserved.
-    for (int s = maxBufferCount; s < BufferQueueDefs::NUM_BUFFER_SLOTS; ++s) {
-        BufferSlot::BufferState state = mSlots[s].mBufferState;
-        if (state == BufferSlot::QUEUED || state == BufferSlot::DEQUEUED) {
-            maxBufferCount = s + 1;
-        }
+    BitSet64 preserved(mStateSlots[BufferSlot::QUEUED].value |
+            mStateSlots[BufferSlot::DEQUEUED].value);
+    if (!preserved.isEmpty()) {
+        maxBufferCount = max(maxBufferCount,
+                static_cast<int>(preserved.lastMarkedBit()) + 1);
     }
 
     return maxBufferCount;
@@ -187,13 +201,59 @@ status_t BufferQueueCore::setDefaultMaxBufferCountLocked(int count) {
     return NO_ERROR;
 }
 
+void BufferQueueCore::setSlotStateLocked(int slot,
+        BufferSlot::BufferState state) {
+    mStateSlots[mSlots[slot].mBufferState].clearBit(slot);
+    mStateSlots[state].markBit(slot);
+    mSlots[slot].mBufferState = state;
+}
+
+void BufferQueueCore::setSlotBufferLocked(int slot,
+        const sp<GraphicBuffer>& buffer) {
+    if (buffer != NULL) {
+        mAllocatedSlots.markBit(slot);
+    } else {
+        mAllocatedSlots.clearBit(slot);
+    }
+    mSlots[slot].mGraphicBuffer = buffer;
+}
+
+BitSet64 BufferQueueCore::getSlotsBelow(int maxBufferCount) {
+    // BitSet64 numbers its bits from the most significant one, so the slots
+    // below maxBufferCount are the top maxBufferCount bits.
+    if (maxBufferCount <= 0) {
+        return BitSet64();
+    } else if (maxBufferCount >= BufferQueueDefs::NUM_BUFFER_SLOTS) {
+        return BitSet64(~0ULL);
+    }
+    return BitSet64(~(~0ULL >> maxBufferCount));
+}
+
+BitSet64 BufferQueueCore::getSlotsLocked(BufferSlot::BufferState state,
+        int maxBufferCount) const {
+    return BitSet64(mStateSlots[state].value &
+            getSlotsBelow(maxBufferCount).value);
+}
+
+int BufferQueueCore::getOldestSlotLocked(BitSet64 slots) const {
+    int found = INVALID_BUFFER_SLOT;
+    while (!slots.isEmpty()) {
+        const int s = static_cast<int>(slots.clearFirstMarkedBit());
+        if (found == INVALID_BUFFER_SLOT ||
+                mSlots[s].mFrameNumber < mSlots[found].mFrameNumber) {
+            found = s;
+        }
+    }
+    return found;
+}
+
 void BufferQueueCore::freeBufferLocked(int slot) {
     BQ_LOGV("freeBufferLocked: slot %d", slot);
-    mSlots[slot].mGraphicBuffer.clear();
+    setSlotBufferLocked(slot, NULL);
     if (mSlots[slot].mBufferState == BufferSlot::ACQUIRED) {
         mSlots[slot].mNeedsCleanupOnRelease = true;
     }
-    mSlots[slot].mBufferState = BufferSlot::FREE;
+    setSlotStateLocked(slot, BufferSlot::FREE);
     mSlots[slot].mFrameNumber = UINT32_MAX;
     mSlots[slot].mAcquireCalled = false;
 
@@ -208,10 +268,24 @@ void BufferQueueCore::freeBufferLocked(int slot) {
 void BufferQueueCore::freeAllBuffersLocked() {
     mBufferHasBeenQueued = false;
     for (int s = 0; s < BufferQueueDefs::NUM_BUFFER_SLOTS; ++s) {
+        // The producer may still write to dequeued buffers and the consumer
+        // may still read acquired (or queued, then acquired) ones, so only
+        // free buffers are safe to hand out again.
+        if (mSlots[s].mBufferState == BufferSlot::FREE) {
+            recycleBufferLocked(s);
+        }
         freeBufferLocked(s);
     }
 }
 
+void BufferQueueCore::recycleBufferLocked(int slot) {
+    if (mRecycleBuffers && mConnectedProducerUid != uid_t(-1) &&
+            mSlots[slot].mGraphicBuffer != NULL) {
+        GraphicBufferPool::getInstance().recycle(mSlots[slot].mGraphicBuffer,
+                mSlots[slot].mFence, mConnectedProducerUid);
+    }
+}
+
 bool BufferQueueCore::stillTracking(const BufferItem* item) const {
     const BufferSlot& slot = mSlots[item->mSlot];
 
@@ -22,6 +22,8 @@
 
 #define EGL_EGLEXT_PROTOTYPES
 
+#include <binder/IPCThreadState.h>
+
 #include <gui/BufferItem.h>
 #include <gui/BufferQueueCore.h>
 #include <gui/BufferQueueProducer.h>
@@ -93,11 +95,9 @@ status_t BufferQueueProducer::setBufferCount(int bufferCount) {
         }
 
         // There must be no dequeued buffers when changing the buffer count.
-        for (int s = 0; s < BufferQueueDefs::NUM_BUFFER_SLOTS; ++s) {
-            if (mSlots[s].mBufferState == BufferSlot::DEQUEUED) {
-                BQ_LOGE("setBufferCount: buffer owned by producer");
-                return BAD_VALUE;
-            }
+        if (!mCore->mStateSlots[BufferSlot::DEQUEUED].isEmpty()) {
+            BQ_LOGE("setBufferCount: buffer owned by producer");
+            return BAD_VALUE;
         }
 
         if (bufferCount == 0) {
@@ -132,7 +132,7 @@ status_t BufferQueueProducer::setBufferCount(int bufferCount) {
 }
 
 status_t BufferQueueProducer::waitForFreeSlotThenRelock(const char* caller,
-        bool async, int* found, status_t* returnFlags) const {
+        bool async, bool canBlock, int* found, status_t* returnFlags) const {
     bool tryAgain = true;
     while (tryAgain) {
         if (mCore->mIsAbandoned) {
@@ -153,39 +153,26 @@ status_t BufferQueueProducer::waitForFreeSlotThenRelock(const char* caller,
         }
 
         // Free up any buffers that are in slots beyond the max buffer count
-        for (int s = maxBufferCount; s < BufferQueueDefs::NUM_BUFFER_SLOTS; ++s) {
+        BitSet64 unusableSlots(mCore->mAllocatedSlots.value &
+                ~BufferQueueCore::getSlotsBelow(maxBufferCount).value);
+        while (!unusableSlots.isEmpty()) {
+            const int s = static_cast<int>(unusableSlots.clearFirstMarkedBit());
             assert(mSlots[s].mBufferState == BufferSlot::FREE);
-            if (mSlots[s].mGraphicBuffer != NULL) {
-                mCore->freeBufferLocked(s);
-                *returnFlags |= RELEASE_ALL_BUFFERS;
-            }
+            mCore->recycleBufferLocked(s);
+            mCore->freeBufferLocked(s);
+            *returnFlags |= RELEASE_ALL_BUFFERS;
         }
 
-        // Look for a free buffer to give to the client
-        *found = BufferQueueCore::INVALID_BUFFER_SLOT;
-        int dequeuedCount = 0;
-        int acquiredCount = 0;
-        for (int s = 0; s < maxBufferCount; ++s) {
-            switch (mSlots[s].mBufferState) {
-                case BufferSlot::DEQUEUED:
-                    ++dequeuedCount;
-                    break;
-                case BufferSlot::ACQUIRED:
-                    ++acquiredCount;
-                    break;
-                case BufferSlot::FREE:
-                    // We return the oldest of the free buffers to avoid
-                    // stalling the producer if possible, since the consumer
-                    // may still have pending reads of in-flight buffers
-                    if (*found == BufferQueueCore::INVALID_BUFFER_SLOT ||
-                            mSlots[s].mFrameNumber < mSlots[*found].mFrameNumber) {
-                        *found = s;
-                    }
-                    break;
-                default:
-                    break;
-            }
-        }
+        // Look for a free buffer to give to the client. We return the oldest
+        // of the free buffers to avoid stalling the producer if possible,
+        // since the consumer may still have pending reads of in-flight
+        // buffers
+        const int dequeuedCount = static_cast<int>(mCore->getSlotsLocked(
+                BufferSlot::DEQUEUED, maxBufferCount).count());
+        const int acquiredCount = static_cast<int>(mCore->getSlotsLocked(
+                BufferSlot::ACQUIRED, maxBufferCount).count());
+        *found = mCore->getOldestSlotLocked(
+                mCore->getSlotsLocked(BufferSlot::FREE, maxBufferCount));
 
         // Producers are not allowed to dequeue more than one buffer if they
         // did not set a buffer count
@@ -237,8 +224,8 @@ status_t BufferQueueProducer::waitForFreeSlotThenRelock(const char* caller,
             // buffer (which could cause us to have to wait here), which is
             // okay, since it is only used to implement an atomic acquire +
             // release (e.g., in GLConsumer::updateTexImage())
-            if (mCore->mDequeueBufferCannotBlock &&
-                    (acquiredCount <= mCore->mMaxAcquiredBufferCount)) {
+            if (!canBlock || (mCore->mDequeueBufferCannotBlock &&
+                    (acquiredCount <= mCore->mMaxAcquiredBufferCount))) {
                 return WOULD_BLOCK;
             }
             mCore->mDequeueCondition.wait(mCore->mMutex);
@@ -252,19 +239,19 @@ status_t BufferQueueProducer::dequeueBuffer(int *outSlot,
         sp<android::Fence> *outFence, bool async,
         uint32_t width, uint32_t height, uint32_t format, uint32_t usage) {
     ATRACE_CALL();
-    { // Autolock scope
-        Mutex::Autolock lock(mCore->mMutex);
-        mConsumerName = mCore->mConsumerName;
-    } // Autolock scope
-
-    BQ_LOGV("dequeueBuffer: async=%s w=%u h=%u format=%#x, usage=%#x",
-            async ? "true" : "false", width, height, format, usage);
+    return dequeueBufferInternal(outSlot, outFence, async, width, height,
+            format, usage, true);
+}
 
+status_t BufferQueueProducer::dequeueBufferInternal(int* outSlot,
+        sp<Fence>* outFence, bool async, uint32_t width, uint32_t height,
+        uint32_t format, uint32_t usage, bool canBlock) {
     if ((width && !height) || (!width && height)) {
         BQ_LOGE("dequeueBuffer: invalid size: w=%u h=%u", width, height);
         return BAD_VALUE;
     }
 
+    const nsecs_t startTime = systemTime();
     status_t returnFlags = NO_ERROR;
     EGLDisplay eglDisplay = EGL_NO_DISPLAY;
     EGLSyncKHR eglFence = EGL_NO_SYNC_KHR;
@@ -272,6 +259,10 @@ status_t BufferQueueProducer::dequeueBuffer(int *outSlot,
 
     { // Autolock scope
         Mutex::Autolock lock(mCore->mMutex);
+        mConsumerName = mCore->mConsumerName;
+        BQ_LOGV("dequeueBuffer: async=%s w=%u h=%u format=%#x, usage=%#x",
+                async ? "true" : "false", width, height, format, usage);
+
         mCore->waitWhileAllocatingLocked();
 
         if (format == 0) {
@@ -283,10 +274,11 @@ status_t BufferQueueProducer::dequeueBuffer(int *outSlot,
 
         int found;
         status_t status = waitForFreeSlotThenRelock("dequeueBuffer", async,
-                &found, &returnFlags);
+                canBlock, &found, &returnFlags);
         if (status != NO_ERROR) {
             return status;
         }
+        mCore->mStatistics.dequeueWait.add(systemTime() - startTime);
 
         // This should not happen
         if (found == BufferQueueCore::INVALID_BUFFER_SLOT) {
@@ -305,7 +297,7 @@ status_t BufferQueueProducer::dequeueBuffer(int *outSlot,
             height = mCore->mDefaultHeight;
         }
 
-        mSlots[found].mBufferState = BufferSlot::DEQUEUED;
+        mCore->setSlotStateLocked(found, BufferSlot::DEQUEUED);
 
         const sp<GraphicBuffer>& buffer(mSlots[found].mGraphicBuffer);
         if ((buffer == NULL) ||
@@ -315,7 +307,8 @@ status_t BufferQueueProducer::dequeueBuffer(int *outSlot,
                 ((static_cast<uint32_t>(buffer->usage) & usage) != usage))
         {
             mSlots[found].mAcquireCalled = false;
-            mSlots[found].mGraphicBuffer = NULL;
+            mCore->recycleBufferLocked(found);
+            mCore->setSlotBufferLocked(found, NULL);
             mSlots[found].mRequestBufferCalled = false;
             mSlots[found].mEglDisplay = EGL_NO_DISPLAY;
             mSlots[found].mEglFence = EGL_NO_SYNC_KHR;
@@ -356,7 +349,7 @@ status_t BufferQueueProducer::dequeueBuffer(int *outSlot,
             }
 
             mSlots[*outSlot].mFrameNumber = UINT32_MAX;
-            mSlots[*outSlot].mGraphicBuffer = graphicBuffer;
+            mCore->setSlotBufferLocked(*outSlot, graphicBuffer);
         } // Autolock scope
     }
 
@@ -439,16 +432,9 @@ status_t BufferQueueProducer::detachNextBuffer(sp<GraphicBuffer>* outBuffer,
     }
 
     // Find the oldest valid slot
-    int found = BufferQueueCore::INVALID_BUFFER_SLOT;
-    for (int s = 0; s < BufferQueueDefs::NUM_BUFFER_SLOTS; ++s) {
-        if (mSlots[s].mBufferState == BufferSlot::FREE &&
-                mSlots[s].mGraphicBuffer != NULL) {
-            if (found == BufferQueueCore::INVALID_BUFFER_SLOT ||
-                    mSlots[s].mFrameNumber < mSlots[found].mFrameNumber) {
-                found = s;
-            }
-        }
-    }
+    int found = mCore->getOldestSlotLocked(BitSet64(
+            mCore->mStateSlots[BufferSlot::FREE].value &
+            mCore->mAllocatedSlots.value));
 
     if (found == BufferQueueCore::INVALID_BUFFER_SLOT) {
         return NO_MEMORY;
@@ -484,7 +470,7 @@ status_t BufferQueueProducer::attachBuffer(int* outSlot,
     // unlikely that buffers which we are attaching to a BufferQueue will
     // be asynchronous (droppable), but it may not be impossible.
     status_t status = waitForFreeSlotThenRelock("attachBuffer(P)", false,
-            &found, &returnFlags);
+            true, &found, &returnFlags);
     if (status != NO_ERROR) {
         return status;
     }
@@ -500,8 +486,8 @@ status_t BufferQueueProducer::attachBuffer(int* outSlot,
     BQ_LOGV("attachBuffer(P): returning slot %d flags=%#x",
             *outSlot, returnFlags);
 
-    mSlots[*outSlot].mGraphicBuffer = buffer;
-    mSlots[*outSlot].mBufferState = BufferSlot::DEQUEUED;
+    mCore->setSlotBufferLocked(*outSlot, buffer);
+    mCore->setSlotStateLocked(*outSlot, BufferSlot::DEQUEUED);
     mSlots[*outSlot].mEglFence = EGL_NO_SYNC_KHR;
     mSlots[*outSlot].mFence = Fence::NO_FENCE;
     mSlots[*outSlot].mRequestBufferCalled = true;
@@ -598,9 +584,10 @@ status_t BufferQueueProducer::queueBuffer(int slot,
         }
 
         mSlots[slot].mFence = fence;
-        mSlots[slot].mBufferState = BufferSlot::QUEUED;
+        mCore->setSlotStateLocked(slot, BufferSlot::QUEUED);
         ++mCore->mFrameCounter;
         mSlots[slot].mFrameNumber = mCore->mFrameCounter;
+        mSlots[slot].mQueueTime = systemTime();
 
         item.mAcquireCalled = mSlots[slot].mAcquireCalled;
         item.mGraphicBuffer = mSlots[slot].mGraphicBuffer;
@@ -632,13 +619,14 @@ status_t BufferQueueProducer::queueBuffer(int slot,
                 // If the front queued buffer is still being tracked, we first
                 // mark it as freed
                 if (mCore->stillTracking(front)) {
-                    mSlots[front->mSlot].mBufferState = BufferSlot::FREE;
+                    mCore->setSlotStateLocked(front->mSlot, BufferSlot::FREE);
                     // Reset the frame number of the freed buffer so that it is
                     // the first in line to be dequeued again
                     mSlots[front->mSlot].mFrameNumber = 0;
                 }
                 // Overwrite the droppable buffer with the incoming one
                 *front = item;
+                mCore->mStatistics.numDropped++;
                 frameReplacedListener = mCore->mConsumerListener;
             } else {
                 mCore->mQueue.push_back(item);
@@ -647,6 +635,7 @@ status_t BufferQueueProducer::queueBuffer(int slot,
         }
 
         mCore->mBufferHasBeenQueued = true;
+        mCore->mStatistics.queueDepth.add(mCore->mQueue.size());
         mCore->mDequeueCondition.broadcast();
 
         output->inflate(mCore->mDefaultWidth, mCore->mDefaultHeight,
@@ -716,7 +705,7 @@ void BufferQueueProducer::cancelBuffer(int slot, const sp<Fence>& fence) {
         return;
     }
 
-    mSlots[slot].mBufferState = BufferSlot::FREE;
+    mCore->setSlotStateLocked(slot, BufferSlot::FREE);
     mSlots[slot].mFrameNumber = 0;
     mSlots[slot].mFence = fence;
     mCore->mDequeueCondition.broadcast();
@@ -804,6 +793,8 @@ status_t BufferQueueProducer::connect(const sp<IProducerListener>& listener,
         case NATIVE_WINDOW_API_MEDIA:
         case NATIVE_WINDOW_API_CAMERA:
             mCore->mConnectedApi = api;
+            mCore->mConnectedProducerUid =
+                    IPCThreadState::self()->getCallingUid();
             output->inflate(mCore->mDefaultWidth, mCore->mDefaultHeight,
                     mCore->mTransformHint, mCore->mQueue.size());
 
@@ -867,6 +858,7 @@ status_t BufferQueueProducer::disconnect(int api) {
                                 static_cast<IBinder::DeathRecipient*>(this));
                     }
                     mCore->mConnectedProducerListener = NULL;
+                    mCore->mConnectedProducerUid = -1;
                     mCore->mConnectedApi = BufferQueueCore::NO_CONNECTED_API;
                     mCore->mSidebandStream.clear();
                     mCore->mDequeueCondition.broadcast();
@@ -994,7 +986,7 @@ void BufferQueueProducer::allocateBuffers(bool async, uint32_t width,
                     continue;
                 }
                 mCore->freeBufferLocked(slot); // Clean up the slot first
-                mSlots[slot].mGraphicBuffer = buffers[i];
+                mCore->setSlotBufferLocked(slot, buffers[i]);
                 mSlots[slot].mFrameNumber = 0;
                 mSlots[slot].mFence = Fence::NO_FENCE;
                 BQ_LOGV("allocateBuffers: allocated a new buffer in slot %d", slot);
@@ -1006,6 +998,28 @@ void BufferQueueProducer::allocateBuffers(bool async, uint32_t width,
     }
 }
 
+status_t BufferQueueProducer::queueAndDequeueBuffer(int buf,
+        const QueueBufferInput& input, QueueBufferOutput* output,
+        int* outSlot, sp<Fence>* outFence, sp<GraphicBuffer>* outBuffer,
+        status_t* outDequeueResult, bool async, uint32_t width,
+        uint32_t height, uint32_t format, uint32_t usage) {
+    ATRACE_CALL();
+    status_t result = queueBuffer(buf, input, output);
+    if (result != NO_ERROR) {
+        return result;
+    }
+
+    *outDequeueResult = dequeueBufferInternal(outSlot, outFence, async, width,
+            height, format, usage, false);
+    if (*outDequeueResult >= 0 &&
+            (*outDequeueResult & BUFFER_NEEDS_REALLOCATION)) {
+        // Save the client the requestBuffer call. If this fails, the client
+        // sees no buffer and requests it itself.
+        requestBuffer(*outSlot, outBuffer);
+    }
+    return NO_ERROR;
+}
+
 void BufferQueueProducer::binderDied(const wp<android::IBinder>& /* who */) {
     // If we're here, it means that a producer we were connected to died.
     // We're guaranteed that we are still connected to it because we remove
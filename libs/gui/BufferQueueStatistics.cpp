@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <gui/BufferQueueStatistics.h>
+
+#include <utils/String8.h>
+
+namespace android {
+
+void BufferQueueStatistics::TimeHistogram::add(nsecs_t duration) {
+    if (duration < 0) {
+        duration = 0;
+    }
+    size_t bucket = 0;
+    if (duration >= FIRST_BUCKET_NS) {
+        // 1 + floor(log2(duration / FIRST_BUCKET_NS))
+        const uint64_t ratio = static_cast<uint64_t>(duration / FIRST_BUCKET_NS);
+        bucket = 64 - __builtin_clzll(ratio);
+        if (bucket >= NUM_BUCKETS) {
+            bucket = NUM_BUCKETS - 1;
+        }
+    }
+    buckets[bucket]++;
+    count++;
+    totalNs += duration;
+    if (duration > maxNs) {
+        maxNs = duration;
+    }
+}
+
+nsecs_t BufferQueueStatistics::TimeHistogram::getBucketEnd(size_t bucket) {
+    return FIRST_BUCKET_NS << bucket;
+}
+
+void BufferQueueStatistics::DepthHistogram::add(size_t depth) {
+    buckets[depth < NUM_BUCKETS ? depth : NUM_BUCKETS - 1]++;
+}
+
+BufferQueueStatistics::BufferQueueStatistics() {
+    memset(this, 0, sizeof(*this));
+}
+
+static void dumpTimeHistogram(String8& result, const char* prefix,
+        const char* name, const BufferQueueStatistics::TimeHistogram& h) {
+    typedef BufferQueueStatistics::TimeHistogram TimeHistogram;
+    result.appendFormat("%s%s: n=%" PRIu64, prefix, name, h.count);
+    if (h.count) {
+        result.appendFormat(" mean=%.3fms max=%.3fms {",
+                h.totalNs / double(h.count) / 1000000.0, h.maxNs / 1000000.0);
+        const char* separator = "";
+        for (size_t i = 0; i < TimeHistogram::NUM_BUCKETS; i++) {
+            if (!h.buckets[i]) {
+                continue;
+            }
+            if (i + 1 < TimeHistogram::NUM_BUCKETS) {
+                result.appendFormat("%s<%.3fms:%u", separator,
+                        TimeHistogram::getBucketEnd(i) / 1000000.0,
+                        h.buckets[i]);
+            } else {
+                result.appendFormat("%s>=%.3fms:%u", separator,
+                        TimeHistogram::getBucketEnd(i - 1) / 1000000.0,
+                        h.buckets[i]);
+            }
+            separator = " ";
+        }
+        result.append("}");
+    }
+    result.append("\n");
+}
+
+void BufferQueueStatistics::dump(String8& result, const char* prefix) const {
+    dumpTimeHistogram(result, prefix, "dequeue-wait", dequeueWait);
+    dumpTimeHistogram(result, prefix, "queue-to-acquire", queueToAcquire);
+    dumpTimeHistogram(result, prefix, "acquire-to-release", acquireToRelease);
+
+    result.appendFormat("%squeue-depth: {", prefix);
+    for (size_t i = 0; i < DepthHistogram::NUM_BUCKETS; i++) {
+        result.appendFormat(i + 1 < DepthHistogram::NUM_BUCKETS ?
+                "%s%zu:%u" : "%s%zu+:%u", i ? " " : "", i,
+                queueDepth.buckets[i]);
+    }
+    result.appendFormat("} dropped=%" PRIu64 "\n", numDropped);
+}
+
+} // namespace android
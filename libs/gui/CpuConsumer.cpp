@@ -30,11 +30,31 @@
 
 namespace android {
 
+// ReadAheadThread runs CpuConsumer::readAheadLoop. It does not hold a
+// reference to the CpuConsumer, whose destructor waits for it to exit.
+class CpuConsumer::ReadAheadThread : public Thread {
+public:
+    ReadAheadThread(CpuConsumer* consumer) :
+        Thread(false), mConsumer(consumer) {}
+
+private:
+    virtual bool threadLoop() {
+        mConsumer->readAheadLoop();
+        return false;
+    }
+
+    CpuConsumer* mConsumer;
+};
+
 CpuConsumer::CpuConsumer(const sp<IGraphicBufferConsumer>& bq,
         uint32_t maxLockedBuffers, bool controlledByApp) :
     ConsumerBase(bq, controlledByApp),
     mMaxLockedBuffers(maxLockedBuffers),
-    mCurrentLockedBuffers(0)
+    mCurrentLockedBuffers(0),
+    mReadAheadDepth(0),
+    mReadAheadPending(false),
+    mReadAheadWake(false),
+    mReadAheadExit(false)
 {
     // Create tracking entries for locked buffers
     mAcquiredBuffers.insertAt(0, maxLockedBuffers);
@@ -44,7 +64,16 @@ CpuConsumer::CpuConsumer(const sp<IGraphicBufferConsumer>& bq,
 }
 
 CpuConsumer::~CpuConsumer() {
-    // ConsumerBase destructor does all the work.
+    // ConsumerBase destructor does all the work, once the read-ahead thread
+    // has stopped using this object.
+    if (mReadAheadThread != NULL) {
+        {
+            Mutex::Autolock _l(mMutex);
+            mReadAheadExit = true;
+            mReadAheadCondition.broadcast();
+        }
+        mReadAheadThread->requestExitAndWait();
+    }
 }
 
 
@@ -95,46 +124,25 @@ static bool isPossiblyYUV(PixelFormat format) {
     }
 }
 
-status_t CpuConsumer::lockNextBuffer(LockedBuffer *nativeBuffer) {
+status_t CpuConsumer::lockBuffer(const String8& name,
+        const sp<GraphicBuffer>& buffer, const BufferQueue::BufferItem& b,
+        LockedBuffer* nativeBuffer) {
     status_t err;
 
-    if (!nativeBuffer) return BAD_VALUE;
-    if (mCurrentLockedBuffers == mMaxLockedBuffers) {
-        CC_LOGW("Max buffers have been locked (%d), cannot lock anymore.",
-                mMaxLockedBuffers);
-        return NOT_ENOUGH_DATA;
-    }
-
-    BufferQueue::BufferItem b;
-
-    Mutex::Autolock _l(mMutex);
-
-    err = acquireBufferLocked(&b, 0);
-    if (err != OK) {
-        if (err == BufferQueue::NO_BUFFER_AVAILABLE) {
-            return BAD_VALUE;
-        } else {
-            CC_LOGE("Error acquiring buffer: %s (%d)", strerror(err), err);
-            return err;
-        }
-    }
-
-    int buf = b.mBuf;
-
     void *bufferPointer = NULL;
     android_ycbcr ycbcr = android_ycbcr();
 
-    PixelFormat format = mSlots[buf].mGraphicBuffer->getPixelFormat();
+    PixelFormat format = buffer->getPixelFormat();
     PixelFormat flexFormat = format;
     if (isPossiblyYUV(format)) {
         if (b.mFence.get()) {
-            err = mSlots[buf].mGraphicBuffer->lockAsyncYCbCr(
+            err = buffer->lockAsyncYCbCr(
                 GraphicBuffer::USAGE_SW_READ_OFTEN,
                 b.mCrop,
                 &ycbcr,
                 b.mFence->dup());
         } else {
-            err = mSlots[buf].mGraphicBuffer->lockYCbCr(
+            err = buffer->lockYCbCr(
                 GraphicBuffer::USAGE_SW_READ_OFTEN,
                 b.mCrop,
                 &ycbcr);
@@ -143,58 +151,45 @@ status_t CpuConsumer::lockNextBuffer(LockedBuffer *nativeBuffer) {
             bufferPointer = ycbcr.y;
             flexFormat = HAL_PIXEL_FORMAT_YCbCr_420_888;
             if (format != HAL_PIXEL_FORMAT_YCbCr_420_888) {
-                CC_LOGV("locking buffer of format %#x as flex YUV", format);
+                ALOGV("[%s] locking buffer of format %#x as flex YUV",
+                        name.string(), format);
             }
         } else if (format == HAL_PIXEL_FORMAT_YCbCr_420_888) {
-            CC_LOGE("Unable to lock YCbCr buffer for CPU reading: %s (%d)",
-                    strerror(-err), err);
+            ALOGE("[%s] Unable to lock YCbCr buffer for CPU reading: %s (%d)",
+                    name.string(), strerror(-err), err);
             return err;
         }
     }
 
     if (bufferPointer == NULL) { // not flexible YUV
         if (b.mFence.get()) {
-            err = mSlots[buf].mGraphicBuffer->lockAsync(
+            err = buffer->lockAsync(
                 GraphicBuffer::USAGE_SW_READ_OFTEN,
                 b.mCrop,
                 &bufferPointer,
                 b.mFence->dup());
         } else {
-            err = mSlots[buf].mGraphicBuffer->lock(
+            err = buffer->lock(
                 GraphicBuffer::USAGE_SW_READ_OFTEN,
                 b.mCrop,
                 &bufferPointer);
         }
         if (err != OK) {
-            CC_LOGE("Unable to lock buffer for CPU reading: %s (%d)",
-                    strerror(-err), err);
+            ALOGE("[%s] Unable to lock buffer for CPU reading: %s (%d)",
+                    name.string(), strerror(-err), err);
             return err;
         }
     }
 
-    size_t lockedIdx = 0;
-    for (; lockedIdx < mMaxLockedBuffers; lockedIdx++) {
-        if (mAcquiredBuffers[lockedIdx].mSlot ==
-                BufferQueue::INVALID_BUFFER_SLOT) {
-            break;
-        }
-    }
-    assert(lockedIdx < mMaxLockedBuffers);
-
-    AcquiredBuffer &ab = mAcquiredBuffers.editItemAt(lockedIdx);
-    ab.mSlot = buf;
-    ab.mBufferPointer = bufferPointer;
-    ab.mGraphicBuffer = mSlots[buf].mGraphicBuffer;
-
     nativeBuffer->data   =
             reinterpret_cast<uint8_t*>(bufferPointer);
-    nativeBuffer->width  = mSlots[buf].mGraphicBuffer->getWidth();
-    nativeBuffer->height = mSlots[buf].mGraphicBuffer->getHeight();
+    nativeBuffer->width  = buffer->getWidth();
+    nativeBuffer->height = buffer->getHeight();
     nativeBuffer->format = format;
     nativeBuffer->flexFormat = flexFormat;
     nativeBuffer->stride = (ycbcr.y != NULL) ?
             ycbcr.ystride :
-            mSlots[buf].mGraphicBuffer->getStride();
+            buffer->getStride();
 
     nativeBuffer->crop        = b.mCrop;
     nativeBuffer->transform   = b.mTransform;
@@ -207,6 +202,75 @@ status_t CpuConsumer::lockNextBuffer(LockedBuffer *nativeBuffer) {
     nativeBuffer->chromaStride = ycbcr.cstride;
     nativeBuffer->chromaStep   = ycbcr.chroma_step;
 
+    return OK;
+}
+
+size_t CpuConsumer::addAcquiredBufferLocked(int slot,
+        const sp<GraphicBuffer>& buffer, const LockedBuffer& nativeBuffer) {
+    size_t lockedIdx = 0;
+    for (; lockedIdx < mMaxLockedBuffers; lockedIdx++) {
+        if (mAcquiredBuffers[lockedIdx].mSlot ==
+                BufferQueue::INVALID_BUFFER_SLOT) {
+            break;
+        }
+    }
+    assert(lockedIdx < mMaxLockedBuffers);
+
+    AcquiredBuffer &ab = mAcquiredBuffers.editItemAt(lockedIdx);
+    ab.mSlot = slot;
+    ab.mBufferPointer = nativeBuffer.data;
+    ab.mGraphicBuffer = buffer;
+    return lockedIdx;
+}
+
+status_t CpuConsumer::lockNextBuffer(LockedBuffer *nativeBuffer) {
+    status_t err;
+
+    if (!nativeBuffer) return BAD_VALUE;
+
+    Mutex::Autolock _l(mMutex);
+
+    if (mCurrentLockedBuffers == mMaxLockedBuffers) {
+        CC_LOGW("Max buffers have been locked (%d), cannot lock anymore.",
+                mMaxLockedBuffers);
+        return NOT_ENOUGH_DATA;
+    }
+
+    // Hand out the buffers that were read ahead first. If the read-ahead
+    // thread is locking one right now, it is older than anything we could
+    // acquire ourselves.
+    while (mReadAheadPending) {
+        mReadAheadCondition.wait(mMutex);
+    }
+    if (!mReadAheadBuffers.isEmpty()) {
+        *nativeBuffer = mReadAheadBuffers[0];
+        mReadAheadBuffers.removeAt(0);
+        mCurrentLockedBuffers++;
+        mReadAheadCondition.broadcast();
+        return OK;
+    }
+
+    BufferQueue::BufferItem b;
+
+    err = acquireBufferLocked(&b, 0);
+    if (err != OK) {
+        if (err == BufferQueue::NO_BUFFER_AVAILABLE) {
+            return BAD_VALUE;
+        } else {
+            CC_LOGE("Error acquiring buffer: %s (%d)", strerror(err), err);
+            return err;
+        }
+    }
+
+    int buf = b.mBuf;
+
+    err = lockBuffer(mName, mSlots[buf].mGraphicBuffer, b, nativeBuffer);
+    if (err != OK) {
+        return err;
+    }
+
+    addAcquiredBufferLocked(buf, mSlots[buf].mGraphicBuffer, *nativeBuffer);
+
     mCurrentLockedBuffers++;
 
     return OK;
@@ -226,7 +290,17 @@ status_t CpuConsumer::unlockBuffer(const LockedBuffer &nativeBuffer) {
         return BAD_VALUE;
     }
 
-    return releaseAcquiredBufferLocked(lockedIdx);
+    err = releaseAcquiredBufferLocked(lockedIdx);
+    if (err != OK) {
+        return err;
+    }
+
+    mCurrentLockedBuffers--;
+
+    // There is room for another buffer to be read ahead now.
+    mReadAheadWake = true;
+    mReadAheadCondition.broadcast();
+    return OK;
 }
 
 status_t CpuConsumer::releaseAcquiredBufferLocked(int lockedIdx) {
@@ -263,10 +337,120 @@ status_t CpuConsumer::releaseAcquiredBufferLocked(int lockedIdx) {
     ab.mBufferPointer = NULL;
     ab.mGraphicBuffer.clear();
 
-    mCurrentLockedBuffers--;
     return OK;
 }
 
+status_t CpuConsumer::setReadAheadDepth(uint32_t depth) {
+    Mutex::Autolock _l(mMutex);
+    if (depth > mMaxLockedBuffers) {
+        CC_LOGE("setReadAheadDepth: depth %u is larger than maxLockedBuffers "
+                "(%u)", depth, mMaxLockedBuffers);
+        return BAD_VALUE;
+    }
+    if (mAbandoned) {
+        CC_LOGE("setReadAheadDepth: CpuConsumer is abandoned!");
+        return NO_INIT;
+    }
+
+    mReadAheadDepth = depth;
+    if (depth > 0 && mReadAheadThread == NULL) {
+        mReadAheadThread = new ReadAheadThread(this);
+        status_t err = mReadAheadThread->run("CpuConsumerReadAhead");
+        if (err != OK) {
+            CC_LOGE("setReadAheadDepth: unable to start read-ahead thread: "
+                    "%s (%d)", strerror(-err), err);
+            mReadAheadThread.clear();
+            mReadAheadDepth = 0;
+            return err;
+        }
+    }
+    mReadAheadWake = true;
+    mReadAheadCondition.broadcast();
+    return OK;
+}
+
+void CpuConsumer::readAheadLoop() {
+    Mutex::Autolock _l(mMutex);
+    while (!mReadAheadExit) {
+        // Buffers that were read ahead are locked just like the ones the
+        // user holds, so together they may not exceed mMaxLockedBuffers.
+        const uint32_t numReadAhead = mReadAheadBuffers.size();
+        if (!mReadAheadWake || numReadAhead >= mReadAheadDepth ||
+                mCurrentLockedBuffers + numReadAhead >= mMaxLockedBuffers) {
+            mReadAheadCondition.wait(mMutex);
+            continue;
+        }
+
+        BufferQueue::BufferItem b;
+        status_t err = acquireBufferLocked(&b, 0);
+        if (err != OK) {
+            if (err != BufferQueue::NO_BUFFER_AVAILABLE) {
+                CC_LOGE("readAheadLoop: error acquiring buffer: %s (%d)",
+                        strerror(-err), err);
+            }
+            mReadAheadWake = false;
+            continue;
+        }
+
+        // Waiting for the fence and mapping the buffer is the slow part, so
+        // do it without holding mMutex.
+        const int buf = b.mBuf;
+        sp<GraphicBuffer> buffer(mSlots[buf].mGraphicBuffer);
+        String8 name(mName);
+        LockedBuffer nativeBuffer;
+        mReadAheadPending = true;
+        mMutex.unlock();
+        err = lockBuffer(name, buffer, b, &nativeBuffer);
+        mMutex.lock();
+        mReadAheadPending = false;
+        mReadAheadCondition.broadcast();
+
+        if (err != OK) {
+            // Drop the frame, as lockNextBuffer would have.
+            if (buffer == mSlots[buf].mGraphicBuffer) {
+                releaseBufferLocked(buf, buffer, EGL_NO_DISPLAY,
+                        EGL_NO_SYNC_KHR);
+            }
+            continue;
+        }
+        addAcquiredBufferLocked(buf, buffer, nativeBuffer);
+        mReadAheadBuffers.push_back(nativeBuffer);
+    }
+    discardReadAheadLocked();
+}
+
+void CpuConsumer::discardReadAheadLocked() {
+    while (!mReadAheadBuffers.isEmpty()) {
+        void *bufPtr = reinterpret_cast<void *>(mReadAheadBuffers[0].data);
+        mReadAheadBuffers.removeAt(0);
+        for (size_t lockedIdx = 0; lockedIdx < mMaxLockedBuffers;
+                lockedIdx++) {
+            if (bufPtr == mAcquiredBuffers[lockedIdx].mBufferPointer) {
+                releaseAcquiredBufferLocked(lockedIdx);
+                break;
+            }
+        }
+    }
+}
+
+void CpuConsumer::onFrameAvailable(const BufferItem& item) {
+    {
+        Mutex::Autolock _l(mMutex);
+        mReadAheadWake = true;
+        mReadAheadCondition.broadcast();
+    }
+    ConsumerBase::onFrameAvailable(item);
+}
+
+void CpuConsumer::abandonLocked() {
+    // The read-ahead thread is joined in the destructor, since it needs
+    // mMutex to notice that it should exit.
+    mReadAheadExit = true;
+    mReadAheadCondition.broadcast();
+    discardReadAheadLocked();
+    ConsumerBase::abandonLocked();
+}
+
 void CpuConsumer::freeBufferLocked(int slotIndex) {
     ConsumerBase::freeBufferLocked(slotIndex);
 }
@@ -22,6 +22,9 @@
 #include <gui/DisplayEventReceiver.h>
 #include <gui/IDisplayEventConnection.h>
 #include <gui/ISurfaceComposer.h>
+#include <gui/VsyncTiming.h>
+
+#include <binder/IMemory.h>
 
 #include <private/gui/ComposerService.h>
 
@@ -76,6 +79,19 @@ status_t DisplayEventReceiver::requestNextVsync() {
     return NO_INIT;
 }
 
+status_t DisplayEventReceiver::getVsyncTiming(VsyncTiming* outTiming) {
+    if (mVsyncTimingHeap == NULL) {
+        if (mEventConnection == NULL) {
+            return NO_INIT;
+        }
+        status_t err = mEventConnection->getVsyncTiming(&mVsyncTimingHeap);
+        if (err != NO_ERROR) {
+            return err;
+        }
+    }
+    // The heap is only mapped once, so the reader is cheap to create.
+    return VsyncTimingReader(mVsyncTimingHeap).read(outTiming);
+}
 
 ssize_t DisplayEventReceiver::getEvents(DisplayEventReceiver::Event* events,
         size_t count) {
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FrameTimeline"
+
+#include <string.h>
+#include <sys/mman.h>
+
+#include <binder/IMemory.h>
+#include <binder/MemoryHeapBase.h>
+
+#include <cutils/atomic.h>
+
+#include <gui/FrameTimeline.h>
+
+#include <utils/Log.h>
+
+namespace android {
+
+// A record is published by making its seq odd, writing it, and then
+// setting seq to 2 * (index + 1), where index is the number of records
+// published before it. A reader knows which seq the record it wants must
+// have, so it can tell when the writer got there first.
+
+static inline int32_t publishedSeq(uint32_t index) {
+    return int32_t(2 * (index + 1));
+}
+
+static inline size_t heapSize(uint32_t capacity) {
+    return sizeof(FrameTimelineHeader) +
+            size_t(capacity) * sizeof(FrameTimelineRecord);
+}
+
+// ----------------------------------------------------------------------------
+
+FrameTimelineWriter::FrameTimelineWriter(uint32_t capacity)
+    : mHeader(NULL), mRecords(NULL), mCapacity(capacity)
+{
+    // Clients map the heap read-only.
+    sp<MemoryHeapBase> heap = new MemoryHeapBase(heapSize(capacity),
+            MemoryHeapBase::READ_ONLY, "FrameTimeline");
+    if (capacity == 0 || heap->getHeapID() < 0 || heap->getBase() == MAP_FAILED) {
+        ALOGE("could not allocate a frame timeline of %u records", capacity);
+        return;
+    }
+    mHeap = heap;
+    mHeader = static_cast<FrameTimelineHeader*>(heap->getBase());
+    mRecords = reinterpret_cast<FrameTimelineRecord*>(mHeader + 1);
+    memset(mHeader, 0, heapSize(capacity));
+    mHeader->magic = FrameTimelineHeader::MAGIC;
+    mHeader->version = FrameTimelineHeader::VERSION;
+    mHeader->recordSize = sizeof(FrameTimelineRecord);
+    mHeader->capacity = capacity;
+}
+
+FrameTimelineWriter::~FrameTimelineWriter() {
+}
+
+status_t FrameTimelineWriter::initCheck() const {
+    return mHeader ? NO_ERROR : NO_MEMORY;
+}
+
+void FrameTimelineWriter::write(const FrameTimelineRecord& record) {
+    if (!mHeader) {
+        return;
+    }
+    const uint32_t index = uint32_t(mHeader->writeCount);
+    FrameTimelineRecord* rec = &mRecords[index % mCapacity];
+
+    android_atomic_release_store(publishedSeq(index) - 1, &rec->seq);
+    android_memory_barrier();
+    memcpy(reinterpret_cast<char*>(rec) + sizeof(rec->seq),
+            reinterpret_cast<const char*>(&record) + sizeof(record.seq),
+            sizeof(record) - sizeof(record.seq));
+    rec->name[FrameTimelineRecord::NAME_LENGTH - 1] = '\0';
+    android_atomic_release_store(publishedSeq(index), &rec->seq);
+    android_atomic_release_store(int32_t(index + 1), &mHeader->writeCount);
+}
+
+// ----------------------------------------------------------------------------
+
+FrameTimelineReader::FrameTimelineReader(const sp<IMemoryHeap>& heap)
+    : mHeader(NULL), mRecords(NULL), mCapacity(0), mNext(0)
+{
+    if (heap == NULL || heap->getHeapID() < 0 ||
+            heap->getBase() == MAP_FAILED ||
+            heap->getSize() < sizeof(FrameTimelineHeader)) {
+        return;
+    }
+    const FrameTimelineHeader* header =
+            static_cast<const FrameTimelineHeader*>(heap->getBase());
+    if (header->magic != FrameTimelineHeader::MAGIC ||
+            header->version != FrameTimelineHeader::VERSION ||
+            header->recordSize != sizeof(FrameTimelineRecord) ||
+            header->capacity == 0 ||
+            heap->getSize() < heapSize(header->capacity)) {
+        ALOGE("not a frame timeline heap");
+        return;
+    }
+    mHeap = heap;
+    mHeader = header;
+    mRecords = reinterpret_cast<const FrameTimelineRecord*>(header + 1);
+    mCapacity = header->capacity;
+    mNext = uint32_t(android_atomic_acquire_load(&header->writeCount));
+}
+
+status_t FrameTimelineReader::initCheck() const {
+    return mHeader ? NO_ERROR : NO_INIT;
+}
+
+size_t FrameTimelineReader::read(FrameTimelineRecord* records, size_t count,
+        uint32_t* outLost) {
+    uint32_t lost = 0;
+    size_t n = 0;
+    if (mHeader) {
+        const uint32_t written =
+                uint32_t(android_atomic_acquire_load(&mHeader->writeCount));
+        if (written - mNext > mCapacity) {
+            lost = written - mNext - mCapacity;
+            mNext = written - mCapacity;
+        }
+        while (n < count && mNext != written) {
+            const FrameTimelineRecord* rec = &mRecords[mNext % mCapacity];
+            const int32_t seq = android_atomic_acquire_load(&rec->seq);
+            memcpy(&records[n], rec, sizeof(*rec));
+            android_memory_barrier();
+            if (seq == publishedSeq(mNext) && rec->seq == seq) {
+                records[n].seq = seq;
+                n++;
+            } else {
+                // The writer has wrapped around and is reusing the record.
+                lost++;
+            }
+            mNext++;
+        }
+    }
+    if (outLost) {
+        *outLost = lost;
+    }
+    return n;
+}
+
+}; // namespace android
@@ -132,6 +132,8 @@ GLConsumer::GLConsumer(const sp<IGraphicBufferConsumer>& bq, uint32_t tex,
     mTexTarget(texTarget),
     mEglDisplay(EGL_NO_DISPLAY),
     mEglContext(EGL_NO_CONTEXT),
+    mEglImageCacheHits(0),
+    mEglImageCacheMisses(0),
     mCurrentTexture(BufferQueue::INVALID_BUFFER_SLOT),
     mAttached(true)
 {
@@ -160,6 +162,8 @@ GLConsumer::GLConsumer(const sp<IGraphicBufferConsumer>& bq, uint32_t texTarget,
     mTexTarget(texTarget),
     mEglDisplay(EGL_NO_DISPLAY),
     mEglContext(EGL_NO_CONTEXT),
+    mEglImageCacheHits(0),
+    mEglImageCacheMisses(0),
     mCurrentTexture(BufferQueue::INVALID_BUFFER_SLOT),
     mAttached(false)
 {
@@ -344,7 +348,9 @@ status_t GLConsumer::acquireBufferLocked(BufferQueue::BufferItem *item,
     // replaces any old EglImage with a new one (using the new buffer).
     if (item->mGraphicBuffer != NULL) {
         int slot = item->mBuf;
-        mEglSlots[slot].mEglImage = new EglImage(item->mGraphicBuffer);
+        mEglSlots[slot].mEglImage = getEglImageLocked(item->mGraphicBuffer,
+                item->mCrop);
+        mEglSlots[slot].mEglImageCrop = item->mCrop;
     }
 
     return NO_ERROR;
@@ -389,7 +395,13 @@ status_t GLConsumer::updateAndReleaseLocked(const BufferQueue::BufferItem& item)
     // if nessessary, for the gralloc buffer currently in the slot in
     // ConsumerBase.
     // We may have to do this even when item.mGraphicBuffer == NULL (which
-    // means the buffer was previously acquired).
+    // means the buffer was previously acquired). If the crop rect changed,
+    // an image for the new one may already be cached.
+    if (hasEglAndroidImageCrop() && mEglSlots[buf].mEglImageCrop != item.mCrop) {
+        mEglSlots[buf].mEglImage = getEglImageLocked(mSlots[buf].mGraphicBuffer,
+                item.mCrop);
+        mEglSlots[buf].mEglImageCrop = item.mCrop;
+    }
     err = mEglSlots[buf].mEglImage->createIfNeeded(mEglDisplay, item.mCrop);
     if (err != NO_ERROR) {
         ST_LOGW("updateAndRelease: unable to createImage on display=%p slot=%d",
@@ -990,18 +1002,65 @@ Rect GLConsumer::getCurrentDirtyRect() const {
      return mCurrentDirtyRect;
 }
 
+sp<GLConsumer::EglImage> GLConsumer::getEglImageLocked(
+        const sp<GraphicBuffer>& graphicBuffer, const Rect& crop) {
+    const uint64_t id = graphicBuffer->getId();
+    const Rect key(hasEglAndroidImageCrop() ? crop : Rect());
+    for (size_t i = 0; i < mEglImageCache.size(); i++) {
+        const EglImageCacheEntry& entry(mEglImageCache[i]);
+        if (entry.mBufferId == id && entry.mCrop == key) {
+            // Move the entry to the most recently used end.
+            EglImageCacheEntry hit(entry);
+            mEglImageCache.removeAt(i);
+            mEglImageCache.push(hit);
+            mEglImageCacheHits++;
+            return hit.mEglImage;
+        }
+    }
+
+    mEglImageCacheMisses++;
+    if (mEglImageCache.size() >= MAX_CACHED_EGL_IMAGES) {
+        mEglImageCache.removeAt(0);
+    }
+    EglImageCacheEntry entry;
+    entry.mBufferId = id;
+    entry.mCrop = key;
+    entry.mEglImage = new EglImage(graphicBuffer);
+    mEglImageCache.push(entry);
+    return entry.mEglImage;
+}
+
 void GLConsumer::freeBufferLocked(int slotIndex) {
     ST_LOGV("freeBufferLocked: slotIndex=%d", slotIndex);
     if (slotIndex == mCurrentTexture) {
         mCurrentTexture = BufferQueue::INVALID_BUFFER_SLOT;
     }
+    const sp<GraphicBuffer> buffer(mSlots[slotIndex].mGraphicBuffer);
     mEglSlots[slotIndex].mEglImage.clear();
     ConsumerBase::freeBufferLocked(slotIndex);
+    if (buffer != NULL) {
+        evictEglImagesLocked(buffer->getId());
+    }
+}
+
+void GLConsumer::evictEglImagesLocked(uint64_t bufferId) {
+    for (int i = 0; i < BufferQueue::NUM_BUFFER_SLOTS; i++) {
+        const sp<GraphicBuffer>& buffer(mSlots[i].mGraphicBuffer);
+        if (buffer != NULL && buffer->getId() == bufferId) {
+            return;
+        }
+    }
+    for (size_t i = mEglImageCache.size(); i-- > 0; ) {
+        if (mEglImageCache[i].mBufferId == bufferId) {
+            mEglImageCache.removeAt(i);
+        }
+    }
 }
 
 void GLConsumer::abandonLocked() {
     ST_LOGV("abandonLocked");
     mCurrentTextureImage.clear();
+    mEglImageCache.clear();
     ConsumerBase::abandonLocked();
 }
 
@@ -1035,6 +1094,10 @@ void GLConsumer::dumpLocked(String8& result, const char* prefix) const
        prefix, mTexName, mCurrentTexture, prefix, mCurrentCrop.left,
        mCurrentCrop.top, mCurrentCrop.right, mCurrentCrop.bottom,
        mCurrentTransform);
+    result.appendFormat(
+       "%sEGLImage cache: %zu images, %u hits, %u misses\n",
+       prefix, mEglImageCache.size(), mEglImageCacheHits,
+       mEglImageCacheMisses);
 
     ConsumerBase::dumpLocked(result, prefix);
 }
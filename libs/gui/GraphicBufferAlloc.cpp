@@ -17,9 +17,12 @@
 
 #include <cutils/log.h>
 
+#include <binder/IPCThreadState.h>
+
 #include <ui/GraphicBuffer.h>
 
 #include <gui/GraphicBufferAlloc.h>
+#include <gui/GraphicBufferPool.h>
 
 // ----------------------------------------------------------------------------
 namespace android {
@@ -33,6 +36,16 @@ GraphicBufferAlloc::~GraphicBufferAlloc() {
 
 sp<GraphicBuffer> GraphicBufferAlloc::createGraphicBuffer(uint32_t w, uint32_t h,
         PixelFormat format, uint32_t usage, status_t* error) {
+    // When called by a BufferQueue of this process on behalf of a producer,
+    // the calling uid is the producer's.
+    const uid_t owner = IPCThreadState::self()->getCallingUid();
+    sp<GraphicBuffer> pooled(GraphicBufferPool::getInstance().acquire(w, h,
+            format, usage, owner));
+    if (pooled != NULL) {
+        *error = NO_ERROR;
+        return pooled;
+    }
+
     sp<GraphicBuffer> graphicBuffer(new GraphicBuffer(w, h, format, usage));
     status_t err = graphicBuffer->initCheck();
     *error = err;
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "GraphicBufferPool"
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <cutils/log.h>
+
+#include <ui/Fence.h>
+#include <ui/GraphicBuffer.h>
+
+#include <utils/String8.h>
+#include <utils/Trace.h>
+
+#include <gui/GraphicBufferPool.h>
+
+namespace android {
+// ----------------------------------------------------------------------------
+
+ANDROID_SINGLETON_STATIC_INSTANCE( GraphicBufferPool )
+
+const nsecs_t GraphicBufferPool::MAX_AGE;
+
+class GraphicBufferPool::TrimThread : public Thread {
+public:
+    TrimThread(GraphicBufferPool* pool) :
+        Thread(false), mPool(pool) {}
+
+private:
+    virtual bool threadLoop() {
+        mPool->trimLoop();
+        return true;
+    }
+
+    // The pool is a singleton that is never destroyed.
+    GraphicBufferPool* mPool;
+};
+
+GraphicBufferPool::GraphicBufferPool() :
+    mPooledBytes(0),
+    mNumHits(0),
+    mNumMisses(0),
+    mNumRecycled(0),
+    mNumDropped(0) {
+}
+
+sp<GraphicBuffer> GraphicBufferPool::acquire(uint32_t w, uint32_t h,
+        PixelFormat format, uint32_t usage, uid_t owner) {
+    Mutex::Autolock lock(mMutex);
+    trimLocked(systemTime());
+
+    // Take the most recently pooled match; older ones are dropped first.
+    for (size_t i = mEntries.size(); i-- > 0; ) {
+        const Entry& entry(mEntries[i]);
+        const sp<GraphicBuffer>& buffer(entry.buffer);
+        if (entry.owner != owner || buffer->getWidth() != w ||
+                buffer->getHeight() != h ||
+                buffer->getPixelFormat() != format ||
+                buffer->getUsage() != usage) {
+            continue;
+        }
+        // The consumer may not have let go of the buffer yet, e.g. while it
+        // is still on screen.
+        if (buffer->getStrongCount() > 1 ||
+                entry.releaseFence->getSignalTime() == INT64_MAX) {
+            continue;
+        }
+        sp<GraphicBuffer> result(buffer);
+        removeLocked(i);
+        mNumHits++;
+        ATRACE_INT("GraphicBufferPool", int32_t(mPooledBytes / 1024));
+        return result;
+    }
+    mNumMisses++;
+    return NULL;
+}
+
+void GraphicBufferPool::recycle(const sp<GraphicBuffer>& buffer,
+        const sp<Fence>& releaseFence, uid_t owner) {
+    if (buffer == NULL || (buffer->getUsage() & GRALLOC_USAGE_PROTECTED)) {
+        return;
+    }
+    const ssize_t bpp = bytesPerPixel(buffer->getPixelFormat());
+    if (bpp <= 0) {
+        return;
+    }
+    const size_t size = size_t(buffer->getStride()) * buffer->getHeight() *
+            size_t(bpp);
+    if (size > MAX_BYTES) {
+        return;
+    }
+
+    Mutex::Autolock lock(mMutex);
+    const nsecs_t now = systemTime();
+    trimLocked(now);
+    while (mPooledBytes + size > MAX_BYTES) {
+        removeLocked(0);
+        mNumDropped++;
+    }
+    Entry entry;
+    entry.buffer = buffer;
+    entry.releaseFence = releaseFence != NULL ? releaseFence : Fence::NO_FENCE;
+    entry.owner = owner;
+    entry.size = size;
+    entry.recycleTime = now;
+    mEntries.add(entry);
+    mPooledBytes += size;
+    mNumRecycled++;
+    ATRACE_INT("GraphicBufferPool", int32_t(mPooledBytes / 1024));
+
+    if (mTrimThread == NULL) {
+        mTrimThread = new TrimThread(this);
+        status_t err = mTrimThread->run("GraphicBufferPool",
+                PRIORITY_BACKGROUND);
+        if (err != NO_ERROR) {
+            ALOGE("recycle: failed to start the trim thread: %s (%d)",
+                    strerror(-err), err);
+        }
+    } else if (mEntries.size() == 1) {
+        mTrimCondition.signal();
+    }
+}
+
+void GraphicBufferPool::trim() {
+    Mutex::Autolock lock(mMutex);
+    trimLocked(systemTime());
+}
+
+void GraphicBufferPool::trimLoop() {
+    Mutex::Autolock lock(mMutex);
+    if (mEntries.isEmpty()) {
+        mTrimCondition.wait(mMutex);
+    } else {
+        const nsecs_t timeout = mEntries[0].recycleTime + MAX_AGE -
+                systemTime();
+        if (timeout > 0) {
+            mTrimCondition.waitRelative(mMutex, timeout);
+        }
+    }
+    trimLocked(systemTime());
+}
+
+void GraphicBufferPool::trimLocked(nsecs_t now) {
+    const size_t count = mEntries.size();
+    while (!mEntries.isEmpty() && now - mEntries[0].recycleTime >= MAX_AGE) {
+        removeLocked(0);
+        mNumDropped++;
+    }
+    if (mEntries.size() != count) {
+        ATRACE_INT("GraphicBufferPool", int32_t(mPooledBytes / 1024));
+    }
+}
+
+void GraphicBufferPool::removeLocked(size_t index) {
+    mPooledBytes -= mEntries[index].size;
+    mEntries.removeAt(index);
+}
+
+void GraphicBufferPool::dump(String8& result) const {
+    Mutex::Autolock lock(mMutex);
+    const uint64_t requests = mNumHits + mNumMisses;
+    result.appendFormat("GraphicBufferPool: %zu buffers, %.2f KiB pooled "
+            "(max %.2f KiB)\n", mEntries.size(), mPooledBytes / 1024.0f,
+            MAX_BYTES / 1024.0f);
+    result.appendFormat("  %" PRIu64 " hits, %" PRIu64 " misses (hit rate "
+            "%.1f%%), %" PRIu64 " recycled, %" PRIu64 " dropped\n",
+            mNumHits, mNumMisses,
+            requests ? 100.0 * mNumHits / requests : 0.0,
+            mNumRecycled, mNumDropped);
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
@@ -23,6 +23,7 @@
 
 #include <binder/Parcel.h>
 #include <binder/IInterface.h>
+#include <binder/IMemory.h>
 
 #include <gui/IDisplayEventConnection.h>
 #include <gui/BitTube.h>
@@ -33,7 +34,8 @@ namespace android {
 enum {
     GET_DATA_CHANNEL = IBinder::FIRST_CALL_TRANSACTION,
     SET_VSYNC_RATE,
-    REQUEST_NEXT_VSYNC
+    REQUEST_NEXT_VSYNC,
+    GET_VSYNC_TIMING
 };
 
 class BpDisplayEventConnection : public BpInterface<IDisplayEventConnection>
@@ -64,6 +66,20 @@ public:
         data.writeInterfaceToken(IDisplayEventConnection::getInterfaceDescriptor());
         remote()->transact(REQUEST_NEXT_VSYNC, data, &reply, IBinder::FLAG_ONEWAY);
     }
+
+    virtual status_t getVsyncTiming(sp<IMemoryHeap>* outHeap) const {
+        Parcel data, reply;
+        data.writeInterfaceToken(IDisplayEventConnection::getInterfaceDescriptor());
+        status_t err = remote()->transact(GET_VSYNC_TIMING, data, &reply);
+        if (err != NO_ERROR) {
+            return err;
+        }
+        status_t result = reply.readInt32();
+        if (result == NO_ERROR) {
+            *outHeap = interface_cast<IMemoryHeap>(reply.readStrongBinder());
+        }
+        return result;
+    }
 };
 
 IMPLEMENT_META_INTERFACE(DisplayEventConnection, "android.gui.DisplayEventConnection");
@@ -90,6 +106,16 @@ status_t BnDisplayEventConnection::onTransact(
             requestNextVsync();
             return NO_ERROR;
         } break;
+        case GET_VSYNC_TIMING: {
+            CHECK_INTERFACE(IDisplayEventConnection, data, reply);
+            sp<IMemoryHeap> heap;
+            status_t result = getVsyncTiming(&heap);
+            reply->writeInt32(result);
+            if (result == NO_ERROR) {
+                reply->writeStrongBinder(heap->asBinder());
+            }
+            return NO_ERROR;
+        } break;
     }
     return BBinder::onTransact(code, data, reply, flags);
 }
@@ -23,9 +23,12 @@
 #include <binder/Parcel.h>
 #include <binder/IInterface.h>
 
+#include <gui/BufferQueueStatistics.h>
 #include <gui/IConsumerListener.h>
 #include <gui/IGraphicBufferConsumer.h>
 
+#include <private/gui/BufferIdCache.h>
+
 #include <ui/GraphicBuffer.h>
 #include <ui/Fence.h>
 
@@ -204,6 +207,7 @@ enum {
     SET_TRANSFORM_HINT,
     GET_SIDEBAND_STREAM,
     DUMP,
+    GET_STATISTICS,
 };
 
 
@@ -219,6 +223,8 @@ public:
         Parcel data, reply;
         data.writeInterfaceToken(IGraphicBufferConsumer::getInterfaceDescriptor());
         data.writeInt64(presentWhen);
+        BufferIdCache::Snapshot snapshot;
+        mBufferCache.writeIds(&data, &snapshot);
         status_t result = remote()->transact(ACQUIRE_BUFFER, data, &reply);
         if (result != NO_ERROR) {
             return result;
@@ -227,6 +233,11 @@ public:
         if (result != NO_ERROR) {
             return result;
         }
+        result = mBufferCache.readBuffer(reply, snapshot, buffer->mBuf,
+                &buffer->mGraphicBuffer);
+        if (result != NO_ERROR) {
+            return result;
+        }
         return reply.readInt32();
     }
 
@@ -239,6 +250,9 @@ public:
             return result;
         }
         result = reply.readInt32();
+        if (result == NO_ERROR) {
+            mBufferCache.freeSlot(slot);
+        }
         return result;
     }
 
@@ -289,7 +303,11 @@ public:
         if (result != NO_ERROR) {
             return result;
         }
-        return reply.readInt32();
+        result = reply.readInt32();
+        if (result == NO_ERROR) {
+            mBufferCache.clear();
+        }
+        return result;
     }
 
     virtual status_t getReleasedBuffers(uint64_t* slotMask) {
@@ -304,7 +322,18 @@ public:
             return result;
         }
         *slotMask = reply.readInt64();
-        return reply.readInt32();
+        result = reply.readInt32();
+        if (result == NO_ERROR && *slotMask == ~0ULL) {
+            // The buffer queue has freed all of its buffers.
+            mBufferCache.clear();
+        } else if (result == NO_ERROR) {
+            for (int i = 0; i < BufferQueueDefs::NUM_BUFFER_SLOTS; i++) {
+                if (*slotMask & (1ULL << i)) {
+                    mBufferCache.freeSlot(i);
+                }
+            }
+        }
+        return result;
     }
 
     virtual status_t setDefaultBufferSize(uint32_t w, uint32_t h) {
@@ -405,6 +434,20 @@ public:
         return stream;
     }
 
+    virtual status_t getStatistics(BufferQueueStatistics* outStatistics) const {
+        Parcel data, reply;
+        data.writeInterfaceToken(IGraphicBufferConsumer::getInterfaceDescriptor());
+        status_t result = remote()->transact(GET_STATISTICS, data, &reply);
+        if (result != NO_ERROR) {
+            return result;
+        }
+        result = reply.readInt32();
+        if (result == NO_ERROR) {
+            result = reply.read(*outStatistics);
+        }
+        return result;
+    }
+
     virtual void dump(String8& result, const char* prefix) const {
         Parcel data, reply;
         data.writeInterfaceToken(IGraphicBufferConsumer::getInterfaceDescriptor());
@@ -413,6 +456,9 @@ public:
         remote()->transact(DUMP, data, &reply);
         reply.readString8();
     }
+
+private:
+    BufferIdCache mBufferCache;
 };
 
 IMPLEMENT_META_INTERFACE(GraphicBufferConsumer, "android.gui.IGraphicBufferConsumer");
@@ -427,8 +473,16 @@ status_t BnGraphicBufferConsumer::onTransact(
             CHECK_INTERFACE(IGraphicBufferConsumer, data, reply);
             BufferItem item;
             int64_t presentWhen = data.readInt64();
+            Vector<uint64_t> cachedIds;
+            status_t err = BufferIdCache::readIds(data, &cachedIds);
+            if (err) return err;
             status_t result = acquireBuffer(&item, presentWhen);
-            status_t err = reply->write(item);
+            // The buffer is sent separately, so that it can be sent by id.
+            sp<GraphicBuffer> graphicBuffer = item.mGraphicBuffer;
+            item.mGraphicBuffer.clear();
+            err = reply->write(item);
+            if (err) return err;
+            err = BufferIdCache::writeBuffer(reply, graphicBuffer, cachedIds);
             if (err) return err;
             reply->writeInt32(result);
             return NO_ERROR;
@@ -546,6 +600,16 @@ status_t BnGraphicBufferConsumer::onTransact(
             reply->writeString8(result);
             return NO_ERROR;
         }
+        case GET_STATISTICS: {
+            CHECK_INTERFACE(IGraphicBufferConsumer, data, reply);
+            BufferQueueStatistics statistics;
+            status_t result = getStatistics(&statistics);
+            reply->writeInt32(result);
+            if (result == NO_ERROR) {
+                reply->write(statistics);
+            }
+            return NO_ERROR;
+        }
     }
     return BBinder::onTransact(code, data, reply, flags);
 }
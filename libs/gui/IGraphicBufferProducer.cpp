@@ -29,6 +29,8 @@
 #include <gui/IGraphicBufferProducer.h>
 #include <gui/IProducerListener.h>
 
+#include <private/gui/BufferIdCache.h>
+
 namespace android {
 // ----------------------------------------------------------------------------
 
@@ -46,6 +48,7 @@ enum {
     DISCONNECT,
     SET_SIDEBAND_STREAM,
     ALLOCATE_BUFFERS,
+    QUEUE_AND_DEQUEUE_BUFFER,
 };
 
 class BpGraphicBufferProducer : public BpInterface<IGraphicBufferProducer>
@@ -60,18 +63,15 @@ public:
         Parcel data, reply;
         data.writeInterfaceToken(IGraphicBufferProducer::getInterfaceDescriptor());
         data.writeInt32(bufferIdx);
+        BufferIdCache::Snapshot snapshot;
+        mBufferCache.writeIds(&data, &snapshot);
         status_t result =remote()->transact(REQUEST_BUFFER, data, &reply);
         if (result != NO_ERROR) {
             return result;
         }
-        bool nonNull = reply.readInt32();
-        if (nonNull) {
-            *buf = new GraphicBuffer();
-            result = reply.read(**buf);
-            if(result != NO_ERROR) {
-                (*buf).clear();
-                return result;
-            }
+        result = mBufferCache.readBuffer(reply, snapshot, bufferIdx, buf);
+        if (result != NO_ERROR) {
+            return result;
         }
         result = reply.readInt32();
         return result;
@@ -110,6 +110,9 @@ public:
             reply.read(**fence);
         }
         result = reply.readInt32();
+        if (result >= 0 && (result & RELEASE_ALL_BUFFERS)) {
+            mBufferCache.clear();
+        }
         return result;
     }
 
@@ -122,6 +125,9 @@ public:
             return result;
         }
         result = reply.readInt32();
+        if (result == NO_ERROR) {
+            mBufferCache.freeSlot(slot);
+        }
         return result;
     }
 
@@ -235,6 +241,9 @@ public:
             return result;
         }
         result = reply.readInt32();
+        if (result == NO_ERROR) {
+            mBufferCache.clear();
+        }
         return result;
     }
 
@@ -268,6 +277,56 @@ public:
             ALOGE("allocateBuffers failed to transact: %d", result);
         }
     }
+
+    virtual status_t queueAndDequeueBuffer(int buf,
+            const QueueBufferInput& input, QueueBufferOutput* output,
+            int* outSlot, sp<Fence>* outFence, sp<GraphicBuffer>* outBuffer,
+            status_t* outDequeueResult, bool async, uint32_t width,
+            uint32_t height, uint32_t format, uint32_t usage) {
+        Parcel data, reply;
+        data.writeInterfaceToken(IGraphicBufferProducer::getInterfaceDescriptor());
+        data.writeInt32(buf);
+        data.write(input);
+        data.writeInt32(async);
+        data.writeInt32(width);
+        data.writeInt32(height);
+        data.writeInt32(format);
+        data.writeInt32(usage);
+        BufferIdCache::Snapshot snapshot;
+        mBufferCache.writeIds(&data, &snapshot);
+        status_t result = remote()->transact(QUEUE_AND_DEQUEUE_BUFFER, data,
+                &reply);
+        if (result == UNKNOWN_TRANSACTION) {
+            // The producer doesn't know this transaction, so just queue
+            return IGraphicBufferProducer::queueAndDequeueBuffer(buf, input,
+                    output, outSlot, outFence, outBuffer, outDequeueResult,
+                    async, width, height, format, usage);
+        } else if (result != NO_ERROR) {
+            return result;
+        }
+        memcpy(output, reply.readInplace(sizeof(*output)), sizeof(*output));
+        result = reply.readInt32();
+        if (result != NO_ERROR) {
+            return result;
+        }
+        *outDequeueResult = reply.readInt32();
+        if (*outDequeueResult >= 0) {
+            if (*outDequeueResult & RELEASE_ALL_BUFFERS) {
+                mBufferCache.clear();
+            }
+            *outSlot = reply.readInt32();
+            if (reply.readInt32()) {
+                *outFence = new Fence;
+                reply.read(**outFence);
+            }
+            result = mBufferCache.readBuffer(reply, snapshot, *outSlot,
+                    outBuffer);
+        }
+        return result;
+    }
+
+private:
+    BufferIdCache mBufferCache;
 };
 
 IMPLEMENT_META_INTERFACE(GraphicBufferProducer, "android.gui.IGraphicBufferProducer");
@@ -281,11 +340,16 @@ status_t BnGraphicBufferProducer::onTransact(
         case REQUEST_BUFFER: {
             CHECK_INTERFACE(IGraphicBufferProducer, data, reply);
             int bufferIdx   = data.readInt32();
+            Vector<uint64_t> cachedIds;
+            status_t err = BufferIdCache::readIds(data, &cachedIds);
+            if (err != NO_ERROR) {
+                return err;
+            }
             sp<GraphicBuffer> buffer;
             int result = requestBuffer(bufferIdx, &buffer);
-            reply->writeInt32(buffer != 0);
-            if (buffer != 0) {
-                reply->write(*buffer);
+            err = BufferIdCache::writeBuffer(reply, buffer, cachedIds);
+            if (err != NO_ERROR) {
+                return err;
             }
             reply->writeInt32(result);
             return NO_ERROR;
@@ -410,7 +474,7 @@ status_t BnGraphicBufferProducer::onTransact(
             reply->writeInt32(result);
             return NO_ERROR;
         } break;
-        case ALLOCATE_BUFFERS:
+        case ALLOCATE_BUFFERS: {
             CHECK_INTERFACE(IGraphicBufferProducer, data, reply);
             bool async = static_cast<bool>(data.readInt32());
             uint32_t width = static_cast<uint32_t>(data.readInt32());
@@ -419,12 +483,66 @@ status_t BnGraphicBufferProducer::onTransact(
             uint32_t usage = static_cast<uint32_t>(data.readInt32());
             allocateBuffers(async, width, height, format, usage);
             return NO_ERROR;
+        }
+        case QUEUE_AND_DEQUEUE_BUFFER: {
+            CHECK_INTERFACE(IGraphicBufferProducer, data, reply);
+            int buf = data.readInt32();
+            QueueBufferInput input(data);
+            bool async      = data.readInt32();
+            uint32_t w      = data.readInt32();
+            uint32_t h      = data.readInt32();
+            uint32_t format = data.readInt32();
+            uint32_t usage  = data.readInt32();
+            Vector<uint64_t> cachedIds;
+            status_t err = BufferIdCache::readIds(data, &cachedIds);
+            if (err != NO_ERROR) {
+                return err;
+            }
+            QueueBufferOutput* const output =
+                    reinterpret_cast<QueueBufferOutput *>(
+                            reply->writeInplace(sizeof(QueueBufferOutput)));
+            int slot = 0;
+            sp<Fence> fence;
+            sp<GraphicBuffer> buffer;
+            status_t dequeueResult = WOULD_BLOCK;
+            status_t result = queueAndDequeueBuffer(buf, input, output, &slot,
+                    &fence, &buffer, &dequeueResult, async, w, h, format,
+                    usage);
+            reply->writeInt32(result);
+            if (result == NO_ERROR) {
+                reply->writeInt32(dequeueResult);
+                if (dequeueResult >= 0) {
+                    reply->writeInt32(slot);
+                    reply->writeInt32(fence != NULL);
+                    if (fence != NULL) {
+                        reply->write(*fence);
+                    }
+                    err = BufferIdCache::writeBuffer(reply, buffer, cachedIds);
+                    if (err != NO_ERROR) {
+                        return err;
+                    }
+                }
+            }
+            return NO_ERROR;
+        }
     }
     return BBinder::onTransact(code, data, reply, flags);
 }
 
 // ----------------------------------------------------------------------------
 
+status_t IGraphicBufferProducer::queueAndDequeueBuffer(int buf,
+        const QueueBufferInput& input, QueueBufferOutput* output,
+        int* /* outSlot */, sp<Fence>* /* outFence */,
+        sp<GraphicBuffer>* /* outBuffer */, status_t* outDequeueResult,
+        bool /* async */, uint32_t /* width */, uint32_t /* height */,
+        uint32_t /* format */, uint32_t /* usage */) {
+    *outDequeueResult = WOULD_BLOCK;
+    return queueBuffer(buf, input, output);
+}
+
+// ----------------------------------------------------------------------------
+
 IGraphicBufferProducer::QueueBufferInput::QueueBufferInput(const Parcel& parcel) {
     parcel.read(*this);
 }
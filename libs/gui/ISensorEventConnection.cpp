@@ -26,6 +26,7 @@
 
 #include <gui/ISensorEventConnection.h>
 #include <gui/BitTube.h>
+#include <gui/SensorEventRing.h>
 
 namespace android {
 // ----------------------------------------------------------------------------
@@ -34,7 +35,8 @@ enum {
     GET_SENSOR_CHANNEL = IBinder::FIRST_CALL_TRANSACTION,
     ENABLE_DISABLE,
     SET_EVENT_RATE,
-    FLUSH_SENSOR
+    FLUSH_SENSOR,
+    GET_SENSOR_EVENT_RING
 };
 
 class BpSensorEventConnection : public BpInterface<ISensorEventConnection>
@@ -83,6 +85,21 @@ public:
         remote()->transact(FLUSH_SENSOR, data, &reply);
         return reply.readInt32();
     }
+
+    virtual sp<SensorEventRing> getSensorEventRing(size_t capacity,
+            nsecs_t doorbellLatencyNs)
+    {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISensorEventConnection::getInterfaceDescriptor());
+        data.writeInt32(capacity);
+        data.writeInt64(doorbellLatencyNs);
+        status_t err = remote()->transact(GET_SENSOR_EVENT_RING, data, &reply);
+        if (err != NO_ERROR || reply.readInt32() != NO_ERROR) {
+            return NULL;
+        }
+        sp<SensorEventRing> ring(new SensorEventRing(reply));
+        return ring->initCheck() == NO_ERROR ? ring : NULL;
+    }
 };
 
 IMPLEMENT_META_INTERFACE(SensorEventConnection, "android.gui.SensorEventConnection");
@@ -125,6 +142,19 @@ status_t BnSensorEventConnection::onTransact(
             reply->writeInt32(result);
             return NO_ERROR;
         } break;
+        case GET_SENSOR_EVENT_RING: {
+            CHECK_INTERFACE(ISensorEventConnection, data, reply);
+            size_t capacity = data.readInt32();
+            nsecs_t doorbellLatencyNs = data.readInt64();
+            sp<SensorEventRing> ring(getSensorEventRing(capacity, doorbellLatencyNs));
+            if (ring == NULL) {
+                reply->writeInt32(NO_INIT);
+                return NO_ERROR;
+            }
+            reply->writeInt32(NO_ERROR);
+            ring->writeToParcel(reply);
+            return NO_ERROR;
+        } break;
     }
     return BBinder::onTransact(code, data, reply, flags);
 }
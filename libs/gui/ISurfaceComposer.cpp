@@ -287,6 +287,21 @@ public:
         reply.read(*outStats);
         return reply.readInt32();
     }
+
+    virtual status_t getFrameTimeline(sp<IMemoryHeap>* outHeap) {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISurfaceComposer::getInterfaceDescriptor());
+        status_t err = remote()->transact(BnSurfaceComposer::GET_FRAME_TIMELINE,
+                data, &reply);
+        if (err != NO_ERROR) {
+            return err;
+        }
+        status_t result = reply.readInt32();
+        if (result == NO_ERROR) {
+            *outHeap = interface_cast<IMemoryHeap>(reply.readStrongBinder());
+        }
+        return result;
+    }
 };
 
 IMPLEMENT_META_INTERFACE(SurfaceComposer, "android.ui.ISurfaceComposer");
@@ -465,6 +480,16 @@ status_t BnSurfaceComposer::onTransact(
             setPowerMode(display, mode);
             return NO_ERROR;
         }
+        case GET_FRAME_TIMELINE: {
+            CHECK_INTERFACE(ISurfaceComposer, data, reply);
+            sp<IMemoryHeap> heap;
+            status_t result = getFrameTimeline(&heap);
+            reply->writeInt32(result);
+            if (result == NO_ERROR) {
+                reply->writeStrongBinder(heap->asBinder());
+            }
+            return NO_ERROR;
+        }
         default: {
             return BBinder::onTransact(code, data, reply, flags);
         }
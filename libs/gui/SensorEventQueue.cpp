@@ -27,6 +27,7 @@
 #include <gui/Sensor.h>
 #include <gui/BitTube.h>
 #include <gui/SensorEventQueue.h>
+#include <gui/SensorEventRing.h>
 #include <gui/ISensorEventConnection.h>
 
 #include <android/sensor.h>
@@ -37,7 +38,7 @@ namespace android {
 
 SensorEventQueue::SensorEventQueue(const sp<ISensorEventConnection>& connection)
     : mSensorEventConnection(connection), mRecBuffer(NULL), mAvailable(0), mConsumed(0),
-      mNumAcksToSend(0) {
+      mNumAcksToSend(0), mSensorChannelDrained(false) {
     mRecBuffer = new ASensorEvent[MAX_RECEIVE_BUFFER_EVENT_COUNT];
 }
 
@@ -52,7 +53,7 @@ void SensorEventQueue::onFirstRef()
 
 int SensorEventQueue::getFd() const
 {
-    return mSensorChannel->getFd();
+    return mEventRing != 0 ? mEventRing->getFd() : mSensorChannel->getFd();
 }
 
 
@@ -62,6 +63,19 @@ ssize_t SensorEventQueue::write(const sp<BitTube>& tube,
 }
 
 ssize_t SensorEventQueue::read(ASensorEvent* events, size_t numEvents) {
+    if (mEventRing != 0) {
+        ASensorEvent const* available;
+        ssize_t count = peekEvents(&available);
+        if (count <= 0) {
+            return count;
+        }
+        if (size_t(count) > numEvents) {
+            count = numEvents;
+        }
+        memcpy(events, available, count*sizeof(ASensorEvent));
+        consumeEvents(count);
+        return count;
+    }
     if (mAvailable == 0) {
         ssize_t err = BitTube::recvObjects(mSensorChannel,
                 mRecBuffer, MAX_RECEIVE_BUFFER_EVENT_COUNT);
@@ -78,6 +92,55 @@ ssize_t SensorEventQueue::read(ASensorEvent* events, size_t numEvents) {
     return count;
 }
 
+status_t SensorEventQueue::useEventRing(size_t capacity, nsecs_t doorbellLatencyNs) {
+    sp<SensorEventRing> ring(mSensorEventConnection->getSensorEventRing(capacity,
+            doorbellLatencyNs));
+    if (ring == 0) {
+        return NO_INIT;
+    }
+    Mutex::Autolock _l(mLock);
+    if (mLooper != 0) {
+        mLooper->removeFd(getFd());
+        mLooper->addFd(ring->getFd(), ring->getFd(), ALOOPER_EVENT_INPUT, NULL, NULL);
+    }
+    mEventRing = ring;
+    return NO_ERROR;
+}
+
+ssize_t SensorEventQueue::peekEvents(ASensorEvent const** events) {
+    if (mEventRing == 0) {
+        return INVALID_OPERATION;
+    }
+    // Events that were written to the BitTube before the switch come first. SensorService
+    // does not write to it after the switch, so once it is empty it need not be read again.
+    if (mAvailable == 0 && !mSensorChannelDrained) {
+        ssize_t err = BitTube::recvObjects(mSensorChannel,
+                mRecBuffer, MAX_RECEIVE_BUFFER_EVENT_COUNT);
+        if (err > 0) {
+            mAvailable = err;
+            mConsumed = 0;
+        } else {
+            mSensorChannelDrained = true;
+        }
+    }
+    if (mAvailable > 0) {
+        *events = mRecBuffer + mConsumed;
+        return mAvailable;
+    }
+    mEventRing->clearDoorbell();
+    return mEventRing->peek(events);
+}
+
+void SensorEventQueue::consumeEvents(size_t count) {
+    if (mAvailable > 0) {
+        count = count < mAvailable ? count : mAvailable;
+        mAvailable -= count;
+        mConsumed += count;
+    } else if (mEventRing != 0) {
+        mEventRing->consume(count);
+    }
+}
+
 sp<Looper> SensorEventQueue::getLooper() const
 {
     Mutex::Autolock _l(mLock);
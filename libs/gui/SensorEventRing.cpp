@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SensorEventRing"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+
+#include <binder/IMemory.h>
+#include <binder/MemoryHeapBase.h>
+#include <binder/Parcel.h>
+
+#include <cutils/atomic.h>
+
+#include <hardware/sensors.h>
+
+#include <gui/SensorEventQueue.h>
+#include <gui/SensorEventRing.h>
+
+#include <utils/Log.h>
+
+#include <android/sensor.h>
+
+namespace android {
+// ----------------------------------------------------------------------------
+
+// writeCount and readCount are free-running, so the capacity has to be a
+// power of two for them to stay in step with the ring across a wrap.
+
+static inline size_t heapSize(uint32_t capacity) {
+    return sizeof(SensorEventRingHeader) +
+            size_t(capacity) * sizeof(ASensorEvent);
+}
+
+SensorEventRing::SensorEventRing(size_t capacity, nsecs_t doorbellLatencyNs)
+    : mHeader(NULL), mEvents(NULL), mCapacity(0), mDoorbellFd(-1),
+      mWriteCount(0),
+      mDoorbellLatency(doorbellLatencyNs > 0 ? doorbellLatencyNs : 0),
+      mLastDoorbellTime(-mDoorbellLatency), mDoorbellPending(false)
+{
+    uint32_t cap = MIN_CAPACITY;
+    while (cap < capacity && cap < MAX_CAPACITY) {
+        cap <<= 1;
+    }
+    sp<MemoryHeapBase> heap = new MemoryHeapBase(heapSize(cap), 0,
+            "SensorEventRing");
+    if (heap->getHeapID() < 0 || heap->getBase() == MAP_FAILED) {
+        ALOGE("could not allocate a sensor event ring of %u events", cap);
+        return;
+    }
+    mDoorbellFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (mDoorbellFd < 0) {
+        ALOGE("could not create the doorbell of a sensor event ring (%s)",
+                strerror(errno));
+        return;
+    }
+    mHeap = heap;
+    mHeader = static_cast<SensorEventRingHeader*>(heap->getBase());
+    mEvents = reinterpret_cast<ASensorEvent*>(mHeader + 1);
+    mCapacity = cap;
+    memset(mHeader, 0, heapSize(cap));
+    mHeader->magic = SensorEventRingHeader::MAGIC;
+    mHeader->version = SensorEventRingHeader::VERSION;
+    mHeader->eventSize = sizeof(ASensorEvent);
+    mHeader->capacity = cap;
+}
+
+SensorEventRing::SensorEventRing(const Parcel& data)
+    : mHeader(NULL), mEvents(NULL), mCapacity(0), mDoorbellFd(-1),
+      mWriteCount(0), mDoorbellLatency(0), mLastDoorbellTime(0),
+      mDoorbellPending(false)
+{
+    sp<IMemoryHeap> heap = interface_cast<IMemoryHeap>(data.readStrongBinder());
+    int fd = data.readFileDescriptor();
+    if (heap == NULL || heap->getHeapID() < 0 ||
+            heap->getBase() == MAP_FAILED ||
+            heap->getSize() < sizeof(SensorEventRingHeader) || fd < 0) {
+        ALOGE("SensorEventRing(Parcel): bad heap or doorbell");
+        return;
+    }
+    SensorEventRingHeader* header =
+            static_cast<SensorEventRingHeader*>(heap->getBase());
+    const uint32_t cap = header->capacity;
+    if (header->magic != SensorEventRingHeader::MAGIC ||
+            header->version != SensorEventRingHeader::VERSION ||
+            header->eventSize != sizeof(ASensorEvent) ||
+            cap < MIN_CAPACITY || cap > MAX_CAPACITY || (cap & (cap - 1)) ||
+            heap->getSize() < heapSize(cap)) {
+        ALOGE("SensorEventRing(Parcel): not a sensor event ring heap");
+        return;
+    }
+    mDoorbellFd = dup(fd);
+    if (mDoorbellFd < 0) {
+        ALOGE("SensorEventRing(Parcel): can't dup filedescriptor (%s)",
+                strerror(errno));
+        return;
+    }
+    mHeap = heap;
+    mHeader = header;
+    mEvents = reinterpret_cast<ASensorEvent*>(header + 1);
+    mCapacity = cap;
+}
+
+SensorEventRing::~SensorEventRing()
+{
+    if (mDoorbellFd >= 0) {
+        close(mDoorbellFd);
+    }
+}
+
+status_t SensorEventRing::initCheck() const
+{
+    return mHeader ? NO_ERROR : NO_INIT;
+}
+
+int SensorEventRing::getFd() const
+{
+    return mDoorbellFd;
+}
+
+status_t SensorEventRing::writeToParcel(Parcel* reply) const
+{
+    if (!mHeader) {
+        return NO_INIT;
+    }
+    status_t result = reply->writeStrongBinder(mHeap->asBinder());
+    if (result == NO_ERROR) {
+        result = reply->writeDupFileDescriptor(mDoorbellFd);
+    }
+    return result;
+}
+
+ssize_t SensorEventRing::write(ASensorEvent const* events, size_t numEvents)
+{
+    if (!mHeader) {
+        return NO_INIT;
+    }
+    const uint32_t readCount =
+            uint32_t(android_atomic_acquire_load(&mHeader->readCount));
+    const uint32_t used = mWriteCount - readCount;
+    // A reader can only have consumed what was written; if it claims
+    // otherwise, treat the ring as full rather than overwrite events.
+    if (used > mCapacity || numEvents > mCapacity - used) {
+        return -EAGAIN;
+    }
+
+    const uint32_t start = mWriteCount & (mCapacity - 1);
+    const size_t first = numEvents < mCapacity - start ?
+            numEvents : mCapacity - start;
+    memcpy(mEvents + start, events, first * sizeof(ASensorEvent));
+    memcpy(mEvents, events + first, (numEvents - first) * sizeof(ASensorEvent));
+    mWriteCount += numEvents;
+    android_atomic_release_store(int32_t(mWriteCount), &mHeader->writeCount);
+    mDoorbellPending = true;
+
+    bool urgent = used + numEvents >= mCapacity / 2;
+    for (size_t i = 0; i < numEvents && !urgent; i++) {
+        urgent = events[i].type == SENSOR_TYPE_META_DATA ||
+                (events[i].flags & WAKE_UP_SENSOR_EVENT_NEEDS_ACK);
+    }
+    if (urgent || systemTime() - mLastDoorbellTime >= mDoorbellLatency) {
+        ringDoorbell();
+    }
+    return numEvents;
+}
+
+void SensorEventRing::ringDoorbell()
+{
+    if (!mDoorbellPending) {
+        return;
+    }
+    const uint64_t one = 1;
+    if (::write(mDoorbellFd, &one, sizeof(one)) != sizeof(one)) {
+        ALOGE("SensorEventRing::ringDoorbell error (%s)", strerror(errno));
+    }
+    mLastDoorbellTime = systemTime();
+    mDoorbellPending = false;
+}
+
+nsecs_t SensorEventRing::getPendingDoorbellTime() const
+{
+    return mDoorbellPending ? mLastDoorbellTime + mDoorbellLatency : -1;
+}
+
+ssize_t SensorEventRing::peek(ASensorEvent const** events)
+{
+    if (!mHeader) {
+        return NO_INIT;
+    }
+    const uint32_t readCount = uint32_t(mHeader->readCount);
+    const uint32_t available =
+            uint32_t(android_atomic_acquire_load(&mHeader->writeCount)) -
+            readCount;
+    if (available == 0 || available > mCapacity) {
+        return 0;
+    }
+    const uint32_t start = readCount & (mCapacity - 1);
+    *events = mEvents + start;
+    return available < mCapacity - start ? available : mCapacity - start;
+}
+
+void SensorEventRing::consume(size_t numEvents)
+{
+    if (!mHeader) {
+        return;
+    }
+    const int32_t readCount = int32_t(uint32_t(mHeader->readCount) + numEvents);
+    android_atomic_release_store(readCount, &mHeader->readCount);
+}
+
+ssize_t SensorEventRing::read(ASensorEvent* events, size_t numEvents)
+{
+    size_t count = 0;
+    while (count < numEvents) {
+        ASensorEvent const* available;
+        ssize_t n = peek(&available);
+        if (n <= 0) {
+            return count ? ssize_t(count) : n;
+        }
+        if (size_t(n) > numEvents - count) {
+            n = numEvents - count;
+        }
+        memcpy(events + count, available, n * sizeof(ASensorEvent));
+        consume(n);
+        count += n;
+    }
+    return count;
+}
+
+void SensorEventRing::clearDoorbell()
+{
+    uint64_t value;
+    ::read(mDoorbellFd, &value, sizeof(value));
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
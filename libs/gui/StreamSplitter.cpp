@@ -28,6 +28,7 @@
 
 #include <binder/ProcessState.h>
 
+#include <utils/String8.h>
 #include <utils/Trace.h>
 
 namespace android {
@@ -55,13 +56,14 @@ status_t StreamSplitter::createSplitter(
 
 StreamSplitter::StreamSplitter(const sp<IGraphicBufferConsumer>& inputQueue)
       : mIsAbandoned(false), mMutex(), mReleaseCondition(),
-        mOutstandingBuffers(0), mInput(inputQueue), mOutputs(), mBuffers() {}
+        mOutstandingBuffers(0), mInput(inputQueue), mOutputs(),
+        mNumLosslessOutputs(0), mBuffers() {}
 
 StreamSplitter::~StreamSplitter() {
     mInput->consumerDisconnect();
-    Vector<sp<IGraphicBufferProducer> >::iterator output = mOutputs.begin();
+    Vector<Output>::iterator output = mOutputs.begin();
     for (; output != mOutputs.end(); ++output) {
-        (*output)->disconnect(NATIVE_WINDOW_API_CPU);
+        output->mQueue->disconnect(NATIVE_WINDOW_API_CPU);
     }
 
     if (mBuffers.size() > 0) {
@@ -71,11 +73,35 @@ StreamSplitter::~StreamSplitter() {
 
 status_t StreamSplitter::addOutput(
         const sp<IGraphicBufferProducer>& outputQueue) {
+    return addOutput(outputQueue, OUTPUT_LOSSLESS, 0);
+}
+
+status_t StreamSplitter::addOutput(
+        const sp<IGraphicBufferProducer>& outputQueue, OutputPolicy policy,
+        size_t queueDepth) {
     if (outputQueue == NULL) {
         ALOGE("addOutput: outputQueue must not be NULL");
         return BAD_VALUE;
     }
 
+    switch (policy) {
+        case OUTPUT_LOSSLESS:
+            queueDepth = 0;
+            break;
+        case OUTPUT_DROP_OLDEST:
+            if (queueDepth == 0) {
+                ALOGE("addOutput: queueDepth must be at least 1");
+                return BAD_VALUE;
+            }
+            break;
+        case OUTPUT_LATEST_ONLY:
+            queueDepth = 1;
+            break;
+        default:
+            ALOGE("addOutput: unknown policy %d", policy);
+            return BAD_VALUE;
+    }
+
     Mutex::Autolock lock(mMutex);
 
     IGraphicBufferProducer::QueueBufferOutput queueBufferOutput;
@@ -88,7 +114,14 @@ status_t StreamSplitter::addOutput(
         return status;
     }
 
-    mOutputs.push_back(outputQueue);
+    Output output;
+    output.mQueue = outputQueue;
+    output.mPolicy = policy;
+    output.mQueueDepth = queueDepth;
+    mOutputs.push_back(output);
+    if (policy == OUTPUT_LOSSLESS) {
+        ++mNumLosslessOutputs;
+    }
 
     return NO_ERROR;
 }
@@ -102,25 +135,27 @@ void StreamSplitter::onFrameAvailable(const BufferItem& /* item */) {
     ATRACE_CALL();
     Mutex::Autolock lock(mMutex);
 
-    // The current policy is that if any one consumer is consuming buffers too
-    // slowly, the splitter will stall the rest of the outputs by not acquiring
-    // any more buffers from the input. This will cause back pressure on the
-    // input queue, slowing down its producer.
-
-    // If there are too many outstanding buffers, we block until a buffer is
-    // released back to the input in onBufferReleased
-    while (mOutstandingBuffers >= MAX_OUTSTANDING_BUFFERS) {
-        mReleaseCondition.wait(mMutex);
-
-        // If the splitter is abandoned while we are waiting, the release
-        // condition variable will be broadcast, and we should just return
-        // without attempting to do anything more (since the input queue will
-        // also be abandoned).
-        if (mIsAbandoned) {
-            return;
+    // If any lossless output is consuming buffers too slowly, the splitter
+    // stalls the rest of the outputs by not acquiring any more buffers from
+    // the input. This will cause back pressure on the input queue, slowing
+    // down its producer. Outputs with another policy drop buffers instead.
+
+    // If there are too many outstanding buffers, we block until a lossless
+    // output releases one in onBufferReleasedByOutput
+    if (mNumLosslessOutputs > 0) {
+        while (mOutstandingBuffers >= MAX_OUTSTANDING_BUFFERS) {
+            mReleaseCondition.wait(mMutex);
+
+            // If the splitter is abandoned while we are waiting, the release
+            // condition variable will be broadcast, and we should just return
+            // without attempting to do anything more (since the input queue
+            // will also be abandoned).
+            if (mIsAbandoned) {
+                return;
+            }
         }
+        ++mOutstandingBuffers;
     }
-    ++mOutstandingBuffers;
 
     // Acquire and detach the buffer from the input
     IGraphicBufferConsumer::BufferItem bufferItem;
@@ -135,52 +170,90 @@ void StreamSplitter::onFrameAvailable(const BufferItem& /* item */) {
     LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
             "detaching buffer from input failed (%d)", status);
 
-    // Initialize our reference count for this buffer
-    mBuffers.add(bufferItem.mGraphicBuffer->getId(),
-            new BufferTracker(bufferItem.mGraphicBuffer));
-
     IGraphicBufferProducer::QueueBufferInput queueInput(
             bufferItem.mTimestamp, bufferItem.mIsAutoTimestamp,
             bufferItem.mCrop, bufferItem.mScalingMode,
             bufferItem.mTransform, bufferItem.mIsDroppable,
             bufferItem.mFence);
 
-    // Attach and queue the buffer to each of the outputs
-    Vector<sp<IGraphicBufferProducer> >::iterator output = mOutputs.begin();
-    for (; output != mOutputs.end(); ++output) {
-        int slot;
-        status = (*output)->attachBuffer(&slot, bufferItem.mGraphicBuffer);
-        if (status == NO_INIT) {
-            // If we just discovered that this output has been abandoned, note
-            // that, increment the release count so that we still release this
-            // buffer eventually, and move on to the next output
-            onAbandonedLocked();
-            mBuffers.editValueFor(bufferItem.mGraphicBuffer->getId())->
-                    incrementReleaseCountLocked();
+    // Initialize our reference count for this buffer
+    sp<BufferTracker> tracker(new BufferTracker(bufferItem.mGraphicBuffer,
+            queueInput, mNumLosslessOutputs));
+    mBuffers.add(bufferItem.mGraphicBuffer->getId(), tracker);
+
+    // Queue the buffer to each of the outputs, or let it wait for the ones
+    // that already have as many buffers as they may
+    for (size_t i = 0; i < mOutputs.size(); ++i) {
+        Output& output(mOutputs.editItemAt(i));
+        if (output.mPolicy == OUTPUT_LOSSLESS ||
+                output.mInFlight < MAX_OUTSTANDING_BUFFERS) {
+            queueToOutputLocked(i, tracker);
             continue;
-        } else {
-            LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
-                    "attaching buffer to output failed (%d)", status);
         }
 
-        IGraphicBufferProducer::QueueBufferOutput queueOutput;
-        status = (*output)->queueBuffer(slot, queueInput, &queueOutput);
-        if (status == NO_INIT) {
-            // If we just discovered that this output has been abandoned, note
-            // that, increment the release count so that we still release this
-            // buffer eventually, and move on to the next output
-            onAbandonedLocked();
-            mBuffers.editValueFor(bufferItem.mGraphicBuffer->getId())->
-                    incrementReleaseCountLocked();
+        // Nothing takes buffers off the waiting list once the splitter has
+        // been abandoned
+        if (mIsAbandoned) {
+            onOutputDoneLocked(i, tracker);
             continue;
-        } else {
-            LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
-                    "queueing buffer to output failed (%d)", status);
         }
 
-        ALOGV("queued buffer %#" PRIx64 " to output %p",
-                bufferItem.mGraphicBuffer->getId(), output->get());
+        if (output.mWaiting.size() >= output.mQueueDepth) {
+            sp<BufferTracker> dropped(output.mWaiting[0]);
+            output.mWaiting.removeAt(0);
+            ++output.mDropped;
+            ALOGV("dropped buffer %#" PRIx64 " for output %p",
+                    dropped->getBuffer()->getId(), output.mQueue.get());
+            onOutputDoneLocked(i, dropped);
+        }
+        output.mWaiting.push_back(tracker);
+        if (output.mInFlight + output.mWaiting.size() > output.mMaxDepth) {
+            output.mMaxDepth = output.mInFlight + output.mWaiting.size();
+        }
+    }
+}
+
+void StreamSplitter::queueToOutputLocked(size_t outputIndex,
+        const sp<BufferTracker>& tracker) {
+    Output& output(mOutputs.editItemAt(outputIndex));
+    const sp<GraphicBuffer>& buffer(tracker->getBuffer());
+
+    int slot;
+    status_t status = output.mQueue->attachBuffer(&slot, buffer);
+    if (status == NO_INIT) {
+        // If we just discovered that this output has been abandoned, note
+        // that, count the buffer as released so that we still release it to
+        // the input eventually, and move on
+        onAbandonedLocked();
+        onOutputDoneLocked(outputIndex, tracker);
+        return;
+    } else {
+        LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
+                "attaching buffer to output failed (%d)", status);
+    }
+
+    const nsecs_t queueTime = systemTime();
+    IGraphicBufferProducer::QueueBufferOutput queueOutput;
+    status = output.mQueue->queueBuffer(slot, tracker->getQueueInput(),
+            &queueOutput);
+    if (status == NO_INIT) {
+        onAbandonedLocked();
+        onOutputDoneLocked(outputIndex, tracker);
+        return;
+    } else {
+        LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
+                "queueing buffer to output failed (%d)", status);
     }
+
+    ++output.mInFlight;
+    ++output.mQueued;
+    output.mQueueTimes.add(buffer->getId(), queueTime);
+    if (output.mInFlight + output.mWaiting.size() > output.mMaxDepth) {
+        output.mMaxDepth = output.mInFlight + output.mWaiting.size();
+    }
+
+    ALOGV("queued buffer %#" PRIx64 " to output %p", buffer->getId(),
+            output.mQueue.get());
 }
 
 void StreamSplitter::onBufferReleasedByOutput(
@@ -204,15 +277,52 @@ void StreamSplitter::onBufferReleasedByOutput(
     ALOGV("detached buffer %#" PRIx64 " from output %p",
           buffer->getId(), from.get());
 
-    const sp<BufferTracker>& tracker = mBuffers.editValueFor(buffer->getId());
+    const ssize_t outputIndex = indexOfOutputLocked(from);
+    LOG_ALWAYS_FATAL_IF(outputIndex < 0, "buffer released by unknown output");
+    Output& output(mOutputs.editItemAt(outputIndex));
+    --output.mInFlight;
+    const ssize_t timeIndex = output.mQueueTimes.indexOfKey(buffer->getId());
+    if (timeIndex >= 0) {
+        const nsecs_t latency = systemTime() -
+                output.mQueueTimes.valueAt(timeIndex);
+        output.mTotalLatency += latency;
+        if (latency > output.mMaxLatency) {
+            output.mMaxLatency = latency;
+        }
+        output.mQueueTimes.removeItemsAt(timeIndex);
+    }
+
+    sp<BufferTracker> tracker(mBuffers.valueFor(buffer->getId()));
 
     // Merge the release fence of the incoming buffer so that the fence we send
     // back to the input includes all of the outputs' fences
     tracker->mergeFence(fence);
+    onOutputDoneLocked(outputIndex, tracker);
+
+    // Now that the output has room, give it the oldest waiting buffer
+    if (!mIsAbandoned && !output.mWaiting.isEmpty()) {
+        sp<BufferTracker> next(output.mWaiting[0]);
+        output.mWaiting.removeAt(0);
+        queueToOutputLocked(outputIndex, next);
+    }
+}
+
+void StreamSplitter::onOutputDoneLocked(size_t outputIndex,
+        const sp<BufferTracker>& tracker) {
+    const sp<GraphicBuffer>& buffer(tracker->getBuffer());
+    const uint64_t id = buffer->getId();
+
+    // A buffer that no lossless output holds any more no longer holds up
+    // waiting onFrameAvailable calls
+    if (mOutputs[outputIndex].mPolicy == OUTPUT_LOSSLESS &&
+            tracker->decrementLosslessOutputsLocked() == 0) {
+        --mOutstandingBuffers;
+        mReleaseCondition.signal();
+    }
 
     // Check to see if this is the last outstanding reference to this buffer
     size_t releaseCount = tracker->incrementReleaseCountLocked();
-    ALOGV("buffer %#" PRIx64 " reference count %zu (of %zu)", buffer->getId(),
+    ALOGV("buffer %#" PRIx64 " reference count %zu (of %zu)", id,
             releaseCount, mOutputs.size());
     if (releaseCount < mOutputs.size()) {
         return;
@@ -221,13 +331,13 @@ void StreamSplitter::onBufferReleasedByOutput(
     // If we've been abandoned, we can't return the buffer to the input, so just
     // stop tracking it and move on
     if (mIsAbandoned) {
-        mBuffers.removeItem(buffer->getId());
+        mBuffers.removeItem(id);
         return;
     }
 
     // Attach and release the buffer back to the input
     int consumerSlot;
-    status = mInput->attachBuffer(&consumerSlot, tracker->getBuffer());
+    status_t status = mInput->attachBuffer(&consumerSlot, buffer);
     LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
             "attaching buffer to input failed (%d)", status);
 
@@ -236,20 +346,57 @@ void StreamSplitter::onBufferReleasedByOutput(
     LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
             "releasing buffer to input failed (%d)", status);
 
-    ALOGV("released buffer %#" PRIx64 " to input", buffer->getId());
+    ALOGV("released buffer %#" PRIx64 " to input", id);
 
     // We no longer need to track the buffer once it has been returned to the
     // input
-    mBuffers.removeItem(buffer->getId());
+    mBuffers.removeItem(id);
+}
 
-    // Notify any waiting onFrameAvailable calls
-    --mOutstandingBuffers;
-    mReleaseCondition.signal();
+ssize_t StreamSplitter::indexOfOutputLocked(
+        const sp<IGraphicBufferProducer>& queue) const {
+    for (size_t i = 0; i < mOutputs.size(); ++i) {
+        if (mOutputs[i].mQueue->asBinder() == queue->asBinder()) {
+            return static_cast<ssize_t>(i);
+        }
+    }
+    return -1;
+}
+
+void StreamSplitter::dump(String8& result, const char* prefix) const {
+    static const char* const policyNames[] = {
+        "lossless", "drop-oldest", "latest-only",
+    };
+    Mutex::Autolock lock(mMutex);
+    result.appendFormat("%sStreamSplitter: %zu outputs, %d outstanding, "
+            "%zu tracked%s\n", prefix, mOutputs.size(), mOutstandingBuffers,
+            mBuffers.size(), mIsAbandoned ? " (abandoned)" : "");
+    for (size_t i = 0; i < mOutputs.size(); ++i) {
+        const Output& output(mOutputs[i]);
+        const uint64_t released = output.mQueued - output.mInFlight;
+        result.appendFormat("%s  [%zu] %s depth %zu: %zu in flight, "
+                "%zu waiting (max %zu), %" PRIu64 " queued, %" PRIu64
+                " dropped, latency avg %.2f ms max %.2f ms\n", prefix, i,
+                policyNames[output.mPolicy], output.mQueueDepth,
+                output.mInFlight, output.mWaiting.size(), output.mMaxDepth,
+                output.mQueued, output.mDropped,
+                released ? output.mTotalLatency / 1e6 / released : 0.0,
+                output.mMaxLatency / 1e6);
+    }
 }
 
 void StreamSplitter::onAbandonedLocked() {
     ALOGE("one of my outputs has abandoned me");
     if (!mIsAbandoned) {
+        // The waiting buffers will never be queued to their outputs, so count
+        // them as done while they can still be released to the input
+        for (size_t i = 0; i < mOutputs.size(); ++i) {
+            Vector<sp<BufferTracker> > waiting(mOutputs[i].mWaiting);
+            mOutputs.editItemAt(i).mWaiting.clear();
+            for (size_t j = 0; j < waiting.size(); ++j) {
+                onOutputDoneLocked(i, waiting[j]);
+            }
+        }
         mInput->consumerDisconnect();
     }
     mIsAbandoned = true;
@@ -272,11 +419,19 @@ void StreamSplitter::OutputListener::binderDied(const wp<IBinder>& /* who */) {
     mSplitter->onAbandonedLocked();
 }
 
-StreamSplitter::BufferTracker::BufferTracker(const sp<GraphicBuffer>& buffer)
-      : mBuffer(buffer), mMergedFence(Fence::NO_FENCE), mReleaseCount(0) {}
+StreamSplitter::BufferTracker::BufferTracker(const sp<GraphicBuffer>& buffer,
+        const IGraphicBufferProducer::QueueBufferInput& queueInput,
+        size_t losslessOutputs)
+      : mBuffer(buffer), mMergedFence(Fence::NO_FENCE), mQueueInput(queueInput),
+        mReleaseCount(0), mLosslessOutputs(losslessOutputs) {}
 
 StreamSplitter::BufferTracker::~BufferTracker() {}
 
+StreamSplitter::Output::Output()
+      : mPolicy(OUTPUT_LOSSLESS), mQueueDepth(0), mInFlight(0), mWaiting(),
+        mQueueTimes(), mQueued(0), mDropped(0), mMaxDepth(0),
+        mTotalLatency(0), mMaxLatency(0) {}
+
 void StreamSplitter::BufferTracker::mergeFence(const sp<Fence>& with) {
     mMergedFence = Fence::merge(String8("StreamSplitter"), mMergedFence, with);
 }
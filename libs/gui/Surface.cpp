@@ -79,6 +79,7 @@ Surface::Surface(
     mConnectedToCpu = false;
     mProducerControlledByApp = controlledByApp;
     mSwapIntervalZero = false;
+    mDequeueAhead = false;
 }
 
 Surface::~Surface() {
@@ -200,6 +201,20 @@ int Surface::setSwapInterval(int interval) {
     return NO_ERROR;
 }
 
+bool Surface::hasDefaultSizeLocked(int slot) const {
+    const sp<GraphicBuffer>& buffer(mSlots[slot].buffer);
+    int width = 0;
+    int height = 0;
+    if (buffer == NULL ||
+            mGraphicBufferProducer->query(NATIVE_WINDOW_DEFAULT_WIDTH,
+                    &width) != NO_ERROR ||
+            mGraphicBufferProducer->query(NATIVE_WINDOW_DEFAULT_HEIGHT,
+                    &height) != NO_ERROR) {
+        return false;
+    }
+    return int(buffer->width) == width && int(buffer->height) == height;
+}
+
 int Surface::dequeueBuffer(android_native_buffer_t** buffer, int* fenceFd) {
     ATRACE_CALL();
     ALOGV("Surface::dequeueBuffer");
@@ -223,8 +238,31 @@ int Surface::dequeueBuffer(android_native_buffer_t** buffer, int* fenceFd) {
 
     int buf = -1;
     sp<Fence> fence;
-    status_t result = mGraphicBufferProducer->dequeueBuffer(&buf, &fence, swapIntervalZero,
-            reqW, reqH, reqFormat, reqUsage);
+    status_t result = WOULD_BLOCK;
+    {
+        Mutex::Autolock lock(mMutex);
+        const DequeuedAhead& ahead(mDequeuedAhead);
+        if (ahead.slot != DequeuedAhead::INVALID_SLOT) {
+            // Without a requested size the buffer has the default size of
+            // the time it was dequeued, which the consumer may have changed
+            // since.
+            if (ahead.async == swapIntervalZero && ahead.width == uint32_t(reqW) &&
+                    ahead.height == uint32_t(reqH) && ahead.format == reqFormat &&
+                    ahead.usage == reqUsage &&
+                    ((reqW && reqH) || hasDefaultSizeLocked(ahead.slot))) {
+                buf = ahead.slot;
+                fence = ahead.fence;
+                result = NO_ERROR;
+                mDequeuedAhead = DequeuedAhead();
+            } else {
+                cancelDequeuedAheadLocked();
+            }
+        }
+    }
+    if (result == WOULD_BLOCK) {
+        result = mGraphicBufferProducer->dequeueBuffer(&buf, &fence, swapIntervalZero,
+                reqW, reqH, reqFormat, reqUsage);
+    }
 
     if (result < 0) {
         ALOGV("dequeueBuffer: IGraphicBufferProducer::dequeueBuffer(%d, %d, %d, %d, %d)"
@@ -338,7 +376,34 @@ int Surface::queueBuffer(android_native_buffer_t* buffer, int fenceFd) {
     IGraphicBufferProducer::QueueBufferInput input(timestamp, isAutoTimestamp,
             crop, dirtyRect, mScalingMode, mTransform ^ mStickyTransform, mSwapIntervalZero,
             fence, mStickyTransform);
-    status_t err = mGraphicBufferProducer->queueBuffer(i, input, &output);
+    status_t err;
+    if (mDequeueAhead && mDequeuedAhead.slot == DequeuedAhead::INVALID_SLOT) {
+        DequeuedAhead ahead;
+        ahead.async = mSwapIntervalZero;
+        ahead.width = mReqWidth ? mReqWidth : mUserWidth;
+        ahead.height = mReqHeight ? mReqHeight : mUserHeight;
+        ahead.format = mReqFormat;
+        ahead.usage = mReqUsage;
+        sp<GraphicBuffer> buffer;
+        status_t dequeueResult = WOULD_BLOCK;
+        err = mGraphicBufferProducer->queueAndDequeueBuffer(i, input, &output,
+                &ahead.slot, &ahead.fence, &buffer, &dequeueResult,
+                ahead.async, ahead.width, ahead.height, ahead.format,
+                ahead.usage);
+        if (err == OK && dequeueResult >= 0) {
+            if (dequeueResult & IGraphicBufferProducer::RELEASE_ALL_BUFFERS) {
+                freeAllBuffers();
+            }
+            if (dequeueResult &
+                    IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) {
+                // If this is NULL, dequeueBuffer requests the buffer itself.
+                mSlots[ahead.slot].buffer = buffer;
+            }
+            mDequeuedAhead = ahead;
+        }
+    } else {
+        err = mGraphicBufferProducer->queueBuffer(i, input, &output);
+    }
     if (err != OK)  {
         ALOGE("queueBuffer: error queuing buffer to SurfaceTexture, %d", err);
     }
@@ -586,6 +651,9 @@ int Surface::connect(int api) {
     if (!err && api == NATIVE_WINDOW_API_CPU) {
         mConnectedToCpu = true;
     }
+    if (!err && api == NATIVE_WINDOW_API_EGL) {
+        mDequeueAhead = true;
+    }
     return err;
 }
 
@@ -594,6 +662,7 @@ int Surface::disconnect(int api) {
     ATRACE_CALL();
     ALOGV("Surface::disconnect");
     Mutex::Autolock lock(mMutex);
+    cancelDequeuedAheadLocked();
     freeAllBuffers();
     int err = mGraphicBufferProducer->disconnect(api);
     if (!err) {
@@ -609,6 +678,9 @@ int Surface::disconnect(int api) {
         if (api == NATIVE_WINDOW_API_CPU) {
             mConnectedToCpu = false;
         }
+        if (api == NATIVE_WINDOW_API_EGL) {
+            mDequeueAhead = false;
+        }
     }
     return err;
 }
@@ -645,6 +717,7 @@ int Surface::setBufferCount(int bufferCount)
     ATRACE_CALL();
     ALOGV("Surface::setBufferCount");
     Mutex::Autolock lock(mMutex);
+    cancelDequeuedAheadLocked();
 
     status_t err = mGraphicBufferProducer->setBufferCount(bufferCount);
     ALOGE_IF(err, "IGraphicBufferProducer::setBufferCount(%d) returned %s",
@@ -766,6 +839,14 @@ void Surface::freeAllBuffers() {
     }
 }
 
+void Surface::cancelDequeuedAheadLocked() {
+    if (mDequeuedAhead.slot != DequeuedAhead::INVALID_SLOT) {
+        mGraphicBufferProducer->cancelBuffer(mDequeuedAhead.slot,
+                mDequeuedAhead.fence);
+        mDequeuedAhead = DequeuedAhead();
+    }
+}
+
 // ----------------------------------------------------------------------
 // the lock/unlock APIs must be used from the same thread
 static int fd_rga=-1;
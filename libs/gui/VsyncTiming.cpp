@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "VsyncTiming"
+
+#include <string.h>
+#include <sys/mman.h>
+
+#include <binder/IMemory.h>
+#include <binder/MemoryHeapBase.h>
+
+#include <cutils/atomic.h>
+
+#include <gui/VsyncTiming.h>
+
+#include <utils/Log.h>
+
+namespace android {
+
+// A reader retries this many times before it gives up on a page that is
+// being written; the writer only holds the seqlock for a few stores.
+static const int kMaxReadAttempts = 100;
+
+nsecs_t VsyncTiming::computeNextVsync(nsecs_t when) const {
+    if (period <= 0) {
+        return when;
+    }
+    nsecs_t sinceLast = (when - phase - phaseOffset) % period;
+    if (sinceLast < 0) {
+        sinceLast += period;
+    }
+    return when - sinceLast + period;
+}
+
+// ----------------------------------------------------------------------------
+
+VsyncTimingWriter::VsyncTimingWriter()
+    : mPage(NULL)
+{
+    memset(&mTiming, 0, sizeof(mTiming));
+    // Clients map the heap read-only.
+    sp<MemoryHeapBase> heap = new MemoryHeapBase(sizeof(VsyncTimingPage),
+            MemoryHeapBase::READ_ONLY, "VsyncTiming");
+    if (heap->getHeapID() < 0 || heap->getBase() == MAP_FAILED) {
+        ALOGE("could not allocate the vsync timing page");
+        return;
+    }
+    mHeap = heap;
+    mPage = static_cast<VsyncTimingPage*>(heap->getBase());
+    memset(mPage, 0, sizeof(*mPage));
+    mPage->magic = VsyncTimingPage::MAGIC;
+    mPage->version = VsyncTimingPage::VERSION;
+}
+
+VsyncTimingWriter::~VsyncTimingWriter() {
+}
+
+status_t VsyncTimingWriter::initCheck() const {
+    return mPage ? NO_ERROR : NO_MEMORY;
+}
+
+void VsyncTimingWriter::publishModel(nsecs_t period, nsecs_t phase,
+        nsecs_t referenceTime) {
+    Mutex::Autolock lock(mMutex);
+    mTiming.period = period;
+    mTiming.phase = phase;
+    mTiming.referenceTime = referenceTime;
+    publishLocked();
+}
+
+void VsyncTimingWriter::publishPhaseOffset(nsecs_t phaseOffset) {
+    Mutex::Autolock lock(mMutex);
+    mTiming.phaseOffset = phaseOffset;
+    publishLocked();
+}
+
+void VsyncTimingWriter::publishLocked() {
+    if (!mPage) {
+        return;
+    }
+    mTiming.sequence++;
+    android_atomic_release_store(int32_t(2 * mTiming.sequence - 1),
+            &mPage->seq);
+    android_memory_barrier();
+    mPage->period = mTiming.period;
+    mPage->phase = mTiming.phase;
+    mPage->phaseOffset = mTiming.phaseOffset;
+    mPage->referenceTime = mTiming.referenceTime;
+    android_atomic_release_store(int32_t(2 * mTiming.sequence), &mPage->seq);
+}
+
+// ----------------------------------------------------------------------------
+
+VsyncTimingReader::VsyncTimingReader(const sp<IMemoryHeap>& heap)
+    : mPage(NULL)
+{
+    if (heap == NULL || heap->getHeapID() < 0 ||
+            heap->getBase() == MAP_FAILED ||
+            heap->getSize() < sizeof(VsyncTimingPage)) {
+        return;
+    }
+    const VsyncTimingPage* page =
+            static_cast<const VsyncTimingPage*>(heap->getBase());
+    if (page->magic != VsyncTimingPage::MAGIC ||
+            page->version != VsyncTimingPage::VERSION) {
+        ALOGE("not a vsync timing heap");
+        return;
+    }
+    mHeap = heap;
+    mPage = page;
+}
+
+status_t VsyncTimingReader::initCheck() const {
+    return mPage ? NO_ERROR : NO_INIT;
+}
+
+status_t VsyncTimingReader::read(VsyncTiming* outTiming) const {
+    if (!mPage) {
+        return NO_INIT;
+    }
+    for (int attempt = 0; attempt < kMaxReadAttempts; attempt++) {
+        const int32_t seq = android_atomic_acquire_load(&mPage->seq);
+        if (seq & 1) {
+            continue;
+        }
+        VsyncTiming timing;
+        timing.period = mPage->period;
+        timing.phase = mPage->phase;
+        timing.phaseOffset = mPage->phaseOffset;
+        timing.referenceTime = mPage->referenceTime;
+        timing.sequence = uint32_t(seq) / 2;
+        android_memory_barrier();
+        if (mPage->seq != seq) {
+            continue;
+        }
+        *outTiming = timing;
+        return timing.period > 0 ? status_t(NO_ERROR) : NOT_ENOUGH_DATA;
+    }
+    return WOULD_BLOCK;
+}
+
+}; // namespace android
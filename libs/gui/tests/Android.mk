@@ -7,13 +7,17 @@ LOCAL_MODULE := libgui_test
 LOCAL_MODULE_TAGS := tests
 
 LOCAL_SRC_FILES := \
+    BufferIdCache_test.cpp \
     BufferQueue_test.cpp \
     CpuConsumer_test.cpp \
     FillBuffer.cpp \
+    FrameTimeline_test.cpp \
+    GraphicBufferPool_test.cpp \
     GLTest.cpp \
     IGraphicBufferProducer_test.cpp \
     MultiTextureConsumer_test.cpp \
     SRGB_test.cpp \
+    SensorEventRing_test.cpp \
     StreamSplitter_test.cpp \
     SurfaceTextureClient_test.cpp \
     SurfaceTextureFBO_test.cpp \
@@ -23,6 +27,7 @@ LOCAL_SRC_FILES := \
     SurfaceTextureMultiContextGL_test.cpp \
     Surface_test.cpp \
     TextureRenderer.cpp \
+    VsyncTiming_test.cpp \
 
 LOCAL_SHARED_LIBRARIES := \
 	libEGL \
@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BufferIdCache_test"
+//#define LOG_NDEBUG 0
+
+#include <binder/Parcel.h>
+
+#include <gui/BufferQueueDefs.h>
+
+#include <private/gui/BufferIdCache.h>
+
+#include <ui/GraphicBuffer.h>
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+namespace android {
+
+class BufferIdCacheTest : public ::testing::Test {
+protected:
+    static sp<GraphicBuffer> createBuffer() {
+        sp<GraphicBuffer> buffer = new GraphicBuffer(16, 16,
+                PIXEL_FORMAT_RGBA_8888, GraphicBuffer::USAGE_SW_READ_OFTEN);
+        EXPECT_EQ(NO_ERROR, buffer->initCheck());
+        return buffer;
+    }
+
+    // Sends buffer for slot from the binder side to the proxy side of
+    // mCache, the way a transaction would.
+    status_t roundTrip(const sp<GraphicBuffer>& buffer,
+            sp<GraphicBuffer>* outBuffer, bool* outSentById, int slot = 0) {
+        Parcel data, reply;
+        BufferIdCache::Snapshot snapshot;
+        mCache.writeIds(&data, &snapshot);
+        data.setDataPosition(0);
+
+        Vector<uint64_t> ids;
+        status_t err = BufferIdCache::readIds(data, &ids);
+        if (err != NO_ERROR) {
+            return err;
+        }
+        err = BufferIdCache::writeBuffer(&reply, buffer, ids);
+        if (err != NO_ERROR) {
+            return err;
+        }
+        *outSentById = reply.objectsCount() == 0 && buffer != NULL;
+        reply.setDataPosition(0);
+        return mCache.readBuffer(reply, snapshot, slot, outBuffer);
+    }
+
+    BufferIdCache mCache;
+};
+
+TEST_F(BufferIdCacheTest, SecondTransferIsById) {
+    sp<GraphicBuffer> buffer = createBuffer();
+    sp<GraphicBuffer> first, second;
+    bool byId;
+
+    ASSERT_EQ(NO_ERROR, roundTrip(buffer, &first, &byId));
+    ASSERT_TRUE(first != NULL);
+    EXPECT_FALSE(byId);
+    EXPECT_EQ(buffer->getId(), first->getId());
+    EXPECT_NE(buffer.get(), first.get());
+
+    ASSERT_EQ(NO_ERROR, roundTrip(buffer, &second, &byId));
+    EXPECT_TRUE(byId);
+    EXPECT_EQ(first.get(), second.get());
+}
+
+TEST_F(BufferIdCacheTest, OtherBuffersAreSentInFull) {
+    sp<GraphicBuffer> a = createBuffer();
+    sp<GraphicBuffer> b = createBuffer();
+    sp<GraphicBuffer> received;
+    bool byId;
+
+    ASSERT_EQ(NO_ERROR, roundTrip(a, &received, &byId));
+    ASSERT_EQ(NO_ERROR, roundTrip(b, &received, &byId));
+    EXPECT_FALSE(byId);
+    ASSERT_TRUE(received != NULL);
+    EXPECT_EQ(b->getId(), received->getId());
+
+    ASSERT_EQ(NO_ERROR, roundTrip(NULL, &received, &byId));
+    EXPECT_TRUE(received == NULL);
+}
+
+TEST_F(BufferIdCacheTest, CacheIsBounded) {
+    Vector<sp<GraphicBuffer> > received;
+    for (int i = 0; i < BufferIdCache::MAX_BUFFERS + 1; i++) {
+        sp<GraphicBuffer> buffer;
+        bool byId;
+        ASSERT_EQ(NO_ERROR, roundTrip(createBuffer(), &buffer, &byId,
+                i % BufferQueueDefs::NUM_BUFFER_SLOTS));
+        received.push(buffer);
+    }
+
+    Parcel data;
+    BufferIdCache::Snapshot snapshot;
+    mCache.writeIds(&data, &snapshot);
+    EXPECT_EQ(size_t(BufferIdCache::MAX_BUFFERS), snapshot.size());
+    // the buffer whose slot was reused was dropped to make room
+    for (size_t i = 0; i < snapshot.size(); i++) {
+        EXPECT_NE(received[0]->getId(), snapshot[i]->getId());
+    }
+}
+
+TEST_F(BufferIdCacheTest, BufferIsKeptWhenItsSlotIsReused) {
+    sp<GraphicBuffer> a = createBuffer();
+    sp<GraphicBuffer> b = createBuffer();
+    sp<GraphicBuffer> c = createBuffer();
+    sp<GraphicBuffer> first, received;
+    bool byId;
+
+    ASSERT_EQ(NO_ERROR, roundTrip(a, &first, &byId, 0));
+    ASSERT_EQ(NO_ERROR, roundTrip(b, &received, &byId, 1));
+    ASSERT_EQ(NO_ERROR, roundTrip(c, &received, &byId, 0));
+
+    // a comes back for another slot, as after a reconnect
+    ASSERT_EQ(NO_ERROR, roundTrip(a, &received, &byId, 2));
+    EXPECT_TRUE(byId);
+    EXPECT_EQ(first.get(), received.get());
+}
+
+TEST_F(BufferIdCacheTest, BufferIsKeptWhenItsSlotIsFreed) {
+    sp<GraphicBuffer> a = createBuffer();
+    sp<GraphicBuffer> first, received;
+    bool byId;
+
+    ASSERT_EQ(NO_ERROR, roundTrip(a, &first, &byId, 3));
+    mCache.freeSlot(3);
+    ASSERT_EQ(NO_ERROR, roundTrip(a, &received, &byId, 3));
+    EXPECT_TRUE(byId);
+    EXPECT_EQ(first.get(), received.get());
+}
+
+TEST_F(BufferIdCacheTest, FreedBuffersAreBounded) {
+    Vector<sp<GraphicBuffer> > received;
+    const int count = BufferIdCache::MAX_FREED_BUFFERS + 2;
+    for (int i = 0; i < count; i++) {
+        sp<GraphicBuffer> buffer;
+        bool byId;
+        ASSERT_EQ(NO_ERROR, roundTrip(createBuffer(), &buffer, &byId, i));
+        received.push(buffer);
+    }
+
+    for (int i = 0; i < count; i++) {
+        mCache.freeSlot(i);
+    }
+    Parcel data;
+    BufferIdCache::Snapshot snapshot;
+    mCache.writeIds(&data, &snapshot);
+    ASSERT_EQ(size_t(BufferIdCache::MAX_FREED_BUFFERS), snapshot.size());
+    // the most recently received buffers are the ones kept
+    for (size_t i = 0; i < snapshot.size(); i++) {
+        EXPECT_EQ(received[count - BufferIdCache::MAX_FREED_BUFFERS + i]->getId(),
+                snapshot[i]->getId());
+    }
+}
+
+TEST_F(BufferIdCacheTest, ClearDropsLastReferenceOfFreedBuffers) {
+    sp<GraphicBuffer> received;
+    bool byId;
+    ASSERT_EQ(NO_ERROR, roundTrip(createBuffer(), &received, &byId, 0));
+    wp<GraphicBuffer> weak(received);
+    received.clear();
+
+    mCache.freeSlot(0);
+    EXPECT_TRUE(weak.promote() != NULL);
+
+    // as on disconnect or when the queue has freed all of its buffers
+    mCache.clear();
+    EXPECT_TRUE(weak.promote() == NULL);
+}
+
+TEST_F(BufferIdCacheTest, FreedBuffersExpire) {
+    sp<GraphicBuffer> received;
+    bool byId;
+    ASSERT_EQ(NO_ERROR, roundTrip(createBuffer(), &received, &byId, 0));
+    wp<GraphicBuffer> weak(received);
+    received.clear();
+
+    mCache.freeSlot(0);
+    usleep(BufferIdCache::MAX_FREED_AGE / 1000 + 100000);
+    {
+        Parcel data;
+        BufferIdCache::Snapshot snapshot;
+        mCache.writeIds(&data, &snapshot);
+        EXPECT_EQ(0U, snapshot.size());
+    }
+    EXPECT_TRUE(weak.promote() == NULL);
+}
+
+TEST_F(BufferIdCacheTest, TooManyIdsAreRejected) {
+    Parcel data;
+    data.writeInt32(BufferIdCache::MAX_BUFFERS + 1);
+    data.setDataPosition(0);
+    Vector<uint64_t> ids;
+    EXPECT_EQ(BAD_VALUE, BufferIdCache::readIds(data, &ids));
+}
+
+} // namespace android
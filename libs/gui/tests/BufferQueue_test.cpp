@@ -18,10 +18,13 @@
 //#define LOG_NDEBUG 0
 
 #include <gui/BufferQueue.h>
+#include <gui/BufferQueueStatistics.h>
+#include <gui/GraphicBufferAlloc.h>
 #include <gui/IProducerListener.h>
 
 #include <ui/GraphicBuffer.h>
 
+#include <binder/Binder.h>
 #include <binder/IPCThreadState.h>
 #include <binder/IServiceManager.h>
 #include <binder/ProcessState.h>
@@ -358,4 +361,367 @@ TEST_F(BufferQueueTest, MoveFromConsumerToProducer) {
     ASSERT_EQ(OK, item.mGraphicBuffer->unlock());
 }
 
+TEST_F(BufferQueueTest, DequeueBuffer_ReturnsOldestFreeSlot) {
+    createBufferQueue();
+    sp<DummyConsumer> dc(new DummyConsumer);
+    ASSERT_EQ(OK, mConsumer->consumerConnect(dc, false));
+    IGraphicBufferProducer::QueueBufferOutput output;
+    ASSERT_EQ(OK, mProducer->connect(new DummyProducerListener,
+            NATIVE_WINDOW_API_CPU, false, &output));
+    ASSERT_EQ(OK, mProducer->setBufferCount(4));
+
+    int slots[3];
+    sp<Fence> fence;
+    sp<GraphicBuffer> buffer;
+    IGraphicBufferProducer::QueueBufferInput input(0, false, Rect(0, 0, 1, 1),
+            NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, false, Fence::NO_FENCE);
+    IGraphicBufferConsumer::BufferItem item;
+
+    // Cycle three buffers through the queue so that their slots hold
+    // increasing frame numbers.
+    for (int i = 0; i < 3; i++) {
+        ASSERT_EQ(IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION,
+                mProducer->dequeueBuffer(&slots[i], &fence, false, 0, 0, 0,
+                        GRALLOC_USAGE_SW_WRITE_OFTEN));
+        ASSERT_EQ(OK, mProducer->requestBuffer(slots[i], &buffer));
+    }
+    for (int i = 0; i < 3; i++) {
+        ASSERT_EQ(OK, mProducer->queueBuffer(slots[i], input, &output));
+        ASSERT_EQ(OK, mConsumer->acquireBuffer(&item, 0));
+        ASSERT_EQ(slots[i], item.mBuf);
+        ASSERT_EQ(OK, mConsumer->releaseBuffer(item.mBuf, item.mFrameNumber,
+                EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+    }
+
+    // The fourth slot has never been queued, so its frame number is still
+    // UINT32_MAX and it is the newest rather than the oldest. The slots come
+    // back in the order they were queued in, and requeueing one sends it to
+    // the back of the line.
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < 3; i++) {
+            int slot;
+            ASSERT_EQ(OK, mProducer->dequeueBuffer(&slot, &fence, false, 0, 0, 0,
+                    GRALLOC_USAGE_SW_WRITE_OFTEN));
+            EXPECT_EQ(slots[i], slot);
+            ASSERT_EQ(OK, mProducer->queueBuffer(slot, input, &output));
+            ASSERT_EQ(OK, mConsumer->acquireBuffer(&item, 0));
+            ASSERT_EQ(OK, mConsumer->releaseBuffer(item.mBuf, item.mFrameNumber,
+                    EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+        }
+    }
+
+    // A canceled buffer goes to the front of the line.
+    int slot;
+    ASSERT_EQ(OK, mProducer->dequeueBuffer(&slot, &fence, false, 0, 0, 0,
+            GRALLOC_USAGE_SW_WRITE_OFTEN));
+    EXPECT_EQ(slots[0], slot);
+    mProducer->cancelBuffer(slot, Fence::NO_FENCE);
+    ASSERT_EQ(OK, mProducer->dequeueBuffer(&slot, &fence, false, 0, 0, 0,
+            GRALLOC_USAGE_SW_WRITE_OFTEN));
+    EXPECT_EQ(slots[0], slot);
+}
+
+TEST_F(BufferQueueTest, QueueAndDequeueBuffer_DequeuesWithoutBlocking) {
+    createBufferQueue();
+    sp<DummyConsumer> dc(new DummyConsumer);
+    ASSERT_EQ(OK, mConsumer->consumerConnect(dc, false));
+    IGraphicBufferProducer::QueueBufferOutput output;
+    ASSERT_EQ(OK, mProducer->connect(new DummyProducerListener,
+            NATIVE_WINDOW_API_EGL, false, &output));
+    ASSERT_EQ(OK, mProducer->setBufferCount(2));
+
+    int slot;
+    sp<Fence> fence;
+    sp<GraphicBuffer> buffer;
+    IGraphicBufferProducer::QueueBufferInput input(0, false, Rect(0, 0, 1, 1),
+            NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, false, Fence::NO_FENCE);
+    ASSERT_EQ(IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION,
+            mProducer->dequeueBuffer(&slot, &fence, false, 0, 0, 0,
+                    GRALLOC_USAGE_SW_WRITE_OFTEN));
+    ASSERT_EQ(OK, mProducer->requestBuffer(slot, &buffer));
+
+    // The other slot is free, so it is dequeued along with the queue and
+    // its new buffer is returned.
+    int nextSlot;
+    sp<GraphicBuffer> nextBuffer;
+    status_t dequeueResult;
+    ASSERT_EQ(OK, mProducer->queueAndDequeueBuffer(slot, input, &output,
+            &nextSlot, &fence, &nextBuffer, &dequeueResult, false, 0, 0, 0,
+            GRALLOC_USAGE_SW_WRITE_OFTEN));
+    ASSERT_EQ(IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION,
+            dequeueResult);
+    EXPECT_NE(slot, nextSlot);
+    ASSERT_TRUE(nextBuffer != NULL);
+
+    // Both buffers are now queued, so the dequeue would have to wait for
+    // the consumer.
+    ASSERT_EQ(OK, mProducer->queueAndDequeueBuffer(nextSlot, input, &output,
+            &slot, &fence, &buffer, &dequeueResult, false, 0, 0, 0,
+            GRALLOC_USAGE_SW_WRITE_OFTEN));
+    EXPECT_EQ(WOULD_BLOCK, dequeueResult);
+
+    IGraphicBufferConsumer::BufferItem item;
+    ASSERT_EQ(OK, mConsumer->acquireBuffer(&item, 0));
+    ASSERT_EQ(OK, mConsumer->releaseBuffer(item.mBuf, item.mFrameNumber,
+            EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+    ASSERT_EQ(OK, mProducer->dequeueBuffer(&slot, &fence, false, 0, 0, 0,
+            GRALLOC_USAGE_SW_WRITE_OFTEN));
+    EXPECT_EQ(item.mBuf, slot);
+}
+
+// Counts the frames that become available and lets a consumer thread wait
+// for them.
+class FrameCountingConsumer : public BnConsumerListener {
+public:
+    FrameCountingConsumer() : mPendingFrames(0) {}
+
+    virtual void onFrameAvailable(const BufferItem& /* item */) {
+        Mutex::Autolock lock(mMutex);
+        mPendingFrames++;
+        mCondition.signal();
+    }
+    virtual void onBuffersReleased() {}
+    virtual void onSidebandStreamChanged() {}
+
+    void waitForFrame() {
+        Mutex::Autolock lock(mMutex);
+        while (mPendingFrames == 0) {
+            mCondition.wait(mMutex);
+        }
+        mPendingFrames--;
+    }
+
+private:
+    Mutex mMutex;
+    Condition mCondition;
+    int mPendingFrames;
+};
+
+class ProducerThread : public Thread {
+public:
+    ProducerThread(const sp<IGraphicBufferProducer>& producer, int numFrames) :
+        Thread(false), mProducer(producer), mNumFrames(numFrames),
+        mResult(NO_ERROR) {}
+
+    status_t getResult() const { return mResult; }
+
+private:
+    virtual bool threadLoop() {
+        IGraphicBufferProducer::QueueBufferOutput output;
+        for (int i = 0; i < mNumFrames; i++) {
+            int slot;
+            sp<Fence> fence;
+            status_t result = mProducer->dequeueBuffer(&slot, &fence, false,
+                    0, 0, 0, GRALLOC_USAGE_SW_WRITE_OFTEN);
+            if (result & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) {
+                sp<GraphicBuffer> buffer;
+                result = mProducer->requestBuffer(slot, &buffer);
+            }
+            if (result < 0) {
+                mResult = result;
+                break;
+            }
+            IGraphicBufferProducer::QueueBufferInput input(i, false,
+                    Rect(0, 0, 1, 1), NATIVE_WINDOW_SCALING_MODE_FREEZE, 0,
+                    false, Fence::NO_FENCE);
+            result = mProducer->queueBuffer(slot, input, &output);
+            if (result != OK) {
+                mResult = result;
+                break;
+            }
+        }
+        return false;
+    }
+
+    sp<IGraphicBufferProducer> mProducer;
+    int mNumFrames;
+    status_t mResult;
+};
+
+TEST_F(BufferQueueTest, ConcurrentProducerAndConsumer_DeliverAllFrames) {
+    const int NUM_FRAMES = 500;
+    createBufferQueue();
+    sp<FrameCountingConsumer> fc(new FrameCountingConsumer);
+    ASSERT_EQ(OK, mConsumer->consumerConnect(fc, false));
+    IGraphicBufferProducer::QueueBufferOutput output;
+    ASSERT_EQ(OK, mProducer->connect(new DummyProducerListener,
+            NATIVE_WINDOW_API_CPU, false, &output));
+    ASSERT_EQ(OK, mProducer->setBufferCount(3));
+
+    sp<ProducerThread> producerThread(new ProducerThread(mProducer,
+            NUM_FRAMES));
+    producerThread->run("BQTestProducer");
+
+    // Every frame must be acquired exactly once and in order.
+    IGraphicBufferConsumer::BufferItem item;
+    for (int i = 0; i < NUM_FRAMES; i++) {
+        fc->waitForFrame();
+        ASSERT_EQ(OK, mConsumer->acquireBuffer(&item, 0));
+        EXPECT_EQ(uint64_t(i + 1), item.mFrameNumber);
+        EXPECT_EQ(int64_t(i), item.mTimestamp);
+        ASSERT_EQ(OK, mConsumer->releaseBuffer(item.mBuf, item.mFrameNumber,
+                EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+    }
+    producerThread->join();
+    ASSERT_EQ(OK, producerThread->getResult());
+
+    // No slot may be left dequeued or acquired.
+    ASSERT_EQ(IGraphicBufferConsumer::NO_BUFFER_AVAILABLE,
+            mConsumer->acquireBuffer(&item, 0));
+    ASSERT_EQ(OK, mProducer->setBufferCount(4));
+    for (int i = 0; i < 3; i++) {
+        int slot;
+        sp<Fence> fence;
+        ASSERT_LE(0, mProducer->dequeueBuffer(&slot, &fence, false, 0, 0, 0,
+                GRALLOC_USAGE_SW_WRITE_OFTEN));
+    }
+}
+
+TEST_F(BufferQueueTest, Statistics_CountEveryStage) {
+    createBufferQueue();
+    sp<DummyConsumer> dc(new DummyConsumer);
+    ASSERT_EQ(OK, mConsumer->consumerConnect(dc, false));
+    IGraphicBufferProducer::QueueBufferOutput qbo;
+    ASSERT_EQ(OK, mProducer->connect(new DummyProducerListener,
+            NATIVE_WINDOW_API_CPU, false, &qbo));
+
+    int slot;
+    sp<Fence> fence;
+    sp<GraphicBuffer> buf;
+    IGraphicBufferProducer::QueueBufferInput qbi(0, false, Rect(0, 0, 1, 1),
+            NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, false, Fence::NO_FENCE);
+    BufferQueue::BufferItem item;
+
+    for (int i = 0; i < 3; i++) {
+        status_t result = mProducer->dequeueBuffer(&slot, &fence, false, 1, 1,
+                0, GRALLOC_USAGE_SW_READ_OFTEN);
+        ASSERT_GE(result, 0);
+        if (result & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) {
+            ASSERT_EQ(OK, mProducer->requestBuffer(slot, &buf));
+        }
+        ASSERT_EQ(OK, mProducer->queueBuffer(slot, qbi, &qbo));
+        ASSERT_EQ(OK, mConsumer->acquireBuffer(&item, 0));
+        ASSERT_EQ(OK, mConsumer->releaseBuffer(item.mBuf, item.mFrameNumber,
+                EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+    }
+
+    BufferQueueStatistics statistics;
+    ASSERT_EQ(OK, mConsumer->getStatistics(&statistics));
+    EXPECT_EQ(3U, statistics.dequeueWait.count);
+    EXPECT_EQ(3U, statistics.queueToAcquire.count);
+    EXPECT_EQ(3U, statistics.acquireToRelease.count);
+    EXPECT_EQ(3U, statistics.queueDepth.buckets[1]);
+    EXPECT_EQ(0U, statistics.numDropped);
+}
+
+TEST_F(BufferQueueTest, Statistics_CountDroppedBuffers) {
+    createBufferQueue();
+    sp<DummyConsumer> dc(new DummyConsumer);
+    ASSERT_EQ(OK, mConsumer->consumerConnect(dc, false));
+    IGraphicBufferProducer::QueueBufferOutput qbo;
+    ASSERT_EQ(OK, mProducer->connect(new DummyProducerListener,
+            NATIVE_WINDOW_API_CPU, false, &qbo));
+
+    int slot;
+    sp<Fence> fence;
+    sp<GraphicBuffer> buf;
+    IGraphicBufferProducer::QueueBufferInput qbi(0, false, Rect(0, 0, 1, 1),
+            NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, true, Fence::NO_FENCE);
+
+    // In async mode, every queued buffer replaces the one before it
+    for (int i = 0; i < 3; i++) {
+        status_t result = mProducer->dequeueBuffer(&slot, &fence, true, 1, 1,
+                0, GRALLOC_USAGE_SW_READ_OFTEN);
+        ASSERT_GE(result, 0);
+        if (result & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) {
+            ASSERT_EQ(OK, mProducer->requestBuffer(slot, &buf));
+        }
+        ASSERT_EQ(OK, mProducer->queueBuffer(slot, qbi, &qbo));
+    }
+
+    BufferQueueStatistics statistics;
+    ASSERT_EQ(OK, mConsumer->getStatistics(&statistics));
+    EXPECT_EQ(2U, statistics.numDropped);
+    EXPECT_EQ(0U, statistics.queueToAcquire.count);
+}
+
+// Forwards transactions to a binder of this process, so that an interface
+// can be used through its proxy without a second process.
+class LoopbackBinder : public BBinder {
+public:
+    LoopbackBinder(const sp<IBinder>& target) : mTarget(target) {}
+
+protected:
+    virtual status_t onTransact(uint32_t code, const Parcel& data,
+            Parcel* reply, uint32_t flags) {
+        return mTarget->transact(code, data, reply, flags);
+    }
+
+private:
+    sp<IBinder> mTarget;
+};
+
+TEST_F(BufferQueueTest, ProxyReceivesRecycledBufferById) {
+    // With an allocator of this process, the buffer freed when a slot is
+    // reallocated for another size goes to the GraphicBufferPool and comes
+    // back once that size is asked for again.
+    BufferQueue::createBufferQueue(&mProducer, &mConsumer,
+            new GraphicBufferAlloc());
+    sp<DummyConsumer> dc(new DummyConsumer);
+    ASSERT_EQ(OK, mConsumer->consumerConnect(dc, false));
+
+    sp<IGraphicBufferProducer> proxy = IGraphicBufferProducer::asInterface(
+            new LoopbackBinder(mProducer->asBinder()));
+    ASSERT_NE(mProducer.get(), proxy.get());
+
+    IGraphicBufferProducer::QueueBufferOutput output;
+    ASSERT_EQ(OK, proxy->connect(NULL, NATIVE_WINDOW_API_CPU, false,
+            &output));
+
+    static const uint32_t SIZES[] = { 16, 32, 16 };
+    sp<GraphicBuffer> first;
+    for (size_t pass = 0; pass < sizeof(SIZES) / sizeof(SIZES[0]); pass++) {
+        int slot;
+        sp<Fence> fence;
+        status_t result = proxy->dequeueBuffer(&slot, &fence, false,
+                SIZES[pass], SIZES[pass], PIXEL_FORMAT_RGBA_8888,
+                GRALLOC_USAGE_SW_WRITE_OFTEN);
+        ASSERT_LE(0, result);
+        ASSERT_TRUE(result & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION);
+
+        sp<GraphicBuffer> buffer;
+        ASSERT_EQ(OK, proxy->requestBuffer(slot, &buffer));
+        ASSERT_TRUE(buffer != NULL);
+        if (pass == 0) {
+            first = buffer;
+        } else if (SIZES[pass] == SIZES[0]) {
+            // Sent by id: the proxy got the very GraphicBuffer it had
+            // received before, without importing its handle again.
+            EXPECT_EQ(first.get(), buffer.get());
+        }
+
+        proxy->cancelBuffer(slot, Fence::NO_FENCE);
+    }
+    ASSERT_EQ(OK, proxy->disconnect(NATIVE_WINDOW_API_CPU));
+}
+
+TEST(BufferQueueStatisticsTest, TimeHistogramBuckets) {
+    typedef BufferQueueStatistics::TimeHistogram TimeHistogram;
+    BufferQueueStatistics statistics;
+    TimeHistogram& h(statistics.dequeueWait);
+
+    h.add(0);
+    h.add(TimeHistogram::FIRST_BUCKET_NS - 1);
+    h.add(TimeHistogram::FIRST_BUCKET_NS);
+    h.add(3 * TimeHistogram::FIRST_BUCKET_NS);
+    h.add(1000000000000LL);
+
+    EXPECT_EQ(2U, h.buckets[0]);
+    EXPECT_EQ(1U, h.buckets[1]);
+    EXPECT_EQ(1U, h.buckets[2]);
+    EXPECT_EQ(1U, h.buckets[TimeHistogram::NUM_BUCKETS - 1]);
+    EXPECT_EQ(5U, h.count);
+    EXPECT_EQ(1000000000000LL, h.maxNs);
+}
+
 } // namespace android
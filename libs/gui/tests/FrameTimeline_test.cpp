@@ -0,0 +1,134 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FrameTimeline_test"
+//#define LOG_NDEBUG 0
+
+#include <string.h>
+
+#include <binder/IMemory.h>
+#include <binder/MemoryHeapBase.h>
+
+#include <gui/FrameTimeline.h>
+#include <gui/ISurfaceComposer.h>
+#include <private/gui/ComposerService.h>
+
+#include <gtest/gtest.h>
+
+namespace android {
+
+class FrameTimelineTest : public ::testing::Test {
+
+protected:
+    FrameTimelineTest() {
+        const ::testing::TestInfo* const testInfo =
+            ::testing::UnitTest::GetInstance()->current_test_info();
+        ALOGV("Begin test: %s.%s", testInfo->test_case_name(),
+                testInfo->name());
+    }
+
+    ~FrameTimelineTest() {
+        const ::testing::TestInfo* const testInfo =
+            ::testing::UnitTest::GetInstance()->current_test_info();
+        ALOGV("End test:   %s.%s", testInfo->test_case_name(),
+                testInfo->name());
+    }
+
+    static FrameTimelineRecord makeRecord(int32_t id, uint64_t frameNumber) {
+        FrameTimelineRecord record;
+        memset(&record, 0, sizeof(record));
+        record.type = FrameTimelineRecord::TYPE_LAYER;
+        record.id = id;
+        record.frameNumber = frameNumber;
+        record.queueTime = 1000 * frameNumber;
+        record.presentTime = FrameTimelineRecord::TIME_UNKNOWN;
+        strcpy(record.name, "test");
+        return record;
+    }
+};
+
+TEST_F(FrameTimelineTest, RecordsAreReadInOrder) {
+    sp<FrameTimelineWriter> writer = new FrameTimelineWriter(8);
+    ASSERT_EQ(NO_ERROR, writer->initCheck());
+    FrameTimelineReader reader(writer->getHeap());
+    ASSERT_EQ(NO_ERROR, reader.initCheck());
+
+    FrameTimelineRecord records[8];
+    uint32_t lost = 1;
+    EXPECT_EQ(0U, reader.read(records, 8, &lost));
+    EXPECT_EQ(0U, lost);
+
+    for (uint64_t i = 0; i < 5; i++) {
+        writer->write(makeRecord(7, i));
+    }
+    ASSERT_EQ(3U, reader.read(records, 3, &lost));
+    EXPECT_EQ(0U, lost);
+    for (uint64_t i = 0; i < 3; i++) {
+        EXPECT_EQ(7, records[i].id);
+        EXPECT_EQ(i, records[i].frameNumber);
+        EXPECT_EQ(int64_t(1000 * i), records[i].queueTime);
+        EXPECT_STREQ("test", records[i].name);
+    }
+    ASSERT_EQ(2U, reader.read(records, 8, &lost));
+    EXPECT_EQ(3U, records[0].frameNumber);
+    EXPECT_EQ(4U, records[1].frameNumber);
+}
+
+TEST_F(FrameTimelineTest, ReaderStartsAtTheCurrentRecord) {
+    sp<FrameTimelineWriter> writer = new FrameTimelineWriter(8);
+    writer->write(makeRecord(1, 0));
+    FrameTimelineReader reader(writer->getHeap());
+    writer->write(makeRecord(1, 1));
+
+    FrameTimelineRecord records[8];
+    ASSERT_EQ(1U, reader.read(records, 8));
+    EXPECT_EQ(1U, records[0].frameNumber);
+}
+
+TEST_F(FrameTimelineTest, OverwrittenRecordsAreCountedAsLost) {
+    sp<FrameTimelineWriter> writer = new FrameTimelineWriter(4);
+    FrameTimelineReader reader(writer->getHeap());
+    for (uint64_t i = 0; i < 10; i++) {
+        writer->write(makeRecord(1, i));
+    }
+
+    FrameTimelineRecord records[8];
+    uint32_t lost = 0;
+    ASSERT_EQ(4U, reader.read(records, 8, &lost));
+    EXPECT_EQ(6U, lost);
+    for (uint64_t i = 0; i < 4; i++) {
+        EXPECT_EQ(6 + i, records[i].frameNumber);
+    }
+}
+
+TEST_F(FrameTimelineTest, OtherHeapsAreRejected) {
+    sp<IMemoryHeap> heap = new MemoryHeapBase(4096, 0, "FrameTimeline_test");
+    FrameTimelineReader reader(heap);
+    EXPECT_NE(NO_ERROR, reader.initCheck());
+
+    FrameTimelineRecord record;
+    EXPECT_EQ(0U, reader.read(&record, 1));
+}
+
+TEST_F(FrameTimelineTest, SurfaceFlingerSharesItsTimeline) {
+    sp<ISurfaceComposer> composer(ComposerService::getComposerService());
+    sp<IMemoryHeap> heap;
+    ASSERT_EQ(NO_ERROR, composer->getFrameTimeline(&heap));
+    FrameTimelineReader reader(heap);
+    EXPECT_EQ(NO_ERROR, reader.initCheck());
+}
+
+} // namespace android
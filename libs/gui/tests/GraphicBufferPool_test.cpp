@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "GraphicBufferPool_test"
+//#define LOG_NDEBUG 0
+
+#include <gui/GraphicBufferPool.h>
+
+#include <ui/Fence.h>
+#include <ui/GraphicBuffer.h>
+
+#include <gtest/gtest.h>
+
+namespace android {
+
+static const uint32_t kUsage = GraphicBuffer::USAGE_SW_READ_OFTEN |
+        GraphicBuffer::USAGE_SW_WRITE_OFTEN;
+
+// The pool is shared by the whole process, so every test uses its own
+// buffer size to stay out of the way of the others.
+class GraphicBufferPoolTest : public ::testing::Test {
+protected:
+    sp<GraphicBuffer> createBuffer(uint32_t w, uint32_t h) {
+        sp<GraphicBuffer> buffer(new GraphicBuffer(w, h, PIXEL_FORMAT_RGBA_8888,
+                kUsage));
+        EXPECT_EQ(NO_ERROR, buffer->initCheck());
+        return buffer;
+    }
+
+    GraphicBufferPool& pool() { return GraphicBufferPool::getInstance(); }
+};
+
+TEST_F(GraphicBufferPoolTest, Acquire_ReturnsRecycledBuffer) {
+    sp<GraphicBuffer> buffer(createBuffer(17, 11));
+    pool().recycle(buffer, Fence::NO_FENCE, 1000);
+    const uint64_t id = buffer->getId();
+    buffer.clear();
+
+    sp<GraphicBuffer> pooled(pool().acquire(17, 11, PIXEL_FORMAT_RGBA_8888,
+            kUsage, 1000));
+    ASSERT_TRUE(pooled != NULL);
+    EXPECT_EQ(id, pooled->getId());
+
+    // Each buffer is only handed out once.
+    EXPECT_TRUE(pool().acquire(17, 11, PIXEL_FORMAT_RGBA_8888, kUsage,
+            1000) == NULL);
+}
+
+TEST_F(GraphicBufferPoolTest, Acquire_OnlyMatchesSameOwnerAndProperties) {
+    sp<GraphicBuffer> buffer(createBuffer(19, 13));
+    pool().recycle(buffer, Fence::NO_FENCE, 1000);
+    buffer.clear();
+
+    EXPECT_TRUE(pool().acquire(19, 13, PIXEL_FORMAT_RGBA_8888, kUsage,
+            1001) == NULL);
+    EXPECT_TRUE(pool().acquire(13, 19, PIXEL_FORMAT_RGBA_8888, kUsage,
+            1000) == NULL);
+    EXPECT_TRUE(pool().acquire(19, 13, PIXEL_FORMAT_RGB_565, kUsage,
+            1000) == NULL);
+    EXPECT_TRUE(pool().acquire(19, 13, PIXEL_FORMAT_RGBA_8888,
+            GraphicBuffer::USAGE_SW_READ_OFTEN, 1000) == NULL);
+    EXPECT_TRUE(pool().acquire(19, 13, PIXEL_FORMAT_RGBA_8888, kUsage,
+            1000) != NULL);
+}
+
+TEST_F(GraphicBufferPoolTest, Acquire_SkipsBuffersStillInUse) {
+    sp<GraphicBuffer> buffer(createBuffer(23, 7));
+    pool().recycle(buffer, Fence::NO_FENCE, 1000);
+
+    // The test still holds a reference, like a consumer that has not
+    // released the buffer yet.
+    EXPECT_TRUE(pool().acquire(23, 7, PIXEL_FORMAT_RGBA_8888, kUsage,
+            1000) == NULL);
+    buffer.clear();
+    EXPECT_TRUE(pool().acquire(23, 7, PIXEL_FORMAT_RGBA_8888, kUsage,
+            1000) != NULL);
+}
+
+TEST_F(GraphicBufferPoolTest, IdlePoolDropsBuffersAfterMaxAge) {
+    sp<GraphicBuffer> buffer(createBuffer(29, 5));
+    pool().recycle(buffer, Fence::NO_FENCE, 1000);
+    wp<GraphicBuffer> weak(buffer);
+    buffer.clear();
+    EXPECT_TRUE(weak.promote() != NULL);
+
+    // Nothing uses the pool meanwhile, so only its own thread can drop the
+    // buffer.
+    usleep(GraphicBufferPool::MAX_AGE / 1000 + 200000);
+    EXPECT_TRUE(weak.promote() == NULL);
+}
+
+} // namespace android
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LATENCIES_H
+#define ANDROID_LATENCIES_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+// Collects call durations and prints their distribution.
+class Latencies {
+public:
+    void add(nsecs_t duration) {
+        mDurations.add(duration);
+    }
+
+    void print(const char* name) {
+        if (mDurations.isEmpty()) {
+            printf("%-14s no samples\n", name);
+            return;
+        }
+        qsort(mDurations.editArray(), mDurations.size(), sizeof(nsecs_t),
+                compare);
+        const size_t n = mDurations.size();
+        printf("%-14s %7zu calls  p50 %7.1f us  p99 %7.1f us  "
+                "max %8.1f us\n", name, n,
+                mDurations[n / 2] / 1000.0,
+                mDurations[(n * 99) / 100] / 1000.0,
+                mDurations[n - 1] / 1000.0);
+    }
+
+private:
+    static int compare(const void* lhs, const void* rhs) {
+        const nsecs_t a = *static_cast<const nsecs_t*>(lhs);
+        const nsecs_t b = *static_cast<const nsecs_t*>(rhs);
+        return a < b ? -1 : (a > b ? 1 : 0);
+    }
+
+    Vector<nsecs_t> mDurations;
+};
+
+} // namespace android
+
+#endif
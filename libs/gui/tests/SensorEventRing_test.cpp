@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SensorEventRing_test"
+//#define LOG_NDEBUG 0
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+
+#include <binder/Parcel.h>
+
+#include <gui/SensorEventQueue.h>
+#include <gui/SensorEventRing.h>
+
+#include <android/sensor.h>
+
+#include <gtest/gtest.h>
+
+namespace android {
+
+static const nsecs_t kLongLatency = 1000000000000LL; // 1000 s
+
+class SensorEventRingTest : public ::testing::Test {
+protected:
+    // Creates a ring and the reader end of it, as an app would get it.
+    void createRing(size_t capacity, nsecs_t doorbellLatencyNs) {
+        mWriter = new SensorEventRing(capacity, doorbellLatencyNs);
+        ASSERT_EQ(NO_ERROR, mWriter->initCheck());
+        Parcel parcel;
+        ASSERT_EQ(NO_ERROR, mWriter->writeToParcel(&parcel));
+        parcel.setDataPosition(0);
+        mReader = new SensorEventRing(parcel);
+        ASSERT_EQ(NO_ERROR, mReader->initCheck());
+        ASSERT_EQ(mWriter->getCapacity(), mReader->getCapacity());
+    }
+
+    static ASensorEvent makeEvent(int64_t timestamp) {
+        ASensorEvent event;
+        memset(&event, 0, sizeof(event));
+        event.version = sizeof(event);
+        event.sensor = 1;
+        event.type = ASENSOR_TYPE_ACCELEROMETER;
+        event.timestamp = timestamp;
+        return event;
+    }
+
+    bool doorbellRung() const {
+        struct pollfd fd = { mReader->getFd(), POLLIN, 0 };
+        return poll(&fd, 1, 0) == 1;
+    }
+
+    sp<SensorEventRing> mWriter;
+    sp<SensorEventRing> mReader;
+};
+
+TEST_F(SensorEventRingTest, EventsAreReadInOrderAcrossTheWrap) {
+    ASSERT_NO_FATAL_FAILURE(createRing(SensorEventRing::MIN_CAPACITY, 0));
+    const size_t capacity = mWriter->getCapacity();
+
+    ASensorEvent events[SensorEventRing::MIN_CAPACITY];
+    int64_t next = 0;
+    int64_t expected = 0;
+    for (int round = 0; round < 5; round++) {
+        for (size_t i = 0; i < capacity - 3; i++) {
+            events[i] = makeEvent(next++);
+        }
+        ASSERT_EQ(ssize_t(capacity - 3), mWriter->write(events, capacity - 3));
+
+        ASensorEvent read[SensorEventRing::MIN_CAPACITY];
+        ASSERT_EQ(ssize_t(capacity - 3), mReader->read(read, capacity));
+        for (size_t i = 0; i < capacity - 3; i++) {
+            EXPECT_EQ(expected++, read[i].timestamp);
+        }
+    }
+    ASensorEvent const* inPlace;
+    EXPECT_EQ(0, mReader->peek(&inPlace));
+}
+
+TEST_F(SensorEventRingTest, WriteFailsWithoutWritingWhenFull) {
+    ASSERT_NO_FATAL_FAILURE(createRing(SensorEventRing::MIN_CAPACITY, 0));
+    const size_t capacity = mWriter->getCapacity();
+
+    ASensorEvent events[SensorEventRing::MIN_CAPACITY];
+    for (size_t i = 0; i < capacity; i++) {
+        events[i] = makeEvent(i);
+    }
+    ASSERT_EQ(ssize_t(capacity - 1), mWriter->write(events, capacity - 1));
+    EXPECT_EQ(-EAGAIN, mWriter->write(events, 2));
+
+    ASensorEvent const* inPlace;
+    ASSERT_EQ(ssize_t(capacity - 1), mReader->peek(&inPlace));
+    EXPECT_EQ(0, inPlace[0].timestamp);
+    mReader->consume(2);
+    EXPECT_EQ(2, mWriter->write(events, 2));
+}
+
+TEST_F(SensorEventRingTest, DoorbellIsCoalesced) {
+    ASSERT_NO_FATAL_FAILURE(createRing(64, kLongLatency));
+
+    // The first write rings, since the doorbell has never been rung.
+    ASensorEvent event = makeEvent(0);
+    ASSERT_EQ(1, mWriter->write(&event, 1));
+    EXPECT_TRUE(doorbellRung());
+    mReader->clearDoorbell();
+    EXPECT_FALSE(doorbellRung());
+
+    // Later ones wait for the latency to pass...
+    ASSERT_EQ(1, mWriter->write(&event, 1));
+    EXPECT_FALSE(doorbellRung());
+    mWriter->ringDoorbell();
+    EXPECT_TRUE(doorbellRung());
+    mReader->clearDoorbell();
+
+    // ...unless an event must not wait.
+    event.flags |= WAKE_UP_SENSOR_EVENT_NEEDS_ACK;
+    ASSERT_EQ(1, mWriter->write(&event, 1));
+    EXPECT_TRUE(doorbellRung());
+}
+
+} // namespace android
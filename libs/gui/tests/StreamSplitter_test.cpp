@@ -75,6 +75,51 @@ private:
     int mAllocCount;
 };
 
+// Dequeues a buffer from the input, writes value to it and queues it. If
+// outBuffer is not NULL, it is set to the buffer.
+static void queueValue(const sp<IGraphicBufferProducer>& producer,
+        uint32_t value, sp<GraphicBuffer>* outBuffer = NULL) {
+    int slot;
+    sp<Fence> fence;
+    status_t result = producer->dequeueBuffer(&slot, &fence, false, 0, 0, 0,
+            GRALLOC_USAGE_SW_WRITE_OFTEN);
+    ASSERT_LE(0, result);
+    sp<GraphicBuffer> buffer;
+    ASSERT_EQ(OK, producer->requestBuffer(slot, &buffer));
+
+    uint32_t* dataIn;
+    ASSERT_EQ(OK, buffer->lock(GraphicBuffer::USAGE_SW_WRITE_OFTEN,
+            reinterpret_cast<void**>(&dataIn)));
+    *dataIn = value;
+    ASSERT_EQ(OK, buffer->unlock());
+
+    IGraphicBufferProducer::QueueBufferInput qbInput(0, false,
+            Rect(0, 0, 1, 1), NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, false,
+            Fence::NO_FENCE);
+    IGraphicBufferProducer::QueueBufferOutput qbOutput;
+    ASSERT_EQ(OK, producer->queueBuffer(slot, qbInput, &qbOutput));
+    if (outBuffer != NULL) {
+        *outBuffer = buffer;
+    }
+}
+
+// Acquires a buffer from an output, checks that it holds value and releases
+// it.
+static void expectValue(const sp<IGraphicBufferConsumer>& consumer,
+        uint32_t value) {
+    IGraphicBufferConsumer::BufferItem item;
+    ASSERT_EQ(OK, consumer->acquireBuffer(&item, 0));
+
+    uint32_t* dataOut;
+    ASSERT_EQ(OK, item.mGraphicBuffer->lock(GraphicBuffer::USAGE_SW_READ_OFTEN,
+            reinterpret_cast<void**>(&dataOut)));
+    EXPECT_EQ(value, *dataOut);
+    ASSERT_EQ(OK, item.mGraphicBuffer->unlock());
+
+    ASSERT_EQ(OK, consumer->releaseBuffer(item.mBuf, item.mFrameNumber,
+            EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+}
+
 TEST_F(StreamSplitterTest, OneInputOneOutput) {
     sp<CountedAllocator> allocator(new CountedAllocator);
 
@@ -203,6 +248,115 @@ TEST_F(StreamSplitterTest, OneInputMultipleOutputs) {
     ASSERT_EQ(1, allocator->getAllocCount());
 }
 
+TEST_F(StreamSplitterTest, SlowOutputsDropInsteadOfStalling) {
+    const uint32_t NUM_FRAMES = 5;
+
+    sp<IGraphicBufferProducer> inputProducer;
+    sp<IGraphicBufferConsumer> inputConsumer;
+    BufferQueue::createBufferQueue(&inputProducer, &inputConsumer);
+
+    // The fast output keeps up with the input, the other two don't consume
+    // anything until the input has queued all of its frames.
+    sp<IGraphicBufferProducer> fastProducer, dropOldestProducer, latestProducer;
+    sp<IGraphicBufferConsumer> fastConsumer, dropOldestConsumer, latestConsumer;
+    BufferQueue::createBufferQueue(&fastProducer, &fastConsumer);
+    BufferQueue::createBufferQueue(&dropOldestProducer, &dropOldestConsumer);
+    BufferQueue::createBufferQueue(&latestProducer, &latestConsumer);
+    ASSERT_EQ(OK, fastConsumer->consumerConnect(new DummyListener, false));
+    ASSERT_EQ(OK, dropOldestConsumer->consumerConnect(new DummyListener,
+            false));
+    ASSERT_EQ(OK, latestConsumer->consumerConnect(new DummyListener, false));
+
+    sp<StreamSplitter> splitter;
+    ASSERT_EQ(OK, StreamSplitter::createSplitter(inputConsumer, &splitter));
+    ASSERT_EQ(OK, splitter->addOutput(fastProducer));
+    ASSERT_EQ(OK, splitter->addOutput(dropOldestProducer,
+            StreamSplitter::OUTPUT_DROP_OLDEST, 2));
+    ASSERT_EQ(OK, splitter->addOutput(latestProducer,
+            StreamSplitter::OUTPUT_LATEST_ONLY, 0));
+    ASSERT_EQ(BAD_VALUE, splitter->addOutput(latestProducer,
+            StreamSplitter::OUTPUT_DROP_OLDEST, 0));
+
+    IGraphicBufferProducer::QueueBufferOutput qbOutput;
+    ASSERT_EQ(OK, inputProducer->connect(new DummyProducerListener,
+            NATIVE_WINDOW_API_CPU, false, &qbOutput));
+
+    // With only lossless outputs, the third frame would block in the
+    // splitter until the slow outputs release a buffer.
+    for (uint32_t frame = 0; frame < NUM_FRAMES; ++frame) {
+        ASSERT_NO_FATAL_FAILURE(queueValue(inputProducer, frame));
+        ASSERT_NO_FATAL_FAILURE(expectValue(fastConsumer, frame));
+    }
+
+    // The slow outputs got the first two frames and then only the newest
+    // ones that fit in their queue depth.
+    ASSERT_NO_FATAL_FAILURE(expectValue(dropOldestConsumer, 0));
+    ASSERT_NO_FATAL_FAILURE(expectValue(dropOldestConsumer, 1));
+    ASSERT_NO_FATAL_FAILURE(expectValue(dropOldestConsumer, 3));
+    ASSERT_NO_FATAL_FAILURE(expectValue(dropOldestConsumer, 4));
+
+    ASSERT_NO_FATAL_FAILURE(expectValue(latestConsumer, 0));
+    ASSERT_NO_FATAL_FAILURE(expectValue(latestConsumer, 1));
+    ASSERT_NO_FATAL_FAILURE(expectValue(latestConsumer, 4));
+
+    IGraphicBufferConsumer::BufferItem item;
+    ASSERT_EQ(IGraphicBufferConsumer::NO_BUFFER_AVAILABLE,
+            dropOldestConsumer->acquireBuffer(&item, 0));
+    ASSERT_EQ(IGraphicBufferConsumer::NO_BUFFER_AVAILABLE,
+            latestConsumer->acquireBuffer(&item, 0));
+
+    String8 result;
+    splitter->dump(result, "");
+    ALOGV("%s", result.string());
+}
+
+TEST_F(StreamSplitterTest, AbandonmentReleasesWaitingBuffers) {
+    sp<IGraphicBufferProducer> inputProducer;
+    sp<IGraphicBufferConsumer> inputConsumer;
+    BufferQueue::createBufferQueue(&inputProducer, &inputConsumer);
+
+    sp<IGraphicBufferProducer> fastProducer, latestProducer;
+    sp<IGraphicBufferConsumer> fastConsumer, latestConsumer;
+    BufferQueue::createBufferQueue(&fastProducer, &fastConsumer);
+    BufferQueue::createBufferQueue(&latestProducer, &latestConsumer);
+    ASSERT_EQ(OK, fastConsumer->consumerConnect(new DummyListener, false));
+    ASSERT_EQ(OK, latestConsumer->consumerConnect(new DummyListener, false));
+
+    sp<StreamSplitter> splitter;
+    ASSERT_EQ(OK, StreamSplitter::createSplitter(inputConsumer, &splitter));
+    ASSERT_EQ(OK, splitter->addOutput(fastProducer));
+    ASSERT_EQ(OK, splitter->addOutput(latestProducer,
+            StreamSplitter::OUTPUT_LATEST_ONLY, 0));
+
+    IGraphicBufferProducer::QueueBufferOutput qbOutput;
+    ASSERT_EQ(OK, inputProducer->connect(new DummyProducerListener,
+            NATIVE_WINDOW_API_CPU, false, &qbOutput));
+
+    // The latest-only output doesn't consume anything, so the third frame
+    // waits for it.
+    sp<GraphicBuffer> waiting;
+    for (uint32_t frame = 0; frame < 3; ++frame) {
+        ASSERT_NO_FATAL_FAILURE(queueValue(inputProducer, frame,
+                frame == 2 ? &waiting : NULL));
+        ASSERT_NO_FATAL_FAILURE(expectValue(fastConsumer, frame));
+    }
+    wp<GraphicBuffer> weakWaiting(waiting);
+    waiting.clear();
+    ASSERT_TRUE(weakWaiting.promote() != NULL);
+
+    // Abandon the fast output; the splitter finds out with the next frame
+    fastConsumer->consumerDisconnect();
+    ASSERT_NO_FATAL_FAILURE(queueValue(inputProducer, 3));
+
+    // The waiting buffer went back to the input, which freed it when the
+    // splitter disconnected from it
+    EXPECT_TRUE(weakWaiting.promote() == NULL);
+    int slot;
+    sp<Fence> fence;
+    ASSERT_EQ(NO_INIT, inputProducer->dequeueBuffer(&slot, &fence, false, 0, 0,
+            0, GRALLOC_USAGE_SW_WRITE_OFTEN));
+}
+
 TEST_F(StreamSplitterTest, OutputAbandonment) {
     sp<IGraphicBufferProducer> inputProducer;
     sp<IGraphicBufferConsumer> inputConsumer;
@@ -17,6 +17,9 @@
 #define LOG_TAG "SurfaceTextureGL_test"
 //#define LOG_NDEBUG 0
 
+#include <stdio.h>
+#include <string.h>
+
 #include "SurfaceTextureGL.h"
 
 #include "DisconnectWaiter.h"
@@ -504,6 +507,59 @@ TEST_F(SurfaceTextureGLTest, DisconnectClearsCurrentTexture) {
             NATIVE_WINDOW_API_EGL));
 }
 
+// Reads the number of EGLImages in the cache from the GLConsumer dump.
+static void getEglImageCacheSize(const sp<GLConsumer>& st, size_t* images) {
+    String8 dump;
+    st->dump(dump);
+    const char* stats = strstr(dump.string(), "EGLImage cache:");
+    ASSERT_TRUE(stats != NULL);
+    ASSERT_EQ(1, sscanf(stats, "EGLImage cache: %zu images", images));
+}
+
+// Queues the buffer in slot and latches it.
+static void queueAndLatch(const sp<IGraphicBufferProducer>& producer, int slot,
+        const sp<GLConsumer>& st, const sp<FrameWaiter>& fw) {
+    IGraphicBufferProducer::QueueBufferInput input(0, false, Rect(1, 1),
+            NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, false, Fence::NO_FENCE);
+    IGraphicBufferProducer::QueueBufferOutput output;
+    ASSERT_EQ(OK, producer->queueBuffer(slot, input, &output));
+    fw->waitForFrame();
+    ASSERT_EQ(OK, st->updateTexImage());
+}
+
+TEST_F(SurfaceTextureGLTest, FreedBufferIsNotKeptByEglImageCache) {
+    sp<IGraphicBufferProducer> producer(mSTC->getIGraphicBufferProducer());
+    IGraphicBufferProducer::QueueBufferOutput output;
+    ASSERT_EQ(OK, producer->connect(NULL, NATIVE_WINDOW_API_CPU, false,
+            &output));
+
+    // Latch two buffers, so that only the cache and the slots still hold
+    // the first one afterwards.
+    wp<GraphicBuffer> first;
+    for (int i = 0; i < 2; i++) {
+        int slot;
+        sp<Fence> fence;
+        ASSERT_LE(0, producer->dequeueBuffer(&slot, &fence, false, 0, 0, 0, 0));
+        sp<GraphicBuffer> buffer;
+        ASSERT_EQ(OK, producer->requestBuffer(slot, &buffer));
+        if (i == 0) {
+            first = buffer;
+        }
+        ASSERT_NO_FATAL_FAILURE(queueAndLatch(producer, slot, mST, mFW));
+    }
+    size_t images;
+    ASSERT_NO_FATAL_FAILURE(getEglImageCacheSize(mST, &images));
+    EXPECT_EQ(2U, images);
+    EXPECT_TRUE(first.promote() != NULL);
+
+    // Disconnecting frees all the slots.  The current texture keeps its own
+    // EglImage, but the cache lets go of both buffers.
+    ASSERT_EQ(OK, producer->disconnect(NATIVE_WINDOW_API_CPU));
+    ASSERT_NO_FATAL_FAILURE(getEglImageCacheSize(mST, &images));
+    EXPECT_EQ(0U, images);
+    EXPECT_TRUE(first.promote() == NULL);
+}
+
 TEST_F(SurfaceTextureGLTest, ScaleToWindowMode) {
     ASSERT_EQ(OK, native_window_set_scaling_mode(mANW.get(),
         NATIVE_WINDOW_SCALING_MODE_SCALE_TO_WINDOW));
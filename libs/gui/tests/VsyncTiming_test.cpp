@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "VsyncTiming_test"
+//#define LOG_NDEBUG 0
+
+#include <binder/IMemory.h>
+
+#include <gui/DisplayEventReceiver.h>
+#include <gui/VsyncTiming.h>
+
+#include <gtest/gtest.h>
+
+namespace android {
+
+static const nsecs_t kPeriod = 16666667;
+
+class VsyncTimingTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        mWriter = new VsyncTimingWriter();
+        ASSERT_EQ(NO_ERROR, mWriter->initCheck());
+    }
+
+    sp<VsyncTimingWriter> mWriter;
+};
+
+TEST_F(VsyncTimingTest, ReadBeforeModelFails) {
+    VsyncTimingReader reader(mWriter->getHeap());
+    ASSERT_EQ(NO_ERROR, reader.initCheck());
+
+    VsyncTiming timing;
+    EXPECT_EQ(NOT_ENOUGH_DATA, reader.read(&timing));
+    mWriter->publishPhaseOffset(1000000);
+    EXPECT_EQ(NOT_ENOUGH_DATA, reader.read(&timing));
+}
+
+TEST_F(VsyncTimingTest, ReaderSeesPublishedModel) {
+    VsyncTimingReader reader(mWriter->getHeap());
+    ASSERT_EQ(NO_ERROR, reader.initCheck());
+
+    mWriter->publishPhaseOffset(1000000);
+    mWriter->publishModel(kPeriod, 5000, 10 * kPeriod + 5000);
+
+    VsyncTiming timing;
+    ASSERT_EQ(NO_ERROR, reader.read(&timing));
+    EXPECT_EQ(kPeriod, timing.period);
+    EXPECT_EQ(5000, timing.phase);
+    EXPECT_EQ(1000000, timing.phaseOffset);
+    EXPECT_EQ(10 * kPeriod + 5000, timing.referenceTime);
+    const uint32_t sequence = timing.sequence;
+
+    mWriter->publishModel(kPeriod + 1, 6000, 11 * kPeriod + 6000);
+    ASSERT_EQ(NO_ERROR, reader.read(&timing));
+    EXPECT_EQ(kPeriod + 1, timing.period);
+    EXPECT_EQ(1000000, timing.phaseOffset);
+    EXPECT_LT(sequence, timing.sequence);
+}
+
+TEST_F(VsyncTimingTest, ComputeNextVsyncIncludesPhaseOffset) {
+    VsyncTiming timing;
+    timing.period = kPeriod;
+    timing.phase = 1000;
+    timing.phaseOffset = 500;
+    timing.referenceTime = 0;
+    timing.sequence = 1;
+
+    EXPECT_EQ(1500 + kPeriod, timing.computeNextVsync(1500));
+    EXPECT_EQ(1500 + kPeriod, timing.computeNextVsync(1501));
+    EXPECT_EQ(1500, timing.computeNextVsync(1499));
+    EXPECT_EQ(1500 + 3 * kPeriod, timing.computeNextVsync(1500 + 2 * kPeriod));
+    // before phase: the result must still lie on the grid
+    EXPECT_EQ(1500 - kPeriod, timing.computeNextVsync(0 - kPeriod));
+}
+
+TEST_F(VsyncTimingTest, ReaderRejectsOtherHeaps) {
+    VsyncTimingReader reader(NULL);
+    EXPECT_EQ(NO_INIT, reader.initCheck());
+    VsyncTiming timing;
+    EXPECT_EQ(NO_INIT, reader.read(&timing));
+}
+
+TEST_F(VsyncTimingTest, DisplayEventReceiverReadsTiming) {
+    DisplayEventReceiver receiver;
+    ASSERT_EQ(NO_ERROR, receiver.initCheck());
+
+    VsyncTiming timing;
+    status_t err = receiver.getVsyncTiming(&timing);
+    // The display may not have a vsync model yet.
+    ASSERT_TRUE(err == NO_ERROR || err == NOT_ENOUGH_DATA);
+    if (err == NO_ERROR) {
+        EXPECT_GT(timing.period, 0);
+        const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        const nsecs_t next = timing.computeNextVsync(now);
+        EXPECT_GT(next, now);
+        EXPECT_LE(next, now + timing.period);
+    }
+}
+
+} // namespace android
@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures how long the BufferQueue calls take while a producer thread, a
+ * consumer thread and a number of observer threads all use the same
+ * BufferQueue. The observers stand in for the other clients of the queue
+ * (listeners, dumpsys, SurfaceFlinger queries) and call query() in a loop.
+ *
+ * usage: test-bufferqueue-contention [frames] [observers]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <binder/ProcessState.h>
+
+#include <gui/BufferQueue.h>
+#include <gui/IProducerListener.h>
+
+#include <ui/GraphicBuffer.h>
+
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+#include <utils/threads.h>
+
+#include "Latencies.h"
+
+using namespace android;
+
+static const int kBufferCount = 3;
+
+// Acquires and releases every frame as soon as it is available.
+class ConsumerThread : public Thread, public BnConsumerListener {
+public:
+    ConsumerThread(const sp<IGraphicBufferConsumer>& consumer, int numFrames) :
+        Thread(false), mConsumer(consumer), mNumFrames(numFrames),
+        mPendingFrames(0) {}
+
+    virtual void onFrameAvailable(const BufferItem& /* item */) {
+        Mutex::Autolock lock(mMutex);
+        mPendingFrames++;
+        mCondition.signal();
+    }
+    virtual void onBuffersReleased() {}
+    virtual void onSidebandStreamChanged() {}
+
+    Latencies mAcquire;
+    Latencies mRelease;
+
+private:
+    virtual bool threadLoop() {
+        for (int i = 0; i < mNumFrames; i++) {
+            {
+                Mutex::Autolock lock(mMutex);
+                while (mPendingFrames == 0) {
+                    mCondition.wait(mMutex);
+                }
+                mPendingFrames--;
+            }
+            IGraphicBufferConsumer::BufferItem item;
+            nsecs_t start = systemTime();
+            status_t err = mConsumer->acquireBuffer(&item, 0);
+            mAcquire.add(systemTime() - start);
+            if (err != NO_ERROR) {
+                fprintf(stderr, "acquireBuffer failed: %d\n", err);
+                return false;
+            }
+            start = systemTime();
+            mConsumer->releaseBuffer(item.mBuf, item.mFrameNumber,
+                    EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, Fence::NO_FENCE);
+            mRelease.add(systemTime() - start);
+        }
+        return false;
+    }
+
+    sp<IGraphicBufferConsumer> mConsumer;
+    int mNumFrames;
+    Mutex mMutex;
+    Condition mCondition;
+    int mPendingFrames;
+};
+
+// Queries the producer in a loop until it is asked to exit.
+class ObserverThread : public Thread {
+public:
+    ObserverThread(const sp<IGraphicBufferProducer>& producer) :
+        Thread(false), mProducer(producer), mNumQueries(0) {}
+
+    int getNumQueries() const { return mNumQueries; }
+
+private:
+    virtual bool threadLoop() {
+        int value;
+        mProducer->query(NATIVE_WINDOW_CONSUMER_RUNNING_BEHIND, &value);
+        mNumQueries++;
+        return true;
+    }
+
+    sp<IGraphicBufferProducer> mProducer;
+    int mNumQueries;
+};
+
+int main(int argc, char** argv)
+{
+    const int numFrames = argc > 1 ? atoi(argv[1]) : 10000;
+    const int numObservers = argc > 2 ? atoi(argv[2]) : 2;
+    if (numFrames <= 0 || numObservers < 0) {
+        fprintf(stderr, "usage: %s [frames] [observers]\n", argv[0]);
+        return 1;
+    }
+
+    // The buffers are allocated through SurfaceFlinger
+    ProcessState::self()->startThreadPool();
+
+    sp<IGraphicBufferProducer> producer;
+    sp<IGraphicBufferConsumer> consumer;
+    BufferQueue::createBufferQueue(&producer, &consumer);
+    consumer->setConsumerName(String8("contention"));
+
+    sp<ConsumerThread> consumerThread(new ConsumerThread(consumer,
+            numFrames));
+    consumer->consumerConnect(consumerThread, false);
+    IGraphicBufferProducer::QueueBufferOutput output;
+    producer->connect(new DummyProducerListener, NATIVE_WINDOW_API_CPU, false,
+            &output);
+    producer->setBufferCount(kBufferCount);
+
+    Vector<sp<ObserverThread> > observers;
+    for (int i = 0; i < numObservers; i++) {
+        sp<ObserverThread> observer(new ObserverThread(producer));
+        observer->run("BQObserver");
+        observers.add(observer);
+    }
+    consumerThread->run("BQConsumer", PRIORITY_URGENT_DISPLAY);
+
+    Latencies dequeue;
+    Latencies queue;
+    const nsecs_t start = systemTime();
+    for (int i = 0; i < numFrames; i++) {
+        int slot;
+        sp<Fence> fence;
+        nsecs_t t = systemTime();
+        status_t err = producer->dequeueBuffer(&slot, &fence, false, 1, 1, 0,
+                GRALLOC_USAGE_SW_WRITE_OFTEN);
+        if (err & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) {
+            sp<GraphicBuffer> buffer;
+            err = producer->requestBuffer(slot, &buffer);
+        } else {
+            dequeue.add(systemTime() - t);
+        }
+        if (err < 0) {
+            fprintf(stderr, "dequeueBuffer failed: %d\n", err);
+            return 1;
+        }
+
+        IGraphicBufferProducer::QueueBufferInput input(systemTime(), false,
+                Rect(0, 0, 1, 1), NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, false,
+                Fence::NO_FENCE);
+        t = systemTime();
+        err = producer->queueBuffer(slot, input, &output);
+        queue.add(systemTime() - t);
+        if (err != NO_ERROR) {
+            fprintf(stderr, "queueBuffer failed: %d\n", err);
+            return 1;
+        }
+    }
+    consumerThread->join();
+    const nsecs_t elapsed = systemTime() - start;
+
+    int numQueries = 0;
+    for (size_t i = 0; i < observers.size(); i++) {
+        observers[i]->requestExitAndWait();
+        numQueries += observers[i]->getNumQueries();
+    }
+
+    printf("%d frames in %.1f ms with %d observers (%d queries)\n",
+            numFrames, elapsed / 1e6, numObservers, numQueries);
+    dequeue.print("dequeueBuffer");
+    queue.print("queueBuffer");
+    consumerThread->mAcquire.print("acquireBuffer");
+    consumerThread->mRelease.print("releaseBuffer");
+    return 0;
+}
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures the throughput of a CpuConsumer whose owner reads every pixel of
+ * each frame, once with read-ahead off and once with the given read-ahead
+ * depth. A producer thread fills the frames with the CPU as fast as it can.
+ *
+ * usage: test-cpuconsumer-readahead [frames] [width] [height] [depth]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <binder/ProcessState.h>
+
+#include <gui/BufferQueue.h>
+#include <gui/CpuConsumer.h>
+#include <gui/IProducerListener.h>
+
+#include <ui/GraphicBuffer.h>
+
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+#include <utils/threads.h>
+
+#include "Latencies.h"
+
+using namespace android;
+
+static const uint32_t kMaxLockedBuffers = 3;
+
+// Counts the frames that have been queued but not locked yet.
+class FrameWaiter : public CpuConsumer::FrameAvailableListener {
+public:
+    FrameWaiter() : mPendingFrames(0) {}
+
+    void waitForFrame() {
+        Mutex::Autolock lock(mMutex);
+        while (mPendingFrames == 0) {
+            mCondition.wait(mMutex);
+        }
+        mPendingFrames--;
+    }
+
+    virtual void onFrameAvailable(const BufferItem& /* item */) {
+        Mutex::Autolock lock(mMutex);
+        mPendingFrames++;
+        mCondition.signal();
+    }
+
+private:
+    Mutex mMutex;
+    Condition mCondition;
+    int mPendingFrames;
+};
+
+// Dequeues, fills and queues numFrames frames.
+class ProducerThread : public Thread {
+public:
+    ProducerThread(const sp<IGraphicBufferProducer>& producer, int numFrames,
+            uint32_t width, uint32_t height) :
+        Thread(false), mProducer(producer), mNumFrames(numFrames),
+        mWidth(width), mHeight(height) {}
+
+private:
+    virtual bool threadLoop() {
+        sp<GraphicBuffer> buffers[BufferQueue::NUM_BUFFER_SLOTS];
+        for (int i = 0; i < mNumFrames; i++) {
+            int slot;
+            sp<Fence> fence;
+            status_t err = mProducer->dequeueBuffer(&slot, &fence, false,
+                    mWidth, mHeight, HAL_PIXEL_FORMAT_RGBA_8888,
+                    GRALLOC_USAGE_SW_WRITE_OFTEN);
+            if (err & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) {
+                err = mProducer->requestBuffer(slot, &buffers[slot]);
+            }
+            if (err < 0) {
+                fprintf(stderr, "dequeueBuffer failed: %d\n", err);
+                return false;
+            }
+
+            uint8_t* img = NULL;
+            err = buffers[slot]->lockAsync(GRALLOC_USAGE_SW_WRITE_OFTEN,
+                    reinterpret_cast<void**>(&img), fence->dup());
+            if (err != NO_ERROR) {
+                fprintf(stderr, "lock failed: %d\n", err);
+                return false;
+            }
+            const size_t rowBytes = buffers[slot]->getStride() * 4;
+            for (uint32_t y = 0; y < mHeight; y++) {
+                memset(img + y * rowBytes, i, mWidth * 4);
+            }
+            int fenceFd = -1;
+            buffers[slot]->unlockAsync(&fenceFd);
+
+            IGraphicBufferProducer::QueueBufferInput input(systemTime(),
+                    false, Rect(mWidth, mHeight),
+                    NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, false,
+                    fenceFd >= 0 ? new Fence(fenceFd) : Fence::NO_FENCE);
+            IGraphicBufferProducer::QueueBufferOutput output;
+            err = mProducer->queueBuffer(slot, input, &output);
+            if (err != NO_ERROR) {
+                fprintf(stderr, "queueBuffer failed: %d\n", err);
+                return false;
+            }
+        }
+        return false;
+    }
+
+    sp<IGraphicBufferProducer> mProducer;
+    int mNumFrames;
+    uint32_t mWidth;
+    uint32_t mHeight;
+};
+
+// Runs numFrames frames through a CpuConsumer with the given read-ahead
+// depth and prints the results.
+static bool run(int numFrames, uint32_t width, uint32_t height,
+        uint32_t depth) {
+    sp<IGraphicBufferProducer> producer;
+    sp<IGraphicBufferConsumer> consumer;
+    BufferQueue::createBufferQueue(&producer, &consumer);
+    sp<CpuConsumer> cpuConsumer(new CpuConsumer(consumer, kMaxLockedBuffers));
+    cpuConsumer->setName(String8("readahead"));
+    sp<FrameWaiter> waiter(new FrameWaiter);
+    cpuConsumer->setFrameAvailableListener(waiter);
+    if (cpuConsumer->setReadAheadDepth(depth) != NO_ERROR) {
+        fprintf(stderr, "setReadAheadDepth(%u) failed\n", depth);
+        return false;
+    }
+
+    IGraphicBufferProducer::QueueBufferOutput output;
+    producer->connect(new DummyProducerListener, NATIVE_WINDOW_API_CPU, false,
+            &output);
+    int minUndequeuedBuffers;
+    producer->query(NATIVE_WINDOW_MIN_UNDEQUEUED_BUFFERS,
+            &minUndequeuedBuffers);
+    producer->setBufferCount(kMaxLockedBuffers + 1 + minUndequeuedBuffers);
+
+    sp<ProducerThread> producerThread(new ProducerThread(producer, numFrames,
+            width, height));
+    producerThread->run("CCProducer");
+
+    Latencies lock;
+    Latencies unlock;
+    uint32_t checksum = 0;
+    const nsecs_t start = systemTime();
+    for (int i = 0; i < numFrames; i++) {
+        waiter->waitForFrame();
+
+        CpuConsumer::LockedBuffer b;
+        nsecs_t t = systemTime();
+        status_t err = cpuConsumer->lockNextBuffer(&b);
+        lock.add(systemTime() - t);
+        if (err != NO_ERROR) {
+            fprintf(stderr, "lockNextBuffer failed: %d\n", err);
+            return false;
+        }
+
+        // Stand in for the analysis that the owner does on each frame.
+        for (uint32_t y = 0; y < b.height; y++) {
+            const uint8_t* row = b.data + y * b.stride * 4;
+            for (uint32_t x = 0; x < b.width * 4; x++) {
+                checksum += row[x];
+            }
+        }
+
+        t = systemTime();
+        cpuConsumer->unlockBuffer(b);
+        unlock.add(systemTime() - t);
+    }
+    const nsecs_t elapsed = systemTime() - start;
+    producerThread->join();
+
+    printf("read-ahead depth %u: %d frames of %ux%u in %.1f ms, "
+            "%.1f frames/s (checksum %u)\n", depth, numFrames, width, height,
+            elapsed / 1e6, numFrames * 1e9 / elapsed, checksum);
+    lock.print("lockNextBuffer");
+    unlock.print("unlockBuffer");
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    const int numFrames = argc > 1 ? atoi(argv[1]) : 300;
+    const int width = argc > 2 ? atoi(argv[2]) : 1920;
+    const int height = argc > 3 ? atoi(argv[3]) : 1080;
+    const int depth = argc > 4 ? atoi(argv[4]) : kMaxLockedBuffers - 1;
+    if (numFrames <= 0 || width <= 0 || height <= 0 || depth <= 0 ||
+            depth > int(kMaxLockedBuffers)) {
+        fprintf(stderr, "usage: %s [frames] [width] [height] [depth <= %u]\n",
+                argv[0], kMaxLockedBuffers);
+        return 1;
+    }
+
+    // The buffers are allocated through SurfaceFlinger
+    ProcessState::self()->startThreadPool();
+
+    if (!run(numFrames, width, height, 0) ||
+            !run(numFrames, width, height, depth)) {
+        return 1;
+    }
+    return 0;
+}
@@ -28,6 +28,7 @@ commonSources := \
 deviceSources := \
     $(commonSources) \
     InputTransport.cpp \
+    TouchPredictor.cpp \
     VelocityControl.cpp \
     VelocityTracker.cpp
 
@@ -24,6 +24,7 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <math.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <unistd.h>
@@ -41,6 +42,9 @@ namespace android {
 // behind processing touches.
 static const size_t SOCKET_BUFFER_SIZE = 32 * 1024;
 
+// Maximum number of messages passed to a single sendmmsg or recvmmsg call.
+static const size_t MAX_MESSAGES_PER_CALL = 16;
+
 // Nanoseconds per milliseconds.
 static const nsecs_t NANOS_PER_MS = 1000000;
 
@@ -55,6 +59,10 @@ static const nsecs_t RESAMPLE_MIN_DELTA = 2 * NANOS_PER_MS;
 // far into the future.  This time is further bounded by 50% of the last time delta.
 static const nsecs_t RESAMPLE_MAX_PREDICTION = 8 * NANOS_PER_MS;
 
+// Maximum time to predict forward from the last known state when touch prediction is
+// enabled, however late the frame is expected to be presented.
+static const nsecs_t TOUCH_PREDICTION_MAX_TIME = 32 * NANOS_PER_MS;
+
 template<typename T>
 inline static T min(const T& a, const T& b) {
     return a < b ? a : b;
@@ -64,6 +72,26 @@ inline static float lerp(float a, float b, float alpha) {
     return a + alpha * (b - a);
 }
 
+static status_t statusFromSendError(int error) {
+    if (error == EAGAIN || error == EWOULDBLOCK) {
+        return WOULD_BLOCK;
+    }
+    if (error == EPIPE || error == ENOTCONN || error == ECONNREFUSED || error == ECONNRESET) {
+        return DEAD_OBJECT;
+    }
+    return -error;
+}
+
+static status_t statusFromReceiveError(int error) {
+    if (error == EAGAIN || error == EWOULDBLOCK) {
+        return WOULD_BLOCK;
+    }
+    if (error == EPIPE || error == ENOTCONN || error == ECONNREFUSED) {
+        return DEAD_OBJECT;
+    }
+    return -error;
+}
+
 // --- InputMessage ---
 
 bool InputMessage::isValid(size_t actualSize) const {
@@ -158,13 +186,7 @@ status_t InputChannel::sendMessage(const InputMessage* msg) {
         ALOGD("channel '%s' ~ error sending message of type %d, errno=%d", mName.string(),
                 msg->header.type, error);
 #endif
-        if (error == EAGAIN || error == EWOULDBLOCK) {
-            return WOULD_BLOCK;
-        }
-        if (error == EPIPE || error == ENOTCONN || error == ECONNREFUSED || error == ECONNRESET) {
-            return DEAD_OBJECT;
-        }
-        return -error;
+        return statusFromSendError(error);
     }
 
     if (size_t(nWrite) != msgLength) {
@@ -192,13 +214,7 @@ status_t InputChannel::receiveMessage(InputMessage* msg) {
 #if DEBUG_CHANNEL_MESSAGES
         ALOGD("channel '%s' ~ receive message failed, errno=%d", mName.string(), errno);
 #endif
-        if (error == EAGAIN || error == EWOULDBLOCK) {
-            return WOULD_BLOCK;
-        }
-        if (error == EPIPE || error == ENOTCONN || error == ECONNREFUSED) {
-            return DEAD_OBJECT;
-        }
-        return -error;
+        return statusFromReceiveError(error);
     }
 
     if (nRead == 0) { // check for EOF
@@ -221,6 +237,106 @@ status_t InputChannel::receiveMessage(InputMessage* msg) {
     return OK;
 }
 
+status_t InputChannel::sendMessages(const InputMessage* const* msgs, size_t count,
+        size_t* outCount) {
+    struct iovec iovs[MAX_MESSAGES_PER_CALL];
+    struct mmsghdr headers[MAX_MESSAGES_PER_CALL];
+
+    *outCount = 0;
+    while (*outCount < count) {
+        size_t n = min(count - *outCount, MAX_MESSAGES_PER_CALL);
+        memset(headers, 0, sizeof(headers[0]) * n);
+        for (size_t i = 0; i < n; i++) {
+            const InputMessage* msg = msgs[*outCount + i];
+            iovs[i].iov_base = const_cast<InputMessage*>(msg);
+            iovs[i].iov_len = msg->size();
+            headers[i].msg_hdr.msg_iov = &iovs[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int nSent;
+        do {
+            nSent = ::sendmmsg(mFd, headers, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+        } while (nSent == -1 && errno == EINTR);
+
+        if (nSent < 0) {
+            int error = errno;
+#if DEBUG_CHANNEL_MESSAGES
+            ALOGD("channel '%s' ~ error sending %zu messages, errno=%d", mName.string(),
+                    n, error);
+#endif
+            return statusFromSendError(error);
+        }
+
+        for (int i = 0; i < nSent; i++) {
+            if (headers[i].msg_len != iovs[i].iov_len) {
+#if DEBUG_CHANNEL_MESSAGES
+                ALOGD("channel '%s' ~ error sending message type %d, send was incomplete",
+                        mName.string(), msgs[*outCount]->header.type);
+#endif
+                return DEAD_OBJECT;
+            }
+            *outCount += 1;
+        }
+
+#if DEBUG_CHANNEL_MESSAGES
+        ALOGD("channel '%s' ~ sent %d messages", mName.string(), nSent);
+#endif
+    }
+    return OK;
+}
+
+status_t InputChannel::receiveMessages(InputMessage* msgs, size_t count, size_t* outCount) {
+    struct iovec iovs[MAX_MESSAGES_PER_CALL];
+    struct mmsghdr headers[MAX_MESSAGES_PER_CALL];
+
+    *outCount = 0;
+    size_t n = min(count, MAX_MESSAGES_PER_CALL);
+    memset(headers, 0, sizeof(headers[0]) * n);
+    for (size_t i = 0; i < n; i++) {
+        iovs[i].iov_base = &msgs[i];
+        iovs[i].iov_len = sizeof(InputMessage);
+        headers[i].msg_hdr.msg_iov = &iovs[i];
+        headers[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int nRead;
+    do {
+        nRead = ::recvmmsg(mFd, headers, n, MSG_DONTWAIT, NULL);
+    } while (nRead == -1 && errno == EINTR);
+
+    if (nRead < 0) {
+        int error = errno;
+#if DEBUG_CHANNEL_MESSAGES
+        ALOGD("channel '%s' ~ receive messages failed, errno=%d", mName.string(), errno);
+#endif
+        return statusFromReceiveError(error);
+    }
+
+    for (int i = 0; i < nRead; i++) {
+        if (headers[i].msg_len == 0) { // check for EOF
+#if DEBUG_CHANNEL_MESSAGES
+            ALOGD("channel '%s' ~ receive message failed because peer was closed",
+                    mName.string());
+#endif
+            return DEAD_OBJECT;
+        }
+
+        if (!msgs[i].isValid(headers[i].msg_len)) {
+#if DEBUG_CHANNEL_MESSAGES
+            ALOGD("channel '%s' ~ received invalid message", mName.string());
+#endif
+            return BAD_VALUE;
+        }
+        *outCount += 1;
+    }
+
+#if DEBUG_CHANNEL_MESSAGES
+    ALOGD("channel '%s' ~ received %d messages", mName.string(), nRead);
+#endif
+    return OK;
+}
+
 sp<InputChannel> InputChannel::dup() const {
     int fd = ::dup(getFd());
     return fd >= 0 ? new InputChannel(getName(), fd) : NULL;
@@ -230,7 +346,7 @@ sp<InputChannel> InputChannel::dup() const {
 // --- InputPublisher ---
 
 InputPublisher::InputPublisher(const sp<InputChannel>& channel) :
-        mChannel(channel) {
+        mChannel(channel), mBatching(false), mBatchCount(0), mBatchBytes(0) {
 }
 
 InputPublisher::~InputPublisher() {
@@ -275,7 +391,7 @@ status_t InputPublisher::publishKeyEvent(
     msg.body.key.repeatCount = repeatCount;
     msg.body.key.downTime = downTime;
     msg.body.key.eventTime = eventTime;
-    return mChannel->sendMessage(&msg);
+    return publishMessage(&msg);
 }
 
 status_t InputPublisher::publishMotionEvent(
@@ -339,7 +455,7 @@ status_t InputPublisher::publishMotionEvent(
         msg.body.motion.pointers[i].properties.copyFrom(pointerProperties[i]);
         msg.body.motion.pointers[i].coords.copyFrom(pointerCoords[i]);
     }
-    return mChannel->sendMessage(&msg);
+    return publishMessage(&msg);
 }
 
 status_t InputPublisher::receiveFinishedSignal(uint32_t* outSeq, bool* outHandled) {
@@ -365,14 +481,65 @@ status_t InputPublisher::receiveFinishedSignal(uint32_t* outSeq, bool* outHandle
     return OK;
 }
 
+void InputPublisher::beginBatch() {
+    ALOG_ASSERT(!mBatching);
+    mBatching = true;
+    mBatchCount = 0;
+    mBatchBytes = 0;
+}
+
+bool InputPublisher::isBatchFull() const {
+    return mBatchCount == MAX_BATCH_SIZE
+            || mBatchBytes + sizeof(InputMessage) > BATCH_BUFFER_SIZE;
+}
+
+status_t InputPublisher::endBatch(size_t* outCount) {
+    ALOG_ASSERT(mBatching);
+#if DEBUG_TRANSPORT_ACTIONS
+    ALOGD("channel '%s' publisher ~ endBatch: count=%zu",
+            mChannel->getName().string(), mBatchCount);
+#endif
+
+    mBatching = false;
+    if (!mBatchCount) {
+        *outCount = 0;
+        return OK;
+    }
+    return mChannel->sendMessages(mBatchMessages, mBatchCount, outCount);
+}
+
+status_t InputPublisher::publishMessage(const InputMessage* msg) {
+    if (!mBatching) {
+        return mChannel->sendMessage(msg);
+    }
+
+    if (isBatchFull()) {
+        ALOGE("channel '%s' publisher ~ Attempted to add an event to a full batch.",
+                mChannel->getName().string());
+        return NO_MEMORY;
+    }
+
+    // Keep the messages 8 byte aligned, like their bodies.
+    size_t size = msg->size();
+    InputMessage* batchMsg = reinterpret_cast<InputMessage*>(
+            reinterpret_cast<uint8_t*>(mBatchBuffer) + mBatchBytes);
+    memcpy(batchMsg, msg, size);
+    mBatchMessages[mBatchCount++] = batchMsg;
+    mBatchBytes += (size + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+    return OK;
+}
+
 // --- InputConsumer ---
 
 InputConsumer::InputConsumer(const sp<InputChannel>& channel) :
         mResampleTouch(isTouchResamplingEnabled()),
-        mChannel(channel), mMsgDeferred(false) {
+        mTouchPredictor(NULL), mPresentLatency(0),
+        mChannel(channel), mReceivedCount(0), mReceivedIndex(0), mReceiveStatus(OK),
+        mMsgDeferred(false) {
 }
 
 InputConsumer::~InputConsumer() {
+    delete mTouchPredictor;
 }
 
 bool InputConsumer::isTouchResamplingEnabled() {
@@ -390,6 +557,12 @@ bool InputConsumer::isTouchResamplingEnabled() {
     return true;
 }
 
+void InputConsumer::setTouchPrediction(const char* strategy, nsecs_t presentLatency) {
+    delete mTouchPredictor;
+    mTouchPredictor = strategy ? new TouchPredictor(strategy) : NULL;
+    mPresentLatency = presentLatency;
+}
+
 status_t InputConsumer::consume(InputEventFactoryInterface* factory,
         bool consumeBatches, nsecs_t frameTime, uint32_t* outSeq, InputEvent** outEvent) {
 #if DEBUG_TRANSPORT_ACTIONS
@@ -409,7 +582,7 @@ status_t InputConsumer::consume(InputEventFactoryInterface* factory,
             mMsgDeferred = false;
         } else {
             // Receive a fresh message.
-            status_t result = mChannel->receiveMessage(&mMsg);
+            status_t result = receiveMessage(&mMsg);
             if (result) {
                 // Consume the next batched event unless batches are being held for later.
                 if (consumeBatches || result != WOULD_BLOCK) {
@@ -519,9 +692,17 @@ status_t InputConsumer::consumeBatch(InputEventFactoryInterface* factory,
             return result;
         }
 
+        // When predicting, consume all samples up to the frame time and resample at the
+        // expected present time.  Otherwise, resample a little in the past.
         nsecs_t sampleTime = frameTime;
+        nsecs_t resampleTime = frameTime;
         if (mResampleTouch) {
-            sampleTime -= RESAMPLE_LATENCY;
+            if (mTouchPredictor) {
+                resampleTime += mPresentLatency;
+            } else {
+                sampleTime -= RESAMPLE_LATENCY;
+                resampleTime = sampleTime;
+            }
         }
         ssize_t split = findSampleNoLaterThan(batch, sampleTime);
         if (split < 0) {
@@ -537,7 +718,7 @@ status_t InputConsumer::consumeBatch(InputEventFactoryInterface* factory,
             next = &batch.samples.itemAt(0);
         }
         if (!result && mResampleTouch) {
-            resampleTouchState(sampleTime, static_cast<MotionEvent*>(*outEvent), next);
+            resampleTouchState(resampleTime, static_cast<MotionEvent*>(*outEvent), next);
         }
         return result;
     }
@@ -572,6 +753,18 @@ status_t InputConsumer::consumeSamples(InputEventFactoryInterface* factory,
     return OK;
 }
 
+// A predicted sample can be ahead of the samples that follow it.  Those are
+// delivered no earlier than the prediction, but with their own coordinates.
+static void holdAtPredictionTime(nsecs_t predictionTime, InputMessage* msg) {
+    if (msg->body.motion.eventTime < predictionTime) {
+#if DEBUG_RESAMPLING
+        ALOGD("hold time at prediction %lld, old %lld", predictionTime,
+                msg->body.motion.eventTime);
+#endif
+        msg->body.motion.eventTime = predictionTime;
+    }
+}
+
 void InputConsumer::updateTouchState(InputMessage* msg) {
     if (!mResampleTouch ||
             !(msg->body.motion.source & AINPUT_SOURCE_CLASS_POINTER)) {
@@ -608,6 +801,7 @@ void InputConsumer::updateTouchState(InputMessage* msg) {
             } else {
                 touchState.lastResample.idBits.clear();
             }
+            holdAtPredictionTime(touchState.lastPredictionTime, msg);
         }
         break;
     }
@@ -617,7 +811,11 @@ void InputConsumer::updateTouchState(InputMessage* msg) {
         if (index >= 0) {
             TouchState& touchState = mTouchStates.editItemAt(index);
             touchState.lastResample.idBits.clearBit(msg->body.motion.getActionId());
+            // The new pointer may reuse the id of one that went up earlier, so start
+            // predicting from scratch.
+            touchState.movementCount = 0;
             rewriteMessage(touchState, msg);
+            holdAtPredictionTime(touchState.lastPredictionTime, msg);
         }
         break;
     }
@@ -627,6 +825,7 @@ void InputConsumer::updateTouchState(InputMessage* msg) {
         if (index >= 0) {
             TouchState& touchState = mTouchStates.editItemAt(index);
             rewriteMessage(touchState, msg);
+            holdAtPredictionTime(touchState.lastPredictionTime, msg);
             touchState.lastResample.idBits.clearBit(msg->body.motion.getActionId());
         }
         break;
@@ -637,6 +836,7 @@ void InputConsumer::updateTouchState(InputMessage* msg) {
         if (index >= 0) {
             const TouchState& touchState = mTouchStates.itemAt(index);
             rewriteMessage(touchState, msg);
+            holdAtPredictionTime(touchState.lastPredictionTime, msg);
         }
         break;
     }
@@ -647,6 +847,7 @@ void InputConsumer::updateTouchState(InputMessage* msg) {
         if (index >= 0) {
             const TouchState& touchState = mTouchStates.itemAt(index);
             rewriteMessage(touchState, msg);
+            holdAtPredictionTime(touchState.lastPredictionTime, msg);
             mTouchStates.removeAt(index);
         }
         break;
@@ -710,6 +911,13 @@ void InputConsumer::resampleTouchState(nsecs_t sampleTime, MotionEvent* event,
         }
     }
 
+    // Predict rather than interpolate if the next sample is older than the sample time.
+    if (mTouchPredictor && touchState.movementCount >= 2
+            && (!next || next->body.motion.eventTime < sampleTime)) {
+        predictTouchState(touchState, sampleTime, event);
+        return;
+    }
+
     // Find the data to use for resampling.
     const History* other;
     History future;
@@ -793,6 +1001,51 @@ void InputConsumer::resampleTouchState(nsecs_t sampleTime, MotionEvent* event,
     event->addSample(sampleTime, touchState.lastResample.pointers);
 }
 
+void InputConsumer::predictTouchState(TouchState& touchState, nsecs_t sampleTime,
+        MotionEvent* event) {
+    const History* current = touchState.getHistory(0);
+    nsecs_t maxPredict = current->eventTime + TOUCH_PREDICTION_MAX_TIME;
+    if (sampleTime > maxPredict) {
+#if DEBUG_RESAMPLING
+        ALOGD("Sample time is too far in the future, adjusting prediction "
+                "from %lld to %lld ns.",
+                sampleTime - current->eventTime, maxPredict - current->eventTime);
+#endif
+        sampleTime = maxPredict;
+    }
+
+    TouchPredictor::Movement movements[MAX_PREDICTION_MOVEMENTS];
+    size_t movementCount = touchState.getMovements(movements);
+    mTouchPredictor->setMovements(movements, movementCount);
+
+    // Predict touch coordinates.  The prediction runs ahead of the samples still to
+    // come, so it is not kept as the last resample: those samples keep their own
+    // coordinates, and updateTouchState only holds their time at the prediction's.
+    touchState.lastResample.idBits.clear();
+    touchState.lastPredictionTime = sampleTime;
+    PointerCoords predictedCoords[MAX_POINTERS];
+    size_t pointerCount = event->getPointerCount();
+    for (size_t i = 0; i < pointerCount; i++) {
+        uint32_t id = event->getPointerId(i);
+        PointerCoords& resampledCoords = predictedCoords[i];
+        const PointerCoords& currentCoords = current->getPointerById(id);
+        resampledCoords.copyFrom(currentCoords);
+        float x, y;
+        if (shouldResampleTool(event->getToolType(i))
+                && mTouchPredictor->predict(id, sampleTime, &x, &y)) {
+            resampledCoords.setAxisValue(AMOTION_EVENT_AXIS_X, x);
+            resampledCoords.setAxisValue(AMOTION_EVENT_AXIS_Y, y);
+        }
+#if DEBUG_RESAMPLING
+        ALOGD("[%d] - predicted (%0.3f, %0.3f), cur (%0.3f, %0.3f)",
+                id, resampledCoords.getX(), resampledCoords.getY(),
+                currentCoords.getX(), currentCoords.getY());
+#endif
+    }
+
+    event->addSample(sampleTime, predictedCoords);
+}
+
 bool InputConsumer::shouldResampleTool(int32_t toolType) {
     return toolType == AMOTION_EVENT_TOOL_TYPE_FINGER
             || toolType == AMOTION_EVENT_TOOL_TYPE_UNKNOWN;
@@ -851,8 +1104,31 @@ status_t InputConsumer::sendUnchainedFinishedSignal(uint32_t seq, bool handled)
     return mChannel->sendMessage(&msg);
 }
 
+status_t InputConsumer::receiveMessage(InputMessage* msg) {
+    if (mReceivedIndex == mReceivedCount) {
+        if (mReceiveStatus) {
+            status_t result = mReceiveStatus;
+            mReceiveStatus = OK;
+            return result;
+        }
+
+        // Receive all messages that are already waiting at once.
+        mReceivedIndex = 0;
+        status_t result = mChannel->receiveMessages(mReceivedMsgs, RECEIVE_BATCH_SIZE,
+                &mReceivedCount);
+        if (!mReceivedCount) {
+            return result;
+        }
+        mReceiveStatus = result;
+    }
+
+    const InputMessage& received = mReceivedMsgs[mReceivedIndex++];
+    memcpy(msg, &received, received.size());
+    return OK;
+}
+
 bool InputConsumer::hasDeferredEvent() const {
-    return mMsgDeferred;
+    return mMsgDeferred || mReceivedIndex < mReceivedCount || mReceiveStatus != OK;
 }
 
 bool InputConsumer::hasPendingBatch() const {
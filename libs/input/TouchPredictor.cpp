@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "TouchPredictor"
+
+#include <input/TouchPredictor.h>
+
+namespace android {
+
+TouchPredictor::TouchPredictor(const char* strategy) :
+        mVelocityTracker(strategy) {
+}
+
+TouchPredictor::~TouchPredictor() {
+}
+
+void TouchPredictor::setMovements(const Movement* movements, size_t count) {
+    mVelocityTracker.clear();
+    for (size_t i = 0; i < count; i++) {
+        mVelocityTracker.addMovement(movements[i].eventTime, movements[i].idBits,
+                movements[i].positions);
+    }
+}
+
+bool TouchPredictor::predict(uint32_t id, nsecs_t time, float* outX, float* outY) const {
+    VelocityTracker::Estimator estimator;
+    estimator.clear();
+    if (!mVelocityTracker.getEstimator(id, &estimator)) {
+        return false;
+    }
+
+    // The estimator describes the motion as polynomials of the time in seconds
+    // since its time base.
+    float t = (time - estimator.time) * 0.000000001f;
+    uint32_t degree = estimator.degree < VelocityTracker::Estimator::MAX_DEGREE
+            ? estimator.degree : VelocityTracker::Estimator::MAX_DEGREE;
+    float x = estimator.xCoeff[degree];
+    float y = estimator.yCoeff[degree];
+    for (uint32_t i = degree; i-- > 0; ) {
+        x = x * t + estimator.xCoeff[i];
+        y = y * t + estimator.yCoeff[i];
+    }
+    *outX = x;
+    *outY = y;
+    return true;
+}
+
+} // namespace android
@@ -375,6 +375,19 @@ void LeastSquaresVelocityTrackerStrategy::clearPointers(BitSet32 idBits) {
 
 void LeastSquaresVelocityTrackerStrategy::addMovement(nsecs_t eventTime, BitSet32 idBits,
         const VelocityTracker::Position* positions) {
+    const Movement& previousMovement = mMovements[mIndex];
+    if (mWeighting == WEIGHTING_NONE) {
+        // The oldest movement is about to be overwritten, so drop it from the sums
+        // while it is still there.
+        for (BitSet32 iterBits(idBits.value & previousMovement.idBits.value);
+                !iterBits.isEmpty(); ) {
+            uint32_t id = iterBits.clearFirstMarkedBit();
+            if (mSums[id].count == HISTORY_SIZE) {
+                removeOldestFromSums(id, mSums[id]);
+            }
+        }
+    }
+
     if (++mIndex == HISTORY_SIZE) {
         mIndex = 0;
     }
@@ -386,6 +399,131 @@ void LeastSquaresVelocityTrackerStrategy::addMovement(nsecs_t eventTime, BitSet3
     for (uint32_t i = 0; i < count; i++) {
         movement.positions[i] = positions[i];
     }
+
+    if (mWeighting != WEIGHTING_NONE) {
+        return;
+    }
+    for (BitSet32 iterBits(idBits); !iterBits.isEmpty(); ) {
+        uint32_t id = iterBits.clearFirstMarkedBit();
+        Sums& sums = mSums[id];
+        if (!previousMovement.idBits.hasBit(id)) {
+            resetSums(sums, movement.getPosition(id));
+        } else if (eventTime < previousMovement.eventTime || !sums.ordered) {
+            // Trimming the oldest samples only matches the horizon while time moves forward.
+            rebuildSums(id);
+            continue;
+        } else {
+            shiftSums(sums, eventTime - previousMovement.eventTime);
+        }
+        addToSums(sums, 0, movement.getPosition(id), 1);
+
+        while (sums.count > 1) {
+            uint32_t oldestIndex = (mIndex + HISTORY_SIZE + 1 - sums.count) % HISTORY_SIZE;
+            if (eventTime - mMovements[oldestIndex].eventTime <= HORIZON) {
+                break;
+            }
+            removeOldestFromSums(id, sums);
+        }
+    }
+}
+
+void LeastSquaresVelocityTrackerStrategy::resetSums(Sums& sums,
+        const VelocityTracker::Position& origin) const {
+    sums.count = 0;
+    sums.ordered = true;
+    sums.originX = origin.x;
+    sums.originY = origin.y;
+    for (uint32_t k = 0; k <= 2 * VelocityTracker::Estimator::MAX_DEGREE; k++) {
+        sums.t[k] = 0;
+    }
+    for (uint32_t k = 0; k <= VelocityTracker::Estimator::MAX_DEGREE; k++) {
+        sums.xt[k] = 0;
+        sums.yt[k] = 0;
+    }
+    sums.xx = 0;
+    sums.yy = 0;
+}
+
+// Adds the sample if sign is 1 or removes it if sign is -1.
+void LeastSquaresVelocityTrackerStrategy::addToSums(Sums& sums, nsecs_t age,
+        const VelocityTracker::Position& position, double sign) const {
+    double t = -age * 0.000000001;
+    double x = position.x - sums.originX;
+    double y = position.y - sums.originY;
+    double power = sign;
+    for (uint32_t k = 0; k <= 2 * mDegree; k++) {
+        sums.t[k] += power;
+        if (k <= mDegree) {
+            sums.xt[k] += x * power;
+            sums.yt[k] += y * power;
+        }
+        power *= t;
+    }
+    sums.xx += sign * x * x;
+    sums.yy += sign * y * y;
+    if (sign > 0) {
+        sums.count += 1;
+    } else {
+        sums.count -= 1;
+    }
+}
+
+// Replaces t with t + shift in sums of t^k for k = 0 .. count - 1, using the
+// binomial expansion of (t + shift)^k.
+static void shiftPowerSums(double* sums, uint32_t count, double shift) {
+    for (uint32_t k = count; k-- > 1; ) {
+        double coefficient = 1;
+        double power = 1;
+        double sum = sums[k];
+        for (uint32_t j = k; j-- > 0; ) {
+            coefficient = coefficient * (j + 1) / (k - j);
+            power *= shift;
+            sum += coefficient * power * sums[j];
+        }
+        sums[k] = sum;
+    }
+}
+
+void LeastSquaresVelocityTrackerStrategy::shiftSums(Sums& sums, nsecs_t delta) const {
+    // The samples age by delta as a newer movement becomes the time base.
+    double shift = -delta * 0.000000001;
+    shiftPowerSums(sums.t, 2 * mDegree + 1, shift);
+    shiftPowerSums(sums.xt, mDegree + 1, shift);
+    shiftPowerSums(sums.yt, mDegree + 1, shift);
+}
+
+void LeastSquaresVelocityTrackerStrategy::removeOldestFromSums(uint32_t id, Sums& sums) const {
+    uint32_t index = (mIndex + HISTORY_SIZE + 1 - sums.count) % HISTORY_SIZE;
+    const Movement& oldestMovement = mMovements[index];
+    addToSums(sums, mMovements[mIndex].eventTime - oldestMovement.eventTime,
+            oldestMovement.getPosition(id), -1);
+}
+
+void LeastSquaresVelocityTrackerStrategy::rebuildSums(uint32_t id) {
+    // Collect the same samples as getEstimatorFromHistory.
+    Sums& sums = mSums[id];
+    const Movement& newestMovement = mMovements[mIndex];
+    resetSums(sums, newestMovement.getPosition(id));
+    nsecs_t newerEventTime = newestMovement.eventTime;
+    uint32_t index = mIndex;
+    do {
+        const Movement& movement = mMovements[index];
+        if (!movement.idBits.hasBit(id)) {
+            break;
+        }
+
+        nsecs_t age = newestMovement.eventTime - movement.eventTime;
+        if (age > HORIZON) {
+            break;
+        }
+
+        addToSums(sums, age, movement.getPosition(id), 1);
+        if (movement.eventTime > newerEventTime) {
+            sums.ordered = false;
+        }
+        newerEventTime = movement.eventTime;
+        index = (index == 0 ? HISTORY_SIZE : index) - 1;
+    } while (sums.count < HISTORY_SIZE);
 }
 
 /**
@@ -554,8 +692,157 @@ static bool solveLeastSquares(const float* x, const float* y,
     return true;
 }
 
+/**
+ * Returns the coefficient of determination of a fit from the sums of the normal
+ * equations, like solveLeastSquares does without weights.
+ */
+static float coefficientOfDetermination(const double* t, const double* vt, double vv,
+        uint32_t m, uint32_t n, const double* b) {
+    // SSerr = sum((v - A B)^2) = vv - 2 B.(At v) + B.(At A B)
+    double sserr = vv;
+    for (uint32_t i = 0; i < n; i++) {
+        sserr -= 2 * b[i] * vt[i];
+        for (uint32_t j = 0; j < n; j++) {
+            sserr += b[i] * b[j] * t[i + j];
+        }
+    }
+    if (sserr < 0) {
+        sserr = 0;
+    }
+    double sstot = vv - vt[0] * vt[0] / m;
+    return sstot > 0.000001 ? 1.0f - float(sserr / sstot) : 1;
+}
+
+/**
+ * Solves the same unweighted least squares problem as solveLeastSquares, for the
+ * X and Y axes at once, from the sums that make up its normal equations.
+ *
+ * The normal equations are (At A) B = At Y where (At A)[i][j] is the sum of t^(i+j)
+ * over the samples and (At Y)[i] is the sum of y t^i.  At A is the same for both
+ * axes, so it is factored only once, by Cholesky decomposition into L Lt.  The
+ * diagonal of L is also the diagonal of R in the QR decomposition of A, so the test
+ * for linearly dependent columns is the same as in solveLeastSquares.
+ *
+ * The sums are in double precision, which keeps squaring the condition number of A
+ * from costing accuracy compared to solving the least squares problem directly.
+ */
+static bool solveNormalEquations(const double* t, const double* xt, const double* yt,
+        double xx, double yy, uint32_t m, uint32_t n,
+        double* outXB, double* outYB, float* outXDet, float* outYDet) {
+    double l[n][n]; // lower triangular matrix, row-major order
+    for (uint32_t j = 0; j < n; j++) {
+        double d = t[2 * j];
+        for (uint32_t k = 0; k < j; k++) {
+            d -= l[j][k] * l[j][k];
+        }
+        if (d < 0.000001 * 0.000001) {
+            // vectors are linearly dependent or zero so no solution
+#if DEBUG_STRATEGY
+            ALOGD("  - no solution, norm=%f", d > 0 ? sqrt(d) : 0);
+#endif
+            return false;
+        }
+        l[j][j] = sqrt(d);
+        for (uint32_t i = j + 1; i < n; i++) {
+            double v = t[i + j];
+            for (uint32_t k = 0; k < j; k++) {
+                v -= l[i][k] * l[j][k];
+            }
+            l[i][j] = v / l[j][j];
+        }
+    }
+
+    // Solve L Z = At Y, then Lt B = Z.
+    double zx[n];
+    double zy[n];
+    for (uint32_t i = 0; i < n; i++) {
+        zx[i] = xt[i];
+        zy[i] = yt[i];
+        for (uint32_t k = 0; k < i; k++) {
+            zx[i] -= l[i][k] * zx[k];
+            zy[i] -= l[i][k] * zy[k];
+        }
+        zx[i] /= l[i][i];
+        zy[i] /= l[i][i];
+    }
+    for (uint32_t i = n; i-- != 0; ) {
+        outXB[i] = zx[i];
+        outYB[i] = zy[i];
+        for (uint32_t k = i + 1; k < n; k++) {
+            outXB[i] -= l[k][i] * outXB[k];
+            outYB[i] -= l[k][i] * outYB[k];
+        }
+        outXB[i] /= l[i][i];
+        outYB[i] /= l[i][i];
+    }
+
+    *outXDet = coefficientOfDetermination(t, xt, xx, m, n, outXB);
+    *outYDet = coefficientOfDetermination(t, yt, yy, m, n, outYB);
+    return true;
+}
+
 bool LeastSquaresVelocityTrackerStrategy::getEstimator(uint32_t id,
         VelocityTracker::Estimator* outEstimator) const {
+    if (mWeighting == WEIGHTING_NONE) {
+        return getEstimatorFromSums(id, outEstimator);
+    }
+    return getEstimatorFromHistory(id, outEstimator);
+}
+
+bool LeastSquaresVelocityTrackerStrategy::getEstimatorFromSums(uint32_t id,
+        VelocityTracker::Estimator* outEstimator) const {
+    outEstimator->clear();
+
+    const Movement& newestMovement = mMovements[mIndex];
+    if (!newestMovement.idBits.hasBit(id)) {
+        return false; // no data
+    }
+
+    // Calculate a least squares polynomial fit.
+    const Sums& sums = mSums[id];
+    uint32_t degree = mDegree;
+    if (degree > sums.count - 1) {
+        degree = sums.count - 1;
+    }
+    if (degree >= 1) {
+        double xb[VelocityTracker::Estimator::MAX_DEGREE + 1];
+        double yb[VelocityTracker::Estimator::MAX_DEGREE + 1];
+        float xdet, ydet;
+        uint32_t n = degree + 1;
+        if (solveNormalEquations(sums.t, sums.xt, sums.yt, sums.xx, sums.yy,
+                sums.count, n, xb, yb, &xdet, &ydet)) {
+            xb[0] += sums.originX;
+            yb[0] += sums.originY;
+            for (uint32_t i = 0; i < n; i++) {
+                outEstimator->xCoeff[i] = xb[i];
+                outEstimator->yCoeff[i] = yb[i];
+            }
+            outEstimator->time = newestMovement.eventTime;
+            outEstimator->degree = degree;
+            outEstimator->confidence = xdet * ydet;
+#if DEBUG_STRATEGY
+            ALOGD("estimate: degree=%d, xCoeff=%s, yCoeff=%s, confidence=%f",
+                    int(outEstimator->degree),
+                    vectorToString(outEstimator->xCoeff, n).string(),
+                    vectorToString(outEstimator->yCoeff, n).string(),
+                    outEstimator->confidence);
+#endif
+            return true;
+        }
+    }
+
+    // No velocity data available for this pointer, but we do have its current position.
+    const VelocityTracker::Position& position = newestMovement.getPosition(id);
+    outEstimator->xCoeff[0] = position.x;
+    outEstimator->yCoeff[0] = position.y;
+    outEstimator->time = newestMovement.eventTime;
+    outEstimator->degree = 0;
+    outEstimator->confidence = 1;
+    return true;
+}
+
+bool LeastSquaresVelocityTrackerStrategy::getEstimatorFromHistory(uint32_t id,
+        VelocityTracker::Estimator* outEstimator) const {
     outEstimator->clear();
 
     // Iterate over movement samples in reverse time order and collect samples.
@@ -6,7 +6,9 @@ include $(CLEAR_VARS)
 test_src_files := \
     InputChannel_test.cpp \
     InputEvent_test.cpp \
-    InputPublisherAndConsumer_test.cpp
+    InputPublisherAndConsumer_test.cpp \
+    TouchPredictor_test.cpp \
+    VelocityTracker_test.cpp
 
 shared_libraries := \
     libinput \
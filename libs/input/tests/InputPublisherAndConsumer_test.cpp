@@ -16,6 +16,7 @@
 
 #include "TestHelpers.h"
 
+#include <stdio.h>
 #include <unistd.h>
 #include <sys/mman.h>
 #include <time.h>
@@ -60,6 +61,28 @@ protected:
 
     void PublishAndConsumeKeyEvent();
     void PublishAndConsumeMotionEvent();
+
+    status_t publishMove(uint32_t seq, nsecs_t eventTime, float x) {
+        return publishTouch(seq, AMOTION_EVENT_ACTION_MOVE, eventTime, x);
+    }
+
+    status_t publishTouch(uint32_t seq, int32_t action, nsecs_t eventTime, float x) {
+        PointerProperties pointerProperties;
+        pointerProperties.clear();
+        pointerProperties.id = 0;
+        pointerProperties.toolType = AMOTION_EVENT_TOOL_TYPE_FINGER;
+        PointerCoords pointerCoords;
+        pointerCoords.clear();
+        pointerCoords.setAxisValue(AMOTION_EVENT_AXIS_X, x);
+        pointerCoords.setAxisValue(AMOTION_EVENT_AXIS_Y, x);
+        return mPublisher->publishMotionEvent(seq, 1, AINPUT_SOURCE_TOUCHSCREEN,
+                action, 0, 0, 0, 0, 0, 0, 1, 1,
+                0, eventTime, 1, &pointerProperties, &pointerCoords);
+    }
+
+    // Publishes count moves, either in one batch or one at a time, then consumes
+    // them and finishes them the way an application would.
+    void publishAndConsumeMoves(uint32_t firstSeq, size_t count, bool batch);
 };
 
 TEST_F(InputPublisherAndConsumerTest, GetChannel_ReturnsTheChannel) {
@@ -285,4 +308,187 @@ TEST_F(InputPublisherAndConsumerTest, PublishMultipleEvents_EndToEnd) {
     ASSERT_NO_FATAL_FAILURE(PublishAndConsumeKeyEvent());
 }
 
+void InputPublisherAndConsumerTest::publishAndConsumeMoves(uint32_t firstSeq, size_t count,
+        bool batch) {
+    if (batch) {
+        mPublisher->beginBatch();
+    }
+    for (size_t i = 0; i < count; i++) {
+        ASSERT_EQ(OK, publishMove(firstSeq + i, i + 1, float(i)));
+    }
+    if (batch) {
+        size_t sentCount;
+        ASSERT_EQ(OK, mPublisher->endBatch(&sentCount));
+        ASSERT_EQ(count, sentCount);
+    }
+
+    size_t consumedCount = 0;
+    for (;;) {
+        uint32_t consumeSeq;
+        InputEvent* event;
+        status_t status = mConsumer->consume(&mEventFactory, true /*consumeBatches*/, -1,
+                &consumeSeq, &event);
+        if (status == WOULD_BLOCK) {
+            break;
+        }
+        ASSERT_EQ(OK, status);
+        ASSERT_TRUE(event != NULL);
+        consumedCount += 1 + static_cast<MotionEvent*>(event)->getHistorySize();
+        ASSERT_EQ(OK, mConsumer->sendFinishedSignal(consumeSeq, true));
+    }
+    ASSERT_EQ(count, consumedCount);
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t finishedSeq;
+        bool handled;
+        ASSERT_EQ(OK, mPublisher->receiveFinishedSignal(&finishedSeq, &handled));
+    }
+}
+
+TEST_F(InputPublisherAndConsumerTest, PublishBatch_EndToEnd) {
+    ASSERT_NO_FATAL_FAILURE(publishAndConsumeMoves(1, InputPublisher::MAX_BATCH_SIZE, true));
+    ASSERT_NO_FATAL_FAILURE(PublishAndConsumeKeyEvent());
+}
+
+TEST_F(InputPublisherAndConsumerTest, PublishBatch_PreservesOrderOfEvents) {
+    // Few enough for the consumer to receive them all at once.
+    const size_t count = 4;
+    mPublisher->beginBatch();
+    for (size_t i = 0; i < count; i++) {
+        ASSERT_EQ(OK, mPublisher->publishKeyEvent(i + 1, 1, AINPUT_SOURCE_KEYBOARD,
+                AKEY_EVENT_ACTION_DOWN, 0, AKEYCODE_A, 30, 0, 0, 0, 0));
+    }
+    size_t sentCount;
+    ASSERT_EQ(OK, mPublisher->endBatch(&sentCount));
+    ASSERT_EQ(count, sentCount);
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t consumeSeq;
+        InputEvent* event;
+        ASSERT_EQ(OK, mConsumer->consume(&mEventFactory, true /*consumeBatches*/, -1,
+                &consumeSeq, &event));
+        EXPECT_EQ(i + 1, consumeSeq);
+        // The remaining events were received along with this one.
+        EXPECT_EQ(i + 1 < count, mConsumer->hasDeferredEvent());
+    }
+}
+
+TEST_F(InputPublisherAndConsumerTest, PublishBatch_WhenFull_ReturnsNoMemory) {
+    mPublisher->beginBatch();
+    size_t count = 0;
+    while (!mPublisher->isBatchFull()) {
+        ASSERT_EQ(OK, publishMove(count + 1, count + 1, 0));
+        count += 1;
+    }
+    EXPECT_EQ(NO_MEMORY, publishMove(count + 1, count + 1, 0));
+
+    size_t sentCount;
+    ASSERT_EQ(OK, mPublisher->endBatch(&sentCount));
+    EXPECT_EQ(count, sentCount);
+}
+
+TEST_F(InputPublisherAndConsumerTest, PublishBatch_WhenEmpty_SendsNothing) {
+    mPublisher->beginBatch();
+    size_t sentCount = 1;
+    ASSERT_EQ(OK, mPublisher->endBatch(&sentCount));
+    EXPECT_EQ(0U, sentCount);
+
+    uint32_t consumeSeq;
+    InputEvent* event;
+    EXPECT_EQ(WOULD_BLOCK, mConsumer->consume(&mEventFactory, true /*consumeBatches*/, -1,
+            &consumeSeq, &event));
+}
+
+TEST_F(InputPublisherAndConsumerTest, TouchPrediction_KeepsLaterSamplesMonotonic) {
+    const nsecs_t interval = 8000000;
+    mConsumer->setTouchPrediction("lsq2", 2 * interval);
+
+    uint32_t consumeSeq;
+    InputEvent* event;
+    ASSERT_EQ(OK, publishTouch(1, AMOTION_EVENT_ACTION_DOWN, 0, 0));
+    ASSERT_EQ(OK, mConsumer->consume(&mEventFactory, true /*consumeBatches*/, -1,
+            &consumeSeq, &event));
+
+    // Moving at 10 px per sample, the frame after the third move is predicted to be
+    // presented two samples later, at x = 50.
+    for (uint32_t i = 1; i <= 3; i++) {
+        ASSERT_EQ(OK, publishMove(i + 1, i * interval, i * 10.0f));
+    }
+    ASSERT_EQ(OK, mConsumer->consume(&mEventFactory, true /*consumeBatches*/, 3 * interval,
+            &consumeSeq, &event));
+    MotionEvent* motionEvent = static_cast<MotionEvent*>(event);
+    EXPECT_EQ(5 * interval, motionEvent->getEventTime());
+    EXPECT_NEAR(50, motionEvent->getX(0), 0.5f);
+
+    // The finger actually stops short of the prediction and lifts.  Samples older than
+    // the prediction are held at its time, so that time does not go backwards, but
+    // keep their own positions.
+    ASSERT_EQ(OK, publishMove(5, 4 * interval, 35));
+    ASSERT_EQ(OK, publishMove(6, 4 * interval + interval / 2, 38));
+    ASSERT_EQ(OK, publishTouch(7, AMOTION_EVENT_ACTION_UP, 5 * interval, 38));
+
+    ASSERT_EQ(OK, mConsumer->consume(&mEventFactory, true /*consumeBatches*/, -1,
+            &consumeSeq, &event));
+    EXPECT_EQ(6U, consumeSeq);
+    motionEvent = static_cast<MotionEvent*>(event);
+    EXPECT_EQ(AMOTION_EVENT_ACTION_MOVE, motionEvent->getAction());
+    ASSERT_EQ(1U, motionEvent->getHistorySize());
+    EXPECT_EQ(5 * interval, motionEvent->getHistoricalEventTime(0));
+    EXPECT_EQ(35, motionEvent->getHistoricalX(0, 0));
+    EXPECT_EQ(5 * interval, motionEvent->getEventTime());
+    EXPECT_EQ(38, motionEvent->getX(0));
+
+    ASSERT_EQ(OK, mConsumer->consume(&mEventFactory, true /*consumeBatches*/, -1,
+            &consumeSeq, &event));
+    EXPECT_EQ(7U, consumeSeq);
+    motionEvent = static_cast<MotionEvent*>(event);
+    EXPECT_EQ(AMOTION_EVENT_ACTION_UP, motionEvent->getAction());
+    EXPECT_EQ(5 * interval, motionEvent->getEventTime());
+    EXPECT_EQ(38, motionEvent->getX(0));
+}
+
+TEST_F(InputPublisherAndConsumerTest, TouchPrediction_LaterSamplesPastPredictionAreKept) {
+    const nsecs_t interval = 8000000;
+    mConsumer->setTouchPrediction("lsq2", 2 * interval);
+
+    uint32_t consumeSeq;
+    InputEvent* event;
+    ASSERT_EQ(OK, publishTouch(1, AMOTION_EVENT_ACTION_DOWN, 0, 0));
+    ASSERT_EQ(OK, mConsumer->consume(&mEventFactory, true /*consumeBatches*/, -1,
+            &consumeSeq, &event));
+    for (uint32_t i = 1; i <= 3; i++) {
+        ASSERT_EQ(OK, publishMove(i + 1, i * interval, i * 10.0f));
+    }
+    ASSERT_EQ(OK, mConsumer->consume(&mEventFactory, true /*consumeBatches*/, 3 * interval,
+            &consumeSeq, &event));
+
+    // Once real samples are newer than the prediction, they are delivered as they are.
+    ASSERT_EQ(OK, publishMove(5, 6 * interval, 45));
+    ASSERT_EQ(OK, mConsumer->consume(&mEventFactory, true /*consumeBatches*/, -1,
+            &consumeSeq, &event));
+    EXPECT_EQ(5U, consumeSeq);
+    MotionEvent* motionEvent = static_cast<MotionEvent*>(event);
+    EXPECT_EQ(6 * interval, motionEvent->getEventTime());
+    EXPECT_EQ(45, motionEvent->getX(0));
+}
+
+// Compares the time to deliver bursts of moves, as the dispatcher does when an application
+// falls behind, with and without batching.  Prints the results; does not fail on them.
+TEST_F(InputPublisherAndConsumerTest, Benchmark_BatchedThroughput) {
+    const size_t burstSize = InputPublisher::MAX_BATCH_SIZE;
+    const size_t iterations = 2000;
+
+    for (int batch = 0; batch < 2; batch++) {
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (size_t i = 0; i < iterations; i++) {
+            ASSERT_NO_FATAL_FAILURE(publishAndConsumeMoves(i * burstSize + 1, burstSize,
+                    batch));
+        }
+        nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        printf("%s: %zu events in %.1fms, %.0f events/s\n",
+                batch ? "batched" : "unbatched", iterations * burstSize,
+                elapsed / 1000000.0, iterations * burstSize * 1e9 / elapsed);
+    }
+}
+
 } // namespace android
@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <input/TouchPredictor.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+#include <gtest/gtest.h>
+#include <dirent.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace android {
+
+// Interval between samples of the traces, as for a 125 Hz touch panel.
+static const nsecs_t SAMPLE_INTERVAL = 8000000;
+
+// Number of samples between the newest known sample and the predicted one.
+static const size_t PREDICTION_SAMPLES = 3;
+
+// Number of movements given to each prediction.
+static const size_t HISTORY_SIZE = 8;
+
+// Duration of the traces in samples.
+static const size_t TRACE_SIZE = 40;
+
+// Directory searched for recorded traces unless TOUCH_PREDICTOR_TRACES names another.
+static const char* const DEFAULT_TRACE_DIR = "/data/local/tmp/touch_traces";
+
+
+// --- TouchPredictorTest ---
+
+/*
+ * Replays gesture traces through predictors and measures how far the
+ * predictions are from where the trace actually went.
+ *
+ * Recorded traces are text files with one sample per line, as
+ * "<event time in ns> <x> <y>"; blank lines and lines starting with '#'
+ * are skipped.
+ */
+class TouchPredictorTest : public testing::Test {
+protected:
+    struct TraceSample {
+        nsecs_t eventTime;
+        float x, y;
+    };
+
+    Vector<TraceSample> mTrace;
+
+    void addSample(nsecs_t eventTime, float x, float y) {
+        TraceSample sample;
+        sample.eventTime = eventTime;
+        sample.x = x;
+        sample.y = y;
+        mTrace.push(sample);
+    }
+
+    // Replaces mTrace with the samples recorded in path.
+    bool loadTrace(const char* path) {
+        mTrace.clear();
+        FILE* file = fopen(path, "r");
+        if (!file) {
+            return false;
+        }
+
+        char line[256];
+        bool ok = true;
+        while (ok && fgets(line, sizeof(line), file)) {
+            const char* p = line + strspn(line, " \t");
+            if (*p == '#' || *p == '\n' || *p == '\0') {
+                continue;
+            }
+            long long eventTime;
+            float x, y;
+            if (sscanf(p, "%lld %f %f", &eventTime, &x, &y) != 3
+                    || (!mTrace.isEmpty() && eventTime <= mTrace.top().eventTime)) {
+                ok = false;
+                break;
+            }
+            addSample(eventTime, x, y);
+        }
+        fclose(file);
+        return ok && mTrace.size() >= HISTORY_SIZE + PREDICTION_SAMPLES;
+    }
+
+    // Returns the paths of the recorded traces in the trace directory.
+    static Vector<String8> findRecordedTraces() {
+        const char* dir = getenv("TOUCH_PREDICTOR_TRACES");
+        if (!dir) {
+            dir = DEFAULT_TRACE_DIR;
+        }
+
+        Vector<String8> paths;
+        DIR* d = opendir(dir);
+        if (!d) {
+            return paths;
+        }
+        while (struct dirent* entry = readdir(d)) {
+            if (entry->d_name[0] != '.') {
+                paths.push(String8::format("%s/%s", dir, entry->d_name));
+            }
+        }
+        closedir(d);
+        return paths;
+    }
+
+    void makeLineTrace() {
+        for (size_t i = 0; i < TRACE_SIZE; i++) {
+            float t = i * SAMPLE_INTERVAL * 0.000000001f;
+            addSample(i * SAMPLE_INTERVAL, 100 + 1000 * t, 200 + 500 * t);
+        }
+    }
+
+    void makeFlingTrace() {
+        // Decelerates from 3000 px/s, without coming to a stop within the trace.
+        for (size_t i = 0; i < TRACE_SIZE; i++) {
+            float t = i * SAMPLE_INTERVAL * 0.000000001f;
+            addSample(i * SAMPLE_INTERVAL, 100 + 3000 * t - 4000 * t * t, 800 - 1500 * t);
+        }
+    }
+
+    void makeCircleTrace() {
+        // One turn per second around a circle with a radius of 300 px.
+        for (size_t i = 0; i < TRACE_SIZE; i++) {
+            float angle = 2 * M_PI * i * SAMPLE_INTERVAL * 0.000000001f;
+            addSample(i * SAMPLE_INTERVAL, 500 + 300 * cosf(angle), 800 + 300 * sinf(angle));
+        }
+    }
+
+    // Returns the root mean square distance between the trace and the positions
+    // predicted PREDICTION_SAMPLES ahead from the historySize samples before.
+    float measurePredictionError(const char* strategy, size_t historySize) {
+        TouchPredictor predictor(strategy);
+        TouchPredictor::Movement movements[HISTORY_SIZE];
+        BitSet32 idBits;
+        idBits.markBit(0);
+
+        float sumSquares = 0;
+        size_t count = 0;
+        for (size_t end = historySize; end + PREDICTION_SAMPLES <= mTrace.size(); end++) {
+            for (size_t i = 0; i < historySize; i++) {
+                const TraceSample& sample = mTrace[end - historySize + i];
+                movements[i].eventTime = sample.eventTime;
+                movements[i].idBits = idBits;
+                movements[i].positions[0].x = sample.x;
+                movements[i].positions[0].y = sample.y;
+            }
+            predictor.setMovements(movements, historySize);
+
+            const TraceSample& actual = mTrace[end + PREDICTION_SAMPLES - 1];
+            float x, y;
+            EXPECT_TRUE(predictor.predict(0, actual.eventTime, &x, &y));
+            sumSquares += (x - actual.x) * (x - actual.x) + (y - actual.y) * (y - actual.y);
+            count += 1;
+        }
+        return sqrtf(sumSquares / count);
+    }
+
+    // Returns the error of linear extrapolation from the two newest samples.
+    float measureLinearPredictionError() {
+        return measurePredictionError("lsq1", 2);
+    }
+};
+
+TEST_F(TouchPredictorTest, Predict_WhenNoMovements_ReturnsFalse) {
+    TouchPredictor predictor("lsq2");
+    predictor.setMovements(NULL, 0);
+
+    float x, y;
+    EXPECT_FALSE(predictor.predict(0, SAMPLE_INTERVAL, &x, &y));
+}
+
+TEST_F(TouchPredictorTest, Predict_WhenPointerUnknown_ReturnsFalse) {
+    TouchPredictor predictor("lsq2");
+    TouchPredictor::Movement movements[2];
+    for (size_t i = 0; i < 2; i++) {
+        movements[i].eventTime = i * SAMPLE_INTERVAL;
+        movements[i].idBits.clear();
+        movements[i].idBits.markBit(1);
+        movements[i].positions[0].x = 10 * i;
+        movements[i].positions[0].y = 20 * i;
+    }
+    predictor.setMovements(movements, 2);
+
+    float x, y;
+    EXPECT_FALSE(predictor.predict(0, 2 * SAMPLE_INTERVAL, &x, &y));
+    EXPECT_TRUE(predictor.predict(1, 2 * SAMPLE_INTERVAL, &x, &y));
+}
+
+TEST_F(TouchPredictorTest, Predict_WhenStationary_ReturnsLastPosition) {
+    TouchPredictor predictor("lsq2");
+    TouchPredictor::Movement movements[HISTORY_SIZE];
+    for (size_t i = 0; i < HISTORY_SIZE; i++) {
+        movements[i].eventTime = i * SAMPLE_INTERVAL;
+        movements[i].idBits.clear();
+        movements[i].idBits.markBit(0);
+        movements[i].positions[0].x = 150;
+        movements[i].positions[0].y = 250;
+    }
+    predictor.setMovements(movements, HISTORY_SIZE);
+
+    float x, y;
+    ASSERT_TRUE(predictor.predict(0, (HISTORY_SIZE + 2) * SAMPLE_INTERVAL, &x, &y));
+    EXPECT_NEAR(150, x, 0.01f);
+    EXPECT_NEAR(250, y, 0.01f);
+}
+
+TEST_F(TouchPredictorTest, LineTrace_IsPredictedAccurately) {
+    makeLineTrace();
+
+    EXPECT_LT(measureLinearPredictionError(), 0.5f);
+    EXPECT_LT(measurePredictionError("lsq2", HISTORY_SIZE), 1.0f);
+}
+
+TEST_F(TouchPredictorTest, FlingTrace_QuadraticFitBeatsLinearExtrapolation) {
+    makeFlingTrace();
+
+    float linearError = measureLinearPredictionError();
+    float quadraticError = measurePredictionError("lsq2", HISTORY_SIZE);
+    EXPECT_LT(quadraticError, 1.0f);
+    EXPECT_LT(quadraticError, linearError);
+}
+
+TEST_F(TouchPredictorTest, CircleTrace_QuadraticFitBeatsLinearExtrapolation) {
+    makeCircleTrace();
+
+    EXPECT_LT(measurePredictionError("lsq2", HISTORY_SIZE), measureLinearPredictionError());
+}
+
+TEST_F(TouchPredictorTest, Report_PredictionErrors) {
+    static const char* const STRATEGIES[] = { "lsq2", "wlsq2-recent", "int1", "int2" };
+    static const char* const TRACES[] = { "line", "fling", "circle" };
+
+    for (size_t t = 0; t < sizeof(TRACES) / sizeof(TRACES[0]); t++) {
+        mTrace.clear();
+        switch (t) {
+        case 0: makeLineTrace(); break;
+        case 1: makeFlingTrace(); break;
+        case 2: makeCircleTrace(); break;
+        }
+        printf("%s trace, %d ms ahead: linear %0.3f px", TRACES[t],
+                int(PREDICTION_SAMPLES * SAMPLE_INTERVAL / 1000000),
+                measureLinearPredictionError());
+        for (size_t s = 0; s < sizeof(STRATEGIES) / sizeof(STRATEGIES[0]); s++) {
+            printf(", %s %0.3f px", STRATEGIES[s],
+                    measurePredictionError(STRATEGIES[s], HISTORY_SIZE));
+        }
+        printf("\n");
+    }
+}
+
+// No traces are checked in, so this only runs with --gtest_also_run_disabled_tests,
+// once recorded traces have been pushed to the device. gtest lists it as disabled
+// otherwise rather than counting it as passing.
+TEST_F(TouchPredictorTest, DISABLED_RecordedTraces_QuadraticFitBeatsLinearExtrapolation) {
+    Vector<String8> paths = findRecordedTraces();
+    ASSERT_FALSE(paths.isEmpty()) << "no recorded traces found, set TOUCH_PREDICTOR_TRACES "
+            "or push them to " << DEFAULT_TRACE_DIR;
+
+    for (size_t i = 0; i < paths.size(); i++) {
+        ASSERT_TRUE(loadTrace(paths[i].string())) << "could not load " << paths[i].string();
+
+        float linearError = measureLinearPredictionError();
+        float quadraticError = measurePredictionError("lsq2", HISTORY_SIZE);
+        printf("%s, %zu samples ahead: linear %0.3f px, lsq2 %0.3f px\n", paths[i].string(),
+                PREDICTION_SAMPLES, linearError, quadraticError);
+        EXPECT_LE(quadraticError, linearError) << paths[i].string();
+    }
+}
+
+} // namespace android
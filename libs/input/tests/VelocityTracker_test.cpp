@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <input/VelocityTracker.h>
+#include <utils/Timers.h>
+#include <gtest/gtest.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace android {
+
+// Nanoseconds per milliseconds.
+static const nsecs_t NANOS_PER_MS = 1000000;
+
+// An arbitrary time at which the movements start.
+static const nsecs_t START_TIME = 1000 * NANOS_PER_MS;
+
+// Number of pointers moved by the random movements.
+static const uint32_t POINTER_COUNT = 5;
+
+
+// --- VelocityTrackerTest ---
+
+class VelocityTrackerTest : public testing::Test {
+protected:
+    // Adds a movement of a single pointer.
+    static void addMovement(VelocityTracker& tracker, nsecs_t eventTime, uint32_t id,
+            float x, float y) {
+        BitSet32 idBits;
+        idBits.markBit(id);
+        VelocityTracker::Position position;
+        position.x = x;
+        position.y = y;
+        tracker.addMovement(eventTime, idBits, &position);
+    }
+
+    /*
+     * Feeds the same random movements of several pointers to two trackers, with
+     * pointers going down and up, time occasionally going backwards and the
+     * trackers being cleared now and then.  Calls compare after each movement.
+     *
+     * The movements are 2 ms apart so that, within the 20 movements that
+     * the least squares strategies keep, they are never older than 50 ms.  Up to
+     * that age, "wlsq2-recent" weighs all of them equally and so solves the same
+     * problem as "lsq2".
+     */
+    template<typename Compare>
+    static void addRandomMovements(VelocityTracker& first, VelocityTracker& second,
+            size_t count, Compare compare) {
+        srand(42);
+        nsecs_t eventTime = START_TIME;
+        BitSet32 idBits;
+        idBits.markBit(0);
+        float x[POINTER_COUNT], y[POINTER_COUNT], vx[POINTER_COUNT], vy[POINTER_COUNT];
+        for (uint32_t id = 0; id < POINTER_COUNT; id++) {
+            x[id] = rand() % 1000;
+            y[id] = rand() % 1000;
+            vx[id] = rand() % 4000 - 2000;
+            vy[id] = rand() % 4000 - 2000;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            nsecs_t delta = rand() % 20 ? 2 * NANOS_PER_MS : -2 * NANOS_PER_MS;
+            eventTime += delta;
+
+            if (rand() % 40 == 0) {
+                uint32_t id = rand() % POINTER_COUNT;
+                if (idBits.hasBit(id) && idBits.count() > 1) {
+                    idBits.clearBit(id);
+                } else if (!idBits.hasBit(id)) {
+                    idBits.markBit(id);
+                    BitSet32 downIdBits;
+                    downIdBits.markBit(id);
+                    first.clearPointers(downIdBits);
+                    second.clearPointers(downIdBits);
+                }
+            }
+            if (rand() % 400 == 0) {
+                first.clear();
+                second.clear();
+            }
+
+            VelocityTracker::Position positions[POINTER_COUNT];
+            for (BitSet32 iterBits(idBits); !iterBits.isEmpty(); ) {
+                uint32_t id = iterBits.clearFirstMarkedBit();
+                vx[id] += rand() % 200 - 100;
+                vy[id] += rand() % 200 - 100;
+                x[id] += vx[id] * delta * 0.000000001f + (rand() % 100) * 0.01f;
+                y[id] += vy[id] * delta * 0.000000001f;
+                if (x[id] < 0 || x[id] > 1000) {
+                    vx[id] = x[id] < 0 ? fabsf(vx[id]) : -fabsf(vx[id]);
+                }
+                if (y[id] < 0 || y[id] > 1000) {
+                    vy[id] = y[id] < 0 ? fabsf(vy[id]) : -fabsf(vy[id]);
+                }
+                positions[idBits.getIndexOfBit(id)].x = x[id];
+                positions[idBits.getIndexOfBit(id)].y = y[id];
+            }
+            first.addMovement(eventTime, idBits, positions);
+            second.addMovement(eventTime, idBits, positions);
+            compare(i);
+        }
+    }
+
+    struct CompareEstimators {
+        const VelocityTracker* first;
+        const VelocityTracker* second;
+
+        void operator()(size_t i) const {
+            for (uint32_t id = 0; id < POINTER_COUNT; id++) {
+                VelocityTracker::Estimator expected, actual;
+                bool expectedResult = first->getEstimator(id, &expected);
+                ASSERT_EQ(expectedResult, second->getEstimator(id, &actual))
+                        << "movement " << i << ", pointer " << id;
+                if (!expectedResult) {
+                    continue;
+                }
+                ASSERT_EQ(expected.time, actual.time);
+                ASSERT_EQ(expected.degree, actual.degree)
+                        << "movement " << i << ", pointer " << id;
+                EXPECT_NEAR(expected.xCoeff[0], actual.xCoeff[0], 0.1f);
+                EXPECT_NEAR(expected.yCoeff[0], actual.yCoeff[0], 0.1f);
+                if (expected.degree >= 1) {
+                    EXPECT_NEAR(expected.xCoeff[1], actual.xCoeff[1],
+                            1.0f + fabsf(expected.xCoeff[1]) * 0.01f)
+                            << "movement " << i << ", pointer " << id;
+                    EXPECT_NEAR(expected.yCoeff[1], actual.yCoeff[1],
+                            1.0f + fabsf(expected.yCoeff[1]) * 0.01f)
+                            << "movement " << i << ", pointer " << id;
+                    EXPECT_NEAR(expected.confidence, actual.confidence, 0.01f);
+                }
+            }
+        }
+    };
+};
+
+TEST_F(VelocityTrackerTest, LeastSquares_MatchesWeightedSolutionWithEqualWeights) {
+    VelocityTracker weighted("wlsq2-recent");
+    VelocityTracker unweighted("lsq2");
+    CompareEstimators compare = { &weighted, &unweighted };
+
+    addRandomMovements(weighted, unweighted, 5000, compare);
+}
+
+TEST_F(VelocityTrackerTest, LeastSquares_FitsPolynomialsOfItsDegree) {
+    static const char* const STRATEGIES[] = { "lsq1", "lsq2", "lsq3" };
+
+    for (uint32_t degree = 1; degree <= 3; degree++) {
+        VelocityTracker tracker(STRATEGIES[degree - 1]);
+        for (size_t i = 0; i <= 60; i++) {
+            // Velocity at the last movement, i = 60, is 1000 px/s in x and -500 px/s in y.
+            float t = (int(i) - 60) * 0.005f;
+            float x = 300 + 1000 * t + (degree >= 2 ? 2000 * t * t : 0)
+                    + (degree >= 3 ? 8000 * t * t * t : 0);
+            float y = 900 - 500 * t + (degree >= 2 ? -3000 * t * t : 0)
+                    + (degree >= 3 ? 5000 * t * t * t : 0);
+            addMovement(tracker, START_TIME + i * 5 * NANOS_PER_MS, 0, x, y);
+        }
+
+        float vx, vy;
+        ASSERT_TRUE(tracker.getVelocity(0, &vx, &vy));
+        EXPECT_NEAR(1000, vx, 1) << STRATEGIES[degree - 1];
+        EXPECT_NEAR(-500, vy, 1) << STRATEGIES[degree - 1];
+    }
+}
+
+TEST_F(VelocityTrackerTest, LeastSquares_IgnoresMovementsBeyondHorizon) {
+    VelocityTracker tracker("lsq2");
+    float x = 0;
+    nsecs_t eventTime = START_TIME;
+    for (size_t i = 0; i < 10; i++) {
+        x += 5000 * 0.008f;
+        eventTime += 8 * NANOS_PER_MS;
+        addMovement(tracker, eventTime, 0, x, 0);
+    }
+    for (size_t i = 0; i < 15; i++) {
+        x += 1000 * 0.008f;
+        eventTime += 8 * NANOS_PER_MS;
+        addMovement(tracker, eventTime, 0, x, 0);
+    }
+
+    float vx, vy;
+    ASSERT_TRUE(tracker.getVelocity(0, &vx, &vy));
+    EXPECT_NEAR(1000, vx, 1);
+    EXPECT_NEAR(0, vy, 1);
+}
+
+TEST_F(VelocityTrackerTest, LeastSquares_ForgetsClearedPointers) {
+    VelocityTracker tracker("lsq2");
+    for (size_t i = 0; i < 10; i++) {
+        addMovement(tracker, START_TIME + i * 8 * NANOS_PER_MS, 0, i * 40.0f, 0);
+    }
+    BitSet32 idBits;
+    idBits.markBit(0);
+    tracker.clearPointers(idBits);
+    for (size_t i = 10; i < 15; i++) {
+        addMovement(tracker, START_TIME + i * 8 * NANOS_PER_MS, 0, 1000 - i * 8.0f, 500);
+    }
+
+    float vx, vy;
+    ASSERT_TRUE(tracker.getVelocity(0, &vx, &vy));
+    EXPECT_NEAR(-1000, vx, 1);
+    EXPECT_NEAR(0, vy, 1);
+}
+
+TEST_F(VelocityTrackerTest, Benchmark_GetVelocity) {
+    static const char* const STRATEGIES[] = { "wlsq2-recent", "lsq2" };
+    const size_t movements = 2000;
+
+    for (size_t s = 0; s < sizeof(STRATEGIES) / sizeof(STRATEGIES[0]); s++) {
+        VelocityTracker tracker(STRATEGIES[s]);
+        BitSet32 idBits;
+        for (uint32_t id = 0; id < POINTER_COUNT; id++) {
+            idBits.markBit(id);
+        }
+
+        // Query every pointer several times per movement, like a busy frame does.
+        float sum = 0;
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (size_t i = 0; i < movements; i++) {
+            VelocityTracker::Position positions[POINTER_COUNT];
+            for (uint32_t id = 0; id < POINTER_COUNT; id++) {
+                positions[id].x = i * (id + 1) * 2.0f + sinf(i * 0.1f);
+                positions[id].y = i * 3.0f;
+            }
+            tracker.addMovement(START_TIME + i * 8 * NANOS_PER_MS, idBits, positions);
+            for (size_t query = 0; query < 4; query++) {
+                for (uint32_t id = 0; id < POINTER_COUNT; id++) {
+                    float vx, vy;
+                    tracker.getVelocity(id, &vx, &vy);
+                    sum += vx + vy;
+                }
+            }
+        }
+        nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        size_t queries = movements * 4 * POINTER_COUNT;
+        printf("%s: %zu movements and %zu queries in %.1fms, %.0f ns/query (checksum %.0f)\n",
+                STRATEGIES[s], movements, queries, elapsed / 1000000.0,
+                double(elapsed) / queries, sum);
+    }
+}
+
+} // namespace android
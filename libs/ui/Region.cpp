@@ -29,6 +29,10 @@
 
 #include <private/ui/RegionHelper.h>
 
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 // ----------------------------------------------------------------------------
 #define VALIDATE_REGIONS        (false)
 #define VALIDATE_WITH_CORECG    (false)
@@ -55,6 +59,125 @@ enum {
 
 // ----------------------------------------------------------------------------
 
+/*
+ * Handles the boolean operations whose result can be computed from the
+ * bounds alone, which covers most rect-vs-rect operations done by
+ * SurfaceFlinger. rhs is already translated. Returns false if the general
+ * region_operator is needed.
+ */
+static bool trivial_boolean_operation(int op, Region& dst,
+        const Region& lhs, const Rect& rhs)
+{
+    const Rect bounds(lhs.getBounds());
+
+    if (bounds.isEmpty()) {
+        if (op == op_or || op == op_xor) {
+            if (rhs.isEmpty()) {
+                dst.clear();
+            } else {
+                dst.set(rhs);
+            }
+        } else {
+            dst.clear();
+        }
+        return true;
+    }
+
+    if (rhs.isEmpty()) {
+        if (op == op_and) {
+            dst.clear();
+        } else {
+            dst = lhs;
+        }
+        return true;
+    }
+
+    Rect common;
+    if (!bounds.intersect(rhs, &common)) {
+        if (op == op_and) {
+            dst.clear();
+            return true;
+        }
+        if (op == op_nand) {
+            dst = lhs;
+            return true;
+        }
+        return false;
+    }
+
+    if (rhs.left <= bounds.left && rhs.top <= bounds.top &&
+            rhs.right >= bounds.right && rhs.bottom >= bounds.bottom) {
+        // rhs covers all of lhs
+        switch (op) {
+            case op_and:  dst = lhs;      return true;
+            case op_nand: dst.clear();    return true;
+            case op_or:   dst.set(rhs);   return true;
+        }
+        return false;
+    }
+
+    if (!lhs.isRect()) {
+        return false;
+    }
+
+    if (op == op_and) {
+        dst.set(common);
+        return true;
+    }
+
+    if (op == op_or) {
+        if (common == rhs) {
+            // lhs covers all of rhs
+            dst = lhs;
+            return true;
+        }
+        if ((bounds.left == rhs.left && bounds.right == rhs.right) ||
+                (bounds.top == rhs.top && bounds.bottom == rhs.bottom)) {
+            // overlapping rects of the same width or height
+            dst.set(Rect(
+                    bounds.left   < rhs.left   ? bounds.left   : rhs.left,
+                    bounds.top    < rhs.top    ? bounds.top    : rhs.top,
+                    bounds.right  > rhs.right  ? bounds.right  : rhs.right,
+                    bounds.bottom > rhs.bottom ? bounds.bottom : rhs.bottom));
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Returns true if the n rects at p and q have the same horizontal extents,
+ * i.e. if two vertically adjacent spans can be merged.
+ */
+static inline bool same_columns(const Rect* p, const Rect* q, size_t n)
+{
+#if defined(__ARM_NEON__)
+    // Rects are laid out as {left, top, right, bottom}; deinterleave four
+    // of them at a time and compare the left and right lanes.
+    while (n >= 4) {
+        const int32x4x4_t a = vld4q_s32(reinterpret_cast<const int32_t*>(p));
+        const int32x4x4_t b = vld4q_s32(reinterpret_cast<const int32_t*>(q));
+        const uint32x4_t eq = vandq_u32(vceqq_s32(a.val[0], b.val[0]),
+                vceqq_s32(a.val[2], b.val[2]));
+        const uint32x2_t eq2 = vand_u32(vget_low_u32(eq), vget_high_u32(eq));
+        if ((vget_lane_u32(eq2, 0) & vget_lane_u32(eq2, 1)) != 0xFFFFFFFF) {
+            return false;
+        }
+        p += 4, q += 4, n -= 4;
+    }
+#endif
+    while (n) {
+        if ((p->left != q->left) || (p->right != q->right)) {
+            return false;
+        }
+        p++, q++, n--;
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
 Region::Region() {
     mStorage.add(Rect(0,0));
 }
@@ -404,22 +527,24 @@ const Region Region::operation(const Region& rhs, int dx, int dy, int op) const
 
 // This is our region rasterizer, which merges rects and spans together
 // to obtain an optimal region.
+// The span being built is kept at the end of the storage itself, right
+// after the previous span, so rasterizing doesn't need any memory besides
+// the destination region's.
 class Region::rasterizer : public region_operator<Rect>::region_rasterizer 
 {
     Rect bounds;
     Vector<Rect>& storage;
-    Rect* head;
-    Rect* tail;
-    Vector<Rect> span;
-    Rect* cur;
+    size_t head;    // first rect of the previous span
+    size_t span;    // first rect of the current span
 public:
-    rasterizer(Region& reg) 
-        : bounds(INT_MAX, 0, INT_MIN, 0), storage(reg.mStorage), head(), tail(), cur() {
+    rasterizer(Region& reg, size_t hint)
+        : bounds(INT_MAX, 0, INT_MIN, 0), storage(reg.mStorage), head(), span() {
         storage.clear();
+        storage.setCapacity(hint);
     }
 
     ~rasterizer() {
-        if (span.size()) {
+        if (storage.size() > span) {
             flushSpan();
         }
         if (storage.size()) {
@@ -438,16 +563,16 @@ public:
     virtual void operator()(const Rect& rect) {
         //ALOGD(">>> %3d, %3d, %3d, %3d",
         //        rect.left, rect.top, rect.right, rect.bottom);
-        if (span.size()) {
-            if (cur->top != rect.top) {
+        if (storage.size() > span) {
+            Rect& cur = storage.editTop();
+            if (cur.top != rect.top) {
                 flushSpan();
-            } else if (cur->right == rect.left) {
-                cur->right = rect.right;
+            } else if (cur.right == rect.left) {
+                cur.right = rect.right;
                 return;
             }
         }
-        span.add(rect);
-        cur = span.editArray() + (span.size() - 1);
+        storage.add(rect);
     }
 private:
     template<typename T> 
@@ -455,36 +580,26 @@ private:
     template<typename T> 
     static inline T max(T rhs, T lhs) { return rhs > lhs ? rhs : lhs; }
     void flushSpan() {
+        const size_t count = storage.size() - span;
+        Rect* const r = storage.editArray();
         bool merge = false;
-        if (tail-head == ssize_t(span.size())) {
-            Rect const* p = span.editArray();
-            Rect const* q = head;
-            if (p->top == q->bottom) {
-                merge = true;
-                while (q != tail) {
-                    if ((p->left != q->left) || (p->right != q->right)) {
-                        merge = false;
-                        break;
-                    }
-                    p++, q++;
-                }
+        if (span - head == count) {
+            if (r[span].top == r[head].bottom) {
+                merge = same_columns(r + span, r + head, count);
             }
         }
         if (merge) {
-            const int bottom = span[0].bottom;
-            Rect* r = head;
-            while (r != tail) {
-                r->bottom = bottom;
-                r++;
+            const int bottom = r[span].bottom;
+            for (size_t i = head; i < span; i++) {
+                r[i].bottom = bottom;
             }
+            storage.removeItemsAt(span, count);
         } else {
-            bounds.left = min(span.itemAt(0).left, bounds.left);
-            bounds.right = max(span.top().right, bounds.right);
-            storage.appendVector(span);
-            tail = storage.editArray() + storage.size();
-            head = tail - span.size();
+            bounds.left = min(r[span].left, bounds.left);
+            bounds.right = max(r[span + count - 1].right, bounds.right);
+            head = span;
+            span = storage.size();
         }
-        span.clear();
     }
 };
 
@@ -566,6 +681,19 @@ void Region::boolean_operation(int op, Region& dst,
     validate(dst, "boolean_operation (before): dst");
 #endif
 
+#if !VALIDATE_WITH_CORECG
+    if (rhs.isRect()) {
+        Rect r(rhs.getBounds());
+        r.offsetBy(dx, dy);
+        if (trivial_boolean_operation(op, dst, lhs, r)) {
+#if VALIDATE_REGIONS
+            validate(dst, "boolean_operation (trivial): dst");
+#endif
+            return;
+        }
+    }
+#endif
+
     size_t lhs_count;
     Rect const * const lhs_rects = lhs.getArray(&lhs_count);
 
@@ -576,7 +704,7 @@ void Region::boolean_operation(int op, Region& dst,
     region_operator<Rect>::region rhs_region(rhs_rects, rhs_count, dx, dy);
     region_operator<Rect> operation(op, lhs_region, rhs_region);
     { // scope for rasterizer (dtor has side effects)
-        rasterizer r(dst);
+        rasterizer r(dst, lhs_count + rhs_count);
         operation(r);
     }
 
@@ -679,6 +807,12 @@ void Region::boolean_operation(int op, Region& dst,
 #if VALIDATE_WITH_CORECG || VALIDATE_REGIONS
     boolean_operation(op, dst, lhs, Region(rhs), dx, dy);
 #else
+    Rect r(rhs);
+    r.offsetBy(dx, dy);
+    if (trivial_boolean_operation(op, dst, lhs, r)) {
+        return;
+    }
+
     size_t lhs_count;
     Rect const * const lhs_rects = lhs.getArray(&lhs_count);
 
@@ -686,7 +820,7 @@ void Region::boolean_operation(int op, Region& dst,
     region_operator<Rect>::region rhs_region(&rhs, 1, dx, dy);
     region_operator<Rect> operation(op, lhs_region, rhs_region);
     { // scope for rasterizer (dtor has side effects)
-        rasterizer r(dst);
+        rasterizer r(dst, lhs_count + 1);
         operation(r);
     }
 
@@ -713,6 +847,31 @@ void Region::translate(Region& reg, int dx, int dy)
 #endif
         size_t count = reg.mStorage.size();
         Rect* rects = reg.mStorage.editArray();
+#if defined(__ARM_NEON__)
+        const int32_t delta[4] = { dx, dy, dx, dy };
+        const int32x4_t d = vld1q_s32(delta);
+        // Every rect is {left, top, right, bottom}, so the same delta
+        // applies to each group of four lanes; do four rects at a time.
+        while (count >= 4) {
+            int32_t* p = reinterpret_cast<int32_t*>(rects);
+            const int32x4_t r0 = vaddq_s32(vld1q_s32(p),      d);
+            const int32x4_t r1 = vaddq_s32(vld1q_s32(p + 4),  d);
+            const int32x4_t r2 = vaddq_s32(vld1q_s32(p + 8),  d);
+            const int32x4_t r3 = vaddq_s32(vld1q_s32(p + 12), d);
+            vst1q_s32(p,      r0);
+            vst1q_s32(p + 4,  r1);
+            vst1q_s32(p + 8,  r2);
+            vst1q_s32(p + 12, r3);
+            rects += 4;
+            count -= 4;
+        }
+        while (count) {
+            int32_t* p = reinterpret_cast<int32_t*>(rects);
+            vst1q_s32(p, vaddq_s32(vld1q_s32(p), d));
+            rects++;
+            count--;
+        }
+#endif
         while (count) {
             rects->offsetBy(dx, dy);
             rects++;
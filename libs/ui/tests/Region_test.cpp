@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <ui/Region.h>
 #include <ui/Rect.h>
+#include <utils/Timers.h>
 #include <gtest/gtest.h>
 
 namespace android {
@@ -53,6 +54,17 @@ protected:
         }
         EXPECT_TRUE((original ^ modified).isEmpty());
     }
+
+    void expectSameRects(const Region& expected, const Region& actual) {
+        size_t expectedCount, actualCount;
+        const Rect* e = expected.getArray(&expectedCount);
+        const Rect* a = actual.getArray(&actualCount);
+        ASSERT_EQ(expectedCount, actualCount);
+        for (size_t i = 0; i < expectedCount; i++) {
+            EXPECT_EQ(e[i], a[i]);
+        }
+        EXPECT_EQ(expected.getBounds(), actual.getBounds());
+    }
 };
 
 TEST_F(RegionTest, MinimalDivision_TJunction) {
@@ -152,5 +164,79 @@ TEST_F(RegionTest, Random_TJunction) {
     }
 }
 
+TEST_F(RegionTest, Random_RectOperations) {
+    // Operations between two rects mostly take a shortcut; check that it
+    // produces exactly what the general algorithm does. Adding a far away
+    // pixel to lhs forces the general path.
+    const Rect far(100, 100, 101, 101);
+    srandom(54321);
+
+    for (int iter = 0; iter < ITER_MAX; iter++) {
+        int l = random() % X_MAX, t = random() % Y_MAX;
+        Rect a(l, t, l + random() % (X_MAX - l + 1), t + random() % (Y_MAX - t + 1));
+        l = random() % X_MAX, t = random() % Y_MAX;
+        Rect b(l, t, l + random() % (X_MAX - l + 1), t + random() % (Y_MAX - t + 1));
+
+        Region ra(a);
+        Region general(a);
+        general.orSelf(far);
+
+        expectSameRects(general.intersect(b), ra.intersect(b));
+        expectSameRects(general.merge(b).subtract(far), ra.merge(b));
+        expectSameRects(general.subtract(b).subtract(far), ra.subtract(b));
+        expectSameRects(general.mergeExclusive(b).subtract(far), ra.mergeExclusive(b));
+
+        Region self(a);
+        self.orSelf(b);
+        expectSameRects(ra.merge(b), self);
+        self = ra;
+        self.subtractSelf(b);
+        expectSameRects(ra.subtract(b), self);
+    }
+}
+
+TEST_F(RegionTest, Benchmark_LayerStack) {
+    // A typical phone screen: status bar, navigation bar and a stack of
+    // application windows, wallpaper at the bottom. Computes what each
+    // layer contributes the same way SurfaceFlinger::computeVisibleRegions
+    // does, front to back.
+    const int W = 1080, H = 1920;
+    Vector<Rect> layers;
+    layers.add(Rect(0, 0, W, 75));                 // status bar
+    layers.add(Rect(0, H - 144, W, H));            // navigation bar
+    layers.add(Rect(90, 600, W - 90, 1100));       // dialog
+    for (int i = 0; i < 12; i++) {
+        // app windows, some offset by window animations
+        int dx = (i % 3) * 40, dy = (i % 4) * 30;
+        layers.add(Rect(dx, 75 + dy, W - dx, H - 144 - dy));
+    }
+    layers.add(Rect(0, 0, W, H));                  // wallpaper
+
+    const int iterations = 2000;
+    size_t totalRects = 0;
+    nsecs_t start = systemTime();
+    for (int iter = 0; iter < iterations; iter++) {
+        Region aboveOpaqueLayers;
+        Region aboveCoveredLayers;
+        Region dirty;
+        for (size_t i = 0; i < layers.size(); i++) {
+            const Rect& bounds(layers[i]);
+            Region visibleRegion(bounds);
+            Region coveredRegion = aboveCoveredLayers.intersect(visibleRegion);
+            aboveCoveredLayers.orSelf(visibleRegion);
+            visibleRegion.subtractSelf(aboveOpaqueLayers);
+            dirty.orSelf(visibleRegion);
+            aboveOpaqueLayers.orSelf(bounds);
+            totalRects += visibleRegion.end() - visibleRegion.begin();
+            totalRects += coveredRegion.end() - coveredRegion.begin();
+        }
+        dirty.andSelf(Rect(W, H));
+    }
+    nsecs_t elapsed = systemTime() - start;
+    printf("%d layer stacks (%zu layers) in %.3f ms: %.2f us per stack, %zu rects\n",
+            iterations, layers.size(), elapsed / 1e6, elapsed / 1e3 / iterations,
+            totalRects);
+}
+
 }; // namespace android
 
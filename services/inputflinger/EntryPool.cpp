@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "EntryPool"
+
+#include "EntryPool.h"
+
+#include <cutils/log.h>
+
+#include <stdlib.h>
+
+namespace android {
+
+// Dispatch entries and key entries fit the smallest class; motion entries with
+// up to one, two and six pointers the others.
+const size_t EntryPool::BLOCK_SIZES[NUM_SIZE_CLASSES] = { 128, 384, 512, 1024 };
+
+EntryPool::EntryPool(size_t blocksPerClass) :
+        mBlocksPerClass(blocksPerClass), mHeapInUse(0), mOversizeAllocations(0) {
+    for (size_t i = 0; i < NUM_SIZE_CLASSES; i++) {
+        SizeClass& sizeClass = mClasses[i];
+        sizeClass.slab = static_cast<uint8_t*>(malloc(BLOCK_SIZES[i] * blocksPerClass));
+        LOG_ALWAYS_FATAL_IF(!sizeClass.slab, "Could not allocate input entry pool.");
+        sizeClass.numUsed = 0;
+        sizeClass.freeList = NULL;
+        sizeClass.inUse = 0;
+        sizeClass.peakInUse = 0;
+        sizeClass.heapAllocations = 0;
+    }
+}
+
+EntryPool::~EntryPool() {
+    for (size_t i = 0; i < NUM_SIZE_CLASSES; i++) {
+        ALOGW_IF(mClasses[i].inUse, "Destroying input entry pool with %zu blocks of "
+                "%zu bytes still in use.", mClasses[i].inUse, BLOCK_SIZES[i]);
+        ::free(mClasses[i].slab);
+    }
+}
+
+void* EntryPool::allocate(size_t size) {
+    { // acquire lock
+        AutoMutex _l(mLock);
+
+        size_t i = 0;
+        while (i < NUM_SIZE_CLASSES && size > BLOCK_SIZES[i]) {
+            i++;
+        }
+        if (i < NUM_SIZE_CLASSES) {
+            SizeClass& sizeClass = mClasses[i];
+            void* block = NULL;
+            if (sizeClass.freeList) {
+                block = sizeClass.freeList;
+                sizeClass.freeList = sizeClass.freeList->next;
+            } else if (sizeClass.numUsed < mBlocksPerClass) {
+                block = sizeClass.slab + sizeClass.numUsed++ * BLOCK_SIZES[i];
+            }
+            if (block) {
+                if (++sizeClass.inUse > sizeClass.peakInUse) {
+                    sizeClass.peakInUse = sizeClass.inUse;
+                }
+                return block;
+            }
+            sizeClass.heapAllocations += 1;
+        } else {
+            mOversizeAllocations += 1;
+        }
+        mHeapInUse += 1;
+    } // release lock
+
+    void* block = malloc(size);
+    LOG_ALWAYS_FATAL_IF(!block, "Could not allocate %zu bytes for an input entry.", size);
+    return block;
+}
+
+void EntryPool::free(void* block) {
+    if (!block) {
+        return;
+    }
+
+    ssize_t i = findClass(block);
+    if (i < 0) {
+        ::free(block);
+    }
+
+    AutoMutex _l(mLock);
+    if (i < 0) {
+        mHeapInUse -= 1;
+        return;
+    }
+    SizeClass& sizeClass = mClasses[i];
+    FreeBlock* freeBlock = static_cast<FreeBlock*>(block);
+    freeBlock->next = sizeClass.freeList;
+    sizeClass.freeList = freeBlock;
+    sizeClass.inUse -= 1;
+}
+
+ssize_t EntryPool::findClass(const void* block) const {
+    const uint8_t* address = static_cast<const uint8_t*>(block);
+    for (size_t i = 0; i < NUM_SIZE_CLASSES; i++) {
+        const uint8_t* slab = mClasses[i].slab;
+        if (address >= slab && address < slab + BLOCK_SIZES[i] * mBlocksPerClass) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+size_t EntryPool::getBlocksInUse() const {
+    AutoMutex _l(mLock);
+    size_t result = mHeapInUse;
+    for (size_t i = 0; i < NUM_SIZE_CLASSES; i++) {
+        result += mClasses[i].inUse;
+    }
+    return result;
+}
+
+size_t EntryPool::getHeapAllocations() const {
+    AutoMutex _l(mLock);
+    size_t result = mOversizeAllocations;
+    for (size_t i = 0; i < NUM_SIZE_CLASSES; i++) {
+        result += mClasses[i].heapAllocations;
+    }
+    return result;
+}
+
+void EntryPool::dump(String8& dump) const {
+    AutoMutex _l(mLock);
+    for (size_t i = 0; i < NUM_SIZE_CLASSES; i++) {
+        const SizeClass& sizeClass = mClasses[i];
+        dump.appendFormat("    %zu bytes: inUse=%zu, peakInUse=%zu, capacity=%zu, "
+                "heapAllocations=%zu\n",
+                BLOCK_SIZES[i], sizeClass.inUse, sizeClass.peakInUse, mBlocksPerClass,
+                sizeClass.heapAllocations);
+    }
+    dump.appendFormat("    oversize: heapAllocations=%zu\n", mOversizeAllocations);
+    dump.appendFormat("    heapInUse=%zu\n", mHeapInUse);
+}
+
+} // namespace android
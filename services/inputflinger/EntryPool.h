@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _UI_INPUT_ENTRY_POOL_H
+#define _UI_INPUT_ENTRY_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils/String8.h>
+#include <utils/threads.h>
+
+namespace android {
+
+/*
+ * A fixed-capacity memory pool for the event and dispatch entries of the
+ * input dispatcher, so that dispatching an event does not go through malloc
+ * and free.
+ *
+ * Blocks come in a few size classes, each carved out of its own slab that is
+ * allocated up front. Blocks that have never been used are handed out from the
+ * end of the slab, so pages are only touched once the load needs them.
+ * Requests larger than the largest class, or made while their class is
+ * exhausted, fall back to the heap and are counted so that dumps show whether
+ * the capacity is adequate.
+ *
+ * The pool is thread safe: entries are created on the dispatcher thread as
+ * well as on the threads that inject events.
+ */
+class EntryPool {
+public:
+    enum { NUM_SIZE_CLASSES = 4 };
+
+    // Block sizes of the size classes, in bytes, ascending.
+    static const size_t BLOCK_SIZES[NUM_SIZE_CLASSES];
+
+    explicit EntryPool(size_t blocksPerClass);
+    ~EntryPool();
+
+    // Returns a block of at least size bytes. Never returns NULL.
+    void* allocate(size_t size);
+
+    // Returns a block obtained from allocate to the pool.
+    void free(void* block);
+
+    // Returns the number of blocks handed out by allocate and not yet freed,
+    // including those that came from the heap.
+    size_t getBlocksInUse() const;
+
+    // Returns the number of allocations that fell back to the heap.
+    size_t getHeapAllocations() const;
+
+    void dump(String8& dump) const;
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    struct SizeClass {
+        uint8_t* slab;
+        size_t numUsed;      // blocks handed out from the end of the slab so far
+        FreeBlock* freeList; // blocks that were freed since
+        size_t inUse;
+        size_t peakInUse;
+        size_t heapAllocations; // allocations made while the slab was exhausted
+    };
+
+    mutable Mutex mLock;
+    const size_t mBlocksPerClass;
+    SizeClass mClasses[NUM_SIZE_CLASSES];
+    size_t mHeapInUse;
+    size_t mOversizeAllocations; // allocations larger than the largest class
+
+    // Returns the size class whose slab holds block, or -1 if it came from the heap.
+    ssize_t findClass(const void* block) const;
+};
+
+} // namespace android
+
+#endif // _UI_INPUT_ENTRY_POOL_H
@@ -96,6 +96,13 @@ const nsecs_t SLOW_EVENT_PROCESSING_WARNING_TIMEOUT = 2000 * 1000000LL; // 2sec
 // Number of recent events to keep for debugging purposes.
 const size_t RECENT_QUEUE_MAX_SIZE = 10;
 
+// Number of blocks of each size in the pool of event and dispatch entries.  Events are
+// normally finished within a few frames, so this only runs out when dispatch is stalled.
+const size_t ENTRY_POOL_BLOCKS_PER_CLASS = 256;
+
+// Pool of memory for event and dispatch entries, shared by all dispatchers.
+static EntryPool gEntryPool(ENTRY_POOL_BLOCKS_PER_CLASS);
+
 static inline nsecs_t now() {
     return systemTime(SYSTEM_TIME_MONOTONIC);
 }
@@ -479,9 +486,10 @@ void InputDispatcher::addRecentEventLocked(EventEntry* entry) {
 
 sp<InputWindowHandle> InputDispatcher::findTouchedWindowAtLocked(int32_t displayId,
         int32_t x, int32_t y) {
-    // Traverse windows from front to back to find touched window.
-    size_t numWindows = mWindowHandles.size();
-    for (size_t i = 0; i < numWindows; i++) {
+    // Traverse the windows that may be hit from front to back to find touched window.
+    InputWindowIndex::Candidates candidates = mWindowIndex.getTouchCandidates(displayId, x, y);
+    size_t i;
+    while (candidates.next(&i)) {
         sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(i);
         const InputWindowInfo* windowInfo = windowHandle->getInfo();
         if (windowInfo->displayId == displayId) {
@@ -1218,9 +1226,12 @@ int32_t InputDispatcher::findTouchedWindowTargetsLocked(nsecs_t currentTime,
         sp<InputWindowHandle> newTouchedWindowHandle;
         bool isTouchModal = false;
 
-        // Traverse windows from front to back to find touched window and outside targets.
-        size_t numWindows = mWindowHandles.size();
-        for (size_t i = 0; i < numWindows; i++) {
+        // Traverse the windows that may be hit from front to back to find touched window
+        // and outside targets.
+        InputWindowIndex::Candidates candidates =
+                mWindowIndex.getTouchCandidates(displayId, x, y);
+        size_t i;
+        while (candidates.next(&i)) {
             sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(i);
             const InputWindowInfo* windowInfo = windowHandle->getInfo();
             if (windowInfo->displayId != displayId) {
@@ -1635,13 +1646,14 @@ bool InputDispatcher::checkInjectionPermission(const sp<InputWindowHandle>& wind
 bool InputDispatcher::isWindowObscuredAtPointLocked(
         const sp<InputWindowHandle>& windowHandle, int32_t x, int32_t y) const {
     int32_t displayId = windowHandle->getInfo()->displayId;
-    size_t numWindows = mWindowHandles.size();
-    for (size_t i = 0; i < numWindows; i++) {
+    // Only the windows in front of this one can obscure it.
+    ssize_t windowIndex = mWindowIndex.indexOf(windowHandle);
+    size_t numWindows = windowIndex >= 0 ? size_t(windowIndex) : mWindowHandles.size();
+    InputWindowIndex::Candidates candidates =
+            mWindowIndex.getObscuringCandidates(displayId, x, y);
+    size_t i;
+    while (candidates.next(&i) && i < numWindows) {
         sp<InputWindowHandle> otherHandle = mWindowHandles.itemAt(i);
-        if (otherHandle == windowHandle) {
-            break;
-        }
-
         const InputWindowInfo* otherInfo = otherHandle->getInfo();
         if (otherInfo->displayId == displayId
                 && otherInfo->visible && !otherInfo->isTrustedOverlay()
@@ -1968,76 +1980,33 @@ void InputDispatcher::startDispatchCycleLocked(nsecs_t currentTime,
 
     while (connection->status == Connection::STATUS_NORMAL
             && !connection->outboundQueue.isEmpty()) {
-        DispatchEntry* dispatchEntry = connection->outboundQueue.head;
-        dispatchEntry->deliveryTime = currentTime;
-
-        // Publish the event.
-        status_t status;
-        EventEntry* eventEntry = dispatchEntry->eventEntry;
-        switch (eventEntry->type) {
-        case EventEntry::TYPE_KEY: {
-            KeyEntry* keyEntry = static_cast<KeyEntry*>(eventEntry);
-
-            // Publish the key event.
-            status = connection->inputPublisher.publishKeyEvent(dispatchEntry->seq,
-                    keyEntry->deviceId, keyEntry->source,
-                    dispatchEntry->resolvedAction, dispatchEntry->resolvedFlags,
-                    keyEntry->keyCode, keyEntry->scanCode,
-                    keyEntry->metaState, keyEntry->repeatCount, keyEntry->downTime,
-                    keyEntry->eventTime);
-            break;
-        }
-
-        case EventEntry::TYPE_MOTION: {
-            MotionEntry* motionEntry = static_cast<MotionEntry*>(eventEntry);
-
-            PointerCoords scaledCoords[MAX_POINTERS];
-            const PointerCoords* usingCoords = motionEntry->pointerCoords;
-
-            // Set the X and Y offset depending on the input source.
-            float xOffset, yOffset, scaleFactor;
-            if ((motionEntry->source & AINPUT_SOURCE_CLASS_POINTER)
-                    && !(dispatchEntry->targetFlags & InputTarget::FLAG_ZERO_COORDS)) {
-                scaleFactor = dispatchEntry->scaleFactor;
-                xOffset = dispatchEntry->xOffset * scaleFactor;
-                yOffset = dispatchEntry->yOffset * scaleFactor;
-                if (scaleFactor != 1.0f) {
-                    for (uint32_t i = 0; i < motionEntry->pointerCount; i++) {
-                        scaledCoords[i] = motionEntry->pointerCoords[i];
-                        scaledCoords[i].scale(scaleFactor);
-                    }
-                    usingCoords = scaledCoords;
-                }
-            } else {
-                xOffset = 0.0f;
-                yOffset = 0.0f;
-                scaleFactor = 1.0f;
-
-                // We don't want the dispatch target to know.
-                if (dispatchEntry->targetFlags & InputTarget::FLAG_ZERO_COORDS) {
-                    for (uint32_t i = 0; i < motionEntry->pointerCount; i++) {
-                        scaledCoords[i].clear();
-                    }
-                    usingCoords = scaledCoords;
-                }
+        // Publish as many events as fit in a batch, then send them all at once.
+        status_t status = OK;
+        connection->inputPublisher.beginBatch();
+        for (DispatchEntry* dispatchEntry = connection->outboundQueue.head;
+                dispatchEntry && !connection->inputPublisher.isBatchFull();
+                dispatchEntry = dispatchEntry->next) {
+            dispatchEntry->deliveryTime = currentTime;
+            status = publishDispatchEntryLocked(connection, dispatchEntry);
+            if (status) {
+                break;
             }
+        }
+        size_t sentCount;
+        status_t sendStatus = connection->inputPublisher.endBatch(&sentCount);
+        if (sendStatus) {
+            // The events that were not sent take precedence over the one that failed
+            // to be published after them.
+            status = sendStatus;
+        }
 
-            // Publish the motion event.
-            status = connection->inputPublisher.publishMotionEvent(dispatchEntry->seq,
-                    motionEntry->deviceId, motionEntry->source,
-                    dispatchEntry->resolvedAction, dispatchEntry->resolvedFlags,
-                    motionEntry->edgeFlags, motionEntry->metaState, motionEntry->buttonState,
-                    xOffset, yOffset,
-                    motionEntry->xPrecision, motionEntry->yPrecision,
-                    motionEntry->downTime, motionEntry->eventTime,
-                    motionEntry->pointerCount, motionEntry->pointerProperties,
-                    usingCoords);
-            break;
-        }
-
-        default:
-            ALOG_ASSERT(false);
-            return;
+        // Re-enqueue the sent events on the wait queue.
+        while (sentCount--) {
+            DispatchEntry* dispatchEntry = connection->outboundQueue.head;
+            connection->outboundQueue.dequeue(dispatchEntry);
+            traceOutboundQueueLengthLocked(connection);
+            connection->waitQueue.enqueueAtTail(dispatchEntry);
+            traceWaitQueueLengthLocked(connection);
         }
 
         // Check the result.
@@ -2066,12 +2035,74 @@ void InputDispatcher::startDispatchCycleLocked(nsecs_t currentTime,
             }
             return;
         }
+    }
+}
 
-        // Re-enqueue the event on the wait queue.
-        connection->outboundQueue.dequeue(dispatchEntry);
-        traceOutboundQueueLengthLocked(connection);
-        connection->waitQueue.enqueueAtTail(dispatchEntry);
-        traceWaitQueueLengthLocked(connection);
+status_t InputDispatcher::publishDispatchEntryLocked(const sp<Connection>& connection,
+        DispatchEntry* dispatchEntry) {
+    EventEntry* eventEntry = dispatchEntry->eventEntry;
+    switch (eventEntry->type) {
+    case EventEntry::TYPE_KEY: {
+        KeyEntry* keyEntry = static_cast<KeyEntry*>(eventEntry);
+
+        // Publish the key event.
+        return connection->inputPublisher.publishKeyEvent(dispatchEntry->seq,
+                keyEntry->deviceId, keyEntry->source,
+                dispatchEntry->resolvedAction, dispatchEntry->resolvedFlags,
+                keyEntry->keyCode, keyEntry->scanCode,
+                keyEntry->metaState, keyEntry->repeatCount, keyEntry->downTime,
+                keyEntry->eventTime);
+    }
+
+    case EventEntry::TYPE_MOTION: {
+        MotionEntry* motionEntry = static_cast<MotionEntry*>(eventEntry);
+
+        PointerCoords scaledCoords[MAX_POINTERS];
+        const PointerCoords* usingCoords = motionEntry->pointerCoords;
+
+        // Set the X and Y offset depending on the input source.
+        float xOffset, yOffset, scaleFactor;
+        if ((motionEntry->source & AINPUT_SOURCE_CLASS_POINTER)
+                && !(dispatchEntry->targetFlags & InputTarget::FLAG_ZERO_COORDS)) {
+            scaleFactor = dispatchEntry->scaleFactor;
+            xOffset = dispatchEntry->xOffset * scaleFactor;
+            yOffset = dispatchEntry->yOffset * scaleFactor;
+            if (scaleFactor != 1.0f) {
+                for (uint32_t i = 0; i < motionEntry->pointerCount; i++) {
+                    scaledCoords[i] = motionEntry->pointerCoords[i];
+                    scaledCoords[i].scale(scaleFactor);
+                }
+                usingCoords = scaledCoords;
+            }
+        } else {
+            xOffset = 0.0f;
+            yOffset = 0.0f;
+            scaleFactor = 1.0f;
+
+            // We don't want the dispatch target to know.
+            if (dispatchEntry->targetFlags & InputTarget::FLAG_ZERO_COORDS) {
+                for (uint32_t i = 0; i < motionEntry->pointerCount; i++) {
+                    scaledCoords[i].clear();
+                }
+                usingCoords = scaledCoords;
+            }
+        }
+
+        // Publish the motion event.
+        return connection->inputPublisher.publishMotionEvent(dispatchEntry->seq,
+                motionEntry->deviceId, motionEntry->source,
+                dispatchEntry->resolvedAction, dispatchEntry->resolvedFlags,
+                motionEntry->edgeFlags, motionEntry->metaState, motionEntry->buttonState,
+                xOffset, yOffset,
+                motionEntry->xPrecision, motionEntry->yPrecision,
+                motionEntry->downTime, motionEntry->eventTime,
+                motionEntry->pointerCount, motionEntry->pointerProperties,
+                usingCoords);
+    }
+
+    default:
+        ALOG_ASSERT(false);
+        return UNKNOWN_ERROR;
     }
 }
 
@@ -2336,7 +2367,7 @@ InputDispatcher::splitMotionEvent(const MotionEntry* originalMotionEntry, BitSet
         }
     }
 
-    MotionEntry* splitMotionEntry = new MotionEntry(
+    MotionEntry* splitMotionEntry = new (splitPointerCount) MotionEntry(
             originalMotionEntry->eventTime,
             originalMotionEntry->deviceId,
             originalMotionEntry->source,
@@ -2530,7 +2561,7 @@ void InputDispatcher::notifyMotion(const NotifyMotionArgs* args) {
         }
 
         // Just enqueue a new motion event.
-        MotionEntry* newEntry = new MotionEntry(args->eventTime,
+        MotionEntry* newEntry = new (args->pointerCount) MotionEntry(args->eventTime,
                 args->deviceId, args->source, policyFlags,
                 args->action, args->flags, args->metaState, args->buttonState,
                 args->edgeFlags, args->xPrecision, args->yPrecision, args->downTime,
@@ -2645,7 +2676,7 @@ int32_t InputDispatcher::injectInputEvent(const InputEvent* event, int32_t displ
         mLock.lock();
         const nsecs_t* sampleEventTimes = motionEvent->getSampleEventTimes();
         const PointerCoords* samplePointerCoords = motionEvent->getSamplePointerCoords();
-        firstInjectedEntry = new MotionEntry(*sampleEventTimes,
+        firstInjectedEntry = new (pointerCount) MotionEntry(*sampleEventTimes,
                 motionEvent->getDeviceId(), motionEvent->getSource(), policyFlags,
                 action, motionEvent->getFlags(),
                 motionEvent->getMetaState(), motionEvent->getButtonState(),
@@ -2658,7 +2689,7 @@ int32_t InputDispatcher::injectInputEvent(const InputEvent* event, int32_t displ
         for (size_t i = motionEvent->getHistorySize(); i > 0; i--) {
             sampleEventTimes += 1;
             samplePointerCoords += pointerCount;
-            MotionEntry* nextInjectedEntry = new MotionEntry(*sampleEventTimes,
+            MotionEntry* nextInjectedEntry = new (pointerCount) MotionEntry(*sampleEventTimes,
                     motionEvent->getDeviceId(), motionEvent->getSource(), policyFlags,
                     action, motionEvent->getFlags(),
                     motionEvent->getMetaState(), motionEvent->getButtonState(),
@@ -2878,6 +2909,7 @@ void InputDispatcher::setInputWindows(const Vector<sp<InputWindowHandle> >& inpu
                 foundHoveredWindow = true;
             }
         }
+        mWindowIndex.build(mWindowHandles);
 
         if (!foundHoveredWindow) {
             mLastHoverWindowHandle = NULL;
@@ -3217,6 +3249,8 @@ void InputDispatcher::dumpDispatchStateLocked(String8& dump) {
                     windowInfo->ownerPid, windowInfo->ownerUid,
                     windowInfo->dispatchingTimeout / 1000000.0);
         }
+        dump.append(INDENT "WindowIndex:\n");
+        mWindowIndex.dump(dump);
     } else {
         dump.append(INDENT "Windows: <none>\n");
     }
@@ -3335,6 +3369,9 @@ void InputDispatcher::dumpDispatchStateLocked(String8& dump) {
         dump.append(INDENT "AppSwitch: not pending\n");
     }
 
+    dump.append(INDENT "EntryPool:\n");
+    gEntryPool.dump(dump);
+
     dump.append(INDENT "Configuration:\n");
     dump.appendFormat(INDENT2 "KeyRepeatDelay: %0.1fms\n",
             mConfig.keyRepeatDelay * 0.000001f);
@@ -3934,6 +3971,14 @@ void InputDispatcher::EventEntry::release() {
     }
 }
 
+void* InputDispatcher::EventEntry::operator new(size_t size) {
+    return gEntryPool.allocate(size);
+}
+
+void InputDispatcher::EventEntry::operator delete(void* ptr) {
+    gEntryPool.free(ptr);
+}
+
 void InputDispatcher::EventEntry::releaseInjectionState() {
     if (injectionState) {
         injectionState->release();
@@ -4022,7 +4067,10 @@ InputDispatcher::MotionEntry::MotionEntry(nsecs_t eventTime,
         deviceId(deviceId), source(source), action(action), flags(flags),
         metaState(metaState), buttonState(buttonState), edgeFlags(edgeFlags),
         xPrecision(xPrecision), yPrecision(yPrecision),
-        downTime(downTime), displayId(displayId), pointerCount(pointerCount),interceptMotionResult(INTERCEPT_MOTION_RESULT_UNKNOWN) {
+        downTime(downTime), displayId(displayId), pointerCount(pointerCount),
+        pointerProperties(reinterpret_cast<PointerProperties*>(this + 1)),
+        pointerCoords(reinterpret_cast<PointerCoords*>(this->pointerProperties + pointerCount)),
+        interceptMotionResult(INTERCEPT_MOTION_RESULT_UNKNOWN) {
     for (uint32_t i = 0; i < pointerCount; i++) {
         this->pointerProperties[i].copyFrom(pointerProperties[i]);
         this->pointerCoords[i].copyFrom(pointerCoords[i]);
@@ -4035,6 +4083,13 @@ InputDispatcher::MotionEntry::MotionEntry(nsecs_t eventTime,
 InputDispatcher::MotionEntry::~MotionEntry() {
 }
 
+void* InputDispatcher::MotionEntry::operator new(size_t size, uint32_t pointerCount) {
+    // The pointer properties come first; the entry's size keeps them aligned, and their
+    // size keeps the pointer coords aligned after them.
+    return EventEntry::operator new(size + pointerCount
+            * (sizeof(PointerProperties) + sizeof(PointerCoords)));
+}
+
 void InputDispatcher::MotionEntry::appendDescription(String8& msg) const {
     msg.appendFormat("MotionEvent(deviceId=%d, source=0x%08x, action=%d, "
             "flags=0x%08x, metaState=0x%08x, buttonState=0x%08x, edgeFlags=0x%08x, "
@@ -4069,6 +4124,14 @@ InputDispatcher::DispatchEntry::~DispatchEntry() {
     eventEntry->release();
 }
 
+void* InputDispatcher::DispatchEntry::operator new(size_t size) {
+    return gEntryPool.allocate(size);
+}
+
+void InputDispatcher::DispatchEntry::operator delete(void* ptr) {
+    gEntryPool.free(ptr);
+}
+
 uint32_t InputDispatcher::DispatchEntry::nextSeq() {
     // Sequence number 0 is reserved and will never be returned.
     uint32_t seq;
@@ -4335,7 +4398,7 @@ void InputDispatcher::InputState::synthesizeCancelationEvents(nsecs_t currentTim
     for (size_t i = 0; i < mMotionMementos.size(); i++) {
         const MotionMemento& memento = mMotionMementos.itemAt(i);
         if (shouldCancelMotion(memento, options)) {
-            outEvents.push(new MotionEntry(currentTime,
+            outEvents.push(new (memento.pointerCount) MotionEntry(currentTime,
                     memento.deviceId, memento.source, memento.policyFlags,
                     memento.hovering
                             ? AMOTION_EVENT_ACTION_HOVER_EXIT
@@ -33,7 +33,9 @@
 #include <unistd.h>
 #include <limits.h>
 
+#include "EntryPool.h"
 #include "InputWindow.h"
+#include "InputWindowIndex.h"
 #include "InputApplication.h"
 #include "InputListener.h"
 
@@ -453,6 +455,10 @@ private:
 
         virtual void appendDescription(String8& msg) const = 0;
 
+        // Entries are allocated from the dispatcher's entry pool.
+        static void* operator new(size_t size);
+        static void operator delete(void* ptr);
+
     protected:
         EventEntry(int32_t type, nsecs_t eventTime, uint32_t policyFlags);
         virtual ~EventEntry();
@@ -524,8 +530,8 @@ private:
         nsecs_t downTime;
         int32_t displayId;
         uint32_t pointerCount;
-        PointerProperties pointerProperties[MAX_POINTERS];
-        PointerCoords pointerCoords[MAX_POINTERS];
+        PointerProperties* pointerProperties; // pointerCount entries stored after the entry
+        PointerCoords* pointerCoords; // pointerCount entries stored after the entry
 		
 	    enum InterceptMotionResult {
             INTERCEPT_MOTION_RESULT_UNKNOWN,
@@ -545,6 +551,10 @@ private:
                 float xOffset, float yOffset);
         virtual void appendDescription(String8& msg) const;
 
+        // Motion entries are allocated together with the storage for their pointers,
+        // so they must be created with new (pointerCount) MotionEntry(...).
+        static void* operator new(size_t size, uint32_t pointerCount);
+
     protected:
         virtual ~MotionEntry();
     };
@@ -568,6 +578,10 @@ private:
                 int32_t targetFlags, float xOffset, float yOffset, float scaleFactor);
         ~DispatchEntry();
 
+        // Entries are allocated from the dispatcher's entry pool.
+        static void* operator new(size_t size);
+        static void operator delete(void* ptr);
+
         inline bool hasForegroundTarget() const {
             return targetFlags & InputTarget::FLAG_FOREGROUND;
         }
@@ -959,6 +973,9 @@ private:
 
     Vector<sp<InputWindowHandle> > mWindowHandles;
 
+    // Spatial index of mWindowHandles for hit testing, rebuilt by setInputWindows.
+    InputWindowIndex mWindowIndex;
+
     sp<InputWindowHandle> getWindowHandleLocked(const sp<InputChannel>& inputChannel) const;
     bool hasWindowHandleLocked(const sp<InputWindowHandle>& windowHandle) const;
 
@@ -1080,6 +1097,8 @@ private:
     void enqueueDispatchEntryLocked(const sp<Connection>& connection,
             EventEntry* eventEntry, const InputTarget* inputTarget, int32_t dispatchMode);
     void startDispatchCycleLocked(nsecs_t currentTime, const sp<Connection>& connection);
+    status_t publishDispatchEntryLocked(const sp<Connection>& connection,
+            DispatchEntry* dispatchEntry);
     void finishDispatchCycleLocked(nsecs_t currentTime, const sp<Connection>& connection,
             uint32_t seq, bool handled);
     void abortBrokenDispatchCycleLocked(nsecs_t currentTime, const sp<Connection>& connection,
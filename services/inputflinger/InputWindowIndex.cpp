@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "InputWindowIndex"
+
+#include "InputWindowIndex.h"
+
+#include <cutils/log.h>
+
+#include <ui/Rect.h>
+
+namespace android {
+
+// --- InputWindowIndex::Candidates ---
+
+InputWindowIndex::Candidates::Candidates() :
+        mFirst(NULL), mFirstEnd(NULL), mSecond(NULL), mSecondEnd(NULL) {
+}
+
+bool InputWindowIndex::Candidates::next(size_t* outIndex) {
+    if (mFirst != mFirstEnd
+            && (mSecond == mSecondEnd || *mFirst < *mSecond)) {
+        *outIndex = *mFirst++;
+        return true;
+    }
+    if (mSecond != mSecondEnd) {
+        *outIndex = *mSecond++;
+        return true;
+    }
+    return false;
+}
+
+
+// --- InputWindowIndex::Grid ---
+
+InputWindowIndex::Grid::Grid() :
+        left(0), top(0), cellWidth(1), cellHeight(1), columns(0), rows(0) {
+}
+
+void InputWindowIndex::Grid::build(const Vector<Entry>& windows) {
+    cellStarts.clear();
+    entries.clear();
+    columns = rows = 0;
+    if (windows.isEmpty()) {
+        return;
+    }
+
+    int32_t right = windows[0].right;
+    int32_t bottom = windows[0].bottom;
+    left = windows[0].left;
+    top = windows[0].top;
+    for (size_t i = 1; i < windows.size(); i++) {
+        const Entry& window = windows[i];
+        if (window.left < left) left = window.left;
+        if (window.top < top) top = window.top;
+        if (window.right > right) right = window.right;
+        if (window.bottom > bottom) bottom = window.bottom;
+    }
+    const int64_t width = int64_t(right) - left + 1;
+    const int64_t height = int64_t(bottom) - top + 1;
+    cellWidth = int32_t((width + GRID_SIZE - 1) / GRID_SIZE);
+    cellHeight = int32_t((height + GRID_SIZE - 1) / GRID_SIZE);
+    columns = int32_t((width + cellWidth - 1) / cellWidth);
+    rows = int32_t((height + cellHeight - 1) / cellHeight);
+
+    // Count the windows of each cell, then fill the cells. The windows are
+    // visited in z order, so every cell lists its windows in z order too.
+    const size_t numCells = size_t(columns) * size_t(rows);
+    cellStarts.insertAt(size_t(0), 0, numCells + 1);
+    size_t* starts = cellStarts.editArray();
+    for (size_t i = 0; i < windows.size(); i++) {
+        int32_t firstColumn, lastColumn, firstRow, lastRow;
+        getCells(windows[i], &firstColumn, &lastColumn, &firstRow, &lastRow);
+        for (int32_t row = firstRow; row <= lastRow; row++) {
+            for (int32_t column = firstColumn; column <= lastColumn; column++) {
+                starts[size_t(row) * columns + column + 1]++;
+            }
+        }
+    }
+    for (size_t c = 0; c < numCells; c++) {
+        starts[c + 1] += starts[c];
+    }
+
+    entries.insertAt(size_t(0), 0, starts[numCells]);
+    size_t* cells = entries.editArray();
+    Vector<size_t> cursors(cellStarts);
+    size_t* next = cursors.editArray();
+    for (size_t i = 0; i < windows.size(); i++) {
+        int32_t firstColumn, lastColumn, firstRow, lastRow;
+        getCells(windows[i], &firstColumn, &lastColumn, &firstRow, &lastRow);
+        for (int32_t row = firstRow; row <= lastRow; row++) {
+            for (int32_t column = firstColumn; column <= lastColumn; column++) {
+                cells[next[size_t(row) * columns + column]++] = windows[i].index;
+            }
+        }
+    }
+}
+
+void InputWindowIndex::Grid::getCells(const Entry& window,
+        int32_t* firstColumn, int32_t* lastColumn,
+        int32_t* firstRow, int32_t* lastRow) const {
+    *firstColumn = int32_t((int64_t(window.left) - left) / cellWidth);
+    *lastColumn = int32_t((int64_t(window.right) - left) / cellWidth);
+    *firstRow = int32_t((int64_t(window.top) - top) / cellHeight);
+    *lastRow = int32_t((int64_t(window.bottom) - top) / cellHeight);
+}
+
+void InputWindowIndex::Grid::lookup(int32_t x, int32_t y,
+        const size_t** first, const size_t** end) const {
+    *first = *end = NULL;
+    if (x < left || y < top) {
+        return;
+    }
+    const int64_t column = (int64_t(x) - left) / cellWidth;
+    const int64_t row = (int64_t(y) - top) / cellHeight;
+    if (column >= columns || row >= rows) {
+        return;
+    }
+    const size_t c = size_t(row) * columns + size_t(column);
+    const size_t* cells = entries.array();
+    *first = cells + cellStarts[c];
+    *end = cells + cellStarts[c + 1];
+}
+
+
+// --- InputWindowIndex ---
+
+InputWindowIndex::InputWindowIndex() {
+}
+
+InputWindowIndex::~InputWindowIndex() {
+}
+
+void InputWindowIndex::build(const Vector<sp<InputWindowHandle> >& windowHandles) {
+    KeyedVector<int32_t, PendingDisplay> pending;
+
+    mIndices.clear();
+    for (size_t i = 0; i < windowHandles.size(); i++) {
+        const sp<InputWindowHandle>& windowHandle = windowHandles.itemAt(i);
+        mIndices.add(windowHandle.get(), i);
+
+        const InputWindowInfo* windowInfo = windowHandle->getInfo();
+        if (!windowInfo->visible) {
+            continue;
+        }
+        ssize_t displayIndex = pending.indexOfKey(windowInfo->displayId);
+        if (displayIndex < 0) {
+            displayIndex = pending.add(windowInfo->displayId, PendingDisplay());
+        }
+        PendingDisplay& display = pending.editValueAt(displayIndex);
+
+        // Mirrors the tests of InputDispatcher::findTouchedWindowTargetsLocked.
+        int32_t flags = windowInfo->layoutParamsFlags;
+        bool isTouchModal = (flags & (InputWindowInfo::FLAG_NOT_FOCUSABLE
+                | InputWindowInfo::FLAG_NOT_TOUCH_MODAL)) == 0;
+        if (flags & InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH) {
+            display.touchEverywhere.push(i);
+        } else if (!(flags & InputWindowInfo::FLAG_NOT_TOUCHABLE)) {
+            if (isTouchModal) {
+                display.touchEverywhere.push(i);
+            } else {
+                Rect bounds = windowInfo->touchableRegion.getBounds();
+                if (!bounds.isEmpty()) {
+                    Entry entry;
+                    entry.index = i;
+                    entry.left = bounds.left;
+                    entry.top = bounds.top;
+                    entry.right = bounds.right;
+                    entry.bottom = bounds.bottom;
+                    display.touchable.push(entry);
+                }
+            }
+        }
+
+        // Mirrors InputDispatcher::isWindowObscuredAtPointLocked. Frames
+        // include their right and bottom edges.
+        if (!windowInfo->isTrustedOverlay()
+                && windowInfo->frameLeft <= windowInfo->frameRight
+                && windowInfo->frameTop <= windowInfo->frameBottom) {
+            Entry entry;
+            entry.index = i;
+            entry.left = windowInfo->frameLeft;
+            entry.top = windowInfo->frameTop;
+            entry.right = windowInfo->frameRight;
+            entry.bottom = windowInfo->frameBottom;
+            display.obscuring.push(entry);
+        }
+    }
+
+    mDisplays.clear();
+    for (size_t d = 0; d < pending.size(); d++) {
+        const PendingDisplay& display = pending.valueAt(d);
+        ssize_t index = mDisplays.add(pending.keyAt(d), DisplayIndex());
+        DisplayIndex& displayIndex = mDisplays.editValueAt(index);
+        displayIndex.touchGrid.build(display.touchable);
+        displayIndex.touchEverywhere = display.touchEverywhere;
+        displayIndex.obscuringGrid.build(display.obscuring);
+    }
+}
+
+InputWindowIndex::Candidates InputWindowIndex::getTouchCandidates(
+        int32_t displayId, int32_t x, int32_t y) const {
+    Candidates candidates;
+    ssize_t index = mDisplays.indexOfKey(displayId);
+    if (index >= 0) {
+        const DisplayIndex& display = mDisplays.valueAt(index);
+        display.touchGrid.lookup(x, y, &candidates.mFirst, &candidates.mFirstEnd);
+        candidates.mSecond = display.touchEverywhere.array();
+        candidates.mSecondEnd = candidates.mSecond + display.touchEverywhere.size();
+    }
+    return candidates;
+}
+
+InputWindowIndex::Candidates InputWindowIndex::getObscuringCandidates(
+        int32_t displayId, int32_t x, int32_t y) const {
+    Candidates candidates;
+    ssize_t index = mDisplays.indexOfKey(displayId);
+    if (index >= 0) {
+        mDisplays.valueAt(index).obscuringGrid.lookup(x, y,
+                &candidates.mFirst, &candidates.mFirstEnd);
+    }
+    return candidates;
+}
+
+ssize_t InputWindowIndex::indexOf(const sp<InputWindowHandle>& windowHandle) const {
+    ssize_t index = mIndices.indexOfKey(windowHandle.get());
+    return index >= 0 ? ssize_t(mIndices.valueAt(index)) : -1;
+}
+
+void InputWindowIndex::dump(String8& dump) const {
+    for (size_t d = 0; d < mDisplays.size(); d++) {
+        const DisplayIndex& display = mDisplays.valueAt(d);
+        dump.appendFormat("    Display %d: touch grid %dx%d cells of %dx%d, "
+                "%zu cell entries, %zu windows touchable everywhere; "
+                "obscuring grid %dx%d cells, %zu cell entries\n",
+                mDisplays.keyAt(d),
+                display.touchGrid.columns, display.touchGrid.rows,
+                display.touchGrid.cellWidth, display.touchGrid.cellHeight,
+                display.touchGrid.entries.size(), display.touchEverywhere.size(),
+                display.obscuringGrid.columns, display.obscuringGrid.rows,
+                display.obscuringGrid.entries.size());
+    }
+}
+
+} // namespace android
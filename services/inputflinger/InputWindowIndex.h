@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _UI_INPUT_WINDOW_INDEX_H
+#define _UI_INPUT_WINDOW_INDEX_H
+
+#include <utils/KeyedVector.h>
+#include <utils/RefBase.h>
+#include <utils/Vector.h>
+
+#include "InputWindow.h"
+
+namespace android {
+
+/*
+ * A spatial index of the input windows of all displays, used to hit test
+ * touches without visiting every window.
+ *
+ * It is built from the window list in z order, front to back, and answers
+ * which windows of that list may be hit at a point, as indices into the
+ * list in the same order. The answers are conservative: callers still do
+ * the exact tests on each candidate, so they behave exactly as if they had
+ * visited all windows.
+ *
+ * Each display gets two uniform grids over the bounds of its windows, one
+ * of touchable regions and one of frames, whose cells list the windows
+ * overlapping them. Windows that can be hit anywhere on the display, i.e.
+ * touch modal windows and windows that watch outside touches, are kept in a
+ * separate list that is merged into every answer.
+ *
+ * The index refers to the window infos as they were when it was built, so
+ * it must be rebuilt whenever the window list is updated.
+ */
+class InputWindowIndex {
+public:
+    // The number of cells along each axis of a grid.
+    enum { GRID_SIZE = 16 };
+
+    /*
+     * Iterates over the union of two sorted lists of window indices.
+     * It stays valid until the index is rebuilt.
+     */
+    class Candidates {
+    public:
+        Candidates();
+
+        // next sets outIndex to the next candidate, front to back, and
+        // returns false once there are no more.
+        bool next(size_t* outIndex);
+
+    private:
+        friend class InputWindowIndex;
+
+        const size_t* mFirst;
+        const size_t* mFirstEnd;
+        const size_t* mSecond;
+        const size_t* mSecondEnd;
+    };
+
+    InputWindowIndex();
+    ~InputWindowIndex();
+
+    // Indexes windowHandles, whose infos must be up to date.
+    void build(const Vector<sp<InputWindowHandle> >& windowHandles);
+
+    // Returns the windows of displayId that a touch at (x, y) may hit or
+    // that watch outside touches. This includes every visible window whose
+    // touchable region contains the point and every visible window that is
+    // touch modal or has FLAG_WATCH_OUTSIDE_TOUCH.
+    Candidates getTouchCandidates(int32_t displayId, int32_t x, int32_t y) const;
+
+    // Returns the windows of displayId that may obscure a window at (x, y).
+    // This includes every visible window that is not a trusted overlay and
+    // whose frame contains the point.
+    Candidates getObscuringCandidates(int32_t displayId, int32_t x, int32_t y) const;
+
+    // Returns the index of windowHandle in the list, or -1 if it is not in
+    // it.
+    ssize_t indexOf(const sp<InputWindowHandle>& windowHandle) const;
+
+    // Appends a description of the index to dump.
+    void dump(String8& dump) const;
+
+private:
+    // A window to be put into a grid, with its bounds, inclusive.
+    struct Entry {
+        size_t index;
+        int32_t left, top, right, bottom;
+    };
+
+    // A uniform grid; the windows of cell c are
+    // entries[cellStarts[c]] .. entries[cellStarts[c + 1] - 1].
+    struct Grid {
+        int32_t left, top;
+        int32_t cellWidth, cellHeight;
+        int32_t columns, rows;
+        Vector<size_t> cellStarts;
+        Vector<size_t> entries;
+
+        Grid();
+        void build(const Vector<Entry>& windows);
+        // Returns the range of cells that window overlaps.
+        void getCells(const Entry& window, int32_t* firstColumn, int32_t* lastColumn,
+                int32_t* firstRow, int32_t* lastRow) const;
+        // Returns the windows of the cell of (x, y) in first and end.
+        void lookup(int32_t x, int32_t y,
+                const size_t** first, const size_t** end) const;
+    };
+
+    // The windows of a display, sorted out while building the index.
+    struct PendingDisplay {
+        Vector<Entry> touchable;
+        Vector<size_t> touchEverywhere;
+        Vector<Entry> obscuring;
+    };
+
+    struct DisplayIndex {
+        Grid touchGrid;
+        Vector<size_t> touchEverywhere;
+        Grid obscuringGrid;
+    };
+
+    KeyedVector<int32_t, DisplayIndex> mDisplays;
+    KeyedVector<const InputWindowHandle*, size_t> mIndices;
+};
+
+} // namespace android
+
+#endif // _UI_INPUT_WINDOW_INDEX_H
@@ -4,8 +4,10 @@ include $(CLEAR_VARS)
 
 # Build the unit tests.
 test_src_files := \
+    EntryPool_test.cpp \
     InputReader_test.cpp \
-    InputDispatcher_test.cpp
+    InputDispatcher_test.cpp \
+    InputWindowIndex_test.cpp
 
 shared_libraries := \
     libcutils \
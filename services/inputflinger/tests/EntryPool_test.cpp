@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../EntryPool.h"
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+namespace android {
+
+// An arbitrary pool capacity.
+static const size_t BLOCKS_PER_CLASS = 4;
+
+
+// --- EntryPoolTest ---
+
+class EntryPoolTest : public testing::Test {
+protected:
+    EntryPoolTest() : mPool(BLOCKS_PER_CLASS) {
+    }
+
+    EntryPool mPool;
+};
+
+TEST_F(EntryPoolTest, FreedBlocksAreReused) {
+    void* first = mPool.allocate(32);
+    ASSERT_TRUE(first != NULL);
+    EXPECT_EQ(size_t(1), mPool.getBlocksInUse());
+
+    mPool.free(first);
+    EXPECT_EQ(size_t(0), mPool.getBlocksInUse());
+
+    void* second = mPool.allocate(32);
+    EXPECT_EQ(first, second);
+    mPool.free(second);
+    EXPECT_EQ(size_t(0), mPool.getHeapAllocations());
+}
+
+TEST_F(EntryPoolTest, BlocksAreDistinctAndWritable) {
+    void* blocks[BLOCKS_PER_CLASS];
+    for (size_t i = 0; i < BLOCKS_PER_CLASS; i++) {
+        blocks[i] = mPool.allocate(EntryPool::BLOCK_SIZES[0]);
+        memset(blocks[i], int(i), EntryPool::BLOCK_SIZES[0]);
+    }
+    for (size_t i = 0; i < BLOCKS_PER_CLASS; i++) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(blocks[i]);
+        EXPECT_EQ(i, bytes[0]);
+        EXPECT_EQ(i, bytes[EntryPool::BLOCK_SIZES[0] - 1]);
+        mPool.free(blocks[i]);
+    }
+    EXPECT_EQ(size_t(0), mPool.getHeapAllocations());
+}
+
+TEST_F(EntryPoolTest, ExhaustedClassFallsBackToHeap) {
+    void* blocks[BLOCKS_PER_CLASS + 1];
+    for (size_t i = 0; i < BLOCKS_PER_CLASS + 1; i++) {
+        blocks[i] = mPool.allocate(EntryPool::BLOCK_SIZES[1]);
+        ASSERT_TRUE(blocks[i] != NULL);
+    }
+    EXPECT_EQ(size_t(1), mPool.getHeapAllocations());
+    EXPECT_EQ(size_t(BLOCKS_PER_CLASS + 1), mPool.getBlocksInUse());
+
+    for (size_t i = 0; i < BLOCKS_PER_CLASS + 1; i++) {
+        mPool.free(blocks[i]);
+    }
+    EXPECT_EQ(size_t(0), mPool.getBlocksInUse());
+}
+
+TEST_F(EntryPoolTest, OversizeBlocksComeFromHeap) {
+    size_t size = EntryPool::BLOCK_SIZES[EntryPool::NUM_SIZE_CLASSES - 1] + 1;
+    void* block = mPool.allocate(size);
+    ASSERT_TRUE(block != NULL);
+    memset(block, 0, size);
+    EXPECT_EQ(size_t(1), mPool.getHeapAllocations());
+    EXPECT_EQ(size_t(1), mPool.getBlocksInUse());
+
+    mPool.free(block);
+    EXPECT_EQ(size_t(0), mPool.getBlocksInUse());
+}
+
+TEST_F(EntryPoolTest, Dump_ReportsUsage) {
+    void* block = mPool.allocate(1);
+    String8 dump;
+    mPool.dump(dump);
+    EXPECT_TRUE(strstr(dump.string(), "inUse=1, peakInUse=1") != NULL);
+    mPool.free(block);
+}
+
+} // namespace android
@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../InputWindowIndex.h"
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+
+namespace android {
+
+// An arbitrary display id.
+static const int32_t DISPLAY_ID = 0;
+
+// Another arbitrary display id.
+static const int32_t OTHER_DISPLAY_ID = 1;
+
+
+// --- FakeInputWindowHandle ---
+
+class FakeInputWindowHandle : public InputWindowHandle {
+public:
+    FakeInputWindowHandle(int32_t displayId, int32_t left, int32_t top,
+            int32_t right, int32_t bottom, int32_t flags) :
+            InputWindowHandle(NULL) {
+        mInfo = new InputWindowInfo();
+        mInfo->name = String8("fake");
+        mInfo->layoutParamsFlags = flags;
+        mInfo->layoutParamsType = InputWindowInfo::TYPE_APPLICATION;
+        mInfo->dispatchingTimeout = 0;
+        mInfo->frameLeft = left;
+        mInfo->frameTop = top;
+        mInfo->frameRight = right;
+        mInfo->frameBottom = bottom;
+        mInfo->scaleFactor = 1.0f;
+        mInfo->addTouchableRegion(Rect(left, top, right, bottom));
+        mInfo->visible = true;
+        mInfo->canReceiveKeys = true;
+        mInfo->hasFocus = false;
+        mInfo->hasWallpaper = false;
+        mInfo->paused = false;
+        mInfo->isHomeWindow = false;
+        mInfo->layer = 0;
+        mInfo->ownerPid = 0;
+        mInfo->ownerUid = 0;
+        mInfo->inputFeatures = 0;
+        mInfo->displayId = displayId;
+    }
+
+    InputWindowInfo* editInfo() {
+        return mInfo;
+    }
+
+    virtual bool updateInfo() {
+        return true;
+    }
+};
+
+
+// --- InputWindowIndexTest ---
+
+class InputWindowIndexTest : public testing::Test {
+protected:
+    Vector<sp<InputWindowHandle> > mWindowHandles;
+    InputWindowIndex mIndex;
+
+    FakeInputWindowHandle* addWindow(int32_t displayId, int32_t left, int32_t top,
+            int32_t right, int32_t bottom,
+            int32_t flags = InputWindowInfo::FLAG_NOT_TOUCH_MODAL) {
+        FakeInputWindowHandle* windowHandle = new FakeInputWindowHandle(displayId,
+                left, top, right, bottom, flags);
+        mWindowHandles.push(windowHandle);
+        return windowHandle;
+    }
+
+    static Vector<size_t> collect(InputWindowIndex::Candidates candidates) {
+        Vector<size_t> result;
+        size_t i;
+        while (candidates.next(&i)) {
+            result.push(i);
+        }
+        return result;
+    }
+
+    Vector<size_t> touchCandidates(int32_t displayId, int32_t x, int32_t y) {
+        return collect(mIndex.getTouchCandidates(displayId, x, y));
+    }
+
+    Vector<size_t> obscuringCandidates(int32_t displayId, int32_t x, int32_t y) {
+        return collect(mIndex.getObscuringCandidates(displayId, x, y));
+    }
+
+    static bool contains(const Vector<size_t>& list, size_t value) {
+        for (size_t i = 0; i < list.size(); i++) {
+            if (list[i] == value) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool isSorted(const Vector<size_t>& list) {
+        for (size_t i = 1; i < list.size(); i++) {
+            if (list[i - 1] >= list[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+TEST_F(InputWindowIndexTest, EmptyIndex_HasNoCandidates) {
+    mIndex.build(mWindowHandles);
+
+    EXPECT_EQ(size_t(0), touchCandidates(DISPLAY_ID, 10, 10).size());
+    EXPECT_EQ(size_t(0), obscuringCandidates(DISPLAY_ID, 10, 10).size());
+}
+
+TEST_F(InputWindowIndexTest, TouchCandidates_AreWindowsContainingPointInZOrder) {
+    addWindow(DISPLAY_ID, 0, 0, 100, 100);
+    addWindow(DISPLAY_ID, 500, 500, 600, 600);
+    addWindow(DISPLAY_ID, 0, 0, 1000, 1000);
+    addWindow(OTHER_DISPLAY_ID, 0, 0, 1000, 1000);
+    mIndex.build(mWindowHandles);
+
+    Vector<size_t> candidates = touchCandidates(DISPLAY_ID, 50, 50);
+    EXPECT_TRUE(isSorted(candidates));
+    EXPECT_TRUE(contains(candidates, 0));
+    EXPECT_TRUE(contains(candidates, 2));
+    EXPECT_FALSE(contains(candidates, 3));
+
+    candidates = touchCandidates(DISPLAY_ID, 550, 550);
+    EXPECT_TRUE(isSorted(candidates));
+    EXPECT_TRUE(contains(candidates, 1));
+    EXPECT_TRUE(contains(candidates, 2));
+    EXPECT_FALSE(contains(candidates, 3));
+
+    candidates = touchCandidates(OTHER_DISPLAY_ID, 50, 50);
+    ASSERT_EQ(size_t(1), candidates.size());
+    EXPECT_EQ(size_t(3), candidates[0]);
+
+    EXPECT_EQ(size_t(0), touchCandidates(DISPLAY_ID, 2000, 2000).size());
+    EXPECT_EQ(size_t(0), touchCandidates(DISPLAY_ID, -1, -1).size());
+}
+
+TEST_F(InputWindowIndexTest, TouchCandidates_IncludeModalAndOutsideWatchingWindowsEverywhere) {
+    addWindow(DISPLAY_ID, 0, 0, 100, 100);
+    addWindow(DISPLAY_ID, 0, 0, 100, 100, InputWindowInfo::FLAG_NOT_TOUCH_MODAL
+            | InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH);
+    addWindow(DISPLAY_ID, 200, 200, 300, 300);
+    addWindow(DISPLAY_ID, 0, 0, 100, 100, 0); // touch modal
+    mIndex.build(mWindowHandles);
+
+    Vector<size_t> candidates = touchCandidates(DISPLAY_ID, 250, 250);
+    ASSERT_EQ(size_t(3), candidates.size());
+    EXPECT_EQ(size_t(1), candidates[0]);
+    EXPECT_EQ(size_t(2), candidates[1]);
+    EXPECT_EQ(size_t(3), candidates[2]);
+
+    candidates = touchCandidates(DISPLAY_ID, 5000, 5000);
+    ASSERT_EQ(size_t(2), candidates.size());
+    EXPECT_EQ(size_t(1), candidates[0]);
+    EXPECT_EQ(size_t(3), candidates[1]);
+}
+
+TEST_F(InputWindowIndexTest, Candidates_ExcludeInvisibleUntouchableAndTrustedWindows) {
+    addWindow(DISPLAY_ID, 0, 0, 100, 100)->editInfo()->visible = false;
+    addWindow(DISPLAY_ID, 0, 0, 100, 100, InputWindowInfo::FLAG_NOT_TOUCH_MODAL
+            | InputWindowInfo::FLAG_NOT_TOUCHABLE);
+    addWindow(DISPLAY_ID, 0, 0, 100, 100)->editInfo()->layoutParamsType =
+            InputWindowInfo::TYPE_INPUT_METHOD;
+    mIndex.build(mWindowHandles);
+
+    Vector<size_t> candidates = touchCandidates(DISPLAY_ID, 50, 50);
+    EXPECT_FALSE(contains(candidates, 0));
+    EXPECT_FALSE(contains(candidates, 1));
+    EXPECT_TRUE(contains(candidates, 2));
+
+    candidates = obscuringCandidates(DISPLAY_ID, 50, 50);
+    EXPECT_FALSE(contains(candidates, 0));
+    EXPECT_TRUE(contains(candidates, 1));
+    EXPECT_FALSE(contains(candidates, 2));
+}
+
+TEST_F(InputWindowIndexTest, ObscuringCandidates_IncludeFrameEdges) {
+    addWindow(DISPLAY_ID, 0, 0, 100, 100);
+    mIndex.build(mWindowHandles);
+
+    EXPECT_TRUE(contains(obscuringCandidates(DISPLAY_ID, 100, 100), 0));
+}
+
+TEST_F(InputWindowIndexTest, IndexOf_ReturnsPositionInList) {
+    sp<InputWindowHandle> first = addWindow(DISPLAY_ID, 0, 0, 100, 100);
+    sp<InputWindowHandle> second = addWindow(OTHER_DISPLAY_ID, 0, 0, 100, 100);
+    sp<InputWindowHandle> absent = new FakeInputWindowHandle(DISPLAY_ID, 0, 0, 1, 1, 0);
+    mIndex.build(mWindowHandles);
+
+    EXPECT_EQ(0, mIndex.indexOf(first));
+    EXPECT_EQ(1, mIndex.indexOf(second));
+    EXPECT_EQ(-1, mIndex.indexOf(absent));
+}
+
+TEST_F(InputWindowIndexTest, Candidates_AreSupersetOfExactHits) {
+    srand(42);
+    for (size_t i = 0; i < 200; i++) {
+        int32_t left = rand() % 1080 - 100;
+        int32_t top = rand() % 1920 - 100;
+        int32_t flags = InputWindowInfo::FLAG_NOT_TOUCH_MODAL;
+        if (rand() % 10 == 0) {
+            flags |= InputWindowInfo::FLAG_NOT_TOUCHABLE;
+        }
+        FakeInputWindowHandle* windowHandle = addWindow(rand() % 2, left, top,
+                left + rand() % 600 + 1, top + rand() % 600 + 1, flags);
+        windowHandle->editInfo()->addTouchableRegion(Rect(left + 700, top, left + 800, top + 50));
+        windowHandle->editInfo()->visible = rand() % 5 != 0;
+    }
+    mIndex.build(mWindowHandles);
+
+    for (size_t p = 0; p < 1000; p++) {
+        int32_t displayId = rand() % 2;
+        int32_t x = rand() % 1400 - 200;
+        int32_t y = rand() % 2200 - 200;
+        Vector<size_t> touch = touchCandidates(displayId, x, y);
+        Vector<size_t> obscuring = obscuringCandidates(displayId, x, y);
+        ASSERT_TRUE(isSorted(touch));
+        ASSERT_TRUE(isSorted(obscuring));
+
+        for (size_t i = 0; i < mWindowHandles.size(); i++) {
+            const InputWindowInfo* info = mWindowHandles[i]->getInfo();
+            if (info->displayId != displayId || !info->visible) {
+                continue;
+            }
+            if (!(info->layoutParamsFlags & InputWindowInfo::FLAG_NOT_TOUCHABLE)
+                    && info->touchableRegionContainsPoint(x, y)) {
+                ASSERT_TRUE(contains(touch, i))
+                        << "window " << i << " at (" << x << ", " << y << ")";
+            }
+            if (!info->isTrustedOverlay() && info->frameContainsPoint(x, y)) {
+                ASSERT_TRUE(contains(obscuring, i))
+                        << "window " << i << " at (" << x << ", " << y << ")";
+            }
+        }
+    }
+}
+
+} // namespace android
@@ -1032,8 +1032,9 @@ SensorService::SensorRecord::getFirstPendingFlushConnection() {
 
 SensorService::SensorEventConnection::SensorEventConnection(
         const sp<SensorService>& service, uid_t uid)
-    : mService(service), mUid(uid), mWakeLockRefCount(0), mHasLooperCallbacks(false),
-      mDead(false), mEventCache(NULL), mCacheSize(0), mMaxCacheSize(0) {
+    : mService(service), mDoorbellScheduled(false), mUid(uid), mWakeLockRefCount(0),
+      mHasLooperCallbacks(false), mDead(false), mEventCache(NULL), mCacheSize(0),
+      mMaxCacheSize(0) {
     mChannel = new BitTube(mService->mSocketBufferSize);
 #if DEBUG_CONNECTIONS
     mEventsReceived = mEventsSentFromCache = mEventsSent = 0;
@@ -1067,6 +1068,9 @@ void SensorService::SensorEventConnection::dump(String8& result) {
     Mutex::Autolock _l(mConnectionLock);
     result.appendFormat("\t WakeLockRefCount %d | uid %d | cache size %d | max cache size %d\n",
             mWakeLockRefCount, mUid, mCacheSize, mMaxCacheSize);
+    if (mEventRing != NULL) {
+        result.appendFormat("\t event ring of %u events\n", mEventRing->getCapacity());
+    }
     for (size_t i = 0; i < mSensorInfo.size(); ++i) {
         const FlushInfo& flushInfo = mSensorInfo.valueAt(i);
         result.appendFormat("\t %s 0x%08x | status: %s | pending flush events %d \n",
@@ -1159,7 +1163,7 @@ void SensorService::SensorEventConnection::updateLooperRegistrationLocked(
     }
 
     int looper_flags = 0;
-    if (mCacheSize > 0) looper_flags |= ALOOPER_EVENT_OUTPUT;
+    if (mCacheSize > 0 && mEventRing == NULL) looper_flags |= ALOOPER_EVENT_OUTPUT;
     for (size_t i = 0; i < mSensorInfo.size(); ++i) {
         const int handle = mSensorInfo.keyAt(i);
         if (mService->getSensorFromHandle(handle).isWakeUpSensor()) {
@@ -1276,6 +1280,10 @@ status_t SensorService::SensorEventConnection::sendEvents(
 #if DEBUG_CONNECTIONS
      mEventsReceived += count;
 #endif
+    if (mCacheSize != 0 && mEventRing != NULL) {
+        // The app may have made room in the ring since the last batch.
+        writeToSocketFromCacheLocked();
+    }
     if (mCacheSize != 0) {
         // There are some events in the cache which need to be sent first. Copy this buffer to
         // the end of cache.
@@ -1317,9 +1325,7 @@ status_t SensorService::SensorEventConnection::sendEvents(
 #endif
     }
 
-    // NOTE: ASensorEvent and sensors_event_t are the same type.
-    ssize_t size = SensorEventQueue::write(mChannel,
-                                    reinterpret_cast<ASensorEvent const*>(scratch), count);
+    ssize_t size = writeEventsLocked(scratch, count);
     if (size < 0) {
         // Write error, copy events to local cache.
         if (index_wake_up_event >= 0) {
@@ -1389,7 +1395,7 @@ void SensorService::SensorEventConnection::sendPendingFlushEventsLocked() {
                ++mWakeLockRefCount;
                flushCompleteEvent.flags |= WAKE_UP_SENSOR_EVENT_NEEDS_ACK;
             }
-            ssize_t size = SensorEventQueue::write(mChannel, &flushCompleteEvent, 1);
+            ssize_t size = writeEventsLocked(&flushCompleteEvent, 1);
             if (size < 0) {
                 if (wakeUpSensor) --mWakeLockRefCount;
                 return;
@@ -1404,9 +1410,13 @@ void SensorService::SensorEventConnection::sendPendingFlushEventsLocked() {
 void SensorService::SensorEventConnection::writeToSocketFromCache() {
     // At a time write at most half the size of the receiver buffer in SensorEventQueue OR
     // half the size of the socket buffer allocated in BitTube whichever is smaller.
+    Mutex::Autolock _l(mConnectionLock);
+    writeToSocketFromCacheLocked();
+}
+
+void SensorService::SensorEventConnection::writeToSocketFromCacheLocked() {
     const int maxWriteSize = helpers::min(SensorEventQueue::MAX_RECEIVE_BUFFER_EVENT_COUNT/2,
             int(mService->mSocketBufferSize/(sizeof(sensors_event_t)*2)));
-    Mutex::Autolock _l(mConnectionLock);
     // Send pending flush complete events (if any)
     sendPendingFlushEventsLocked();
     for (int numEventsSent = 0; numEventsSent < mCacheSize;) {
@@ -1422,9 +1432,7 @@ void SensorService::SensorEventConnection::writeToSocketFromCache() {
 #endif
         }
 
-        ssize_t size = SensorEventQueue::write(mChannel,
-                          reinterpret_cast<ASensorEvent const*>(mEventCache + numEventsSent),
-                          numEventsToWrite);
+        ssize_t size = writeEventsLocked(mEventCache + numEventsSent, numEventsToWrite);
         if (size < 0) {
             if (index_wake_up_event >= 0) {
                 // If there was a wake_up sensor_event, reset the flag.
@@ -1488,6 +1496,61 @@ sp<BitTube> SensorService::SensorEventConnection::getSensorChannel() const
     return mChannel;
 }
 
+sp<SensorEventRing> SensorService::SensorEventConnection::getSensorEventRing(size_t capacity,
+        nsecs_t doorbellLatencyNs)
+{
+    Mutex::Autolock _l(mConnectionLock);
+    if (mEventRing == NULL) {
+        sp<SensorEventRing> ring(new SensorEventRing(capacity, doorbellLatencyNs));
+        if (ring->initCheck() != NO_ERROR) {
+            return NULL;
+        }
+        mEventRing = ring;
+        // Events waiting in the cache now wait for the next batch instead of mChannel.
+        updateLooperRegistrationLocked(mService->getLooper());
+    }
+    return mEventRing;
+}
+
+ssize_t SensorService::SensorEventConnection::writeEventsLocked(sensors_event_t const* events,
+        size_t count)
+{
+    // NOTE: ASensorEvent and sensors_event_t are the same type.
+    ASensorEvent const* asensorEvents = reinterpret_cast<ASensorEvent const*>(events);
+    if (mEventRing != NULL) {
+        ssize_t size = mEventRing->write(asensorEvents, count);
+        scheduleDoorbellLocked();
+        return size;
+    }
+    return SensorEventQueue::write(mChannel, asensorEvents, count);
+}
+
+void SensorService::SensorEventConnection::scheduleDoorbellLocked()
+{
+    const nsecs_t doorbellTime = mEventRing->getPendingDoorbellTime();
+    if (doorbellTime >= 0 && !mDoorbellScheduled) {
+        mDoorbellScheduled = true;
+        mService->getLooper()->sendMessageAtTime(doorbellTime, this, Message());
+    }
+}
+
+void SensorService::SensorEventConnection::handleMessage(const Message& /*message*/)
+{
+    Mutex::Autolock _l(mConnectionLock);
+    mDoorbellScheduled = false;
+    if (mEventRing == NULL) {
+        return;
+    }
+    // The doorbell may have been rung since this message was scheduled, in which case the
+    // events written after that have a later deadline.
+    const nsecs_t doorbellTime = mEventRing->getPendingDoorbellTime();
+    if (doorbellTime > systemTime(SYSTEM_TIME_MONOTONIC)) {
+        scheduleDoorbellLocked();
+    } else {
+        mEventRing->ringDoorbell();
+    }
+}
+
 status_t SensorService::SensorEventConnection::enableDisable(
         int handle, bool enabled, nsecs_t samplingPeriodNs, nsecs_t maxBatchReportLatencyNs,
         int reservedFlags)
@@ -1499,6 +1562,11 @@ status_t SensorService::SensorEventConnection::enableDisable(
 
     } else {
         err = mService->disable(this, handle);
+        // Don't let the last events of the sensor wait for a doorbell that may never come.
+        Mutex::Autolock _l(mConnectionLock);
+        if (mEventRing != NULL) {
+            mEventRing->ringDoorbell();
+        }
     }
     return err;
 }
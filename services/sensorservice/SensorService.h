@@ -34,6 +34,7 @@
 #include <gui/BitTube.h>
 #include <gui/ISensorServer.h>
 #include <gui/ISensorEventConnection.h>
+#include <gui/SensorEventRing.h>
 
 #include "SensorInterface.h"
 
@@ -74,7 +75,8 @@ class SensorService :
     virtual sp<ISensorEventConnection> createSensorEventConnection();
     virtual status_t dump(int fd, const Vector<String16>& args);
 
-    class SensorEventConnection : public BnSensorEventConnection, public LooperCallback {
+    class SensorEventConnection : public BnSensorEventConnection, public LooperCallback,
+            public MessageHandler {
         friend class SensorService;
         virtual ~SensorEventConnection();
         virtual void onFirstRef();
@@ -83,6 +85,8 @@ class SensorService :
                                        nsecs_t maxBatchReportLatencyNs, int reservedFlags);
         virtual status_t setEventRate(int handle, nsecs_t samplingPeriodNs);
         virtual status_t flush();
+        virtual sp<SensorEventRing> getSensorEventRing(size_t capacity,
+                nsecs_t doorbellLatencyNs);
         // Count the number of flush complete events which are about to be dropped in the buffer.
         // Increment mPendingFlushEventsToSend in mSensorInfo. These flush complete events will be
         // sent separately before the next batch of events.
@@ -100,8 +104,13 @@ class SensorService :
         // method emulates the behavior of flush().
         void sendPendingFlushEventsLocked();
 
+        // Writes events to mEventRing if the app has asked for one, or to mChannel otherwise. Like
+        // BitTube, either all events are written or the call fails.
+        ssize_t writeEventsLocked(sensors_event_t const* events, size_t count);
+
         // Writes events from mEventCache to the socket.
         void writeToSocketFromCache();
+        void writeToSocketFromCacheLocked();
 
         // Compute the approximate cache size from the FIFO sizes of various sensors registered for
         // this connection. Wake up and non-wake up sensors have separate FIFOs but FIFO may be
@@ -117,6 +126,14 @@ class SensorService :
         // If this fd is available for writing send the data from the cache.
         virtual int handleEvent(int fd, int events, void* data);
 
+        // MessageHandler method. Rings the doorbell of mEventRing that was held back by its
+        // latency, so that the last events of a burst don't wait for the next write.
+        virtual void handleMessage(const Message& message);
+
+        // Schedules handleMessage for when the doorbell of mEventRing is due, if it has events
+        // that the app was not told about yet and no message is scheduled already.
+        void scheduleDoorbellLocked();
+
         // Increment mPendingFlushEventsToSend for the given sensor handle.
         void incrementPendingFlushCount(int32_t handle);
 
@@ -133,6 +150,13 @@ class SensorService :
 
         sp<SensorService> const mService;
         sp<BitTube> mChannel;
+        // If the app has asked for a shared-memory ring, events are written to it instead of
+        // mChannel; mChannel is then only used for acknowledgements. The app does not tell us when
+        // it has made room in the ring, so events cached because the ring was full are written
+        // with the next batch of events rather than when mChannel becomes writable.
+        sp<SensorEventRing> mEventRing;
+        // True while a message to ring the doorbell of mEventRing is in the Looper.
+        bool mDoorbellScheduled;
         uid_t mUid;
         mutable Mutex mConnectionLock;
         // Number of events from wake up sensors which are still pending and haven't been delivered
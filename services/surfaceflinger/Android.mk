@@ -10,11 +10,14 @@ LOCAL_SRC_FILES:= \
     DispSync.cpp \
     EventControlThread.cpp \
     EventThread.cpp \
+    FrameTimeline.cpp \
     FrameTracker.cpp \
+    TransactionQueue.cpp \
     Layer.cpp \
     LayerDim.cpp \
     MessageQueue.cpp \
     MonitoredProducer.cpp \
+    PhaseOffsetTuner.cpp \
     SurfaceFlinger.cpp \
     SurfaceFlingerConsumer.cpp \
     Transform.cpp \
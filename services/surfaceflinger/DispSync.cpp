@@ -23,6 +23,8 @@
 
 #include <cutils/log.h>
 
+#include <gui/VsyncTiming.h>
+
 #include <ui/Fence.h>
 
 #include <utils/String8.h>
@@ -45,6 +47,17 @@ static const bool kTraceDetailedInfo = false;
 // present time and the nearest software-predicted vsync.
 static const nsecs_t kErrorThreshold = 160000000000;    // 400 usec squared
 
+// Present times are as jittery as the resync samples, so a model fitted to
+// jittery samples gets a proportionally higher error threshold, up to this
+// limit.
+static const nsecs_t kMaxErrorThreshold = 4000000000000;    // 2 msec squared
+
+// Resync samples that are further than this many standard deviations from
+// the fitted model are outliers (e.g. a late vsync interrupt).  Samples
+// closer than kMinOutlierDistance are never outliers.
+static const double kOutlierDeviations = 4.0;
+static const nsecs_t kMinOutlierDistance = 200000;    // 200 usec
+
 // This is the offset from the present fence timestamps to the corresponding
 // vsync event.
 static const int64_t kPresentTimeOffset = PRESENT_TIME_OFFSET_FROM_VSYNC_NS;
@@ -185,6 +198,21 @@ public:
         return BAD_VALUE;
     }
 
+    status_t changePhaseOffset(const sp<DispSync::Callback>& callback,
+            nsecs_t phase) {
+        Mutex::Autolock lock(mMutex);
+
+        for (size_t i = 0; i < mEventListeners.size(); i++) {
+            if (mEventListeners[i].mCallback == callback) {
+                mEventListeners.editItemAt(i).mPhase = phase;
+                mCond.signal();
+                return NO_ERROR;
+            }
+        }
+
+        return BAD_VALUE;
+    }
+
     // This method is only here to handle the kIgnorePresentFences case.
     bool hasAnyEventListeners() {
         Mutex::Autolock lock(mMutex);
@@ -288,6 +316,8 @@ private:
 };
 
 DispSync::DispSync() :
+        mJitter(0),
+        mNumModelSamples(0),
         mRefreshSkipCount(0),
         mThread(new DispSyncThread()) {
 
@@ -340,7 +370,7 @@ bool DispSync::addPresentFence(const sp<Fence>& fence) {
 
     updateErrorLocked();
 
-    return mPeriod == 0 || mError > kErrorThreshold;
+    return mPeriod == 0 || mError > errorThresholdLocked();
 }
 
 void DispSync::beginResync() {
@@ -376,7 +406,7 @@ bool DispSync::addResyncSample(nsecs_t timestamp) {
         return mThread->hasAnyEventListeners();
     }
 
-    return mPeriod == 0 || mError > kErrorThreshold;
+    return mPeriod == 0 || mError > errorThresholdLocked();
 }
 
 void DispSync::endResync() {
@@ -401,11 +431,18 @@ status_t DispSync::removeEventListener(const sp<Callback>& callback) {
     return mThread->removeEventListener(callback);
 }
 
+status_t DispSync::changePhaseOffset(const sp<Callback>& callback,
+        nsecs_t phase) {
+    Mutex::Autolock lock(mMutex);
+    return mThread->changePhaseOffset(callback, phase);
+}
+
 void DispSync::setPeriod(nsecs_t period) {
     Mutex::Autolock lock(mMutex);
     mPeriod = period;
     mPhase = 0;
     mThread->updateModel(mPeriod, mPhase);
+    publishModelLocked();
 }
 
 nsecs_t DispSync::getPeriod() {
@@ -414,49 +451,194 @@ nsecs_t DispSync::getPeriod() {
     return mPeriod;
 }
 
-void DispSync::updateModelLocked() {
-    if (mNumResyncSamples >= MIN_RESYNC_SAMPLES_FOR_UPDATE) {
-        nsecs_t durationSum = 0;
-        for (size_t i = 1; i < mNumResyncSamples; i++) {
-            size_t idx = (mFirstResyncSample + i) % MAX_RESYNC_SAMPLES;
-            size_t prev = (idx + MAX_RESYNC_SAMPLES - 1) % MAX_RESYNC_SAMPLES;
-            durationSum += mResyncSamples[idx] - mResyncSamples[prev];
+// Returns the median of the n values, reordering them.
+static nsecs_t medianOf(nsecs_t* values, size_t n) {
+    for (size_t i = 1; i < n; i++) {
+        const nsecs_t v = values[i];
+        size_t j = i;
+        for ( ; j > 0 && values[j - 1] > v; j--) {
+            values[j] = values[j - 1];
         }
+        values[j] = v;
+    }
+    return values[n / 2];
+}
 
-        mPeriod = durationSum / (mNumResyncSamples - 1);
+size_t DispSync::fitModel(const nsecs_t* samples, size_t numSamples,
+        nsecs_t* outPeriod, nsecs_t* outPhase, nsecs_t* outJitter) {
+    if (numSamples < MIN_RESYNC_SAMPLES_FOR_UPDATE ||
+            numSamples > MAX_RESYNC_SAMPLES) {
+        return 0;
+    }
 
-        double sampleAvgX = 0;
-        double sampleAvgY = 0;
-        double scale = 2.0 * M_PI / double(mPeriod);
-        for (size_t i = 0; i < mNumResyncSamples; i++) {
-            size_t idx = (mFirstResyncSample + i) % MAX_RESYNC_SAMPLES;
-            nsecs_t sample = mResyncSamples[idx];
-            double samplePhase = double(sample % mPeriod) * scale;
-            sampleAvgX += cos(samplePhase);
-            sampleAvgY += sin(samplePhase);
+    // The median interval between samples is a rough period that isn't
+    // thrown off by missed or spurious samples.  Use it to number the
+    // vsyncs that the samples belong to.
+    nsecs_t scratch[MAX_RESYNC_SAMPLES];
+    for (size_t i = 1; i < numSamples; i++) {
+        scratch[i - 1] = samples[i] - samples[i - 1];
+        if (scratch[i - 1] <= 0) {
+            return 0;
+        }
+    }
+    const nsecs_t roughPeriod = medianOf(scratch, numSamples - 1);
+
+    const nsecs_t origin = samples[0];
+    double x[MAX_RESYNC_SAMPLES];
+    double y[MAX_RESYNC_SAMPLES];
+    bool inlier[MAX_RESYNC_SAMPLES];
+    for (size_t i = 0; i < numSamples; i++) {
+        const nsecs_t t = samples[i] - origin;
+        x[i] = double((t + roughPeriod / 2) / roughPeriod);
+        y[i] = double(t);
+        inlier[i] = true;
+    }
+
+    // Fit a line through the samples, drop the outliers and fit again
+    // until there are none left.
+    double period = 0;
+    double intercept = 0;
+    size_t numInliers = numSamples;
+    for (int pass = 0; pass < 3; pass++) {
+        double meanX = 0;
+        double meanY = 0;
+        for (size_t i = 0; i < numSamples; i++) {
+            if (inlier[i]) {
+                meanX += x[i];
+                meanY += y[i];
+            }
+        }
+        meanX /= numInliers;
+        meanY /= numInliers;
+        double sxx = 0;
+        double sxy = 0;
+        for (size_t i = 0; i < numSamples; i++) {
+            if (inlier[i]) {
+                sxx += (x[i] - meanX) * (x[i] - meanX);
+                sxy += (x[i] - meanX) * (y[i] - meanY);
+            }
+        }
+        if (sxx == 0) {
+            return 0;
+        }
+        period = sxy / sxx;
+        intercept = meanY - period * meanX;
+
+        // The median absolute residual is a robust estimate of the
+        // standard deviation (times 0.6745 for normally distributed jitter).
+        for (size_t i = 0; i < numSamples; i++) {
+            scratch[i] = nsecs_t(fabs(y[i] - intercept - period * x[i]));
+        }
+        const nsecs_t mad = medianOf(scratch, numSamples);
+        double limit = kOutlierDeviations * 1.4826 * double(mad);
+        if (limit < kMinOutlierDistance) {
+            limit = kMinOutlierDistance;
         }
 
-        sampleAvgX /= double(mNumResyncSamples);
-        sampleAvgY /= double(mNumResyncSamples);
+        size_t kept = 0;
+        bool changed = false;
+        for (size_t i = 0; i < numSamples; i++) {
+            const bool in = fabs(y[i] - intercept - period * x[i]) <= limit;
+            changed |= in != inlier[i];
+            inlier[i] = in;
+            kept += in ? 1 : 0;
+        }
+        if (kept < MIN_RESYNC_SAMPLES_FOR_UPDATE) {
+            return 0;
+        }
+        numInliers = kept;
+        if (!changed) {
+            break;
+        }
+    }
 
-        mPhase = nsecs_t(atan2(sampleAvgY, sampleAvgX) / scale);
+    double sqErrSum = 0;
+    for (size_t i = 0; i < numSamples; i++) {
+        if (inlier[i]) {
+            const double err = y[i] - intercept - period * x[i];
+            sqErrSum += err * err;
+        }
+    }
 
-        if (mPhase < 0) {
-            mPhase += mPeriod;
+    const nsecs_t p = nsecs_t(period + 0.5);
+    if (p <= 0) {
+        return 0;
+    }
+    // Anchor the phase at the newest sample so that rounding the period to
+    // whole nanoseconds doesn't shift the vsyncs that are predicted next.
+    const nsecs_t anchor = origin +
+            nsecs_t(intercept + period * x[numSamples - 1]);
+    nsecs_t phase = anchor % p;
+    if (phase < 0) {
+        phase += p;
+    }
+    *outPeriod = p;
+    *outPhase = phase;
+    *outJitter = nsecs_t(sqrt(sqErrSum / numInliers));
+    return numInliers;
+}
+
+void DispSync::updateModelLocked() {
+    if (mNumResyncSamples >= MIN_RESYNC_SAMPLES_FOR_UPDATE) {
+        nsecs_t samples[MAX_RESYNC_SAMPLES];
+        for (size_t i = 0; i < mNumResyncSamples; i++) {
+            samples[i] = mResyncSamples[
+                    (mFirstResyncSample + i) % MAX_RESYNC_SAMPLES];
+        }
+
+        nsecs_t period, phase, jitter;
+        size_t numModelSamples = fitModel(samples, mNumResyncSamples,
+                &period, &phase, &jitter);
+        if (!numModelSamples) {
+            return;
         }
+        mPeriod = period;
+        mPhase = phase;
+        mJitter = jitter;
+        mNumModelSamples = numModelSamples;
 
         if (kTraceDetailedInfo) {
             ATRACE_INT64("DispSync:Period", mPeriod);
             ATRACE_INT64("DispSync:Phase", mPhase);
+            ATRACE_INT64("DispSync:Jitter", mJitter);
         }
 
         // Artificially inflate the period if requested.
         mPeriod += mPeriod * mRefreshSkipCount;
 
         mThread->updateModel(mPeriod, mPhase);
+        publishModelLocked();
     }
 }
 
+void DispSync::addTimingWriter(const sp<VsyncTimingWriter>& writer) {
+    Mutex::Autolock lock(mMutex);
+    mTimingWriters.add(writer);
+    publishModelLocked();
+}
+
+void DispSync::publishModelLocked() {
+    nsecs_t reference = 0;
+    if (mNumResyncSamples) {
+        reference = mResyncSamples[
+                (mFirstResyncSample + mNumResyncSamples - 1) %
+                MAX_RESYNC_SAMPLES];
+    }
+    for (size_t i = 0; i < mTimingWriters.size(); i++) {
+        mTimingWriters[i]->publishModel(mPeriod, mPhase, reference);
+    }
+}
+
+nsecs_t DispSync::errorThresholdLocked() const {
+    nsecs_t threshold = 4 * mJitter * mJitter;
+    if (threshold < kErrorThreshold) {
+        threshold = kErrorThreshold;
+    } else if (threshold > kMaxErrorThreshold) {
+        threshold = kMaxErrorThreshold;
+    }
+    return threshold;
+}
+
 void DispSync::updateErrorLocked() {
     if (mPeriod == 0) {
         return;
@@ -507,6 +689,18 @@ nsecs_t DispSync::computeNextRefresh(int periodOffset) const {
     return (((now - mPhase) / mPeriod) + periodOffset + 1) * mPeriod + mPhase;
 }
 
+nsecs_t DispSync::computePreviousEvent(nsecs_t phase, nsecs_t when) const {
+    Mutex::Autolock lock(mMutex);
+    if (mPeriod == 0) {
+        return when;
+    }
+    nsecs_t sincePrevious = (when - mPhase - phase) % mPeriod;
+    if (sincePrevious < 0) {
+        sincePrevious += mPeriod;
+    }
+    return when - sincePrevious;
+}
+
 void DispSync::dump(String8& result) const {
     Mutex::Autolock lock(mMutex);
     result.appendFormat("present fences are %s\n",
@@ -514,8 +708,10 @@ void DispSync::dump(String8& result) const {
     result.appendFormat("mPeriod: %" PRId64 " ns (%.3f fps; skipCount=%d)\n",
             mPeriod, 1000000000.0 / mPeriod, mRefreshSkipCount);
     result.appendFormat("mPhase: %" PRId64 " ns\n", mPhase);
-    result.appendFormat("mError: %" PRId64 " ns (sqrt=%.1f)\n",
-            mError, sqrt(mError));
+    result.appendFormat("mError: %" PRId64 " ns (sqrt=%.1f, threshold sqrt=%.1f)\n",
+            mError, sqrt(mError), sqrt(errorThresholdLocked()));
+    result.appendFormat("mJitter: %" PRId64 " ns over %zd samples\n",
+            mJitter, mNumModelSamples);
     result.appendFormat("mNumResyncSamplesSincePresent: %d (limit %d)\n",
             mNumResyncSamplesSincePresent, MAX_RESYNC_SAMPLES_WITHOUT_PRESENT);
     result.appendFormat("mNumResyncSamples: %zd (max %d)\n",
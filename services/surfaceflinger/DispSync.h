@@ -22,6 +22,7 @@
 #include <utils/Mutex.h>
 #include <utils/Timers.h>
 #include <utils/RefBase.h>
+#include <utils/Vector.h>
 
 namespace android {
 
@@ -40,6 +41,7 @@ static const bool kIgnorePresentFences = false;
 class String8;
 class Fence;
 class DispSyncThread;
+class VsyncTimingWriter;
 
 // DispSync maintains a model of the periodic hardware-based vsync events of a
 // display and uses that model to execute period callbacks at specific phase
@@ -64,6 +66,13 @@ public:
         virtual void onDispSyncEvent(nsecs_t when) = 0;
     };
 
+    // MAX_RESYNC_SAMPLES is the number of most recent hardware vsync
+    // timestamps that the model is fitted to.  Hardware vsync stays on
+    // while the model doesn't match the present fences, so with jittery
+    // vsync timestamps the window fills up and the fit averages over
+    // about a second of vsyncs.
+    enum { MAX_RESYNC_SAMPLES = 64 };
+
     DispSync();
     ~DispSync();
 
@@ -121,12 +130,34 @@ public:
     // DispSync object.
     status_t removeEventListener(const sp<Callback>& callback);
 
+    // changePhaseOffset changes the phase offset of an already-registered
+    // event callback.  An event that was due less than half a period before
+    // the new one is not repeated.
+    status_t changePhaseOffset(const sp<Callback>& callback, nsecs_t phase);
+
+    // addTimingWriter makes the model be published to writer, now and
+    // whenever it changes.  Writers are never removed.
+    void addTimingWriter(const sp<VsyncTimingWriter>& writer);
+
     // computeNextRefresh computes when the next refresh is expected to begin.
     // The periodOffset value can be used to move forward or backward; an
     // offset of zero is the next refresh, -1 is the previous refresh, 1 is
     // the refresh after next. etc.
     nsecs_t computeNextRefresh(int periodOffset) const;
 
+    // computePreviousEvent computes the time of the last event at the given
+    // phase offset that happened at or before the time when.
+    nsecs_t computePreviousEvent(nsecs_t phase, nsecs_t when) const;
+
+    // fitModel fits a vsync period and phase to numSamples (at most
+    // MAX_RESYNC_SAMPLES) increasing hardware vsync timestamps.  The
+    // timestamps need not be consecutive vsyncs, and those that are far off
+    // the fitted model are ignored.  On success, it returns how many samples
+    // the model was fitted to and sets outJitter to their RMS distance from
+    // the model; it returns 0 if there are not enough usable samples.
+    static size_t fitModel(const nsecs_t* samples, size_t numSamples,
+            nsecs_t* outPeriod, nsecs_t* outPhase, nsecs_t* outJitter);
+
     // dump appends human-readable debug info to the result string.
     void dump(String8& result) const;
 
@@ -135,8 +166,12 @@ private:
     void updateModelLocked();
     void updateErrorLocked();
     void resetErrorLocked();
+    void publishModelLocked();
+
+    // errorThresholdLocked returns the model error above which a resync is
+    // needed.
+    nsecs_t errorThresholdLocked() const;
 
-    enum { MAX_RESYNC_SAMPLES = 32 };
     enum { MIN_RESYNC_SAMPLES_FOR_UPDATE = 3 };
     enum { NUM_PRESENT_SAMPLES = 8 };
     enum { MAX_RESYNC_SAMPLES_WITHOUT_PRESENT = 12 };
@@ -154,6 +189,12 @@ private:
     // mPresentTimes array.
     nsecs_t mError;
 
+    // mJitter is the RMS distance of the resync samples that the model was
+    // fitted to from the model, and mNumModelSamples is how many of them
+    // there were.  Together they are the confidence in the model.
+    nsecs_t mJitter;
+    size_t mNumModelSamples;
+
     // These member variables are the state used during the resynchronization
     // process to store information about the hardware vsync event times used
     // to compute the model.
@@ -170,6 +211,9 @@ private:
 
     int mRefreshSkipCount;
 
+    // mTimingWriters are the shared pages the model is published in.
+    Vector<sp<VsyncTimingWriter> > mTimingWriters;
+
     // mThread is the thread from which all the callbacks are called.
     sp<DispSyncThread> mThread;
 
@@ -40,6 +40,8 @@
 #include "SurfaceFlinger.h"
 #include "Layer.h"
 
+EGLAPI const char* eglQueryStringImplementationANDROID(EGLDisplay dpy, EGLint name);
+
 // ----------------------------------------------------------------------------
 using namespace android;
 // ----------------------------------------------------------------------------
@@ -71,8 +73,11 @@ DisplayDevice::DisplayDevice(
       mDisplayWidth(), mDisplayHeight(), mFormat(),
       mFlags(),
       mPageFlipCount(),
+      mHasBufferAge(false),
       mIsSecure(isSecure),
       mSecureLayerVisible(false),
+      mBufferDamageCount(0),
+      mHasPendingBufferDamage(false),
       mLayerStack(NO_LAYER_STACK),
       mOrientation(),
       mPowerMode(HWC_POWER_MODE_OFF),
@@ -111,6 +116,9 @@ DisplayDevice::DisplayDevice(
     mSurface = surface;
     mFormat  = format;
     mPageFlipCount = 0;
+
+    const char* exts = eglQueryStringImplementationANDROID(display, EGL_EXTENSIONS);
+    mHasBufferAge = exts && strstr(exts, "EGL_EXT_buffer_age");
     mViewport.makeInvalid();
     mFrame.makeInvalid();
 
@@ -256,6 +264,20 @@ void DisplayDevice::swapBuffers(HWComposer& hwc) const {
     if (hwc.initCheck() != NO_ERROR ||
             ((hwc.hasGlesComposition(mHwcDisplayId)/*|| hwc.hasBlitComposition(mHwcDisplayId)*/) &&
              (hwc.supportsFramebufferTarget() || mType >= DISPLAY_VIRTUAL))) {
+        // remember what changed in the buffer we're about to present, for
+        // getBufferAgeDirtyRegion(); if we don't know, forget everything.
+        if (mHasPendingBufferDamage) {
+            for (size_t i=MAX_BUFFER_AGE-1 ; i>0 ; i--) {
+                mBufferDamage[i] = mBufferDamage[i-1];
+            }
+            mBufferDamage[0] = mPendingBufferDamage;
+            if (mBufferDamageCount < MAX_BUFFER_AGE) {
+                mBufferDamageCount++;
+            }
+        } else {
+            mBufferDamageCount = 0;
+        }
+
         EGLBoolean success = eglSwapBuffers(mDisplay, mSurface);
         if (!success) {
             EGLint error = eglGetError();
@@ -268,7 +290,13 @@ void DisplayDevice::swapBuffers(HWComposer& hwc) const {
                         mDisplay, mSurface, error);
             }
         }
+    } else {
+        // the framebuffer wasn't presented, so its history no longer
+        // tells what's on screen
+        mBufferDamageCount = 0;
     }
+    mPendingBufferDamage.clear();
+    mHasPendingBufferDamage = false;
 
     status_t result = mDisplaySurface->advanceFrame();
     if (result != NO_ERROR) {
@@ -277,6 +305,44 @@ void DisplayDevice::swapBuffers(HWComposer& hwc) const {
     }
 }
 
+Region DisplayDevice::getBufferAgeDirtyRegion(const Region& dirty,
+        const Vector<uintptr_t>& composition) const {
+    const Region screen(bounds());
+
+    // if the last frame never made it to swapBuffers(), what it changed
+    // isn't in the history
+    if (mHasPendingBufferDamage) {
+        mBufferDamageCount = 0;
+    }
+    mPendingBufferDamage = dirty;
+    mHasPendingBufferDamage = true;
+
+    if (composition.size() != mBufferComposition.size() ||
+            memcmp(composition.array(), mBufferComposition.array(),
+                    composition.size() * sizeof(uintptr_t))) {
+        mBufferComposition = composition;
+        mBufferDamageCount = 0;
+        return screen;
+    }
+
+    EGLint age = 0;
+    if (!mHasBufferAge ||
+            !eglQuerySurface(mDisplay, mSurface, EGL_BUFFER_AGE_EXT, &age)) {
+        return screen;
+    }
+    // age 1 means the back buffer holds the previous frame, age 0 that
+    // its content is undefined.
+    if (age <= 0 || size_t(age - 1) > mBufferDamageCount) {
+        return screen;
+    }
+
+    Region region(dirty);
+    for (EGLint i=0 ; i<age-1 ; i++) {
+        region.orSelf(mBufferDamage[i]);
+    }
+    return region.intersect(screen);
+}
+
 void DisplayDevice::onSwapBuffersCompleted(HWComposer& hwc) const {
     if (hwc.initCheck() == NO_ERROR) {
         mDisplaySurface->onFrameCommitted();
@@ -137,6 +137,15 @@ public:
 
     void swapBuffers(HWComposer& hwc) const;
     void hwcSwapBuffers() const;
+
+    // Returns the region of the back buffer that must be redrawn for it to
+    // be up to date once dirty is redrawn, using EGL_EXT_buffer_age: dirty
+    // plus whatever changed since the back buffer was last presented.
+    // composition describes how the framebuffer is composed; if it differs
+    // from the previous frame, or the age of the back buffer is unknown,
+    // the whole display is returned. The display must be current.
+    Region getBufferAgeDirtyRegion(const Region& dirty,
+            const Vector<uintptr_t>& composition) const;
     status_t compositionComplete() const;
 
     // called after h/w composer has completed its set() call
@@ -197,6 +206,7 @@ private:
     uint32_t        mFlags;
     mutable uint32_t mPageFlipCount;
     String8         mDisplayName;
+    bool            mHasBufferAge;
     bool            mIsSecure;
 
     /*
@@ -210,6 +220,17 @@ private:
     // Whether we have a visible secure layer on this display
     bool mSecureLayerVisible;
 
+    // What changed in each of the last frames that were swapped, most
+    // recent first, and how they were composed. swapBuffers() moves the
+    // pending damage into the history, or clears the history when a frame
+    // is presented without it.
+    enum { MAX_BUFFER_AGE = 4 };
+    mutable Region mBufferDamage[MAX_BUFFER_AGE];
+    mutable size_t mBufferDamageCount;
+    mutable Region mPendingBufferDamage;
+    mutable bool mHasPendingBufferDamage;
+    mutable Vector<uintptr_t> mBufferComposition;
+
 
     /*
      * Transaction state
@@ -492,6 +492,10 @@ sp<Fence> HWComposer::getDisplayFence(int disp) const {
     return mDisplayData[disp].lastDisplayFence;
 }
 
+sp<Fence> HWComposer::getFramebufferTargetFence(int disp) const {
+    return mDisplayData[disp].fbTargetAcquireFence;
+}
+
 uint32_t HWComposer::getFormat(int disp) const {
     if (uint32_t(disp)>31 || !mAllocatedDisplayIDs.hasBit(disp)) {
         return HAL_PIXEL_FORMAT_RGBA_8888;
@@ -658,6 +662,7 @@ status_t HWComposer::setFramebufferTarget(int32_t id,
     }
 
     disp.fbTargetHandle = buf->handle;
+    disp.fbTargetAcquireFence = acquireFence;
     disp.framebufferTarget->handle = disp.fbTargetHandle;
     disp.framebufferTarget->acquireFenceFd = acquireFenceFd;
     return NO_ERROR;
@@ -975,6 +980,7 @@ void HWComposer::disconnectDisplay(int disp) {
     dd.list = NULL;
     dd.framebufferTarget = NULL;    // points into dd.list
     dd.fbTargetHandle = NULL;
+    dd.fbTargetAcquireFence = Fence::NO_FENCE;
     dd.outbufHandle = NULL;
     dd.lastRetireFence = Fence::NO_FENCE;
     dd.lastDisplayFence = Fence::NO_FENCE;
@@ -1525,6 +1531,7 @@ HWComposer::DisplayData::DisplayData()
     hasFbComp(false), hasBlitComp(false),hasOvComp(false),
     capacity(0), list(NULL),
     framebufferTarget(NULL), fbTargetHandle(0),
+    fbTargetAcquireFence(Fence::NO_FENCE),
     lastRetireFence(Fence::NO_FENCE), lastDisplayFence(Fence::NO_FENCE),
     outbufHandle(NULL), outbufAcquireFence(Fence::NO_FENCE),
     events(0)
@@ -276,6 +276,9 @@ public:
     // HWC_DISPLAY_PRIMARY).
     nsecs_t getRefreshTimestamp(int disp) const;
     sp<Fence> getDisplayFence(int disp) const;
+    // returns the acquire fence of the last framebuffer target, which
+    // signals when GLES composition of that frame completes
+    sp<Fence> getFramebufferTargetFence(int disp) const;
     uint32_t getFormat(int disp) const;
     bool isConnected(int disp) const;
 
@@ -365,6 +368,7 @@ private:
         hwc_display_contents_1* list;
         hwc_layer_1* framebufferTarget;
         buffer_handle_t fbTargetHandle;
+        sp<Fence> fbTargetAcquireFence;
         sp<Fence> lastRetireFence;  // signals when the last set op retires
         sp<Fence> lastDisplayFence; // signals when the last set op takes
                                     // effect on screen
@@ -19,6 +19,8 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <binder/IMemory.h>
+
 #include <cutils/compiler.h>
 
 #include <gui/BitTube.h>
@@ -46,6 +48,7 @@ static void vsyncOffCallback(union sigval val) {
 
 EventThread::EventThread(const sp<VSyncSource>& src)
     : mVSyncSource(src),
+      mTimingWriter(new VsyncTimingWriter()),
       mUseSoftwareVSync(false),
       mVsyncEnabled(false),
       mDebugVsyncEnabled(false),
@@ -63,6 +66,19 @@ EventThread::EventThread(const sp<VSyncSource>& src)
     se.sigev_notify_function = vsyncOffCallback;
     se.sigev_notify_attributes = NULL;
     timer_create(CLOCK_MONOTONIC, &se, &mTimerId);
+
+    if (mTimingWriter->initCheck() == NO_ERROR) {
+        mVSyncSource->setTimingWriter(mTimingWriter);
+    } else {
+        mTimingWriter.clear();
+    }
+}
+
+sp<IMemoryHeap> EventThread::getVsyncTimingHeap() const {
+    if (mTimingWriter == NULL) {
+        return NULL;
+    }
+    return mTimingWriter->getHeap();
 }
 
 void EventThread::sendVsyncHintOff() {
@@ -402,6 +418,12 @@ void EventThread::Connection::requestNextVsync() {
     mEventThread->requestNextVsync(this);
 }
 
+status_t EventThread::Connection::getVsyncTiming(
+        sp<IMemoryHeap>* outHeap) const {
+    *outHeap = mEventThread->getVsyncTimingHeap();
+    return *outHeap != NULL ? status_t(NO_ERROR) : status_t(NO_INIT);
+}
+
 status_t EventThread::Connection::postEvent(
         const DisplayEventReceiver::Event& event) {
     ssize_t size = DisplayEventReceiver::sendEvents(mChannel, &event, 1);
@@ -22,6 +22,7 @@
 
 #include <gui/DisplayEventReceiver.h>
 #include <gui/IDisplayEventConnection.h>
+#include <gui/VsyncTiming.h>
 
 #include <utils/Errors.h>
 #include <utils/threads.h>
@@ -51,6 +52,8 @@ public:
     virtual ~VSyncSource() {}
     virtual void setVSyncEnabled(bool enable) = 0;
     virtual void setCallback(const sp<Callback>& callback) = 0;
+    // Sources that know the vsync model keep writer up to date with it.
+    virtual void setTimingWriter(const sp<VsyncTimingWriter>& /*writer*/) {}
 };
 
 class EventThread : public Thread, private VSyncSource::Callback {
@@ -70,6 +73,7 @@ class EventThread : public Thread, private VSyncSource::Callback {
         virtual sp<BitTube> getDataChannel() const;
         virtual void setVsyncRate(uint32_t count);
         virtual void requestNextVsync();    // asynchronous
+        virtual status_t getVsyncTiming(sp<IMemoryHeap>* outHeap) const;
         sp<EventThread> const mEventThread;
         sp<BitTube> const mChannel;
     };
@@ -99,6 +103,9 @@ public:
     void dump(String8& result) const;
     void sendVsyncHintOff();
 
+    // the page the vsync timing of this thread is published in, or NULL
+    sp<IMemoryHeap> getVsyncTimingHeap() const;
+
 private:
     virtual bool        threadLoop();
     virtual void        onFirstRef();
@@ -112,6 +119,7 @@ private:
 
     // constants
     sp<VSyncSource> mVSyncSource;
+    sp<VsyncTimingWriter> mTimingWriter;
     PowerHAL mPowerHAL;
 
     mutable Mutex mLock;
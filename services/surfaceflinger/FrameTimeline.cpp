@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This is needed for stdint.h to define INT64_MAX in C++
+#define __STDC_LIMIT_MACROS
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <binder/IMemory.h>
+
+#include <hardware/hwcomposer_defs.h>
+
+#include <ui/Fence.h>
+
+#include <utils/String8.h>
+
+#include "FrameTimeline.h"
+#include "SortNsecs.h"
+
+namespace android {
+
+// Resolves a fence to its signal time. Returns false if the fence has not
+// signaled yet.
+static bool resolveFence(sp<Fence>& fence, int64_t* outTime) {
+    if (fence == NULL) {
+        return true;
+    }
+    const nsecs_t signalTime = fence->getSignalTime();
+    if (signalTime == INT64_MAX) {
+        return false;
+    }
+    if (signalTime >= 0) {
+        *outTime = signalTime;
+    } else {
+        *outTime = FrameTimelineRecord::TIME_UNKNOWN;
+    }
+    fence.clear();
+    return true;
+}
+
+static void initRecord(FrameTimelineRecord* record, uint32_t type,
+        int32_t id, const String8& name, uint64_t frameNumber) {
+    memset(record, 0, sizeof(*record));
+    record->type = type;
+    record->id = id;
+    record->frameNumber = frameNumber;
+    record->queueTime = FrameTimelineRecord::TIME_UNKNOWN;
+    record->latchTime = FrameTimelineRecord::TIME_UNKNOWN;
+    record->desiredPresentTime = FrameTimelineRecord::TIME_UNKNOWN;
+    record->frameReadyTime = FrameTimelineRecord::TIME_UNKNOWN;
+    record->compositionStartTime = FrameTimelineRecord::TIME_UNKNOWN;
+    record->hwcPrepareDuration = FrameTimelineRecord::TIME_UNKNOWN;
+    record->hwcSetDuration = FrameTimelineRecord::TIME_UNKNOWN;
+    record->gpuCompositionDoneTime = FrameTimelineRecord::TIME_UNKNOWN;
+    record->presentTime = FrameTimelineRecord::TIME_UNKNOWN;
+    strncpy(record->name, name.string(), FrameTimelineRecord::NAME_LENGTH - 1);
+}
+
+FrameTimeline::FrameTimeline() :
+        mWriter(new FrameTimelineWriter(NUM_RECORDS)),
+        mDisplayPeriod(0),
+        mLastPresentTime(0),
+        mNumLatencies(0),
+        mLatencyOffset(0),
+        mNumPublished(0),
+        mNumIncomplete(0) {
+    memset(mIntervals, 0, sizeof(mIntervals));
+}
+
+status_t FrameTimeline::getHeap(sp<IMemoryHeap>* outHeap) const {
+    status_t err = mWriter->initCheck();
+    if (err == NO_ERROR) {
+        *outHeap = mWriter->getHeap();
+    }
+    return err;
+}
+
+void FrameTimeline::setDisplayRefreshPeriod(nsecs_t displayPeriod) {
+    Mutex::Autolock lock(mMutex);
+    mDisplayPeriod = displayPeriod;
+}
+
+void FrameTimeline::addLayerFrame(int32_t sequence, const String8& name,
+        uint64_t frameNumber, nsecs_t queueTime, nsecs_t latchTime,
+        nsecs_t desiredPresentTime,
+        const sp<Fence>& frameReadyFence, nsecs_t frameReadyTime,
+        const sp<Fence>& presentFence, nsecs_t presentTime) {
+    FrameTimelineRecord record;
+    initRecord(&record, FrameTimelineRecord::TYPE_LAYER, sequence, name,
+            frameNumber);
+    record.queueTime = queueTime;
+    record.latchTime = latchTime;
+    record.desiredPresentTime = desiredPresentTime;
+    record.frameReadyTime = frameReadyTime;
+    record.presentTime = presentTime;
+
+    Mutex::Autolock lock(mMutex);
+    addPendingLocked(record, frameReadyFence, presentFence);
+}
+
+void FrameTimeline::addDisplayFrame(int32_t hwcDisplayId, const String8& name,
+        uint64_t frameNumber, nsecs_t compositionStartTime,
+        nsecs_t hwcPrepareDuration, nsecs_t hwcSetDuration,
+        const sp<Fence>& gpuCompositionFence,
+        const sp<Fence>& presentFence, nsecs_t presentTime) {
+    FrameTimelineRecord record;
+    initRecord(&record, FrameTimelineRecord::TYPE_DISPLAY, hwcDisplayId, name,
+            frameNumber);
+    record.compositionStartTime = compositionStartTime;
+    record.hwcPrepareDuration = hwcPrepareDuration;
+    record.hwcSetDuration = hwcSetDuration;
+    record.presentTime = presentTime;
+
+    Mutex::Autolock lock(mMutex);
+    addPendingLocked(record, gpuCompositionFence, presentFence);
+}
+
+void FrameTimeline::addPendingLocked(const FrameTimelineRecord& record,
+        const sp<Fence>& readyFence, const sp<Fence>& presentFence) {
+    PendingRecord pending;
+    pending.record = record;
+    if (readyFence != NULL && readyFence->isValid()) {
+        pending.readyFence = readyFence;
+    }
+    if (presentFence != NULL && presentFence->isValid()) {
+        pending.presentFence = presentFence;
+    }
+    pending.age = 0;
+    mPending.add(pending);
+}
+
+void FrameTimeline::processPending() {
+    Mutex::Autolock lock(mMutex);
+    size_t i = 0;
+    while (i < mPending.size()) {
+        PendingRecord& pending(mPending.editItemAt(i));
+        FrameTimelineRecord& record(pending.record);
+        int64_t* readyTime =
+                record.type == FrameTimelineRecord::TYPE_LAYER ?
+                &record.frameReadyTime : &record.gpuCompositionDoneTime;
+        bool complete = resolveFence(pending.readyFence, readyTime);
+        complete = resolveFence(pending.presentFence, &record.presentTime) &&
+                complete;
+        if (!complete && ++pending.age < MAX_PENDING_FRAMES) {
+            i++;
+            continue;
+        }
+        if (!complete) {
+            // Give up on the fences that are still pending.
+            if (pending.readyFence != NULL) {
+                *readyTime = FrameTimelineRecord::TIME_UNKNOWN;
+            }
+            if (pending.presentFence != NULL) {
+                record.presentTime = FrameTimelineRecord::TIME_UNKNOWN;
+            }
+            mNumIncomplete++;
+        }
+        publishLocked(record);
+        mPending.removeAt(i);
+    }
+}
+
+void FrameTimeline::publishLocked(const FrameTimelineRecord& record) {
+    mWriter->write(record);
+    mNumPublished++;
+
+    const nsecs_t presentTime = record.presentTime;
+    if (presentTime == FrameTimelineRecord::TIME_UNKNOWN) {
+        return;
+    }
+    if (record.type == FrameTimelineRecord::TYPE_DISPLAY) {
+        if (record.id != HWC_DISPLAY_PRIMARY) {
+            return;
+        }
+        const nsecs_t interval = presentTime - mLastPresentTime;
+        if (mLastPresentTime > 0 && interval > 0 && mDisplayPeriod > 0) {
+            // Round to the nearest number of refresh periods. Much longer
+            // intervals are the display going idle rather than jank.
+            nsecs_t periods = (interval + mDisplayPeriod / 2) / mDisplayPeriod;
+            if (periods < 1) {
+                periods = 1;
+            }
+            if (periods <= 2 * NUM_INTERVAL_BUCKETS) {
+                if (periods > NUM_INTERVAL_BUCKETS) {
+                    periods = NUM_INTERVAL_BUCKETS;
+                }
+                mIntervals[periods - 1]++;
+            }
+        }
+        if (presentTime > mLastPresentTime) {
+            mLastPresentTime = presentTime;
+        }
+    } else if (record.queueTime != FrameTimelineRecord::TIME_UNKNOWN &&
+            presentTime > record.queueTime) {
+        mLatencies[mLatencyOffset] = presentTime - record.queueTime;
+        mLatencyOffset = (mLatencyOffset + 1) % NUM_LATENCY_SAMPLES;
+        if (mNumLatencies < NUM_LATENCY_SAMPLES) {
+            mNumLatencies++;
+        }
+    }
+}
+
+void FrameTimeline::dump(String8& result) const {
+    Mutex::Autolock lock(mMutex);
+
+    result.appendFormat("  frame timeline: %" PRIu64 " records published "
+            "(%" PRIu64 " with missing fences), %zu pending\n",
+            mNumPublished, mNumIncomplete, mPending.size());
+
+    uint64_t numIntervals = 0;
+    for (size_t i = 0; i < NUM_INTERVAL_BUCKETS; i++) {
+        numIntervals += mIntervals[i];
+    }
+    result.append("    primary present intervals (refresh periods):");
+    for (size_t i = 0; i < NUM_INTERVAL_BUCKETS; i++) {
+        result.appendFormat(" %zu%s: %" PRIu64 " (%.1f%%)", i + 1,
+                i + 1 == NUM_INTERVAL_BUCKETS ? "+" : "",
+                mIntervals[i],
+                numIntervals ? 100.0 * mIntervals[i] / numIntervals : 0.0);
+    }
+    result.append("\n");
+
+    if (mNumLatencies == 0) {
+        result.append("    queue to present latency: no samples\n");
+        return;
+    }
+    nsecs_t sorted[NUM_LATENCY_SAMPLES];
+    memcpy(sorted, mLatencies, mNumLatencies * sizeof(nsecs_t));
+    sortNsecs(sorted, mNumLatencies);
+    const size_t n = mNumLatencies;
+    result.appendFormat("    queue to present latency (last %zu frames): "
+            "p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms\n", n,
+            sorted[(n * 50) / 100] / 1e6,
+            sorted[(n * 90) / 100] / 1e6,
+            sorted[(n * 99) / 100] / 1e6,
+            sorted[n - 1] / 1e6);
+}
+
+}; // namespace android
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_FRAME_TIMELINE_H
+#define ANDROID_SF_FRAME_TIMELINE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <gui/FrameTimeline.h>
+
+#include <utils/Mutex.h>
+#include <utils/RefBase.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+class Fence;
+class IMemoryHeap;
+class String8;
+
+// FrameTimeline collects the timeline of every composed frame of every
+// layer and display, and publishes it to a shared memory ring (see
+// gui/FrameTimeline.h) once the frame's fences have signaled. It also keeps
+// a summary of the primary display's present intervals and of the
+// queue-to-present latency of layer frames, for dumpsys.
+//
+// As with FrameTracker, when a valid fence is given for a time value, the
+// signal time of the fence is used instead of the timestamp.
+//
+// FrameTimeline is thread-safe.
+class FrameTimeline {
+public:
+    // NUM_RECORDS is the capacity of the shared memory ring.
+    enum { NUM_RECORDS = 2048 };
+
+    // NUM_INTERVAL_BUCKETS is the number of present interval buckets: one
+    // refresh period, two, ..., and NUM_INTERVAL_BUCKETS or more. Intervals
+    // of more than twice that are idle time and aren't counted.
+    enum { NUM_INTERVAL_BUCKETS = 5 };
+
+    // NUM_LATENCY_SAMPLES is the number of recent layer frames that the
+    // latency percentiles are computed over.
+    enum { NUM_LATENCY_SAMPLES = 512 };
+
+    // MAX_PENDING_FRAMES is how many frames a record waits for its fences
+    // before it is published without them.
+    enum { MAX_PENDING_FRAMES = 8 };
+
+    FrameTimeline();
+
+    // getHeap returns the shared memory ring.
+    status_t getHeap(sp<IMemoryHeap>* outHeap) const;
+
+    // setDisplayRefreshPeriod sets the primary display refresh period, which
+    // the present intervals are measured in.
+    void setDisplayRefreshPeriod(nsecs_t displayPeriod);
+
+    // addLayerFrame records a buffer of a layer that was composed in the
+    // current frame.
+    void addLayerFrame(int32_t sequence, const String8& name,
+            uint64_t frameNumber, nsecs_t queueTime, nsecs_t latchTime,
+            nsecs_t desiredPresentTime,
+            const sp<Fence>& frameReadyFence, nsecs_t frameReadyTime,
+            const sp<Fence>& presentFence, nsecs_t presentTime);
+
+    // addDisplayFrame records the composition of the current frame for a
+    // HWC display.
+    void addDisplayFrame(int32_t hwcDisplayId, const String8& name,
+            uint64_t frameNumber, nsecs_t compositionStartTime,
+            nsecs_t hwcPrepareDuration, nsecs_t hwcSetDuration,
+            const sp<Fence>& gpuCompositionFence,
+            const sp<Fence>& presentFence, nsecs_t presentTime);
+
+    // processPending publishes the records whose fences have signaled, or
+    // that have waited for MAX_PENDING_FRAMES calls. It should be called
+    // once per composed frame, after the frame's records were added.
+    void processPending();
+
+    // dump appends the present interval and latency summary to result.
+    void dump(String8& result) const;
+
+private:
+    struct PendingRecord {
+        FrameTimelineRecord record;
+        // sets frameReadyTime or gpuCompositionDoneTime
+        sp<Fence> readyFence;
+        sp<Fence> presentFence;
+        uint32_t age;
+    };
+
+    void addPendingLocked(const FrameTimelineRecord& record,
+            const sp<Fence>& readyFence, const sp<Fence>& presentFence);
+
+    // publishLocked writes the record to the ring and updates the summary.
+    void publishLocked(const FrameTimelineRecord& record);
+
+    mutable Mutex mMutex;
+
+    sp<FrameTimelineWriter> mWriter;
+    Vector<PendingRecord> mPending;
+
+    nsecs_t mDisplayPeriod;
+    nsecs_t mLastPresentTime;
+    uint64_t mIntervals[NUM_INTERVAL_BUCKETS];
+
+    nsecs_t mLatencies[NUM_LATENCY_SAMPLES];
+    size_t mNumLatencies;
+    size_t mLatencyOffset;
+
+    uint64_t mNumPublished;
+    uint64_t mNumIncomplete;
+};
+
+}; // namespace android
+
+#endif // ANDROID_SF_FRAME_TIMELINE_H
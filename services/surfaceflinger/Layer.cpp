@@ -74,6 +74,8 @@ Layer::Layer(SurfaceFlinger* flinger, const sp<Client>& client,
         mCurrentOpacity(true),
         mRefreshPending(false),
         mFrameLatencyNeeded(false),
+        mCurrentQueueTime(FrameTimelineRecord::TIME_UNKNOWN),
+        mCurrentLatchTime(FrameTimelineRecord::TIME_UNKNOWN),
         mFiltering(false),
         mNeedsFiltering(false),
         mMesh(Mesh::TRIANGLE_FAN, 4, 2, 2),
@@ -180,6 +182,7 @@ void Layer::onFrameAvailable(const BufferItem& item) {
     { // Autolock scope
         Mutex::Autolock lock(mQueueItemLock);
         mQueueItems.push_back(item);
+        mQueueTimes.push_back(systemTime());
     }
 
     android_atomic_inc(&mQueuedFrames);
@@ -203,6 +206,7 @@ void Layer::onFrameReplaced(const BufferItem& item) {
         return;
     }
     mQueueItems.editItemAt(0) = item;
+    mQueueTimes.editItemAt(0) = systemTime();
 }
 
 void Layer::onSidebandStreamChanged() {
@@ -1527,16 +1531,23 @@ void Layer::onPostComposition() {
 
         const HWComposer& hwc = mFlinger->getHwComposer();
         sp<Fence> presentFence = hwc.getDisplayFence(HWC_DISPLAY_PRIMARY);
+        nsecs_t presentTime = FrameTimelineRecord::TIME_UNKNOWN;
         if (presentFence->isValid()) {
             mFrameTracker.setActualPresentFence(presentFence);
         } else {
             // The HWC doesn't support present fences, so use the refresh
             // timestamp instead.
-            nsecs_t presentTime = hwc.getRefreshTimestamp(HWC_DISPLAY_PRIMARY);
+            presentTime = hwc.getRefreshTimestamp(HWC_DISPLAY_PRIMARY);
             mFrameTracker.setActualPresentTime(presentTime);
         }
 
         mFrameTracker.advanceFrame();
+
+        mFlinger->mFrameTimeline.addLayerFrame(sequence, mName,
+                mSurfaceFlingerConsumer->getFrameNumber(),
+                mCurrentQueueTime, mCurrentLatchTime, desiredPresentTime,
+                frameReadyFence, desiredPresentTime,
+                presentFence, presentTime);
         mFrameLatencyNeeded = false;
     }
 }
@@ -1702,6 +1713,8 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
         { // Autolock scope
             Mutex::Autolock lock(mQueueItemLock);
             mQueueItems.removeAt(0);
+            mCurrentQueueTime = mQueueTimes[0];
+            mQueueTimes.removeAt(0);
         }
 
         // Decrement the queued-frames count.  Signal another event if we
@@ -1729,6 +1742,8 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
 
         mRefreshPending = true;
         mFrameLatencyNeeded = true;
+        mCurrentLatchTime = systemTime();
+        mFlinger->addRenderSample(mCurrentQueueTime);
         if (oldActiveBuffer == NULL) {
              // the first time we receive a buffer, we need to trigger a
              // geometry invalidation.
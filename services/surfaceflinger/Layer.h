@@ -77,6 +77,42 @@ public:
     Region coveredRegion;
     Region visibleNonTransparentRegion;
 
+    // What the regions above were last computed from, and what this layer
+    // left behind for the layers below it. SurfaceFlinger uses this to skip
+    // layers whose visible region can't have changed.
+    struct VisibleRegionCache {
+        VisibleRegionCache()
+            : valid(false), layerStack(0), visible(false),
+              translucent(false), opaque(false), orientation(0) { }
+
+        bool isSameGeometry(const VisibleRegionCache& o) const {
+            if (!valid || layerStack != o.layerStack || visible != o.visible)
+                return false;
+            if (!visible)
+                return true;
+            return translucent == o.translucent && opaque == o.opaque &&
+                    orientation == o.orientation &&
+                    bounds == o.bounds && sourceBounds == o.sourceBounds &&
+                    activeTransparentRegion.isTriviallyEqual(
+                            o.activeTransparentRegion);
+        }
+
+        bool valid;
+        uint32_t layerStack;
+        bool visible;
+        bool translucent;
+        bool opaque;
+        uint32_t orientation;
+        Rect bounds;
+        Rect sourceBounds;
+        Region activeTransparentRegion;
+        Region aboveOpaqueLayers;
+        Region aboveCoveredLayers;
+        Region belowOpaqueLayers;
+        Region belowCoveredLayers;
+    };
+    VisibleRegionCache visibleRegionCache;
+
     // Layer serial number.  This gives layers an explicit ordering, so we
     // have a stable sort order when their layer stack and Z-order are
     // the same.
@@ -399,6 +435,9 @@ private:
     bool mCurrentOpacity;
     bool mRefreshPending;
     bool mFrameLatencyNeeded;
+    // when the current buffer was queued and latched, for the frame timeline
+    nsecs_t mCurrentQueueTime;
+    nsecs_t mCurrentLatchTime;
     // Whether filtering is forced on or not
     bool mFiltering;
     // Whether filtering is needed b/c of the drawingstate
@@ -426,6 +465,8 @@ private:
     // Local copy of the queued contents of the incoming BufferQueue
     mutable Mutex mQueueItemLock;
     Vector<BufferItem> mQueueItems;
+    // when each of mQueueItems was queued
+    Vector<nsecs_t> mQueueTimes;
 };
 
 // ---------------------------------------------------------------------------
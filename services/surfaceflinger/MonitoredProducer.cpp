@@ -110,6 +110,16 @@ void MonitoredProducer::allocateBuffers(bool async, uint32_t width,
     mProducer->allocateBuffers(async, width, height, format, usage);
 }
 
+status_t MonitoredProducer::queueAndDequeueBuffer(int buf,
+        const QueueBufferInput& input, QueueBufferOutput* output,
+        int* outSlot, sp<Fence>* outFence, sp<GraphicBuffer>* outBuffer,
+        status_t* outDequeueResult, bool async, uint32_t width,
+        uint32_t height, uint32_t format, uint32_t usage) {
+    return mProducer->queueAndDequeueBuffer(buf, input, output, outSlot,
+            outFence, outBuffer, outDequeueResult, async, width, height,
+            format, usage);
+}
+
 IBinder* MonitoredProducer::onAsBinder() {
     return mProducer->asBinder().get();
 }
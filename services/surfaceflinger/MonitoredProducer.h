@@ -53,6 +53,11 @@ public:
     virtual status_t setSidebandStream(const sp<NativeHandle>& stream);
     virtual void allocateBuffers(bool async, uint32_t width, uint32_t height,
             uint32_t format, uint32_t usage);
+    virtual status_t queueAndDequeueBuffer(int buf,
+            const QueueBufferInput& input, QueueBufferOutput* output,
+            int* outSlot, sp<Fence>* outFence, sp<GraphicBuffer>* outBuffer,
+            status_t* outDequeueResult, bool async, uint32_t width,
+            uint32_t height, uint32_t format, uint32_t usage);
     virtual IBinder* onAsBinder();
 
 private:
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include <utils/String8.h>
+#include <utils/Trace.h>
+
+#include "PhaseOffsetTuner.h"
+#include "SortNsecs.h"
+
+namespace android {
+
+// Composition has to finish before the next vsync in this share of frames,
+// and apps have to queue their buffer before SurfaceFlinger wakes up in this
+// share of frames.
+static const size_t kCompositionPercentile = 95;
+static const size_t kRenderPercentile = 90;
+
+// Added to the percentiles to allow for scheduling delays.
+static const nsecs_t kCompositionMargin = 1000000;  // 1 ms
+static const nsecs_t kRenderMargin = 1000000;       // 1 ms
+
+// Offsets are only changed by at least this much, so that they don't
+// follow every small variation.
+static const nsecs_t kMinOffsetChange = 500000;     // 500 us
+
+// Returns the given percentile of the n durations, reordering them.
+static nsecs_t percentileOf(nsecs_t* durations, size_t n, size_t percentile) {
+    sortNsecs(durations, n);
+    size_t index = (n * percentile) / 100;
+    if (index >= n) {
+        index = n - 1;
+    }
+    return durations[index];
+}
+
+PhaseOffsetTuner::PhaseOffsetTuner(nsecs_t appOffset, nsecs_t sfOffset) :
+        mPeriod(0),
+        mAppOffset(appOffset),
+        mSfOffset(sfOffset),
+        mNumCompositionDurations(0),
+        mNumRenderDurations(0),
+        mCompositionDeadline(0),
+        mRenderDeadline(0),
+        mNumUpdates(0) {
+}
+
+void PhaseOffsetTuner::setDisplayRefreshPeriod(nsecs_t period) {
+    Mutex::Autolock lock(mMutex);
+    mPeriod = period;
+}
+
+void PhaseOffsetTuner::addCompositionDuration(nsecs_t duration) {
+    Mutex::Autolock lock(mMutex);
+    if (mNumCompositionDurations < NUM_SAMPLES && duration >= 0) {
+        mCompositionDurations[mNumCompositionDurations++] = duration;
+    }
+}
+
+void PhaseOffsetTuner::addRenderDuration(nsecs_t duration) {
+    Mutex::Autolock lock(mMutex);
+    if (mNumRenderDurations < NUM_SAMPLES && duration >= 0) {
+        mRenderDurations[mNumRenderDurations++] = duration;
+    }
+}
+
+bool PhaseOffsetTuner::update() {
+    Mutex::Autolock lock(mMutex);
+    if (mPeriod <= 0 || mNumCompositionDurations < NUM_SAMPLES) {
+        return false;
+    }
+
+    const nsecs_t compositionDeadline = kCompositionMargin + percentileOf(
+            mCompositionDurations, mNumCompositionDurations,
+            kCompositionPercentile);
+    nsecs_t sfOffset = mPeriod - compositionDeadline;
+    if (sfOffset < 0) {
+        sfOffset = 0;
+    }
+
+    // Without enough app frames, give apps the whole period, as the
+    // compile-time defaults do.
+    nsecs_t renderDeadline = mPeriod;
+    if (mNumRenderDurations >= NUM_SAMPLES / 4) {
+        renderDeadline = kRenderMargin + percentileOf(mRenderDurations,
+                mNumRenderDurations, kRenderPercentile);
+    }
+    nsecs_t appOffset = sfOffset;
+    if (renderDeadline < mPeriod) {
+        appOffset = sfOffset - renderDeadline;
+    }
+
+    mNumCompositionDurations = 0;
+    mNumRenderDurations = 0;
+    mCompositionDeadline = compositionDeadline;
+    mRenderDeadline = renderDeadline;
+    mNumUpdates++;
+
+    if (llabs(sfOffset - mSfOffset) < kMinOffsetChange &&
+            llabs(appOffset - mAppOffset) < kMinOffsetChange) {
+        return false;
+    }
+    mSfOffset = sfOffset;
+    mAppOffset = appOffset;
+    ATRACE_INT64("PhaseOffset-sf", mSfOffset);
+    ATRACE_INT64("PhaseOffset-app", mAppOffset);
+    return true;
+}
+
+nsecs_t PhaseOffsetTuner::getAppOffset() const {
+    Mutex::Autolock lock(mMutex);
+    return mAppOffset;
+}
+
+nsecs_t PhaseOffsetTuner::getSfOffset() const {
+    Mutex::Autolock lock(mMutex);
+    return mSfOffset;
+}
+
+void PhaseOffsetTuner::dump(String8& result) const {
+    Mutex::Autolock lock(mMutex);
+    result.appendFormat("  adaptive phase offsets: app %" PRId64 " ns, "
+            "sf %" PRId64 " ns (p%zu composition + margin %" PRId64 " ns, "
+            "p%zu render + margin %" PRId64 " ns, %zu updates)\n",
+            mAppOffset, mSfOffset,
+            kCompositionPercentile, mCompositionDeadline,
+            kRenderPercentile, mRenderDeadline, mNumUpdates);
+}
+
+}; // namespace android
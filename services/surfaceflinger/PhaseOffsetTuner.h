@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_PHASE_OFFSET_TUNER_H
+#define ANDROID_SF_PHASE_OFFSET_TUNER_H
+
+#include <stddef.h>
+
+#include <utils/Mutex.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+class String8;
+
+// PhaseOffsetTuner picks the app and SurfaceFlinger vsync phase offsets
+// from how long composition and app rendering actually take, instead of
+// the VSYNC_EVENT_PHASE_OFFSET_NS and SF_VSYNC_EVENT_PHASE_OFFSET_NS
+// compile-time values.
+//
+// SurfaceFlinger is woken as late as possible while still committing the
+// frame before the next hardware vsync, and apps are woken early enough to
+// queue their frame before SurfaceFlinger wakes up. Both deadlines are
+// taken from a high percentile of the recent durations plus a margin.
+//
+// Samples are added and the offsets updated on the main thread, while dump
+// runs on a binder thread, so all state is guarded by mMutex.
+class PhaseOffsetTuner {
+public:
+    // NUM_SAMPLES is how many samples of each duration are collected before
+    // the offsets are recomputed.
+    enum { NUM_SAMPLES = 120 };
+
+    PhaseOffsetTuner(nsecs_t appOffset, nsecs_t sfOffset);
+
+    // setDisplayRefreshPeriod sets the vsync period. The offsets are not
+    // tuned until it is set.
+    void setDisplayRefreshPeriod(nsecs_t period);
+
+    // addCompositionDuration adds the time from SurfaceFlinger's vsync event
+    // to the end of the HWC commit of a frame.
+    void addCompositionDuration(nsecs_t duration);
+
+    // addRenderDuration adds the time from an app's vsync event to when it
+    // queued the resulting buffer.
+    void addRenderDuration(nsecs_t duration);
+
+    // update recomputes the offsets once enough samples were added since the
+    // last time. Returns true if the offsets changed.
+    bool update();
+
+    nsecs_t getAppOffset() const;
+    nsecs_t getSfOffset() const;
+
+    // dump appends the offsets and the durations they are based on to
+    // result.
+    void dump(String8& result) const;
+
+private:
+    // mMutex is used to protect access to all member variables.
+    mutable Mutex mMutex;
+
+    nsecs_t mPeriod;
+    nsecs_t mAppOffset;
+    nsecs_t mSfOffset;
+
+    nsecs_t mCompositionDurations[NUM_SAMPLES];
+    size_t mNumCompositionDurations;
+    nsecs_t mRenderDurations[NUM_SAMPLES];
+    size_t mNumRenderDurations;
+
+    // the percentiles that the current offsets are based on
+    nsecs_t mCompositionDeadline;
+    nsecs_t mRenderDeadline;
+    size_t mNumUpdates;
+};
+
+}; // namespace android
+
+#endif // ANDROID_SF_PHASE_OFFSET_TUNER_H
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_SORT_NSECS_H
+#define ANDROID_SF_SORT_NSECS_H
+
+#include <stddef.h>
+#include <stdlib.h>
+
+#include <utils/Timers.h>
+
+namespace android {
+
+static inline int compareNsecs(const void* lhs, const void* rhs) {
+    const nsecs_t a = *static_cast<const nsecs_t*>(lhs);
+    const nsecs_t b = *static_cast<const nsecs_t*>(rhs);
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+// sortNsecs sorts n durations or timestamps in increasing order.
+static inline void sortNsecs(nsecs_t* values, size_t n) {
+    qsort(values, n, sizeof(nsecs_t), compareNsecs);
+}
+
+}; // namespace android
+
+#endif // ANDROID_SF_SORT_NSECS_H
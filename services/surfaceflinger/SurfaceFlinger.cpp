@@ -43,6 +43,7 @@
 #include <gui/IDisplayEventConnection.h>
 #include <gui/Surface.h>
 #include <gui/GraphicBufferAlloc.h>
+#include <gui/GraphicBufferPool.h>
 
 #include <ui/GraphicBufferAllocator.h>
 #include <ui/PixelFormat.h>
@@ -143,6 +144,10 @@ SurfaceFlinger::SurfaceFlinger()
         mVisibleRegionsDirty(false),
         mHwWorkListDirty(false),
         mAnimCompositionPending(false),
+        mRefreshStartTime(0),
+        mInvalidateTime(0),
+        mHwcPrepareDuration(0),
+        mHwcSetDuration(0),
         mDebugRegion(0),
         mDebugDDMS(0),
         mDebugDisableHWC(0),
@@ -151,7 +156,12 @@ SurfaceFlinger::SurfaceFlinger()
         mLastSwapBufferTime(0),
         mDebugInTransaction(0),
         mLastTransactionTime(0),
+        mIncrementalVisibleRegions(true),
+        mDebugCheckVisibleRegions(false),
+        mUseBufferAge(true),
+        mAdaptivePhaseOffsets(false),
         mBootFinished(false),
+        mPhaseOffsetTuner(vsyncPhaseOffsetNs, sfVsyncPhaseOffsetNs),
         mPrimaryHWVsyncEnabled(false),
         mHWVsyncAvailable(false),
         mDaltonize(false),
@@ -172,6 +182,18 @@ SurfaceFlinger::SurfaceFlinger()
     property_get("debug.sf.showupdates", value, "0");
     mDebugRegion = atoi(value);
 
+    property_get("debug.sf.incremental_visreg", value, "1");
+    mIncrementalVisibleRegions = atoi(value);
+
+    property_get("debug.sf.check_visreg", value, "0");
+    mDebugCheckVisibleRegions = atoi(value);
+
+    property_get("debug.sf.buffer_age", value, "1");
+    mUseBufferAge = atoi(value);
+
+    property_get("debug.sf.adaptive_phase", value, "0");
+    mAdaptivePhaseOffsets = atoi(value);
+
     property_get("debug.sf.ddms", value, "0");
     mDebugDDMS = atoi(value);
     if (mDebugDDMS) {
@@ -364,17 +386,20 @@ public:
     DispSyncSource(DispSync* dispSync, nsecs_t phaseOffset, bool traceVsync,
         const char* label) :
             mValue(0),
-            mPhaseOffset(phaseOffset),
             mTraceVsync(traceVsync),
             mVsyncOnLabel(String8::format("VsyncOn-%s", label)),
             mVsyncEventLabel(String8::format("VSYNC-%s", label)),
-            mDispSync(dispSync) {}
+            mDispSync(dispSync),
+            mPhaseOffset(phaseOffset),
+            mEnabled(false) {}
 
     virtual ~DispSyncSource() {}
 
     virtual void setVSyncEnabled(bool enable) {
-        // Do NOT lock the mutex here so as to avoid any mutex ordering issues
+        // Do NOT lock mMutex here so as to avoid any mutex ordering issues
         // with locking it in the onDispSyncEvent callback.
+        Mutex::Autolock lock(mVsyncMutex);
+        mEnabled = enable;
         if (enable) {
             status_t err = mDispSync->addEventListener(mPhaseOffset,
                     static_cast<DispSync::Callback*>(this));
@@ -399,6 +424,37 @@ public:
         mCallback = callback;
     }
 
+    virtual void setTimingWriter(const sp<VsyncTimingWriter>& writer) {
+        Mutex::Autolock lock(mVsyncMutex);
+        mTimingWriter = writer;
+        mTimingWriter->publishPhaseOffset(mPhaseOffset);
+        mDispSync->addTimingWriter(mTimingWriter);
+    }
+
+    void setPhaseOffset(nsecs_t phaseOffset) {
+        Mutex::Autolock lock(mVsyncMutex);
+        if (phaseOffset == mPhaseOffset) {
+            return;
+        }
+        mPhaseOffset = phaseOffset;
+        if (mTimingWriter != NULL) {
+            mTimingWriter->publishPhaseOffset(mPhaseOffset);
+        }
+        if (mEnabled) {
+            status_t err = mDispSync->changePhaseOffset(
+                    static_cast<DispSync::Callback*>(this), mPhaseOffset);
+            if (err != NO_ERROR) {
+                ALOGE("error changing vsync offset: %s (%d)",
+                        strerror(-err), err);
+            }
+        }
+    }
+
+    nsecs_t getPhaseOffset() {
+        Mutex::Autolock lock(mVsyncMutex);
+        return mPhaseOffset;
+    }
+
 private:
 #ifdef ENABLE_VR
     struct timeval tpend1, tpend2_tt;
@@ -435,7 +491,6 @@ private:
 
     int mValue;
 
-    const nsecs_t mPhaseOffset;
     const bool mTraceVsync;
     const String8 mVsyncOnLabel;
     const String8 mVsyncEventLabel;
@@ -443,6 +498,12 @@ private:
     DispSync* mDispSync;
     sp<VSyncSource::Callback> mCallback;
     Mutex mMutex;
+
+    // protected by mVsyncMutex
+    nsecs_t mPhaseOffset;
+    bool mEnabled;
+    sp<VsyncTimingWriter> mTimingWriter;
+    Mutex mVsyncMutex;
 };
 
 void SurfaceFlinger::init() {
@@ -509,12 +570,12 @@ void SurfaceFlinger::init() {
     getDefaultDisplayDevice()->makeCurrent(mEGLDisplay, mEGLContext);
 
     // start the EventThread
-    sp<VSyncSource> vsyncSrc = new DispSyncSource(&mPrimaryDispSync,
+    mAppVsyncSource = new DispSyncSource(&mPrimaryDispSync,
             vsyncPhaseOffsetNs, true, "app");
-    mEventThread = new EventThread(vsyncSrc);
-    sp<VSyncSource> sfVsyncSrc = new DispSyncSource(&mPrimaryDispSync,
+    mEventThread = new EventThread(mAppVsyncSource);
+    mSfVsyncSource = new DispSyncSource(&mPrimaryDispSync,
             sfVsyncPhaseOffsetNs, true, "sf");
-    mSFEventThread = new EventThread(sfVsyncSrc);
+    mSFEventThread = new EventThread(mSfVsyncSource);
     mEventQueue.setEventThread(mSFEventThread);
 
     mEventControlThread = new EventControlThread(this);
@@ -795,6 +856,10 @@ status_t SurfaceFlinger::getAnimationFrameStats(FrameStats* outStats) const {
     return NO_ERROR;
 }
 
+status_t SurfaceFlinger::getFrameTimeline(sp<IMemoryHeap>* outHeap) {
+    return mFrameTimeline.getHeap(outHeap);
+}
+
 // ----------------------------------------------------------------------------
 
 sp<IDisplayEventConnection> SurfaceFlinger::createDisplayEventConnection() {
@@ -886,6 +951,18 @@ void SurfaceFlinger::disableHardwareVsync(bool makeUnavailable) {
     }
 }
 
+void SurfaceFlinger::addRenderSample(nsecs_t queueTime) {
+    if (!mAdaptivePhaseOffsets || queueTime < 0) {
+        return;
+    }
+    // The app started rendering at the last app vsync event before it
+    // queued the buffer. Frames that took longer than a period look shorter
+    // than they were, but they are late whatever the offsets.
+    const nsecs_t appVsync = mPrimaryDispSync.computePreviousEvent(
+            mAppVsyncSource->getPhaseOffset(), queueTime);
+    mPhaseOffsetTuner.addRenderDuration(queueTime - appVsync);
+}
+
 void SurfaceFlinger::onVSyncReceived(int type, nsecs_t timestamp) {
     bool needsHwVsync = false;
 
@@ -943,6 +1020,7 @@ void SurfaceFlinger::onMessageReceived(int32_t what) {
             break;
         }
         case MessageQueue::INVALIDATE: {
+            mInvalidateTime = systemTime();
             bool refreshNeeded = handleMessageTransaction();
             refreshNeeded |= handleMessageInvalidate();
             refreshNeeded |= mRepaintEverything;
@@ -963,9 +1041,8 @@ void SurfaceFlinger::onMessageReceived(int32_t what) {
 
 bool SurfaceFlinger::handleMessageTransaction() {
     uint32_t transactionFlags = peekTransactionFlags(eTransactionMask);
-    if (transactionFlags) {
-        handleTransaction(transactionFlags);
-        return true;
+    if (transactionFlags || !mTransactionQueue.isEmpty()) {
+        return handleTransaction(transactionFlags);
     }
     return false;
 }
@@ -982,6 +1059,7 @@ void SurfaceFlinger::handleMessageRefresh() {
     // long usec1 = 0;
     // gettimeofday(&tpend1,NULL);
     // ALOGD("sf start");
+    mRefreshStartTime = systemTime();
     preComposition();
     rebuildLayerStacks();
     setUpHWComposer();
@@ -1122,6 +1200,33 @@ void SurfaceFlinger::postComposition()
         }
         mAnimFrameTracker.advanceFrame();
     }
+
+    for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
+        const sp<DisplayDevice>& hw(mDisplays[dpy]);
+        const int32_t id = hw->getHwcDisplayId();
+        if (id < 0 || !hw->isDisplayOn()) {
+            continue;
+        }
+        sp<Fence> gpuFence = Fence::NO_FENCE;
+        if (hwc.hasGlesComposition(id)) {
+            gpuFence = hwc.getFramebufferTargetFence(id);
+        }
+        sp<Fence> displayFence = hwc.getDisplayFence(id);
+        nsecs_t displayTime = FrameTimelineRecord::TIME_UNKNOWN;
+        if (!displayFence->isValid()) {
+            displayTime = hwc.getRefreshTimestamp(id);
+        }
+        mFrameTimeline.addDisplayFrame(id, hw->getDisplayName(),
+                hw->getPageFlipCount(), mRefreshStartTime,
+                mHwcPrepareDuration, mHwcSetDuration,
+                gpuFence, displayFence, displayTime);
+    }
+    mFrameTimeline.processPending();
+
+    if (mAdaptivePhaseOffsets && mPhaseOffsetTuner.update()) {
+        mAppVsyncSource->setPhaseOffset(mPhaseOffsetTuner.getAppOffset());
+        mSfVsyncSource->setPhaseOffset(mPhaseOffsetTuner.getSfOffset());
+    }
 }
 
 void SurfaceFlinger::rebuildLayerStacks() {
@@ -1140,7 +1245,7 @@ void SurfaceFlinger::rebuildLayerStacks() {
             const Transform& tr(hw->getTransform());
             const Rect bounds(hw->getBounds());
             if (hw->isDisplayOn()) {
-                SurfaceFlinger::computeVisibleRegions(layers,
+                computeVisibleRegions(layers,
                         hw->getLayerStack(), dirtyRegion, opaqueRegion);
 
                 const size_t count = layers.size();
@@ -1314,7 +1419,9 @@ void SurfaceFlinger::setUpHWComposer() {
             }
         }
 
+        const nsecs_t prepareStart = systemTime();
         status_t err = hwc.prepare();
+        mHwcPrepareDuration = systemTime() - prepareStart;
         ALOGE_IF(err, "HWComposer::prepare failed (%s)", strerror(-err));
 #ifndef USE_PREPARE_FENCE
         if (mUseLcdcComposer) {
@@ -1353,8 +1460,27 @@ void SurfaceFlinger::setUpHWComposer() {
 void SurfaceFlinger::doComposition() {
     ATRACE_CALL();
     const bool repaintEverything = android_atomic_and(0, &mRepaintEverything);
-    for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
-        const sp<DisplayDevice>& hw(mDisplays[dpy]);
+
+    // All displays share one GL context and are committed to the HWC
+    // together, so the order in which they are composed decides whose
+    // GLES work reaches the GPU first. mDisplays is in no particular order;
+    // compose the primary display first, then external, then virtual
+    // displays, so that the primary's framebuffer target doesn't have to
+    // wait for a virtual display's composition.
+    const size_t numDisplays = mDisplays.size();
+    Vector<size_t> order;
+    order.setCapacity(numDisplays);
+    for (size_t dpy=0 ; dpy<numDisplays ; dpy++) {
+        const int32_t type = mDisplays[dpy]->getDisplayType();
+        size_t pos = order.size();
+        while (pos > 0 && mDisplays[order[pos-1]]->getDisplayType() > type) {
+            pos--;
+        }
+        order.insertAt(dpy, pos);
+    }
+
+    for (size_t i=0 ; i<numDisplays ; i++) {
+        const sp<DisplayDevice>& hw(mDisplays[order[i]]);
         if (hw->isDisplayOn()) {
             // transform the dirty region into this screen's coordinate space
             const Region dirtyRegion(hw->getDirtyRegion(repaintEverything));
@@ -1390,8 +1516,17 @@ void SurfaceFlinger::postFramebuffer()
 #ifdef TARGET_BOARD_PLATFORM_RK30XXB
         hwc.fbs_post();
 #endif
+        const nsecs_t commitStart = systemTime();
         r = hwc.commit();
+        const nsecs_t commitEnd = systemTime();
+        mHwcSetDuration = commitEnd - commitStart;
+        if (mAdaptivePhaseOffsets && mInvalidateTime) {
+            const nsecs_t sfVsync = mPrimaryDispSync.computePreviousEvent(
+                    mSfVsyncSource->getPhaseOffset(), mInvalidateTime);
+            mPhaseOffsetTuner.addCompositionDuration(commitEnd - sfVsync);
+        }
     }
+    mInvalidateTime = 0;
     if (mDebugFPS > 0)
     {    //add by qiuen
         debugShowFPS();
@@ -1434,7 +1569,7 @@ void SurfaceFlinger::postFramebuffer()
     }
 }
 
-void SurfaceFlinger::handleTransaction(uint32_t transactionFlags)
+bool SurfaceFlinger::handleTransaction(uint32_t transactionFlags)
 {
     ATRACE_CALL();
 
@@ -1444,23 +1579,32 @@ void SurfaceFlinger::handleTransaction(uint32_t transactionFlags)
     // don't happen with mStateLock held (which can cause deadlocks).
     State drawingState(mDrawingState);
 
+    // likewise, the queued transactions hold references to clients and
+    // layer handles, which must not be released with mStateLock held.
+    Vector<TransactionQueue::State> queuedStates;
+
     Mutex::Autolock _l(mStateLock);
     const nsecs_t now = systemTime();
     mDebugInTransaction = now;
 
-    // Here we're guaranteed that some transaction flags are set
-    // so we can call handleTransactionLocked() unconditionally.
     // We call getTransactionFlags(), which will also clear the flags,
     // with mStateLock held to guarantee that mCurrentState won't change
     // until the transaction is committed.
 
-    transactionFlags = getTransactionFlags(eTransactionMask);
+    transactionFlags = applyQueuedTransactionsLocked(queuedStates);
+    transactionFlags |= getTransactionFlags(eTransactionMask);
+    if (!transactionFlags) {
+        // only queued transactions that didn't change anything
+        mDebugInTransaction = 0;
+        return false;
+    }
     handleTransactionLocked(transactionFlags);
 
     mLastTransactionTime = systemTime() - now;
     mDebugInTransaction = 0;
     invalidateHwcGeometry();
     // here the transaction has been committed
+    return true;
 }
 
 void SurfaceFlinger::handleTransactionLocked(uint32_t transactionFlags)
@@ -1804,6 +1948,78 @@ void SurfaceFlinger::commitTransaction()
     mTransactionCV.broadcast();
 }
 
+// Returns true if both regions describe the same rects. This is cheap when
+// they share their storage, which is the common case for the regions kept
+// in Layer::VisibleRegionCache.
+static bool isSameRegion(const Region& lhs, const Region& rhs) {
+    if (lhs.isTriviallyEqual(rhs)) {
+        return true;
+    }
+    size_t lhsCount, rhsCount;
+    const Rect* lhsRects = lhs.getArray(&lhsCount);
+    const Rect* rhsRects = rhs.getArray(&rhsCount);
+    return lhsCount == rhsCount &&
+            !memcmp(lhsRects, rhsRects, lhsCount * sizeof(Rect));
+}
+
+// Computes the layer's footprint and the parts of it that are opaque and
+// hinted transparent, in screen space, from what was gathered in geometry.
+static void computeLayerFootprint(const sp<Layer>& layer,
+        const Layer::VisibleRegionCache& geometry,
+        Region& outVisibleRegion, Region& outOpaqueRegion,
+        Region& outTransparentRegion)
+{
+    const Layer::State& s(layer->getDrawingState());
+
+    // handle hidden surfaces by setting the visible region to empty
+    if (CC_LIKELY(geometry.visible)) {
+        outVisibleRegion.set(geometry.bounds);
+        if (!outVisibleRegion.isEmpty()) {
+            // Remove the transparent area from the visible region
+            if (geometry.translucent) {
+                const Transform tr(s.transform);
+                if (tr.transformed()) {
+                    if (tr.preserveRects()) {
+                        // transform the transparent region
+                        outTransparentRegion = tr.transform(s.activeTransparentRegion);
+                    } else {
+                        // transformation too complex, can't do the
+                        // transparent region optimization.
+                        outTransparentRegion.clear();
+                    }
+                } else {
+                    outTransparentRegion = s.activeTransparentRegion;
+                }
+            }
+
+            // compute the opaque region
+            if (geometry.opaque) {
+                // the opaque region is the layer's footprint
+                outOpaqueRegion = outVisibleRegion;
+            }
+        }
+    }
+}
+
+// Gathers everything about the layer that its visible region depends on.
+static void getLayerGeometry(const sp<Layer>& layer, uint32_t layerStack,
+        Layer::VisibleRegionCache& outGeometry)
+{
+    const Layer::State& s(layer->getDrawingState());
+
+    outGeometry.layerStack = layerStack;
+    outGeometry.visible = layer->isVisible();
+    if (CC_LIKELY(outGeometry.visible)) {
+        outGeometry.translucent = !layer->isOpaque(s);
+        outGeometry.sourceBounds = layer->computeBounds();
+        outGeometry.bounds = s.transform.transform(outGeometry.sourceBounds);
+        outGeometry.orientation = s.transform.getOrientation();
+        outGeometry.opaque = s.alpha==255 && !outGeometry.translucent &&
+                ((outGeometry.orientation & Transform::ROT_INVALID) == false);
+        outGeometry.activeTransparentRegion = s.activeTransparentRegion;
+    }
+}
+
 void SurfaceFlinger::computeVisibleRegions(
         const LayerVector& currentLayers, uint32_t layerStack,
         Region& outDirtyRegion, Region& outOpaqueRegion)
@@ -1827,6 +2043,25 @@ void SurfaceFlinger::computeVisibleRegions(
         if (s.layerStack != layerStack)
             continue;
 
+        Layer::VisibleRegionCache geometry;
+        getLayerGeometry(layer, layerStack, geometry);
+
+        // If neither this layer nor anything above it changed since the
+        // last pass, the last results still hold and this layer doesn't
+        // contribute anything to the dirty region.
+        Layer::VisibleRegionCache& cache(layer->visibleRegionCache);
+        if (mIncrementalVisibleRegions && !layer->contentDirty &&
+                cache.isSameGeometry(geometry) &&
+                isSameRegion(cache.aboveOpaqueLayers, aboveOpaqueLayers) &&
+                isSameRegion(cache.aboveCoveredLayers, aboveCoveredLayers)) {
+            aboveOpaqueLayers = cache.belowOpaqueLayers;
+            aboveCoveredLayers = cache.belowCoveredLayers;
+            continue;
+        }
+
+        geometry.aboveOpaqueLayers = aboveOpaqueLayers;
+        geometry.aboveCoveredLayers = aboveCoveredLayers;
+
         /*
          * opaqueRegion: area of a surface that is fully opaque.
          */
@@ -1856,39 +2091,8 @@ void SurfaceFlinger::computeVisibleRegions(
          */
         Region transparentRegion;
 
-
-        // handle hidden surfaces by setting the visible region to empty
-        if (CC_LIKELY(layer->isVisible())) {
-            const bool translucent = !layer->isOpaque(s);
-            Rect bounds(s.transform.transform(layer->computeBounds()));
-            visibleRegion.set(bounds);
-            if (!visibleRegion.isEmpty()) {
-                // Remove the transparent area from the visible region
-                if (translucent) {
-                    const Transform tr(s.transform);
-                    if (tr.transformed()) {
-                        if (tr.preserveRects()) {
-                            // transform the transparent region
-                            transparentRegion = tr.transform(s.activeTransparentRegion);
-                        } else {
-                            // transformation too complex, can't do the
-                            // transparent region optimization.
-                            transparentRegion.clear();
-                        }
-                    } else {
-                        transparentRegion = s.activeTransparentRegion;
-                    }
-                }
-
-                // compute the opaque region
-                const int32_t layerOrientation = s.transform.getOrientation();
-                if (s.alpha==255 && !translucent &&
-                        ((layerOrientation & Transform::ROT_INVALID) == false)) {
-                    // the opaque region is the layer's footprint
-                    opaqueRegion = visibleRegion;
-                }
-            }
-        }
+        computeLayerFootprint(layer, geometry,
+                visibleRegion, opaqueRegion, transparentRegion);
 
         // Clip the covered region to the visible region
         coveredRegion = aboveCoveredLayers.intersect(visibleRegion);
@@ -1938,9 +2142,68 @@ void SurfaceFlinger::computeVisibleRegions(
         layer->setCoveredRegion(coveredRegion);
         layer->setVisibleNonTransparentRegion(
                 visibleRegion.subtract(transparentRegion));
+
+        // Remember what this was computed from
+        geometry.belowOpaqueLayers = aboveOpaqueLayers;
+        geometry.belowCoveredLayers = aboveCoveredLayers;
+        geometry.valid = true;
+        cache = geometry;
     }
 
     outOpaqueRegion = aboveOpaqueLayers;
+
+    if (CC_UNLIKELY(mIncrementalVisibleRegions && mDebugCheckVisibleRegions)) {
+        checkVisibleRegions(currentLayers, layerStack, outOpaqueRegion);
+    }
+}
+
+void SurfaceFlinger::checkVisibleRegions(const LayerVector& currentLayers,
+        uint32_t layerStack, const Region& opaqueRegion)
+{
+    // Redo the whole computation from scratch, without touching the
+    // layers, and compare with what the incremental pass left behind.
+    Region aboveOpaqueLayers;
+    Region aboveCoveredLayers;
+
+    size_t i = currentLayers.size();
+    while (i--) {
+        const sp<Layer>& layer = currentLayers[i];
+        const Layer::State& s(layer->getDrawingState());
+        if (s.layerStack != layerStack)
+            continue;
+
+        Layer::VisibleRegionCache geometry;
+        getLayerGeometry(layer, layerStack, geometry);
+
+        Region opaqueRegion;
+        Region visibleRegion;
+        Region coveredRegion;
+        Region transparentRegion;
+        computeLayerFootprint(layer, geometry,
+                visibleRegion, opaqueRegion, transparentRegion);
+        coveredRegion = aboveCoveredLayers.intersect(visibleRegion);
+        aboveCoveredLayers.orSelf(visibleRegion);
+        visibleRegion.subtractSelf(aboveOpaqueLayers);
+        aboveOpaqueLayers.orSelf(opaqueRegion);
+
+        if (!isSameRegion(visibleRegion, layer->visibleRegion) ||
+                !isSameRegion(coveredRegion, layer->coveredRegion) ||
+                !isSameRegion(visibleRegion.subtract(transparentRegion),
+                        layer->visibleNonTransparentRegion)) {
+            ALOGE("incremental visible regions out of sync for layer '%s'",
+                    layer->getName().string());
+            layer->visibleRegion.dump("incremental visibleRegion");
+            visibleRegion.dump("expected visibleRegion");
+            layer->coveredRegion.dump("incremental coveredRegion");
+            coveredRegion.dump("expected coveredRegion");
+        }
+    }
+
+    if (!isSameRegion(aboveOpaqueLayers, opaqueRegion)) {
+        ALOGE("incremental opaque region out of sync for layer stack %u", layerStack);
+        opaqueRegion.dump("incremental opaqueRegion");
+        aboveOpaqueLayers.dump("expected opaqueRegion");
+    }
 }
 
 void SurfaceFlinger::invalidateLayerStack(uint32_t layerStack,
@@ -2045,8 +2308,9 @@ void SurfaceFlinger::doDisplayComposition(const sp<const DisplayDevice>& hw,
             // rectangle instead of a region (see DisplayDevice::flip())
             dirtyRegion.set(hw->swapRegion.bounds());
         } else {
-            // we need to redraw everything (the whole screen)
-            dirtyRegion.set(hw->bounds());
+            // we need to redraw everything (the whole screen), except
+            // what the back buffer is known to be up to date for
+            dirtyRegion = computeRedrawRegion(hw, dirtyRegion);
             hw->swapRegion = dirtyRegion;
         }
     }
@@ -2129,6 +2393,54 @@ void SurfaceFlinger::doDisplayComposition(const sp<const DisplayDevice>& hw,
 
 }
 
+Region SurfaceFlinger::computeRedrawRegion(const sp<const DisplayDevice>& hw,
+        const Region& dirty)
+{
+    const Region screen(hw->bounds());
+#ifdef ENABLE_VR
+    // may be composed through an FBO, see doDisplayComposition()
+    return screen;
+#else
+    // the color matrix is applied by composing through an FBO, which is
+    // drawn to the whole screen
+    if (!mUseBufferAge || mDaltonize || mHasColorMatrix) {
+        return screen;
+    }
+
+    HWComposer& hwc(getHwComposer());
+    const int32_t id = hw->getHwcDisplayId();
+    if (!hwc.hasGlesComposition(id) ||
+            !hw->makeCurrent(mEGLDisplay, mEGLContext)) {
+        return screen;
+    }
+
+    // Describe how the framebuffer is composed: a layer moving between
+    // HWC and GLES, or a change in how the framebuffer is cleared, changes
+    // its content without the layers being dirty.
+    Vector<uintptr_t> composition;
+    composition.add(hwc.hasHwcComposition(id));
+    composition.add(hwc.hasBlitComposition(id));
+    composition.add(hwc.hasLcdComposition(id));
+    composition.add(mWfdOptimize);
+    composition.add(mUseLcdcComposer);
+    const Vector< sp<Layer> >& layers(hw->getVisibleLayersSortedByZ());
+    HWComposer::LayerListIterator cur = hwc.begin(id);
+    const HWComposer::LayerListIterator end = hwc.end(id);
+    for (size_t i=0 ; i<layers.size() ; i++) {
+        composition.add(reinterpret_cast<uintptr_t>(layers[i].get()));
+        if (cur != end) {
+            composition.add(cur->getCompositionType());
+            composition.add(cur->getHints());
+            ++cur;
+        }
+    }
+
+    // layers are drawn as whole quads, which doComposeSurfaces() can only
+    // keep inside a rectangle, with the GL scissor
+    return Region(hw->getBufferAgeDirtyRegion(dirty, composition).getBounds());
+#endif
+}
+
 bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const Region& dirty)
 {
     RenderEngine& engine(getRenderEngine());
@@ -2184,7 +2496,7 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
             // remove where there are opaque FB layers. however, on some
             // GPUs doing a "clean slate" clear might be more efficient.
             // We'll revisit later if needed.
-            engine.clearWithColor(0, 0, 0, 0);
+            clearFramebuffer(hw, dirty);
         } else {
             // we start with the whole screen area
             const Region bounds(hw->getBounds());
@@ -2207,25 +2519,48 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
             }
         }
 
+        const Rect& bounds(hw->getBounds());
+        Rect scissor(bounds);
         if (hw->getDisplayType() != DisplayDevice::DISPLAY_PRIMARY) {
             // just to be on the safe side, we don't set the
             // scissor on the main display. It should never be needed
             // anyways (though in theory it could since the API allows it).
-            const Rect& bounds(hw->getBounds());
-            const Rect& scissor(hw->getScissor());
-            if (scissor != bounds) {
-                // scissor doesn't match the screen's dimensions, so we
-                // need to clear everything outside of it and enable
-                // the GL scissor so we don't draw anything where we shouldn't
+            scissor = hw->getScissor();
+        }
 
-                // enable scissor for this frame
-                const uint32_t height = hw->getHeight();
-                engine.setScissor(scissor.left, height - scissor.bottom,
-                        scissor.getWidth(), scissor.getHeight());
-            }
+        // Layers draw whole quads whatever their clip, so when only part
+        // of the framebuffer is redrawn (see computeRedrawRegion()) they
+        // must be kept inside it.  Not when composing through an FBO,
+        // which is then drawn to the whole screen.
+        bool composeThroughFbo = mDaltonize || mHasColorMatrix;
+#ifdef ENABLE_VR
+        composeThroughFbo = composeThroughFbo || mDeform;
+#endif
+        if (!composeThroughFbo && !scissor.intersect(dirty.getBounds(), &scissor)) {
+            scissor.clear();
+        }
+
+        if (scissor != bounds) {
+            // scissor doesn't match the screen's dimensions, so we
+            // need to clear everything outside of it and enable
+            // the GL scissor so we don't draw anything where we shouldn't
+
+            // enable scissor for this frame
+            const uint32_t height = hw->getHeight();
+            engine.setScissor(scissor.left, height - scissor.bottom,
+                    scissor.getWidth(), scissor.getHeight());
         }
     }
 
+    // disable scissor at the end of the frame, whichever way we leave,
+    // so that it doesn't clip later GL work such as screenshots
+    class ScissorGuard {
+        RenderEngine& mEngine;
+    public:
+        ScissorGuard(RenderEngine& engine) : mEngine(engine) { }
+        ~ScissorGuard() { mEngine.disableScissor(); }
+    } scissorGuard(engine);
+
     /*
      * and then, render the layers targeted at the framebuffer
      */
@@ -2234,7 +2569,7 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
     bool wfdOptimize = mWfdOptimize && (hw->getDisplayType()==DisplayDevice::DISPLAY_VIRTUAL) && (mUseLcdcComposer==false);
     if (wfdOptimize)
     {
-        engine.clearWithColor(0, 0, 0, 0);
+        clearFramebuffer(hw, dirty);
     }
     const size_t count = layers.size();
     const Transform& tr = hw->getTransform();
@@ -2305,8 +2640,6 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
         }
     }
 
-    // disable scissor at the end of the frame
-    engine.disableScissor();
     return true;
 }
 
@@ -2316,6 +2649,17 @@ void SurfaceFlinger::drawWormhole(const sp<const DisplayDevice>& hw, const Regio
     engine.fillRegionWithColor(region, height, 0, 0, 0, 0);
 }
 
+void SurfaceFlinger::clearFramebuffer(const sp<const DisplayDevice>& hw,
+        const Region& dirty) const {
+    if (dirty.isRect() && dirty.getBounds() == hw->getBounds()) {
+        getRenderEngine().clearWithColor(0, 0, 0, 0);
+    } else {
+        // only part of the framebuffer is redrawn this frame, see
+        // computeRedrawRegion()
+        drawWormhole(hw, dirty);
+    }
+}
+
 void SurfaceFlinger::addClientLayer(const sp<Client>& client,
         const sp<IBinder>& handle,
         const sp<IGraphicBufferProducer>& gbc,
@@ -2358,12 +2702,71 @@ uint32_t SurfaceFlinger::setTransactionFlags(uint32_t flags) {
     return old;
 }
 
+// Returns the Client behind the given interface, or NULL if it isn't one
+// of ours.
+static sp<Client> getClient(const sp<ISurfaceComposerClient>& client)
+{
+    // Here we need to check that the interface we're given is indeed
+    // one of our own. A malicious client could give us a NULL
+    // IInterface, or one of its own or even one of our own but a
+    // different type. All these situations would cause us to crash.
+    //
+    // NOTE: it would be better to use RTTI as we could directly check
+    // that we have a Client*. however, RTTI is disabled in Android.
+    if (client != NULL) {
+        sp<IBinder> binder = client->asBinder();
+        if (binder != NULL) {
+            String16 desc(binder->getInterfaceDescriptor());
+            if (desc == ISurfaceComposerClient::descriptor) {
+                return static_cast<Client *>(client.get());
+            }
+        }
+    }
+    return NULL;
+}
+
+uint32_t SurfaceFlinger::applyQueuedTransactionsLocked(
+        Vector<TransactionQueue::State>& outStates)
+{
+    uint32_t transactionFlags = 0;
+    if (mTransactionQueue.dequeueAll(outStates)) {
+        const size_t count = outStates.size();
+        for (size_t i=0 ; i<count ; i++) {
+            const TransactionQueue::State& s(outStates[i]);
+            transactionFlags |= setClientStateLocked(s.client, s.state);
+        }
+    }
+    return transactionFlags;
+}
+
 void SurfaceFlinger::setTransactionState(
         const Vector<ComposerState>& state,
         const Vector<DisplayState>& displays,
         uint32_t flags)
 {
     ATRACE_CALL();
+
+    if (!(flags & (eSynchronous | eAnimation)) && displays.isEmpty()) {
+        // Nobody waits for this transaction, queue it without taking
+        // mStateLock; handleTransaction() applies it with the next frame.
+        Vector<TransactionQueue::State> queued;
+        queued.setCapacity(state.size());
+        const size_t count = state.size();
+        for (size_t i=0 ; i<count ; i++) {
+            TransactionQueue::State s;
+            s.client = getClient(state[i].client);
+            if (s.client != NULL) {
+                s.state = state[i].state;
+                queued.add(s);
+            }
+        }
+        if (!queued.isEmpty() && mTransactionQueue.enqueue(queued)) {
+            signalTransaction();
+        }
+        return;
+    }
+
+    Vector<TransactionQueue::State> queuedStates;
     Mutex::Autolock _l(mStateLock);
     uint32_t transactionFlags = 0;
 
@@ -2383,6 +2786,9 @@ void SurfaceFlinger::setTransactionState(
         }
     }
 
+    // Transactions queued earlier must take effect before this one.
+    transactionFlags |= applyQueuedTransactionsLocked(queuedStates);
+
     size_t count = displays.size();
     for (size_t i=0 ; i<count ; i++) {
         const DisplayState& s(displays[i]);
@@ -2392,22 +2798,9 @@ void SurfaceFlinger::setTransactionState(
     count = state.size();
     for (size_t i=0 ; i<count ; i++) {
         const ComposerState& s(state[i]);
-        // Here we need to check that the interface we're given is indeed
-        // one of our own. A malicious client could give us a NULL
-        // IInterface, or one of its own or even one of our own but a
-        // different type. All these situations would cause us to crash.
-        //
-        // NOTE: it would be better to use RTTI as we could directly check
-        // that we have a Client*. however, RTTI is disabled in Android.
-        if (s.client != NULL) {
-            sp<IBinder> binder = s.client->asBinder();
-            if (binder != NULL) {
-                String16 desc(binder->getInterfaceDescriptor());
-                if (desc == ISurfaceComposerClient::descriptor) {
-                    sp<Client> client( static_cast<Client *>(s.client.get()) );
-                    transactionFlags |= setClientStateLocked(client, s.state);
-                }
-            }
+        sp<Client> client(getClient(s.client));
+        if (client != NULL) {
+            transactionFlags |= setClientStateLocked(client, s.state);
         }
     }
 
@@ -2677,6 +3070,8 @@ void SurfaceFlinger::onInitializeDisplays() {
     const nsecs_t period =
             getHwComposer().getRefreshPeriod(HWC_DISPLAY_PRIMARY);
     mAnimFrameTracker.setDisplayRefreshPeriod(period);
+    mFrameTimeline.setDisplayRefreshPeriod(period);
+    mPhaseOffsetTuner.setDisplayRefreshPeriod(period);
 }
 
 void SurfaceFlinger::initializeDisplays() {
@@ -2971,6 +3366,9 @@ void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
         vsyncPhaseOffsetNs, sfVsyncPhaseOffsetNs, PRESENT_TIME_OFFSET_FROM_VSYNC_NS,
         mHwc->getRefreshPeriod(HWC_DISPLAY_PRIMARY));
     result.append("\n");
+    if (mAdaptivePhaseOffsets) {
+        mPhaseOffsetTuner.dump(result);
+    }
 
     /*
      * Dump the visible layer list
@@ -3043,6 +3441,9 @@ void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
     result.appendFormat("  transaction time: %f us\n",
             inTransactionDuration/1000.0);
 
+    mTransactionQueue.dump(result);
+    mFrameTimeline.dump(result);
+
     /*
      * VSYNC state
      */
@@ -3065,6 +3466,7 @@ void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
      */
     const GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
     alloc.dump(result);
+    GraphicBufferPool::getInstance().dump(result);
 }
 
 const Vector< sp<Layer> >&
@@ -3166,6 +3568,7 @@ status_t SurfaceFlinger::onTransact(
         case CLEAR_ANIMATION_FRAME_STATS:
         case GET_ANIMATION_FRAME_STATS:
         case SET_POWER_MODE:
+        case GET_FRAME_TIMELINE:
         {
             // codes that require permission check
             IPCThreadState* ipc = IPCThreadState::self();
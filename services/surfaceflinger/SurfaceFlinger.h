@@ -50,8 +50,11 @@
 #include "Barrier.h"
 #include "DisplayDevice.h"
 #include "DispSync.h"
+#include "FrameTimeline.h"
 #include "FrameTracker.h"
 #include "MessageQueue.h"
+#include "PhaseOffsetTuner.h"
+#include "TransactionQueue.h"
 
 #include "DisplayHardware/HWComposer.h"
 #include "Effects/Daltonizer.h"
@@ -62,6 +65,7 @@ namespace android {
 
 class Client;
 class DisplayEventConnection;
+class DispSyncSource;
 class EventThread;
 class IGraphicBufferAlloc;
 class Layer;
@@ -268,6 +272,7 @@ private:
     virtual status_t setActiveConfig(const sp<IBinder>& display, int id);
     virtual status_t clearAnimationFrameStats();
     virtual status_t getAnimationFrameStats(FrameStats* outStats) const;
+    virtual status_t getFrameTimeline(sp<IMemoryHeap>* outHeap);
 
     /* ------------------------------------------------------------------------
      * DeathRecipient interface
@@ -308,7 +313,8 @@ private:
 
     void handleMessageRefresh();
 
-    void handleTransaction(uint32_t transactionFlags);
+    // Returns false if there turned out to be nothing to commit
+    bool handleTransaction(uint32_t transactionFlags);
     void handleTransactionLocked(uint32_t transactionFlags);
 
     void updateCursorAsync();
@@ -327,6 +333,10 @@ private:
     uint32_t setTransactionFlags(uint32_t flags);
     void commitTransaction();
     uint32_t setClientStateLocked(const sp<Client>& client, const layer_state_t& s);
+    // applies the transactions queued by setTransactionState(); outStates
+    // must be released after mStateLock
+    uint32_t applyQueuedTransactionsLocked(
+            Vector<TransactionQueue::State>& outStates);
     uint32_t setDisplayStateLocked(const DisplayState& s);
 
     /* ------------------------------------------------------------------------
@@ -418,9 +428,13 @@ private:
      * Compositing
      */
     void invalidateHwcGeometry();
-    static void computeVisibleRegions(
+    void computeVisibleRegions(
             const LayerVector& currentLayers, uint32_t layerStack,
             Region& dirtyRegion, Region& opaqueRegion);
+    // debugging: checks the incremental computeVisibleRegions() against
+    // a full recomputation
+    void checkVisibleRegions(const LayerVector& currentLayers,
+            uint32_t layerStack, const Region& opaqueRegion);
 
     void preComposition();
     void postComposition();
@@ -433,9 +447,16 @@ private:
     // compose surfaces for display hw. this fails if using GL and the surface
     // has been destroyed and is no longer valid.
     bool doComposeSurfaces(const sp<const DisplayDevice>& hw, const Region& dirty);
+    // returns what needs to be redrawn in the display's back buffer, given
+    // what changed since the last frame
+    Region computeRedrawRegion(const sp<const DisplayDevice>& hw,
+            const Region& dirty);
 
     void postFramebuffer();
     void drawWormhole(const sp<const DisplayDevice>& hw, const Region& region) const;
+    // clears the part of the framebuffer that is redrawn
+    void clearFramebuffer(const sp<const DisplayDevice>& hw,
+            const Region& dirty) const;
 
     /* ------------------------------------------------------------------------
      * Display management
@@ -447,6 +468,8 @@ private:
      void enableHardwareVsync();
      void disableHardwareVsync(bool makeUnavailable);
      void resyncToHardwareVsync(bool makeAvailable);
+     // feeds the phase offset tuner with a latched buffer's queue time
+     void addRenderSample(nsecs_t queueTime);
 
     /* ------------------------------------------------------------------------
      * Debugging & dumpsys
@@ -480,6 +503,9 @@ private:
     // protected by mStateLock (but we could use another lock)
     bool mLayersRemoved;
 
+    // asynchronous transactions waiting for handleTransaction(); thread-safe
+    TransactionQueue mTransactionQueue;
+
     // access must be protected by mInvalidateLock
     volatile int32_t mRepaintEverything;
 
@@ -490,6 +516,8 @@ private:
     bool mGpuToCpuSupported;
     sp<EventThread> mEventThread;
     sp<EventThread> mSFEventThread;
+    sp<DispSyncSource> mAppVsyncSource;
+    sp<DispSyncSource> mSfVsyncSource;
     sp<EventControlThread> mEventControlThread;
     EGLContext mEGLContext;
     EGLDisplay mEGLDisplay;
@@ -501,6 +529,12 @@ private:
     bool mVisibleRegionsDirty;
     bool mHwWorkListDirty;
     bool mAnimCompositionPending;
+    // timing of the current refresh, for the frame timeline
+    nsecs_t mRefreshStartTime;
+    // when the current frame's INVALIDATE message was handled, or 0
+    nsecs_t mInvalidateTime;
+    nsecs_t mHwcPrepareDuration;
+    nsecs_t mHwcSetDuration;
 
     // this may only be written from the main thread with mStateLock held
     // it may be read from other threads with mStateLock held
@@ -515,11 +549,21 @@ private:
     nsecs_t mLastSwapBufferTime;
     volatile nsecs_t mDebugInTransaction;
     nsecs_t mLastTransactionTime;
+    // only recompute the visible regions of layers affected by a change
+    bool mIncrementalVisibleRegions;
+    bool mDebugCheckVisibleRegions;
+    // only redraw what changed since the back buffer was last presented
+    bool mUseBufferAge;
+    // tune the vsync phase offsets from the measured frame durations
+    bool mAdaptivePhaseOffsets;
     bool mBootFinished;
     int mWfdOptimize;
     // these are thread safe
     mutable MessageQueue mEventQueue;
     FrameTracker mAnimFrameTracker;
+    FrameTimeline mFrameTimeline;
+    // main thread
+    PhaseOffsetTuner mPhaseOffsetTuner;
     DispSync mPrimaryDispSync;
 
     // protected by mDestroyedLayerLock;
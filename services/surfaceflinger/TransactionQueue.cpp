@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include <inttypes.h>
+
+#include <utils/KeyedVector.h>
+#include <utils/String8.h>
+#include <utils/Trace.h>
+
+#include "Client.h"
+#include "TransactionQueue.h"
+
+namespace android {
+
+// Updates that only replace a value, so that only the last one of a batch
+// needs to be applied.
+static const uint32_t COALESCED_UPDATES =
+        layer_state_t::ePositionChanged |
+        layer_state_t::eAlphaChanged |
+        layer_state_t::eMatrixChanged;
+
+TransactionQueue::TransactionQueue() :
+        mTransactions(0),
+        mBatches(0),
+        mLastBatch(0),
+        mMaxBatch(0),
+        mUpdates(0),
+        mCoalescedUpdates(0) {
+    atomic_init(&mHead, 0);
+}
+
+TransactionQueue::~TransactionQueue() {
+    Node* node = reinterpret_cast<Node*>(
+            atomic_exchange_explicit(&mHead, 0, memory_order_acquire));
+    while (node) {
+        Node* next = node->next;
+        delete node;
+        node = next;
+    }
+}
+
+bool TransactionQueue::enqueue(const Vector<State>& states) {
+    Node* node = new Node;
+    node->states = states;
+
+    uintptr_t head = atomic_load_explicit(&mHead, memory_order_relaxed);
+    do {
+        node->next = reinterpret_cast<Node*>(head);
+    } while (!atomic_compare_exchange_weak_explicit(&mHead, &head,
+            reinterpret_cast<uintptr_t>(node),
+            memory_order_release, memory_order_relaxed));
+    return head == 0;
+}
+
+bool TransactionQueue::isEmpty() const {
+    return atomic_load_explicit(&mHead, memory_order_acquire) == 0;
+}
+
+size_t TransactionQueue::dequeueAll(Vector<State>& outStates) {
+    Node* node = reinterpret_cast<Node*>(
+            atomic_exchange_explicit(&mHead, 0, memory_order_acquire));
+    if (!node) {
+        return 0;
+    }
+    ATRACE_CALL();
+
+    // The list is in LIFO order, reverse it.
+    Node* fifo = NULL;
+    size_t count = 0;
+    while (node) {
+        Node* next = node->next;
+        node->next = fifo;
+        fifo = node;
+        node = next;
+        count++;
+    }
+
+    const size_t first = outStates.size();
+    while (fifo) {
+        Node* next = fifo->next;
+        outStates.appendVector(fifo->states);
+        delete fifo;
+        fifo = next;
+    }
+
+    // Walk the batch backwards, remembering which updates were already
+    // seen for each layer, and drop those from earlier states.
+    KeyedVector<const IBinder*, uint32_t> seen;
+    size_t kept = first;
+    for (size_t i = outStates.size(); i > first; i--) {
+        State& s(outStates.editItemAt(i - 1));
+        const uint32_t updates = s.state.what & COALESCED_UPDATES;
+        if (!updates) {
+            kept++;
+            continue;
+        }
+        const IBinder* key = s.state.surface.get();
+        ssize_t index = seen.indexOfKey(key);
+        const uint32_t overridden = index >= 0 ?
+                (updates & seen.valueAt(index)) : 0;
+        if (index >= 0) {
+            seen.editValueAt(index) |= updates;
+        } else {
+            seen.add(key, updates);
+        }
+        mUpdates += __builtin_popcount(updates);
+        mCoalescedUpdates += __builtin_popcount(overridden);
+        s.state.what &= ~overridden;
+        if (s.state.what) {
+            kept++;
+        }
+    }
+
+    // Remove the states that were left with nothing to do.
+    if (kept != outStates.size()) {
+        size_t j = first;
+        for (size_t i = first; i < outStates.size(); i++) {
+            if (outStates[i].state.what) {
+                if (i != j) {
+                    outStates.editItemAt(j) = outStates[i];
+                }
+                j++;
+            }
+        }
+        outStates.removeItemsAt(j, outStates.size() - j);
+    }
+
+    mTransactions += count;
+    mBatches++;
+    mLastBatch = count;
+    if (count > mMaxBatch) {
+        mMaxBatch = count;
+    }
+    return count;
+}
+
+void TransactionQueue::dump(String8& result) const {
+    result.appendFormat("  transaction queue: %" PRIu64 " transactions in %"
+            PRIu64 " frames (%.2f per frame, last %zu, max %zu)\n",
+            mTransactions, mBatches,
+            mBatches ? double(mTransactions) / mBatches : 0.0,
+            mLastBatch, mMaxBatch);
+    result.appendFormat("  coalesced updates: %" PRIu64 " of %" PRIu64
+            " (%.1f%%)\n",
+            mCoalescedUpdates, mUpdates,
+            mUpdates ? 100.0 * mCoalescedUpdates / mUpdates : 0.0);
+}
+
+}; // namespace android
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_TRANSACTION_QUEUE_H
+#define ANDROID_SF_TRANSACTION_QUEUE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/RefBase.h>
+#include <utils/Vector.h>
+
+#include <private/gui/LayerState.h>
+
+namespace android {
+
+class Client;
+class String8;
+
+// TransactionQueue holds asynchronous client transactions until the main
+// thread applies them, so that setTransactionState() doesn't need to take
+// mStateLock for them.
+//
+// Any number of threads may call enqueue() concurrently; it never blocks.
+// dequeueAll() and dump() must only be called by one thread at a time
+// (SurfaceFlinger calls them with mStateLock held).
+class TransactionQueue {
+public:
+    struct State {
+        sp<Client> client;
+        layer_state_t state;
+    };
+
+    TransactionQueue();
+    ~TransactionQueue();
+
+    // enqueue adds one transaction to the queue. The states of a
+    // transaction are always dequeued together. Returns true if the queue
+    // was empty, in which case the caller must arrange for dequeueAll() to
+    // be called.
+    bool enqueue(const Vector<State>& states);
+
+    // dequeueAll removes every transaction from the queue and appends their
+    // states to outStates, in the order they were enqueued. Position, alpha
+    // and matrix updates that a later state of the same batch overrides are
+    // dropped. Returns the number of transactions dequeued.
+    //
+    // The states hold references to clients and layer handles, so
+    // outStates must not be destroyed with mStateLock held.
+    size_t dequeueAll(Vector<State>& outStates);
+
+    bool isEmpty() const;
+
+    void dump(String8& result) const;
+
+private:
+    struct Node {
+        Node* next;
+        Vector<State> states;
+    };
+
+    // Node*, most recently enqueued first
+    mutable atomic_uintptr_t mHead;
+
+    // statistics, updated by dequeueAll()
+    uint64_t mTransactions;
+    uint64_t mBatches;
+    size_t mLastBatch;
+    size_t mMaxBatch;
+    uint64_t mUpdates;
+    uint64_t mCoalescedUpdates;
+};
+
+}; // namespace android
+
+#endif // ANDROID_SF_TRANSACTION_QUEUE_H
@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures how long frames posted to a layer on the primary display take to
+ * be presented, with 0, 1 and 2 virtual displays mirroring the primary
+ * display's layer stack. Every frame therefore has to be composed for each
+ * of the active displays.
+ *
+ * usage: test-multidisplay [frames]
+ */
+
+// This is needed for stdint.h to define INT64_MAX in C++
+#define __STDC_LIMIT_MACROS
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <binder/ProcessState.h>
+
+#include <gui/BufferItemConsumer.h>
+#include <gui/BufferQueue.h>
+#include <gui/ISurfaceComposer.h>
+#include <gui/Surface.h>
+#include <gui/SurfaceComposerClient.h>
+
+#include <ui/DisplayInfo.h>
+#include <ui/FrameStats.h>
+
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+using namespace android;
+
+static const int kMaxSecondaryDisplays = 2;
+static const uint32_t kLayerSize = 256;
+
+// The output of a virtual display. Every frame is consumed as soon as it
+// arrives so that the display never stalls.
+class DisplaySink : public BufferItemConsumer::FrameAvailableListener {
+public:
+    DisplaySink(uint32_t w, uint32_t h) {
+        sp<IGraphicBufferConsumer> consumer;
+        BufferQueue::createBufferQueue(&mProducer, &consumer);
+        mConsumer = new BufferItemConsumer(consumer,
+                GRALLOC_USAGE_SW_READ_OFTEN, 1);
+        mConsumer->setName(String8("multidisplay"));
+        mConsumer->setDefaultBufferSize(w, h);
+    }
+
+    void connect() {
+        mConsumer->setFrameAvailableListener(this);
+    }
+
+    const sp<IGraphicBufferProducer>& getProducer() const {
+        return mProducer;
+    }
+
+private:
+    virtual void onFrameAvailable(const android::BufferItem& /* item */) {
+        BufferItemConsumer::BufferItem item;
+        if (mConsumer->acquireBuffer(&item, 0) == NO_ERROR) {
+            mConsumer->releaseBuffer(item);
+        }
+    }
+
+    sp<IGraphicBufferProducer> mProducer;
+    sp<BufferItemConsumer> mConsumer;
+};
+
+struct SecondaryDisplay {
+    sp<IBinder> token;
+    sp<DisplaySink> sink;
+};
+
+static SecondaryDisplay createSecondaryDisplay(int index,
+        const DisplayInfo& info) {
+    SecondaryDisplay display;
+    display.sink = new DisplaySink(info.w, info.h);
+    display.sink->connect();
+    display.token = SurfaceComposerClient::createDisplay(
+            String8::format("multidisplay-%d", index), false);
+
+    // Mirror the primary display, slightly scaled down so that composing
+    // it can't be a plain copy.
+    Rect layerStackRect(info.w, info.h);
+    Rect displayRect(info.w / 8, info.h / 8, info.w - info.w / 8,
+            info.h - info.h / 8);
+    SurfaceComposerClient::openGlobalTransaction();
+    SurfaceComposerClient::setDisplaySurface(display.token,
+            display.sink->getProducer());
+    SurfaceComposerClient::setDisplayLayerStack(display.token, 0);
+    SurfaceComposerClient::setDisplayProjection(display.token,
+            DISPLAY_ORIENTATION_0, layerStackRect, displayRect);
+    SurfaceComposerClient::closeGlobalTransaction();
+    return display;
+}
+
+static void fill(const sp<Surface>& surface, int frame) {
+    ANativeWindow_Buffer buffer;
+    if (surface->lock(&buffer, NULL) != NO_ERROR) {
+        return;
+    }
+    const uint32_t color = 0xff000000 | ((frame * 0x050301) & 0xffffff);
+    uint32_t* row = static_cast<uint32_t*>(buffer.bits);
+    for (int32_t y = 0; y < buffer.height; y++) {
+        for (int32_t x = 0; x < buffer.width; x++) {
+            row[x] = color;
+        }
+        row += buffer.stride;
+    }
+    surface->unlockAndPost();
+}
+
+static int compareNsecs(const void* lhs, const void* rhs) {
+    const nsecs_t a = *static_cast<const nsecs_t*>(lhs);
+    const nsecs_t b = *static_cast<const nsecs_t*>(rhs);
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static int runOne(const sp<SurfaceComposerClient>& client, int secondaries,
+        int frames) {
+    sp<SurfaceControl> control = client->createSurface(
+            String8("multidisplay"), kLayerSize, kLayerSize,
+            PIXEL_FORMAT_RGBX_8888, 0);
+    if (control == NULL || !control->isValid()) {
+        fprintf(stderr, "could not create the test layer\n");
+        return 1;
+    }
+    SurfaceComposerClient::openGlobalTransaction();
+    control->setLayer(0x7fffffff);
+    control->show();
+    SurfaceComposerClient::closeGlobalTransaction();
+
+    sp<Surface> surface = control->getSurface();
+
+    // Let the display settle before measuring.
+    for (int i = 0; i < 10; i++) {
+        fill(surface, i);
+    }
+    control->clearLayerFrameStats();
+
+    const nsecs_t start = systemTime();
+    for (int i = 0; i < frames; i++) {
+        fill(surface, i);
+    }
+    const nsecs_t elapsed = systemTime() - start;
+
+    // Give the last frames time to be presented.
+    usleep(100000);
+
+    FrameStats stats;
+    control->getLayerFrameStats(&stats);
+
+    Vector<nsecs_t> latencies;
+    for (size_t i = 0; i < stats.actualPresentTimesNano.size(); i++) {
+        const nsecs_t desired = stats.desiredPresentTimesNano[i];
+        const nsecs_t actual = stats.actualPresentTimesNano[i];
+        if (desired > 0 && actual > desired && actual != INT64_MAX) {
+            latencies.add(actual - desired);
+        }
+    }
+    control->clear();
+
+    if (latencies.isEmpty()) {
+        printf("%11d %10s\n", secondaries, "-");
+        return 0;
+    }
+
+    qsort(latencies.editArray(), latencies.size(), sizeof(nsecs_t),
+            compareNsecs);
+    nsecs_t total = 0;
+    for (size_t i = 0; i < latencies.size(); i++) {
+        total += latencies[i];
+    }
+    const size_t n = latencies.size();
+    printf("%11d %10zu %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+            secondaries, n,
+            double(total) / n / 1e6,
+            latencies[n / 2] / 1e6,
+            latencies[(n * 9) / 10] / 1e6,
+            latencies[n - 1] / 1e6,
+            frames * 1e9 / elapsed);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    int frames = argc > 1 ? atoi(argv[1]) : 300;
+    if (frames <= 0) {
+        fprintf(stderr, "usage: %s [frames]\n", argv[0]);
+        return 1;
+    }
+
+    sp<ProcessState> proc(ProcessState::self());
+    ProcessState::self()->startThreadPool();
+
+    sp<SurfaceComposerClient> client = new SurfaceComposerClient();
+    if (client->initCheck() != NO_ERROR) {
+        fprintf(stderr, "could not connect to SurfaceFlinger\n");
+        return 1;
+    }
+
+    sp<IBinder> primary = SurfaceComposerClient::getBuiltInDisplay(
+            ISurfaceComposer::eDisplayIdMain);
+    DisplayInfo info;
+    if (SurfaceComposerClient::getDisplayInfo(primary, &info) != NO_ERROR) {
+        fprintf(stderr, "could not get the primary display info\n");
+        return 1;
+    }
+
+    printf("primary display %ux%u, %d frames per run, latencies in ms\n",
+            info.w, info.h, frames);
+    printf("%11s %10s %10s %10s %10s %10s %10s\n", "secondaries", "frames",
+            "mean", "median", "90%", "max", "fps");
+
+    Vector<SecondaryDisplay> displays;
+    int result = 0;
+    for (int secondaries = 0; secondaries <= kMaxSecondaryDisplays;
+            secondaries++) {
+        while (int(displays.size()) < secondaries) {
+            displays.add(createSecondaryDisplay(displays.size(), info));
+        }
+        result = runOne(client, secondaries, frames);
+        if (result) {
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < displays.size(); i++) {
+        SurfaceComposerClient::destroyDisplay(displays[i].token);
+    }
+    return result;
+}
@@ -16,3 +16,25 @@ LOCAL_MODULE:= test-vsync-events
 LOCAL_MODULE_TAGS := tests
 
 include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	replay.cpp \
+	../../DispSync.cpp \
+	../../PhaseOffsetTuner.cpp
+
+LOCAL_CFLAGS += -DPRESENT_TIME_OFFSET_FROM_VSYNC_NS=0
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils \
+	libutils \
+	liblog \
+	libui \
+	libgui
+
+LOCAL_MODULE:= test-vsync-replay
+
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
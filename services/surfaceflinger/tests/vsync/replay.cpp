@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays hardware vsync timestamps through the DispSync model. For every
+ * timestamp, the model is fitted to the DispSync::MAX_RESYNC_SAMPLES before
+ * it and used to predict it; the prediction errors are compared with those
+ * of the averaging model that DispSync used before.
+ *
+ * usage: test-vsync-replay [file]
+ *
+ * file holds one timestamp in nanoseconds per line, e.g. the mResyncSamples
+ * of "dumpsys SurfaceFlinger --dispsync" collected over a while; anything
+ * after the first number of a line is ignored. Without a file, synthetic
+ * timestamps with jitter, missed and late vsyncs are replayed, the phase
+ * offset tuner is run on synthetic frame durations, and the test fails if
+ * either does worse than expected.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <utils/Vector.h>
+
+#include "../../DispSync.h"
+#include "../../PhaseOffsetTuner.h"
+
+using namespace android;
+
+static const nsecs_t kPeriod = 16666667;
+
+// Synthetic vsyncs: normally distributed jitter, some vsyncs that are not
+// reported at all, and some that are reported late.
+static const double kJitter = 150000;           // 150 us
+static const double kMissedRate = 0.03;
+static const double kLateRate = 0.02;
+static const nsecs_t kLateDelay = 2000000;      // 2 ms
+
+// Limits for the synthetic replay.
+static const double kMaxRmsError = 100000;      // 100 us
+static const double kMaxMissRate = 0.10;
+
+// A small deterministic generator so that runs can be compared.
+class Random {
+public:
+    Random() : mState(1) {}
+
+    double uniform() {
+        mState = mState * 6364136223846793005ULL + 1442695040888963407ULL;
+        return double(mState >> 11) / double(1ULL << 53);
+    }
+
+    double normal() {
+        const double u = uniform() + 1e-12;
+        const double v = uniform();
+        return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+    }
+
+private:
+    uint64_t mState;
+};
+
+// The model DispSync used before: the mean interval between the samples
+// and the circular mean of their phases.
+static bool averageModel(const nsecs_t* samples, size_t n,
+        nsecs_t* outPeriod, nsecs_t* outPhase) {
+    if (n < 2) {
+        return false;
+    }
+    const nsecs_t period = (samples[n - 1] - samples[0]) / nsecs_t(n - 1);
+    if (period <= 0) {
+        return false;
+    }
+    double x = 0;
+    double y = 0;
+    const double scale = 2.0 * M_PI / double(period);
+    for (size_t i = 0; i < n; i++) {
+        const double phase = double(samples[i] % period) * scale;
+        x += cos(phase);
+        y += sin(phase);
+    }
+    nsecs_t phase = nsecs_t(atan2(y, x) / scale);
+    if (phase < 0) {
+        phase += period;
+    }
+    *outPeriod = period;
+    *outPhase = phase;
+    return true;
+}
+
+// Returns the model's vsync that is nearest to t.
+static nsecs_t nearestVsync(nsecs_t period, nsecs_t phase, nsecs_t t) {
+    const nsecs_t n = (t - phase + period / 2) / period;
+    return phase + n * period;
+}
+
+struct ErrorStats {
+    ErrorStats() : count(0), sqSum(0), max(0) {}
+
+    void add(nsecs_t error) {
+        const double e = fabs(double(error));
+        count++;
+        sqSum += e * e;
+        if (e > max) {
+            max = e;
+        }
+    }
+
+    double rms() const { return count ? sqrt(sqSum / count) : 0; }
+
+    size_t count;
+    double sqSum;
+    double max;
+};
+
+// Replays the timestamps. truth, if not NULL, holds the vsync that each
+// timestamp should have been, which is what the predictions are compared
+// against; otherwise they are compared against the timestamps.
+static void replay(const Vector<nsecs_t>& samples, const Vector<nsecs_t>* truth,
+        ErrorStats* fitted, ErrorStats* averaged, double* jitterSum) {
+    const size_t window = DispSync::MAX_RESYNC_SAMPLES;
+    *jitterSum = 0;
+    for (size_t i = window; i < samples.size(); i++) {
+        const nsecs_t* history = samples.array() + i - window;
+        const nsecs_t actual = truth ? (*truth)[i] : samples[i];
+        nsecs_t period, phase, jitter;
+        if (DispSync::fitModel(history, window, &period, &phase, &jitter)) {
+            fitted->add(actual - nearestVsync(period, phase, actual));
+            *jitterSum += jitter;
+        }
+        if (averageModel(history, window, &period, &phase)) {
+            averaged->add(actual - nearestVsync(period, phase, actual));
+        }
+    }
+}
+
+static void printStats(const char* name, const ErrorStats& stats) {
+    printf("%-10s %8zu predictions, rms error %8.1f us, max error %8.1f us\n",
+            name, stats.count, stats.rms() / 1000, stats.max / 1000);
+}
+
+static bool readSamples(const char* path, Vector<nsecs_t>* samples) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        return false;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        char* end;
+        const long long t = strtoll(line, &end, 10);
+        if (end != line && t > 0) {
+            samples->add(nsecs_t(t));
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+static void synthesizeSamples(size_t count, Vector<nsecs_t>* samples,
+        Vector<nsecs_t>* truth) {
+    Random random;
+    nsecs_t vsync = 1000000000;
+    while (samples->size() < count) {
+        vsync += kPeriod;
+        if (random.uniform() < kMissedRate) {
+            continue;
+        }
+        nsecs_t t = vsync + nsecs_t(kJitter * random.normal());
+        if (random.uniform() < kLateRate) {
+            t += kLateDelay;
+        }
+        if (!samples->isEmpty() && t <= samples->top()) {
+            continue;
+        }
+        samples->add(t);
+        truth->add(vsync);
+    }
+}
+
+// Runs the phase offset tuner on synthetic composition and render
+// durations and returns how many of a fresh set of frames would miss their
+// deadline with the tuned offsets.
+static double tuneOffsets() {
+    Random random;
+    PhaseOffsetTuner tuner(0, 0);
+    tuner.setDisplayRefreshPeriod(kPeriod);
+    for (int frame = 0; frame < 10 * PhaseOffsetTuner::NUM_SAMPLES; frame++) {
+        tuner.addCompositionDuration(nsecs_t(6e6 + 1e6 * random.normal()));
+        tuner.addRenderDuration(nsecs_t(5e6 + 1e6 * random.normal()));
+        tuner.update();
+    }
+    const nsecs_t sf = tuner.getSfOffset();
+    const nsecs_t app = tuner.getAppOffset();
+    printf("tuned offsets: app %.2f ms, sf %.2f ms\n", app / 1e6, sf / 1e6);
+
+    const int frames = 10000;
+    int missed = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        const nsecs_t composition = nsecs_t(6e6 + 1e6 * random.normal());
+        const nsecs_t render = nsecs_t(5e6 + 1e6 * random.normal());
+        if (sf + composition > kPeriod || app + render > sf) {
+            missed++;
+        }
+    }
+    const double missRate = double(missed) / frames;
+    printf("frames missing a deadline: %.1f%%\n", missRate * 100);
+    return missRate;
+}
+
+int main(int argc, char** argv)
+{
+    Vector<nsecs_t> samples;
+    Vector<nsecs_t> truth;
+    if (argc > 1) {
+        if (!readSamples(argv[1], &samples)) {
+            return 1;
+        }
+    } else {
+        synthesizeSamples(2000, &samples, &truth);
+    }
+    if (samples.size() <= DispSync::MAX_RESYNC_SAMPLES) {
+        fprintf(stderr, "need more than %d timestamps\n",
+                DispSync::MAX_RESYNC_SAMPLES);
+        return 1;
+    }
+
+    ErrorStats fitted, averaged;
+    double jitterSum;
+    replay(samples, truth.isEmpty() ? NULL : &truth, &fitted, &averaged,
+            &jitterSum);
+    printStats("fitted", fitted);
+    printStats("averaged", averaged);
+    if (fitted.count) {
+        printf("mean model jitter %.1f us\n", jitterSum / fitted.count / 1000);
+    }
+
+    if (argc > 1) {
+        return 0;
+    }
+
+    int result = 0;
+    if (fitted.rms() > kMaxRmsError) {
+        fprintf(stderr, "FAIL: rms prediction error above %.1f us\n",
+                kMaxRmsError / 1000);
+        result = 1;
+    }
+    if (tuneOffsets() > kMaxMissRate) {
+        fprintf(stderr, "FAIL: more than %.1f%% of frames miss a deadline\n",
+                kMaxMissRate * 100);
+        result = 1;
+    }
+    if (!result) {
+        printf("PASS\n");
+    }
+    return result;
+}